@@ -107,6 +107,38 @@ for target in "${targets[@]}"; do
     fi
 done
 
+# Test generated code
+echo -e "${BLUE}Testing generated code...${NC}"
+if ./tests/codegen/run_tests.sh; then
+    log_result "Code generation tests" "PASS"
+else
+    log_result "Code generation tests" "FAIL" "Compiled programs returned the wrong exit code"
+fi
+
+# Test machine code encoders
+echo -e "${BLUE}Testing machine code encoders...${NC}"
+if ./tests/encoders/run_tests.sh; then
+    log_result "Encoder tests" "PASS"
+else
+    log_result "Encoder tests" "FAIL" "Encoded bytes differ from the reference encodings"
+fi
+
+# Test switch lowering
+echo -e "${BLUE}Testing switch lowering...${NC}"
+if ./tests/switch/run_tests.sh; then
+    log_result "Switch tests" "PASS"
+else
+    log_result "Switch tests" "FAIL" "Switch code jumps to undefined labels"
+fi
+
+# Test frame layout
+echo -e "${BLUE}Testing ALETHEIA-Core frame layout...${NC}"
+if ./tests/frames/run_tests.sh; then
+    log_result "Frame tests" "PASS"
+else
+    log_result "Frame tests" "FAIL" "Locals are not packed, scopes do not share slots or leaves leave the red zone"
+fi
+
 # Test AI system (if available)
 echo -e "${BLUE}Testing AI system...${NC}"
 if [ -f "ai/simple_ai_test.py" ]; then
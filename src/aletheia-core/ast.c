@@ -76,6 +76,11 @@ void free_ast_node(ASTNode* node) {
             free_ast_node(node->data.assign.value);
             break;
 
+        case AST_INDEX_EXPR:
+            free_ast_node(node->data.index.base);
+            free_ast_node(node->data.index.index);
+            break;
+
         case AST_FUNCTION_CALL:
             core_free(node->data.call.name);
             for (int i = 0; i < node->data.call.arg_count; i++) {
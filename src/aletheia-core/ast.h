@@ -19,6 +19,7 @@ typedef enum {
     AST_BINARY_EXPR,
     AST_UNARY_EXPR,
     AST_ASSIGN_EXPR,
+    AST_INDEX_EXPR,
     AST_FUNCTION_CALL,
     AST_IDENTIFIER,
     AST_INTEGER_LITERAL,
@@ -108,6 +109,12 @@ typedef struct ASTNode {
             struct ASTNode* value;
         } assign;
 
+        /* Element access: base[index] */
+        struct {
+            struct ASTNode* base;
+            struct ASTNode* index;
+        } index;
+
         /* Function call */
         struct {
             char* name;
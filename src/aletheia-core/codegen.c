@@ -11,12 +11,21 @@ CodeGen* create_codegen(FILE* output) {
     gen->output = output;
     gen->symtab = create_symbol_table();
     gen->label_count = 0;
+    gen->slots = 0;
+    gen->slot_count = 0;
+    gen->slot_capacity = 0;
+    gen->frame_size = 0;
+    gen->stack_depth = 0;
+    gen->temp_base = 0;
+    gen->leaf = false;
+    gen->frame_reg = "rbp";
     return gen;
 }
 
 /* Free code generator */
 void free_codegen(CodeGen* gen) {
     free_symbol_table(gen->symtab);
+    core_free(gen->slots);
     core_free(gen);
 }
 
@@ -29,37 +38,27 @@ SymbolTable* create_symbol_table() {
     return symtab;
 }
 
-/* Free symbol table */
+/* Free symbol table (types belong to the declarations in the AST) */
 void free_symbol_table(SymbolTable* symtab) {
     for (int i = 0; i < symtab->count; i++) {
         core_free(symtab->symbols[i].name);
-        free_type(symtab->symbols[i].type);
     }
     core_free(symtab->symbols);
     core_free(symtab);
 }
 
-/* Add symbol */
-int add_symbol(SymbolTable* symtab, char* name, TypeInfo* type) {
-    /* Check if already exists */
-    for (int i = 0; i < symtab->count; i++) {
-        char* existing = symtab->symbols[i].name;
-        bool match = true;
-        char* n = name;
-        char* e = existing;
-        while (*n && *e) {
-            if (*n != *e) {
-                match = false;
-                break;
-            }
-            n++;
-            e++;
-        }
-        if (match && *n == '\0' && *e == '\0') {
-            return symtab->symbols[i].offset;
-        }
+/* Compare two identifiers */
+static bool names_equal(char* a, char* b) {
+    while (*a && *b) {
+        if (*a != *b) return false;
+        a++;
+        b++;
     }
+    return *a == '\0' && *b == '\0';
+}
 
+/* Add symbol at a frame offset chosen by layout_frame; inner scopes shadow */
+int add_symbol(SymbolTable* symtab, char* name, TypeInfo* type, int offset) {
     /* Expand if needed */
     if (symtab->count >= symtab->capacity) {
         int old_capacity = symtab->capacity;
@@ -70,36 +69,139 @@ int add_symbol(SymbolTable* symtab, char* name, TypeInfo* type) {
         /* Copy existing symbols to new allocation */
         if (old_symbols != NULL && old_capacity > 0) {
             memcpy(symtab->symbols, old_symbols, old_capacity * sizeof(Symbol));
+            core_free(old_symbols);
         }
     }
 
     /* Add new symbol */
     symtab->symbols[symtab->count].name = core_strdup(name);
     symtab->symbols[symtab->count].type = type;
-    symtab->symbols[symtab->count].offset = -(symtab->count + 1) * 8;
+    symtab->symbols[symtab->count].offset = offset;
     return symtab->symbols[symtab->count++].offset;
 }
 
+/* Drop symbols declared since `mark` when their scope closes */
+void pop_symbols(SymbolTable* symtab, int mark) {
+    while (symtab->count > mark) {
+        symtab->count--;
+        core_free(symtab->symbols[symtab->count].name);
+    }
+}
+
+/* Look up a symbol, innermost scope first */
+Symbol* lookup_symbol(SymbolTable* symtab, char* name) {
+    for (int i = symtab->count - 1; i >= 0; i--) {
+        if (names_equal(symtab->symbols[i].name, name)) {
+            return &symtab->symbols[i];
+        }
+    }
+    return 0;
+}
+
 /* Find symbol */
 int find_symbol(SymbolTable* symtab, char* name) {
-    for (int i = 0; i < symtab->count; i++) {
-        char* existing = symtab->symbols[i].name;
-        bool match = true;
-        char* n = name;
-        char* e = existing;
-        while (*n && *e) {
-            if (*n != *e) {
-                match = false;
-                break;
-            }
-            n++;
-            e++;
+    Symbol* sym = lookup_symbol(symtab, name);
+    return sym ? sym->offset : 0; /* 0 = not found */
+}
+
+/* Slot size of a variable; void and unknown types get a full word */
+static int slot_size(TypeInfo* type) {
+    if (!type || type->size <= 0) return 8;
+    return type->size;
+}
+
+/* Record the frame offset chosen for a declaration */
+static void add_frame_slot(CodeGen* gen, ASTNode* decl, int offset) {
+    if (gen->slot_count >= gen->slot_capacity) {
+        int old_capacity = gen->slot_capacity;
+        gen->slot_capacity = gen->slot_capacity == 0 ? 8 : gen->slot_capacity * 2;
+        FrameSlot* old_slots = gen->slots;
+        gen->slots = core_malloc(gen->slot_capacity * sizeof(FrameSlot));
+        if (old_slots != NULL && old_capacity > 0) {
+            memcpy(gen->slots, old_slots, old_capacity * sizeof(FrameSlot));
+            core_free(old_slots);
         }
-        if (match && *n == '\0' && *e == '\0') {
-            return symtab->symbols[i].offset;
+    }
+    gen->slots[gen->slot_count].decl = decl;
+    gen->slots[gen->slot_count].offset = offset;
+    gen->slot_count++;
+}
+
+/* Frame offset assigned to a declaration by layout_frame */
+int frame_slot_offset(CodeGen* gen, ASTNode* decl) {
+    for (int i = 0; i < gen->slot_count; i++) {
+        if (gen->slots[i].decl == decl) return gen->slots[i].offset;
+    }
+    return 0;
+}
+
+/* Allocate `decl` below `used` bytes of frame, aligned to its size */
+static int allocate_slot(CodeGen* gen, ASTNode* decl, int used) {
+    int size = slot_size(decl->data.var_decl.var_type);
+    used = (used + size + size - 1) / size * size;
+    add_frame_slot(gen, decl, -used);
+    if (used > gen->frame_size) gen->frame_size = used;
+    return used;
+}
+
+/* Lay out the variables of one statement starting `used` bytes below rbp.
+ * A block packs its own declarations largest first; nested statements
+ * then start from the same depth, so siblings share space. */
+static void layout_statement(ASTNode* stmt, int used, CodeGen* gen) {
+    if (!stmt) return;
+
+    switch (stmt->type) {
+        case AST_VAR_DECL:
+            allocate_slot(gen, stmt, used);
+            break;
+
+        case AST_BLOCK: {
+            int sizes[4] = {8, 4, 2, 1};
+            for (int s = 0; s < 4; s++) {
+                for (int i = 0; i < stmt->data.block.stmt_count; i++) {
+                    ASTNode* child = stmt->data.block.statements[i];
+                    if (child->type == AST_VAR_DECL &&
+                        slot_size(child->data.var_decl.var_type) == sizes[s]) {
+                        used = allocate_slot(gen, child, used);
+                    }
+                }
+            }
+            for (int i = 0; i < stmt->data.block.stmt_count; i++) {
+                ASTNode* child = stmt->data.block.statements[i];
+                if (child->type != AST_VAR_DECL) {
+                    layout_statement(child, used, gen);
+                }
+            }
+            break;
         }
+
+        case AST_IF_STMT:
+            layout_statement(stmt->data.if_stmt.then_branch, used, gen);
+            layout_statement(stmt->data.if_stmt.else_branch, used, gen);
+            break;
+
+        case AST_WHILE_STMT:
+            layout_statement(stmt->data.while_stmt.body, used, gen);
+            break;
+
+        default:
+            break;
+    }
+}
+
+/* Assign every local of a function a frame offset; returns the frame
+ * size rounded up so rsp stays 16-byte aligned after the prologue.
+ * Register parameters are spilled to the first slots; stack parameters
+ * are used where the caller left them. */
+int layout_frame(ASTNode* func, CodeGen* gen) {
+    int used = 0;
+    gen->slot_count = 0;
+    gen->frame_size = 0;
+    for (int i = 0; i < func->data.func_def.param_count && i < 6; i++) {
+        used = allocate_slot(gen, func->data.func_def.params[i], used);
     }
-    return 0; /* Not found */
+    layout_statement(func->data.func_def.body, used, gen);
+    return (gen->frame_size + 15) / 16 * 16;
 }
 
 /* Generate unique label */
@@ -107,71 +209,383 @@ void generate_label(CodeGen* gen, char* prefix) {
     fprintf(gen->output, ".L%s_%d:\n", prefix, gen->label_count++);
 }
 
-/* Generate expression */
-void generate_expression(ASTNode* expr, CodeGen* gen) {
+/* Push rax, tracking the depth so calls can keep rsp 16-byte aligned.
+ * Leaf functions never move rsp: temporaries go to red-zone slots
+ * below the locals instead. */
+static void generate_push(CodeGen* gen) {
+    if (gen->leaf) {
+        fprintf(gen->output, "    mov [rsp%+d], rax\n", -(gen->temp_base + 8 * (gen->stack_depth + 1)));
+    } else {
+        fprintf(gen->output, "    push rax\n");
+    }
+    gen->stack_depth++;
+}
+
+static void generate_pop(CodeGen* gen, char* reg) {
+    gen->stack_depth--;
+    if (gen->leaf) {
+        fprintf(gen->output, "    mov %s, [rsp%+d]\n", reg, -(gen->temp_base + 8 * (gen->stack_depth + 1)));
+    } else {
+        fprintf(gen->output, "    pop %s\n", reg);
+    }
+}
+
+/* Epilogue for the current function's frame */
+static void generate_epilogue(CodeGen* gen) {
+    if (!gen->leaf) {
+        fprintf(gen->output, "    mov rsp, rbp\n");
+        fprintf(gen->output, "    pop rbp\n");
+    }
+    fprintf(gen->output, "    ret\n");
+}
+
+/* Register names by width (64, 32 and 8 bits): rax, then the System V
+ * integer argument registers in order */
+static char* rax_names[3] = {"rax", "eax", "al"};
+static char* arg_names[6][3] = {
+    {"rdi", "edi", "dil"}, {"rsi", "esi", "sil"}, {"rdx", "edx", "dl"},
+    {"rcx", "ecx", "cl"}, {"r8", "r8d", "r8b"}, {"r9", "r9d", "r9b"}
+};
+
+static TypeInfo* pointee_type(ASTNode* expr, CodeGen* gen);
+static void generate_sized(ASTNode* expr, int size, CodeGen* gen);
+
+/* Width a value is computed in. char and int values live in 32-bit
+ * registers (writing one clears the upper half, and the encodings need no
+ * REX.W); only pointers take all 64 bits. Calls return int or char. */
+static int value_size(ASTNode* expr, CodeGen* gen) {
+    Symbol* sym;
+    int left, right;
+
     switch (expr->type) {
-        case AST_INTEGER_LITERAL:
-            fprintf(gen->output, "    mov rax, %d\n", expr->data.int_value);
+        case AST_STRING_LITERAL:
+            return 8;
+        case AST_IDENTIFIER:
+            sym = lookup_symbol(gen->symtab, expr->data.identifier);
+            return sym && slot_size(sym->type) == 8 ? 8 : 4;
+        case AST_UNARY_EXPR: {
+            TypeInfo* type = pointee_type(expr->data.unary.operand, gen);
+            return type && type->kind == TYPE_PTR ? 8 : 4;
+        }
+        case AST_INDEX_EXPR: {
+            TypeInfo* type = pointee_type(expr->data.index.base, gen);
+            return !type || type->kind == TYPE_PTR ? 8 : 4;
+        }
+        case AST_BINARY_EXPR:
+            if (expr->data.binary.op == '<' || expr->data.binary.op == '>' ||
+                expr->data.binary.op == '=') {
+                return 4;
+            }
+            left = value_size(expr->data.binary.left, gen);
+            right = value_size(expr->data.binary.right, gen);
+            return left > right ? left : right;
+        default:
+            return 4;
+    }
+}
+
+/* Type a pointer expression points to, or 0 if unknown. Arithmetic on a
+ * pointer keeps pointing at the same type. */
+static TypeInfo* pointee_type(ASTNode* expr, CodeGen* gen) {
+    TypeInfo* type = expr->node_type;
+    if (expr->type == AST_BINARY_EXPR) {
+        TypeInfo* base = pointee_type(expr->data.binary.left, gen);
+        return base ? base : pointee_type(expr->data.binary.right, gen);
+    }
+    if (expr->type == AST_INDEX_EXPR) {
+        type = pointee_type(expr->data.index.base, gen);
+    }
+    if (expr->type == AST_IDENTIFIER) {
+        Symbol* sym = lookup_symbol(gen->symtab, expr->data.identifier);
+        type = sym ? sym->type : 0;
+    }
+    return type && type->kind == TYPE_PTR ? (TypeInfo*)type->base : 0;
+}
+
+/* Load a variable at its own width: char sign-extends into the 32-bit
+ * register, int loads it directly, pointers fill the 64-bit one */
+static void generate_load_var(Symbol* sym, char** names, CodeGen* gen) {
+    switch (slot_size(sym->type)) {
+        case 1:
+            fprintf(gen->output, "    movsx %s, byte [%s%+d]  ;; load %s\n", names[1], gen->frame_reg, sym->offset, sym->name);
+            break;
+        case 4:
+            fprintf(gen->output, "    mov %s, dword [%s%+d]  ;; load %s\n", names[1], gen->frame_reg, sym->offset, sym->name);
+            break;
+        default:
+            fprintf(gen->output, "    mov %s, [%s%+d]  ;; load %s\n", names[0], gen->frame_reg, sym->offset, sym->name);
             break;
+    }
+}
 
-        case AST_IDENTIFIER: {
-            int offset = find_symbol(gen->symtab, expr->data.identifier);
-            if (offset != 0) {
-                fprintf(gen->output, "    mov rax, [rbp%+d]  ;; load %s\n",
-                       offset, expr->data.identifier);
-            } else {
-                fprintf(gen->output, "    mov rax, 0  ;; undefined variable %s\n",
-                       expr->data.identifier);
-            }
+/* Store a register into a variable, writing only the slot's width */
+static void generate_store_var(Symbol* sym, char** names, CodeGen* gen) {
+    switch (slot_size(sym->type)) {
+        case 1:
+            fprintf(gen->output, "    mov byte [%s%+d], %s  ;; %s =\n", gen->frame_reg, sym->offset, names[2], sym->name);
             break;
+        case 4:
+            fprintf(gen->output, "    mov dword [%s%+d], %s  ;; %s =\n", gen->frame_reg, sym->offset, names[1], sym->name);
+            break;
+        default:
+            fprintf(gen->output, "    mov [%s%+d], %s  ;; %s =\n", gen->frame_reg, sym->offset, names[0], sym->name);
+            break;
+    }
+}
+
+/* Literals and variables load straight into any register */
+static bool is_simple_operand(ASTNode* expr) {
+    return expr->type == AST_INTEGER_LITERAL || expr->type == AST_IDENTIFIER;
+}
+
+static void generate_operand(ASTNode* expr, char** names, CodeGen* gen) {
+    if (expr->type == AST_INTEGER_LITERAL) {
+        fprintf(gen->output, "    mov %s, %d\n", names[1], expr->data.int_value);
+        return;
+    }
+
+    Symbol* sym = lookup_symbol(gen->symtab, expr->data.identifier);
+    if (sym) {
+        generate_load_var(sym, names, gen);
+    } else {
+        fprintf(gen->output, "    mov %s, 0  ;; undefined variable %s\n",
+               names[1], expr->data.identifier);
+    }
+}
+
+/* Split an index into its variable part and a constant element offset,
+ * so `p[i + 1]` folds the 1 into the displacement. Returns the variable
+ * part, or 0 for a constant index. */
+static ASTNode* split_index(ASTNode* index, int* constant) {
+    *constant = 0;
+    if (index->type == AST_INTEGER_LITERAL) {
+        *constant = index->data.int_value;
+        return 0;
+    }
+    if (index->type == AST_BINARY_EXPR &&
+        index->data.binary.right->type == AST_INTEGER_LITERAL) {
+        if (index->data.binary.op == '+') {
+            *constant = index->data.binary.right->data.int_value;
+            return index->data.binary.left;
         }
+        if (index->data.binary.op == '-') {
+            *constant = -index->data.binary.right->data.int_value;
+            return index->data.binary.left;
+        }
+    }
+    if (index->type == AST_BINARY_EXPR && index->data.binary.op == '+' &&
+        index->data.binary.left->type == AST_INTEGER_LITERAL) {
+        *constant = index->data.binary.left->data.int_value;
+        return index->data.binary.right;
+    }
+    return index;
+}
+
+/* Load a variable sign-extended to 64 bits, ready to scale as an index */
+static void generate_load_index(Symbol* sym, char* reg, CodeGen* gen) {
+    switch (slot_size(sym->type)) {
+        case 1:
+            fprintf(gen->output, "    movsx %s, byte [%s%+d]  ;; index %s\n", reg, gen->frame_reg, sym->offset, sym->name);
+            break;
+        case 4:
+            fprintf(gen->output, "    movsxd %s, dword [%s%+d]  ;; index %s\n", reg, gen->frame_reg, sym->offset, sym->name);
+            break;
+        default:
+            fprintf(gen->output, "    mov %s, [%s%+d]  ;; index %s\n", reg, gen->frame_reg, sym->offset, sym->name);
+            break;
+    }
+}
+
+/* Compute base[index] as a single memory operand: the base in rax, the
+ * index in rbx, and the element size as the scale, with a constant part of
+ * the index folded into the displacement. Writes the operand into `operand`
+ * and returns the element size. */
+static int generate_element(ASTNode* expr, char* operand, CodeGen* gen) {
+    ASTNode* base = expr->data.index.base;
+    TypeInfo* type = pointee_type(base, gen);
+    int size = type ? slot_size(type) : 8;
+    int constant;
+    ASTNode* index = split_index(expr->data.index.index, &constant);
+    int disp = constant * size;
+    Symbol* sym = 0;
+
+    if (index && index->type == AST_IDENTIFIER) {
+        sym = lookup_symbol(gen->symtab, index->data.identifier);
+    }
+
+    if (!index) {
+        generate_sized(base, 8, gen);
+    } else if (sym) {
+        generate_sized(base, 8, gen);
+        generate_load_index(sym, "rbx", gen);
+    } else if (is_simple_operand(base)) {
+        generate_expression(index, gen);
+        if (value_size(index, gen) == 8) {
+            fprintf(gen->output, "    mov rbx, rax\n");
+        } else {
+            fprintf(gen->output, "    movsxd rbx, eax\n");
+        }
+        generate_operand(base, rax_names, gen);
+    } else {
+        generate_sized(index, 8, gen);
+        generate_push(gen);
+        generate_sized(base, 8, gen);
+        generate_pop(gen, "rbx");
+    }
+
+    if (!index && disp == 0) {
+        sprintf(operand, "[rax]");
+    } else if (!index) {
+        sprintf(operand, "[rax%+d]", disp);
+    } else if (disp == 0) {
+        sprintf(operand, "[rax+rbx*%d]", size);
+    } else {
+        sprintf(operand, "[rax+rbx*%d%+d]", size, disp);
+    }
+    return size;
+}
+
+/* System V call: the first six arguments go in registers, the rest on the
+ * stack above any alignment padding. Nested calls are evaluated before
+ * simple operands fill their registers, so nothing is clobbered. */
+static void generate_call(ASTNode* call, CodeGen* gen) {
+    int count = call->data.call.arg_count;
+    int stack_args = count > 6 ? count - 6 : 0;
+    int pad = (gen->stack_depth + stack_args) % 2;
+
+    if (pad) {
+        fprintf(gen->output, "    sub rsp, 8  ;; align call\n");
+        gen->stack_depth++;
+    }
+    for (int i = count - 1; i >= 0; i--) {
+        ASTNode* arg = call->data.call.args[i];
+        if (i < 6 && is_simple_operand(arg)) continue;
+        generate_expression(arg, gen);
+        generate_push(gen);
+    }
+    for (int i = 0; i < count && i < 6; i++) {
+        if (!is_simple_operand(call->data.call.args[i])) {
+            generate_pop(gen, arg_names[i][0]);
+        }
+    }
+    for (int i = 0; i < count && i < 6; i++) {
+        if (is_simple_operand(call->data.call.args[i])) {
+            generate_operand(call->data.call.args[i], arg_names[i], gen);
+        }
+    }
+
+    /* Variadic callees read the number of vector arguments from al */
+    fprintf(gen->output, "    xor eax, eax\n");
+    fprintf(gen->output, "    call %s\n", call->data.call.name);
+    if (stack_args + pad > 0) {
+        fprintf(gen->output, "    add rsp, %d\n", 8 * (stack_args + pad));
+        gen->stack_depth -= stack_args + pad;
+    }
+}
+
+/* Evaluate into rax for an operation `size` bytes wide, sign-extending a
+ * 32-bit value when it meets a pointer */
+static void generate_sized(ASTNode* expr, int size, CodeGen* gen) {
+    generate_expression(expr, gen);
+    if (size == 8 && value_size(expr, gen) == 4) {
+        fprintf(gen->output, "    movsxd rax, eax\n");
+    }
+}
+
+/* Evaluate both operands of a binary expression at the wider of their
+ * widths: the left one in rax, the right one in rbx. Returns that width. */
+static int generate_operands(ASTNode* expr, CodeGen* gen) {
+    int left = value_size(expr->data.binary.left, gen);
+    int right = value_size(expr->data.binary.right, gen);
+    int size = left > right ? left : right;
+
+    /* Right operand first */
+    generate_sized(expr->data.binary.right, size, gen);
+    generate_push(gen);
+
+    /* Left operand */
+    generate_sized(expr->data.binary.left, size, gen);
+
+    generate_pop(gen, "rbx");
+    return size;
+}
+
+/* Generate expression */
+void generate_expression(ASTNode* expr, CodeGen* gen) {
+    switch (expr->type) {
+        case AST_INTEGER_LITERAL:
+        case AST_IDENTIFIER:
+            generate_operand(expr, rax_names, gen);
+            break;
 
         case AST_UNARY_EXPR:
             if (expr->data.unary.op == '*') {
+                TypeInfo* type = pointee_type(expr->data.unary.operand, gen);
                 generate_expression(expr->data.unary.operand, gen);
-                fprintf(gen->output, "    mov rax, [rax]  ;; dereference\n");
+                switch (slot_size(type)) {
+                    case 1:
+                        fprintf(gen->output, "    movsx eax, byte [rax]  ;; dereference\n");
+                        break;
+                    case 4:
+                        fprintf(gen->output, "    mov eax, dword [rax]  ;; dereference\n");
+                        break;
+                    default:
+                        fprintf(gen->output, "    mov rax, [rax]  ;; dereference\n");
+                        break;
+                }
             }
             break;
 
-        case AST_BINARY_EXPR: {
-            /* Right operand first */
-            generate_expression(expr->data.binary.right, gen);
-            fprintf(gen->output, "    push rax\n");
-
-            /* Left operand */
-            generate_expression(expr->data.binary.left, gen);
+        case AST_INDEX_EXPR: {
+            char operand[48];
+            switch (generate_element(expr, operand, gen)) {
+                case 1:
+                    fprintf(gen->output, "    movsx eax, byte %s  ;; element\n", operand);
+                    break;
+                case 4:
+                    fprintf(gen->output, "    mov eax, dword %s  ;; element\n", operand);
+                    break;
+                default:
+                    fprintf(gen->output, "    mov rax, %s  ;; element\n", operand);
+                    break;
+            }
+            break;
+        }
 
-            fprintf(gen->output, "    pop rbx\n");
+        case AST_BINARY_EXPR: {
+            int size = generate_operands(expr, gen);
+            char* a = size == 8 ? "rax" : "eax";
+            char* b = size == 8 ? "rbx" : "ebx";
 
             /* Operation */
             switch (expr->data.binary.op) {
                 case '+':
-                    fprintf(gen->output, "    add rax, rbx\n");
+                    fprintf(gen->output, "    add %s, %s\n", a, b);
                     break;
                 case '-':
-                    fprintf(gen->output, "    sub rax, rbx\n");
+                    fprintf(gen->output, "    sub %s, %s\n", a, b);
                     break;
                 case '*':
-                    fprintf(gen->output, "    imul rax, rbx\n");
+                    fprintf(gen->output, "    imul %s, %s\n", a, b);
                     break;
                 case '/':
-                    fprintf(gen->output, "    cqo\n");
-                    fprintf(gen->output, "    idiv rbx\n");
+                    fprintf(gen->output, "    %s\n", size == 8 ? "cqo" : "cdq");
+                    fprintf(gen->output, "    idiv %s\n", b);
                     break;
                 case '<':
-                    fprintf(gen->output, "    cmp rax, rbx\n");
+                    fprintf(gen->output, "    cmp %s, %s\n", a, b);
                     fprintf(gen->output, "    setl al\n");
-                    fprintf(gen->output, "    movzx rax, al\n");
+                    fprintf(gen->output, "    movzx eax, al\n");
                     break;
                 case '>':
-                    fprintf(gen->output, "    cmp rax, rbx\n");
+                    fprintf(gen->output, "    cmp %s, %s\n", a, b);
                     fprintf(gen->output, "    setg al\n");
-                    fprintf(gen->output, "    movzx rax, al\n");
+                    fprintf(gen->output, "    movzx eax, al\n");
                     break;
                 case '=': /* Note: simplified equality */
-                    fprintf(gen->output, "    cmp rax, rbx\n");
+                    fprintf(gen->output, "    cmp %s, %s\n", a, b);
                     fprintf(gen->output, "    sete al\n");
-                    fprintf(gen->output, "    movzx rax, al\n");
+                    fprintf(gen->output, "    movzx eax, al\n");
                     break;
                 default:
                     fprintf(gen->output, "    ;; unknown op %c\n", expr->data.binary.op);
@@ -180,8 +594,7 @@ void generate_expression(ASTNode* expr, CodeGen* gen) {
         }
 
         case AST_FUNCTION_CALL:
-            /* For now, simple calls without arguments */
-            fprintf(gen->output, "    call %s\n", expr->data.call.name);
+            generate_call(expr, gen);
             break;
 
         default:
@@ -189,18 +602,93 @@ void generate_expression(ASTNode* expr, CodeGen* gen) {
     }
 }
 
+/* Generate conditional jump to .L<prefix>_<id> taken when cond is
+ * nonzero (sense true) or zero (sense false). Comparisons branch on the
+ * flags directly instead of materializing 0/1. */
+static void generate_branch(ASTNode* cond, bool sense, char* prefix, int label_id, CodeGen* gen) {
+    char* jump = 0;
+
+    if (cond->type == AST_BINARY_EXPR) {
+        switch (cond->data.binary.op) {
+            case '<': jump = sense ? "jl" : "jge"; break;
+            case '>': jump = sense ? "jg" : "jle"; break;
+            case '=': jump = sense ? "je" : "jne"; break;
+        }
+    }
+
+    if (jump) {
+        if (generate_operands(cond, gen) == 8) {
+            fprintf(gen->output, "    cmp rax, rbx\n");
+        } else {
+            fprintf(gen->output, "    cmp eax, ebx\n");
+        }
+        fprintf(gen->output, "    %s .L%s_%d\n", jump, prefix, label_id);
+    } else {
+        generate_expression(cond, gen);
+        if (value_size(cond, gen) == 8) {
+            fprintf(gen->output, "    test rax, rax\n");
+        } else {
+            fprintf(gen->output, "    test eax, eax\n");
+        }
+        fprintf(gen->output, "    %s .L%s_%d\n", sense ? "jnz" : "jz", prefix, label_id);
+    }
+}
+
+/* Generate conditional jump to .L<prefix>_<id> taken when cond is false */
+void generate_condition(ASTNode* cond, char* prefix, int label_id, CodeGen* gen) {
+    generate_branch(cond, false, prefix, label_id, gen);
+}
+
+/* base[index] = value. A simple value loads straight into rcx once the
+ * address is formed; anything else is evaluated first and held meanwhile. */
+static void generate_element_store(ASTNode* target, ASTNode* value, CodeGen* gen) {
+    static char* rcx_names[3] = {"rcx", "ecx", "cl"};
+    TypeInfo* type = pointee_type(target->data.index.base, gen);
+    char operand[48];
+    bool simple = is_simple_operand(value);
+    int size;
+
+    if (!simple) {
+        generate_sized(value, type ? slot_size(type) : 8, gen);
+        generate_push(gen);
+    }
+    size = generate_element(target, operand, gen);
+    if (simple) {
+        generate_operand(value, rcx_names, gen);
+        if (size == 8 && value_size(value, gen) == 4) {
+            fprintf(gen->output, "    movsxd rcx, ecx\n");
+        }
+    } else {
+        generate_pop(gen, "rcx");
+    }
+
+    switch (size) {
+        case 1:
+            fprintf(gen->output, "    mov byte %s, cl  ;; element =\n", operand);
+            break;
+        case 4:
+            fprintf(gen->output, "    mov dword %s, ecx  ;; element =\n", operand);
+            break;
+        default:
+            fprintf(gen->output, "    mov %s, rcx  ;; element =\n", operand);
+            break;
+    }
+}
+
 /* Generate statement */
 void generate_statement(ASTNode* stmt, CodeGen* gen) {
     switch (stmt->type) {
         case AST_VAR_DECL: {
             int offset = add_symbol(gen->symtab, stmt->data.var_decl.name,
-                                   stmt->data.var_decl.var_type);
-            fprintf(gen->output, "    ;; var %s at [rbp%+d]\n",
-                   stmt->data.var_decl.name, offset);
+                                   stmt->data.var_decl.var_type,
+                                   frame_slot_offset(gen, stmt));
+            fprintf(gen->output, "    ;; var %s at [%s%+d]\n",
+                   stmt->data.var_decl.name, gen->frame_reg, offset);
 
             if (stmt->data.var_decl.initializer) {
-                generate_expression(stmt->data.var_decl.initializer, gen);
-                fprintf(gen->output, "    mov [rbp%+d], rax\n", offset);
+                Symbol* sym = lookup_symbol(gen->symtab, stmt->data.var_decl.name);
+                generate_sized(stmt->data.var_decl.initializer, slot_size(sym->type), gen);
+                generate_store_var(sym, rax_names, gen);
             }
             break;
         }
@@ -209,17 +697,13 @@ void generate_statement(ASTNode* stmt, CodeGen* gen) {
             if (stmt->data.return_expr) {
                 generate_expression(stmt->data.return_expr, gen);
             }
-            fprintf(gen->output, "    mov rsp, rbp\n");
-            fprintf(gen->output, "    pop rbp\n");
-            fprintf(gen->output, "    ret\n");
+            generate_epilogue(gen);
             break;
 
         case AST_IF_STMT: {
             int label_id = gen->label_count++;
 
-            generate_expression(stmt->data.if_stmt.condition, gen);
-            fprintf(gen->output, "    test rax, rax\n");
-            fprintf(gen->output, "    jz .Lelse_%d\n", label_id);
+            generate_condition(stmt->data.if_stmt.condition, "else", label_id, gen);
 
             generate_statement(stmt->data.if_stmt.then_branch, gen);
 
@@ -236,37 +720,55 @@ void generate_statement(ASTNode* stmt, CodeGen* gen) {
         }
 
         case AST_WHILE_STMT: {
+            /* Rotated into a guarded do-while: the test sits at the bottom,
+             * so each iteration takes one branch instead of two */
             int label_id = gen->label_count++;
-            fprintf(gen->output, ".Lwhile_%d:\n", label_id);
+            ASTNode* cond = stmt->data.while_stmt.condition;
+            bool always = cond->type == AST_INTEGER_LITERAL && cond->data.int_value != 0;
 
-            generate_expression(stmt->data.while_stmt.condition, gen);
-            fprintf(gen->output, "    test rax, rax\n");
-            fprintf(gen->output, "    jz .Lend_while_%d\n", label_id);
+            if (!always) {
+                generate_condition(cond, "end_while", label_id, gen);
+            }
+            fprintf(gen->output, "    align 16\n");
+            fprintf(gen->output, ".Lwhile_%d:\n", label_id);
 
             generate_statement(stmt->data.while_stmt.body, gen);
-            fprintf(gen->output, "    jmp .Lwhile_%d\n", label_id);
+            if (always) {
+                fprintf(gen->output, "    jmp .Lwhile_%d\n", label_id);
+            } else {
+                generate_branch(cond, true, "while", label_id, gen);
+            }
             fprintf(gen->output, ".Lend_while_%d:\n", label_id);
             break;
         }
 
-        case AST_BLOCK:
+        case AST_BLOCK: {
+            int scope = gen->symtab->count;
             for (int i = 0; i < stmt->data.block.stmt_count; i++) {
                 generate_statement(stmt->data.block.statements[i], gen);
             }
+            pop_symbols(gen->symtab, scope);
             break;
+        }
 
         case AST_ASSIGN_EXPR: {
-            /* Generate value first */
-            generate_expression(stmt->data.assign.value, gen);
-            fprintf(gen->output, "    push rax\n");
+            if (stmt->data.assign.target->type == AST_INDEX_EXPR) {
+                generate_element_store(stmt->data.assign.target, stmt->data.assign.value, gen);
+                break;
+            }
 
             /* Assume simple identifier for now */
+            Symbol* sym = 0;
             if (stmt->data.assign.target->type == AST_IDENTIFIER) {
-                int offset = find_symbol(gen->symtab, stmt->data.assign.target->data.identifier);
-                fprintf(gen->output, "    pop rax\n");
-                fprintf(gen->output, "    mov [rbp%+d], rax\n", offset);
+                sym = lookup_symbol(gen->symtab, stmt->data.assign.target->data.identifier);
+            }
+
+            /* Generate value first */
+            generate_sized(stmt->data.assign.value, sym ? slot_size(sym->type) : 8, gen);
+            if (sym) {
+                generate_store_var(sym, rax_names, gen);
             } else {
-                fprintf(gen->output, "    pop rax  ;; complex assignment not implemented\n");
+                fprintf(gen->output, "    ;; complex assignment not implemented\n");
             }
             break;
         }
@@ -278,23 +780,136 @@ void generate_statement(ASTNode* stmt, CodeGen* gen) {
     }
 }
 
+/* True if evaluating the tree may call another function */
+static bool contains_call(ASTNode* node) {
+    if (!node) return false;
+
+    switch (node->type) {
+        case AST_FUNCTION_CALL:
+            return true;
+        case AST_VAR_DECL:
+            return contains_call(node->data.var_decl.initializer);
+        case AST_RETURN_STMT:
+            return contains_call(node->data.return_expr);
+        case AST_IF_STMT:
+            return contains_call(node->data.if_stmt.condition) ||
+                   contains_call(node->data.if_stmt.then_branch) ||
+                   contains_call(node->data.if_stmt.else_branch);
+        case AST_WHILE_STMT:
+            return contains_call(node->data.while_stmt.condition) ||
+                   contains_call(node->data.while_stmt.body);
+        case AST_BLOCK:
+            for (int i = 0; i < node->data.block.stmt_count; i++) {
+                if (contains_call(node->data.block.statements[i])) return true;
+            }
+            return false;
+        case AST_BINARY_EXPR:
+            return contains_call(node->data.binary.left) ||
+                   contains_call(node->data.binary.right);
+        case AST_UNARY_EXPR:
+            return contains_call(node->data.unary.operand);
+        case AST_ASSIGN_EXPR:
+            return contains_call(node->data.assign.target) ||
+                   contains_call(node->data.assign.value);
+        case AST_INDEX_EXPR:
+            return contains_call(node->data.index.base) ||
+                   contains_call(node->data.index.index);
+        default:
+            return false;
+    }
+}
+
+/* Deepest temporary stack reached while evaluating the tree. Binary
+ * operators hold the right operand while the left one is evaluated. */
+static int temp_depth(ASTNode* node) {
+    if (!node) return 0;
+
+    int depth = 0;
+    int d;
+    switch (node->type) {
+        case AST_BINARY_EXPR:
+            depth = temp_depth(node->data.binary.right);
+            d = 1 + temp_depth(node->data.binary.left);
+            return d > depth ? d : depth;
+        case AST_UNARY_EXPR:
+            return temp_depth(node->data.unary.operand);
+        case AST_INDEX_EXPR:
+            /* The index may be held while the base is evaluated */
+            depth = temp_depth(node->data.index.index);
+            d = 1 + temp_depth(node->data.index.base);
+            return d > depth ? d : depth;
+        case AST_ASSIGN_EXPR:
+            depth = temp_depth(node->data.assign.value);
+            if (node->data.assign.target->type == AST_INDEX_EXPR) {
+                d = 1 + temp_depth(node->data.assign.target);
+                if (d > depth) depth = d;
+            }
+            return depth;
+        case AST_VAR_DECL:
+            return temp_depth(node->data.var_decl.initializer);
+        case AST_RETURN_STMT:
+            return temp_depth(node->data.return_expr);
+        case AST_IF_STMT:
+            depth = temp_depth(node->data.if_stmt.condition);
+            d = temp_depth(node->data.if_stmt.then_branch);
+            if (d > depth) depth = d;
+            d = temp_depth(node->data.if_stmt.else_branch);
+            return d > depth ? d : depth;
+        case AST_WHILE_STMT:
+            depth = temp_depth(node->data.while_stmt.condition);
+            d = temp_depth(node->data.while_stmt.body);
+            return d > depth ? d : depth;
+        case AST_BLOCK:
+            for (int i = 0; i < node->data.block.stmt_count; i++) {
+                d = temp_depth(node->data.block.statements[i]);
+                if (d > depth) depth = d;
+            }
+            return depth;
+        default:
+            return 0;
+    }
+}
+
 /* Generate function */
 void generate_function(ASTNode* func, CodeGen* gen) {
     fprintf(gen->output, ";; Function: %s\n", func->data.func_def.name);
     fprintf(gen->output, "global %s\n", func->data.func_def.name);
     fprintf(gen->output, "%s:\n", func->data.func_def.name);
 
-    /* Prologue */
-    fprintf(gen->output, "    push rbp\n");
-    fprintf(gen->output, "    mov rbp, rsp\n");
+    /* Prologue: reserve the whole frame once. Leaf functions whose locals
+     * and temporaries fit in the 128-byte System V red zone skip it. */
+    int frame_size = layout_frame(func, gen);
+    gen->stack_depth = 0;
+    gen->temp_base = (gen->frame_size + 7) / 8 * 8;
+    gen->leaf = !contains_call(func->data.func_def.body) &&
+                gen->temp_base + 8 * temp_depth(func->data.func_def.body) <= 128;
+    gen->frame_reg = gen->leaf ? "rsp" : "rbp";
+    if (!gen->leaf) {
+        fprintf(gen->output, "    push rbp\n");
+        fprintf(gen->output, "    mov rbp, rsp\n");
+        if (frame_size > 0) {
+            fprintf(gen->output, "    sub rsp, %d\n", frame_size);
+        }
+    }
+
+    /* Parameters: registers are stored to their slots, stack arguments sit
+     * above the return address (and the saved rbp with a frame) */
+    int scope = gen->symtab->count;
+    for (int i = 0; i < func->data.func_def.param_count; i++) {
+        ASTNode* param = func->data.func_def.params[i];
+        int offset = i < 6 ? frame_slot_offset(gen, param) : (gen->leaf ? 8 : 16) + 8 * (i - 6);
+        add_symbol(gen->symtab, param->data.var_decl.name, param->data.var_decl.var_type, offset);
+        if (i < 6) {
+            generate_store_var(lookup_symbol(gen->symtab, param->data.var_decl.name), arg_names[i], gen);
+        }
+    }
 
     /* Generate body */
     generate_statement(func->data.func_def.body, gen);
+    pop_symbols(gen->symtab, scope);
 
     /* Epilogue (in case no return) */
-    fprintf(gen->output, "    mov rsp, rbp\n");
-    fprintf(gen->output, "    pop rbp\n");
-    fprintf(gen->output, "    ret\n");
+    generate_epilogue(gen);
     fprintf(gen->output, "\n");
 }
 
@@ -5,6 +5,7 @@
 #ifndef CODEGEN_H
 #define CODEGEN_H
 
+#include <stdio.h>
 #include "ast.h"
 #include "core.h"
 
@@ -22,11 +23,25 @@ typedef struct {
     int capacity;
 } SymbolTable;
 
+/* Frame offset assigned to a local declaration */
+typedef struct {
+    ASTNode* decl;
+    int offset;
+} FrameSlot;
+
 /* Code generator */
 typedef struct {
     FILE* output;
     SymbolTable* symtab;
     int label_count;
+    FrameSlot* slots;     /* Filled by layout_frame for the current function */
+    int slot_count;
+    int slot_capacity;
+    int frame_size;
+    int stack_depth;      /* Temporaries pushed below the frame */
+    int temp_base;        /* Leaf functions: red-zone bytes used by locals */
+    bool leaf;            /* No calls: no frame pointer, locals off rsp */
+    char* frame_reg;
 } CodeGen;
 
 /* Functions */
@@ -37,11 +52,18 @@ void generate_code(ASTNode* ast, CodeGen* gen);
 void generate_function(ASTNode* func, CodeGen* gen);
 void generate_statement(ASTNode* stmt, CodeGen* gen);
 void generate_expression(ASTNode* expr, CodeGen* gen);
+void generate_condition(ASTNode* cond, char* prefix, int label_id, CodeGen* gen);
+
+/* Frame layout */
+int layout_frame(ASTNode* func, CodeGen* gen);
+int frame_slot_offset(CodeGen* gen, ASTNode* decl);
 
 /* Symbol table functions */
 SymbolTable* create_symbol_table();
 void free_symbol_table(SymbolTable* symtab);
-int add_symbol(SymbolTable* symtab, char* name, TypeInfo* type);
+int add_symbol(SymbolTable* symtab, char* name, TypeInfo* type, int offset);
+void pop_symbols(SymbolTable* symtab, int mark);
+Symbol* lookup_symbol(SymbolTable* symtab, char* name);
 int find_symbol(SymbolTable* symtab, char* name);
 
 #endif /* CODEGEN_H */
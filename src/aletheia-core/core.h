@@ -7,6 +7,8 @@ typedef int bool;
 
 /* Memory management (simplified) */
 void* core_malloc(int size);
+void core_free(void* ptr);
+char* core_strdup(char* s);
 
 /* Error reporting */
 void core_error();
@@ -388,13 +388,17 @@ void generate_code(ASTNode* node) {
         }
         printf(".L_end_%d:\n", label_id);
     } else if (node->type == AST_WHILE) {
+        // Rotated: guard once, then test at the bottom of the aligned loop
         int label_id = label_count++;
-        printf(".L_while_start_%d:\n", label_id);
         generate_code(node->data.while_stmt.cond);
         printf("    test rax, rax\n");
         printf("    jz .L_while_end_%d\n", label_id);
+        printf("    .p2align 4\n");
+        printf(".L_while_start_%d:\n", label_id);
         generate_code(node->data.while_stmt.body);
-        printf("    jmp .L_while_start_%d\n", label_id);
+        generate_code(node->data.while_stmt.cond);
+        printf("    test rax, rax\n");
+        printf("    jnz .L_while_start_%d\n", label_id);
         printf(".L_while_end_%d:\n", label_id);
     } else if (node->type == AST_FOR) {
         int label_id = label_count++;
@@ -402,13 +406,14 @@ void generate_code(ASTNode* node) {
         if (node->data.for_stmt.init) {
             generate_code(node->data.for_stmt.init);
         }
-        printf(".L_for_start_%d:\n", label_id);
-        // Generate condition
+        // Guard the first iteration; the loop itself tests at the bottom
         if (node->data.for_stmt.cond) {
             generate_code(node->data.for_stmt.cond);
             printf("    test rax, rax\n");
             printf("    jz .L_for_end_%d\n", label_id);
         }
+        printf("    .p2align 4\n");
+        printf(".L_for_start_%d:\n", label_id);
         // Generate body
         if (node->data.for_stmt.body) {
             generate_code(node->data.for_stmt.body);
@@ -417,15 +422,18 @@ void generate_code(ASTNode* node) {
         if (node->data.for_stmt.incr) {
             generate_code(node->data.for_stmt.incr);
         }
-        printf("    jmp .L_for_start_%d\n", label_id);
+        // Generate condition
+        if (node->data.for_stmt.cond) {
+            generate_code(node->data.for_stmt.cond);
+            printf("    test rax, rax\n");
+            printf("    jnz .L_for_start_%d\n", label_id);
+        } else {
+            printf("    jmp .L_for_start_%d\n", label_id);
+        }
         printf(".L_for_end_%d:\n", label_id);
     } else if (node->type == AST_ARRAY_ACCESS) {
-        printf("    ;; array access %s[...] (simplified)\n", node->data.array_access.array_name);
-        if (node->data.array_access.index) {
-            generate_code(node->data.array_access.index);
-        }
-        printf("    ;; simplified: assume array starts at address 0\n");
-        printf("    mov rax, 0\n");
+        // Variables have no storage or element type to address from
+        printf(";; ERROR: indexing %s is not supported\n", node->data.array_access.array_name);
     } else if (node->type == AST_FUNC_CALL) {
         // Handle standard library functions
         if (strcmp(node->data.func_call.func_name, "printf") == 0) {
@@ -159,6 +159,8 @@ Token* next_token(Lexer* lexer) {
         case ')': advance(lexer); return make_token(TOK_RPAREN, 0, lexer->line);
         case '{': advance(lexer); return make_token(TOK_LBRACE, 0, lexer->line);
         case '}': advance(lexer); return make_token(TOK_RBRACE, 0, lexer->line);
+        case '[': advance(lexer); return make_token(TOK_LBRACKET, 0, lexer->line);
+        case ']': advance(lexer); return make_token(TOK_RBRACKET, 0, lexer->line);
         case ';': advance(lexer); return make_token(TOK_SEMI, 0, lexer->line);
         case ',': advance(lexer); return make_token(TOK_COMMA, 0, lexer->line);
         case '+': advance(lexer); return make_token(TOK_PLUS, 0, lexer->line);
@@ -239,6 +241,8 @@ const char* token_type_name(TokenType type) {
         case TOK_RPAREN: return ")";
         case TOK_LBRACE: return "{";
         case TOK_RBRACE: return "}";
+        case TOK_LBRACKET: return "[";
+        case TOK_RBRACKET: return "]";
         case TOK_SEMI: return ";";
         case TOK_COMMA: return ",";
         case TOK_PLUS: return "+";
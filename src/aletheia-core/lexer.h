@@ -14,6 +14,7 @@ typedef enum {
     TOK_RETURN, TOK_IF, TOK_ELSE, TOK_WHILE,
     TOK_LPAREN, TOK_RPAREN,
     TOK_LBRACE, TOK_RBRACE,
+    TOK_LBRACKET, TOK_RBRACKET,
     TOK_SEMI, TOK_COMMA,
     TOK_PLUS, TOK_MINUS, TOK_STAR, TOK_SLASH,
     TOK_EQ, TOK_LT, TOK_GT,
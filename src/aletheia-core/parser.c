@@ -44,7 +44,7 @@ bool expect(Parser* parser, TokenType type) {
 }
 
 /* Parse type */
-ASTNode* parse_type(Parser* parser) {
+TypeInfo* parse_type(Parser* parser) {
     /* For now, only support int and char */
     if (match(parser, TOK_INT)) {
         advance(parser);
@@ -99,14 +99,32 @@ ASTNode* parse_primary(Parser* parser) {
             call->data.call.name = core_strdup(node->data.identifier);
             call->data.call.args = 0;
             call->data.call.arg_count = 0;
+            free_ast_node(node);
+
+            /* Comma-separated argument expressions */
+            ASTNode* args[MAX_ARGS];
+            int arg_count = 0;
+            if (!match(parser, TOK_RPAREN)) {
+                do {
+                    ASTNode* arg = arg_count < MAX_ARGS ? parse_expression(parser) : 0;
+                    if (!arg) {
+                        for (int i = 0; i < arg_count; i++) free_ast_node(args[i]);
+                        free_ast_node(call);
+                        return 0;
+                    }
+                    args[arg_count++] = arg;
+                } while (expect(parser, TOK_COMMA));
+            }
+            if (arg_count > 0) {
+                call->data.call.args = core_malloc(arg_count * sizeof(ASTNode*));
+                for (int i = 0; i < arg_count; i++) call->data.call.args[i] = args[i];
+                call->data.call.arg_count = arg_count;
+            }
 
-            /* For simplicity, no arguments for now */
             if (!expect(parser, TOK_RPAREN)) {
                 free_ast_node(call);
                 return 0;
             }
-
-            free_ast_node(node);
             return call;
         }
 
@@ -126,6 +144,29 @@ ASTNode* parse_primary(Parser* parser) {
     return 0; /* Error */
 }
 
+/* Parse postfix expression: a primary followed by any number of [index] */
+ASTNode* parse_postfix(Parser* parser) {
+    ASTNode* node = parse_primary(parser);
+    if (!node) return 0;
+
+    while (match(parser, TOK_LBRACKET)) {
+        advance(parser);
+        ASTNode* index = parse_expression(parser);
+        if (!index || !expect(parser, TOK_RBRACKET)) {
+            free_ast_node(index);
+            free_ast_node(node);
+            return 0;
+        }
+
+        ASTNode* element = create_ast_node(AST_INDEX_EXPR);
+        element->data.index.base = node;
+        element->data.index.index = index;
+        node = element;
+    }
+
+    return node;
+}
+
 /* Parse unary expression */
 ASTNode* parse_unary(Parser* parser) {
     if (match(parser, TOK_STAR)) {
@@ -142,7 +183,7 @@ ASTNode* parse_unary(Parser* parser) {
         return unary;
     }
 
-    return parse_primary(parser);
+    return parse_postfix(parser);
 }
 
 /* Parse binary expression (simplified precedence) */
@@ -283,17 +324,32 @@ ASTNode* parse_statement(Parser* parser) {
     if (match(parser, TOK_LBRACE)) {
         advance(parser);
 
-        /* Simple block - for now, just one statement */
-        ASTNode* stmt = parse_statement(parser);
-        if (!expect(parser, TOK_RBRACE)) {
-            free_ast_node(stmt);
-            return 0;
+        /* Declarations and statements in any order up to the '}' */
+        ASTNode* block = create_ast_node(AST_BLOCK);
+        ASTNode** statements = 0;
+        int count = 0;
+        int capacity = 0;
+        while (!match(parser, TOK_RBRACE)) {
+            ASTNode* stmt = match(parser, TOK_EOF) ? 0 : parse_statement(parser);
+            if (!stmt) {
+                for (int i = 0; i < count; i++) free_ast_node(statements[i]);
+                core_free(statements);
+                core_free(block);
+                return 0;
+            }
+            if (count == capacity) {
+                ASTNode** old = statements;
+                capacity = capacity == 0 ? 8 : capacity * 2;
+                statements = core_malloc(capacity * sizeof(ASTNode*));
+                for (int i = 0; i < count; i++) statements[i] = old[i];
+                core_free(old);
+            }
+            statements[count++] = stmt;
         }
+        advance(parser);
 
-        ASTNode* block = create_ast_node(AST_BLOCK);
-        block->data.block.statements = core_malloc(sizeof(ASTNode*));
-        block->data.block.statements[0] = stmt;
-        block->data.block.stmt_count = 1;
+        block->data.block.statements = statements;
+        block->data.block.stmt_count = count;
         return block;
     }
 
@@ -321,7 +377,11 @@ ASTNode* parse_variable_declaration(Parser* parser) {
         return 0;
     }
 
-    /* Variable name */
+    /* Pointer, then the variable name */
+    if (match(parser, TOK_STAR)) {
+        advance(parser);
+        var_type = create_pointer_type(var_type);
+    }
     if (!match(parser, TOK_IDENT)) {
         free_type(var_type);
         return 0;
@@ -330,12 +390,6 @@ ASTNode* parse_variable_declaration(Parser* parser) {
     char* name = core_strdup(parser->current_token->value);
     advance(parser);
 
-    /* Check for pointer */
-    if (match(parser, TOK_STAR)) {
-        advance(parser);
-        var_type = create_pointer_type(var_type);
-    }
-
     /* Initializer */
     ASTNode* init = 0;
     if (match(parser, TOK_ASSIGN)) {
@@ -357,6 +411,37 @@ ASTNode* parse_variable_declaration(Parser* parser) {
     return decl;
 }
 
+/* Parse one parameter: int or char, an optional *, then its name */
+ASTNode* parse_parameter(Parser* parser) {
+    TypeInfo* param_type = 0;
+    if (match(parser, TOK_INT)) {
+        advance(parser);
+        param_type = create_type(TYPE_INT);
+    } else if (match(parser, TOK_CHAR)) {
+        advance(parser);
+        param_type = create_type(TYPE_CHAR);
+    } else {
+        return 0;
+    }
+
+    if (match(parser, TOK_STAR)) {
+        advance(parser);
+        param_type = create_pointer_type(param_type);
+    }
+
+    if (!match(parser, TOK_IDENT)) {
+        free_type(param_type);
+        return 0;
+    }
+
+    ASTNode* param = create_ast_node(AST_VAR_DECL);
+    param->data.var_decl.name = core_strdup(parser->current_token->value);
+    param->data.var_decl.var_type = param_type;
+    param->data.var_decl.initializer = 0;
+    advance(parser);
+    return param;
+}
+
 /* Parse function definition */
 ASTNode* parse_function_definition(Parser* parser) {
     /* Return type */
@@ -383,8 +468,24 @@ ASTNode* parse_function_definition(Parser* parser) {
     char* name = core_strdup(parser->current_token->value);
     advance(parser);
 
-    /* Parameters (simplified - no params for now) */
-    if (!expect(parser, TOK_LPAREN) || !expect(parser, TOK_RPAREN)) {
+    /* Parameters: "type name" pairs, each kept as a declaration */
+    ASTNode* params[MAX_ARGS];
+    int param_count = 0;
+    bool ok = expect(parser, TOK_LPAREN);
+    if (ok && match(parser, TOK_VOID)) {
+        advance(parser);
+    } else if (ok && !match(parser, TOK_RPAREN)) {
+        do {
+            ASTNode* param = param_count < MAX_ARGS ? parse_parameter(parser) : 0;
+            if (!param) {
+                ok = false;
+                break;
+            }
+            params[param_count++] = param;
+        } while (expect(parser, TOK_COMMA));
+    }
+    if (!ok || !expect(parser, TOK_RPAREN)) {
+        for (int i = 0; i < param_count; i++) free_ast_node(params[i]);
         free_type(return_type);
         core_free(name);
         return 0;
@@ -393,6 +494,7 @@ ASTNode* parse_function_definition(Parser* parser) {
     /* Body */
     ASTNode* body = parse_statement(parser);
     if (!body) {
+        for (int i = 0; i < param_count; i++) free_ast_node(params[i]);
         free_type(return_type);
         core_free(name);
         return 0;
@@ -401,7 +503,11 @@ ASTNode* parse_function_definition(Parser* parser) {
     ASTNode* func = create_ast_node(AST_FUNCTION_DEF);
     func->data.func_def.name = name;
     func->data.func_def.params = 0;
-    func->data.func_def.param_count = 0;
+    func->data.func_def.param_count = param_count;
+    if (param_count > 0) {
+        func->data.func_def.params = core_malloc(param_count * sizeof(ASTNode*));
+        for (int i = 0; i < param_count; i++) func->data.func_def.params[i] = params[i];
+    }
     func->data.func_def.return_type = return_type;
     func->data.func_def.body = body;
     return func;
@@ -8,6 +8,9 @@
 #include "ast.h"
 #include "lexer.h"
 
+/* Most arguments a call or parameters a function may have */
+#define MAX_ARGS 16
+
 /* Parser state */
 typedef struct {
     Lexer* lexer;
@@ -21,9 +24,10 @@ void free_parser(Parser* parser);
 ASTNode* parse_program(Parser* parser);
 ASTNode* parse_function_definition(Parser* parser);
 ASTNode* parse_variable_declaration(Parser* parser);
+ASTNode* parse_parameter(Parser* parser);
 ASTNode* parse_statement(Parser* parser);
 ASTNode* parse_expression(Parser* parser);
-ASTNode* parse_type(Parser* parser);
+TypeInfo* parse_type(Parser* parser);
 
 /* Helper functions */
 Token* current_token(Parser* parser);
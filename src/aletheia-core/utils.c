@@ -15,6 +15,20 @@ void* core_malloc(int size) {
     return ptr;
 }
 
+/* The pool is only ever released as a whole */
+void core_free(void* ptr) {
+    (void)ptr;
+}
+
+char* core_strdup(char* s) {
+    int length = 0;
+    while (s[length]) length++;
+    char* copy = core_malloc(length + 1);
+    if (!copy) return 0;
+    for (int i = 0; i <= length; i++) copy[i] = s[i];
+    return copy;
+}
+
 void core_error() {
     /* Simple error - just exit */
 }
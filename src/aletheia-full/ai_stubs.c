@@ -3,6 +3,8 @@
  * Temporary stubs until full AI integration
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -2,13 +2,24 @@
 // Extends ALETHEIA-Core with full GCC compatibility
 // Features: GCC extensions, optimizations, preprocessor, linker, DWARF
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
+#include <limits.h>
+#include <errno.h>
 #include <time.h>
 #include "ai_integration.h"
 #include "../backends/backend.h"
+#include "../backends/ir.h"
+#include "../backends/isel.h"
+#include "../backends/regalloc.h"
+#include "../backends/sched.h"
+#include "../backends/peephole.h"
+#include "../backends/parallel.h"
+#include "../asm/geno_format.h"
 
 // Forward declarations to avoid typedef redefinition warnings
 typedef struct ASTNode ASTNode;
@@ -21,7 +32,9 @@ typedef enum {
     AST_NUM, AST_STRING, AST_VAR, AST_ASSIGN, AST_RETURN,
     AST_IF, AST_WHILE, AST_FOR, AST_BINARY_OP, AST_ARRAY_ACCESS,
     AST_FUNC_CALL, AST_VAR_DECL, AST_ARRAY_DECL, AST_STRUCT_DECL,
-    AST_FUNC_DECL, AST_PTR_DECL, AST_ADDR_OF, AST_DEREF,
+    AST_FUNC_DECL, AST_PTR_DECL, AST_ADDR_OF, AST_DEREF, AST_BLOCK,
+    AST_BREAK, AST_CONTINUE,
+    AST_CONDITIONAL,    // c ? a : b, in if_stmt
 
     // GCC compatible extensions
     AST_GCC_ATTRIBUTE, AST_GCC_BUILTIN, AST_PRAGMA,
@@ -37,7 +50,7 @@ typedef enum {
 
 // Enhanced AST Data Union
 typedef union {
-    int num_val;
+    long num_val;
     char* string_value;
     char* var_name;
     struct { ASTNode* left; ASTNode* right; char op; } binary;
@@ -46,13 +59,16 @@ typedef union {
     struct { ASTNode* init; ASTNode* cond; ASTNode* incr; ASTNode* body; } for_stmt;
     struct { char* array_name; ASTNode* index; } array_access;
     struct { char* func_name; ASTNode* args; int arg_count; } func_call;
-    struct { char* var_name; ASTNode* init_expr; } var_decl;
+    struct { char* var_name; ASTNode* init_expr; int size; int elem_size; } var_decl;
     struct { char* array_name; int size; } array_decl;
     struct { char* struct_name; } struct_decl;
     struct { char* func_name; ASTNode** params; int param_count; ASTNode* body; } func_decl;
     struct { char* ptr_name; } ptr_decl;
     struct { ASTNode* operand; } deref;
     struct { ASTNode* operand; } addr_of;
+    struct { ASTNode* value; } return_stmt;
+    struct { char* var_name; ASTNode* value; } assign;
+    struct { ASTNode** statements; int stmt_count; } block;
 
     // GCC extensions
     struct { char* attr_name; ASTNode** attr_args; int arg_count; } gcc_attribute;
@@ -121,6 +137,17 @@ typedef struct {
     int current_line;
 } DWARFGenerator;
 
+// A function compiled once per target_clones entry and entered through a
+// resolver that picks the clone for the running CPU
+#define MAX_TARGET_CLONES 4
+
+typedef struct {
+    const char* name;
+    char* clones[MAX_TARGET_CLONES];    // "name.target", best first; the last is the default
+    uint32_t features[MAX_TARGET_CLONES];
+    int count;
+} ClonedFunction;
+
 // Main compiler structure
 typedef struct {
     char* input_filename;
@@ -134,6 +161,21 @@ typedef struct {
     int builtin_count;
     int error_count;
     int warning_count;
+    IRCFGStats cfg_stats;   // What CFG simplification removed, all functions
+    SchedStats sched_stats; // What scheduling moved, all functions
+    PeepholeRuleSet* peephole_hits; // Peephole rule hits, all functions
+    int peephole_stats;     // --peephole-stats: print peephole_hits
+    EmitBuffer asm_buffer;  // Assembly emitted outside any function
+    int emit_assembly;      // -S: print assembly instead of linking
+    int emit_object;        // -c: write the GENO object instead of linking
+    CodeBuffer code_buffer; // Machine code of every function, for the object
+    int workers;            // -jN: threads generating functions in parallel
+    const char* clone_targets;  // -mtarget-clones: targets for functions with vector loops
+    ClonedFunction* clones; // Functions dispatched on the CPU, in source order
+    int clone_count;
+    const char* tune_cpu;   // -mtune: core the scheduler models, NULL for the target default
+    const TargetBackend* backend;   // Shared descriptor for target_arch
+    uint32_t features;      // -m extensions every function of this compilation may use
 } ALETHEIAFullCompiler;
 
 // GCC Built-in function implementations
@@ -180,6 +222,1702 @@ void dwarf_generate_function(ALETHEIAFullCompiler* compiler, const char* func_na
     // Generate DWARF DIE for function
 }
 
+// IR lowering: AST -> backend IR over virtual registers. Nothing in the
+// subset takes an address, so every local and parameter lives in a vreg of
+// its own and only the register allocator decides what goes to the frame.
+typedef struct {
+    char* name;
+    int vreg;
+    int size;               // Declared bytes: 4 for int, 8 for long and pointers
+    int elem_size;          // Bytes a pointer points to, 0 for void* and non-pointers
+} LocalVar;
+
+typedef struct {
+    IRFunction* fn;
+    IselTree tree;
+    LocalVar* locals;       // In scope, innermost last
+    int local_count;
+    int local_capacity;
+    bool vectorize;         // Run reduction loops on fn->vector_bits wide vectors
+    IRBlock* break_target;  // Exit and latch of the innermost loop
+    IRBlock* continue_target;
+    bool failed;
+} LoweringContext;
+
+// A declaration hides any outer local of the same name until its scope ends
+static int lower_declare_local(LoweringContext* ctx, const char* name, int vreg, int size,
+                               int elem_size) {
+    if (ctx->local_count == ctx->local_capacity) {
+        ctx->local_capacity = ctx->local_capacity ? ctx->local_capacity * 2 : 8;
+        ctx->locals = realloc(ctx->locals, sizeof(LocalVar) * ctx->local_capacity);
+    }
+    ctx->locals[ctx->local_count].name = (char*)name;
+    ctx->locals[ctx->local_count].vreg = vreg;
+    ctx->locals[ctx->local_count].size = size;
+    ctx->locals[ctx->local_count].elem_size = elem_size;
+    return ctx->locals[ctx->local_count++].vreg;
+}
+
+static LocalVar* lower_find_local(LoweringContext* ctx, const char* name) {
+    for (int i = ctx->local_count - 1; i >= 0; i--) {
+        if (strcmp(ctx->locals[i].name, name) == 0) return &ctx->locals[i];
+    }
+
+    fprintf(stderr, "aletheia-full: %s: '%s' undeclared\n", ctx->fn->name, name);
+    ctx->failed = true;
+    lower_declare_local(ctx, name, ir_new_vreg(ctx->fn), 8, 8);
+    return &ctx->locals[ctx->local_count - 1];
+}
+
+static int lower_local(LoweringContext* ctx, const char* name) {
+    return lower_find_local(ctx, name)->vreg;
+}
+
+// An int lives in a 64-bit register like a long and nothing wraps what is
+// stored to it, so a constant outside its range is refused
+static void lower_check_store(LoweringContext* ctx, const char* name, int size, ASTNode* value) {
+    long constant;
+
+    if (size != 4 || !value) return;
+    if (value->type == AST_NUM) {
+        constant = value->data.num_val;
+    } else if (value->type == AST_BINARY_OP && value->data.binary.op == '-' &&
+               value->data.binary.left && value->data.binary.left->type == AST_NUM &&
+               value->data.binary.left->data.num_val == 0 &&
+               value->data.binary.right && value->data.binary.right->type == AST_NUM) {
+        constant = -value->data.binary.right->data.num_val;
+    } else {
+        return;
+    }
+    if (constant >= INT_MIN && constant <= INT_MAX) return;
+
+    fprintf(stderr, "%s:%d: error: constant %ld does not fit in int '%s'\n",
+            value->filename, value->line_number, constant, name);
+    ctx->failed = true;
+}
+
+static bool lower_is_local(LoweringContext* ctx, int vreg) {
+    for (int i = 0; i < ctx->local_count; i++) {
+        if (ctx->locals[i].vreg == vreg) return true;
+    }
+    return false;
+}
+
+static int lower_expression(LoweringContext* ctx, ASTNode* node);
+
+// Splits an array index into the part computed at run time and a constant
+// element offset, so a[i + 1] becomes one load at a displacement. Returns
+// NULL when the whole index is constant.
+static ASTNode* lower_split_index(ASTNode* index, long* constant) {
+    *constant = 0;
+    if (!index) return NULL;
+    if (index->type == AST_NUM) {
+        *constant = index->data.num_val;
+        return NULL;
+    }
+    if (index->type == AST_BINARY_OP && index->data.binary.right &&
+        index->data.binary.right->type == AST_NUM) {
+        if (index->data.binary.op == '+') {
+            *constant = index->data.binary.right->data.num_val;
+            return index->data.binary.left;
+        }
+        if (index->data.binary.op == '-') {
+            *constant = -index->data.binary.right->data.num_val;
+            return index->data.binary.left;
+        }
+    }
+    if (index->type == AST_BINARY_OP && index->data.binary.op == '+' &&
+        index->data.binary.left && index->data.binary.left->type == AST_NUM) {
+        *constant = index->data.binary.left->data.num_val;
+        return index->data.binary.right;
+    }
+    return index;
+}
+
+// && and ||, which branch rather than compute
+static bool lower_is_logical(ASTNode* node) {
+    return node && node->type == AST_BINARY_OP &&
+           (node->data.binary.op == '&' || node->data.binary.op == '|');
+}
+
+// Whether evaluating the expression assigns a local, calls a function or
+// branches
+static bool lower_has_effects(ASTNode* node) {
+    if (!node) return false;
+    switch (node->type) {
+        case AST_ASSIGN:
+        case AST_FUNC_CALL:
+        case AST_CONDITIONAL:
+            return true;
+        case AST_BINARY_OP:
+            if (lower_is_logical(node)) return true;
+            return lower_has_effects(node->data.binary.left) ||
+                   lower_has_effects(node->data.binary.right);
+        case AST_ARRAY_ACCESS:
+            return lower_has_effects(node->data.array_access.index);
+        default:
+            return false;
+    }
+}
+
+// A tree built before `rest` is reduced right away when `rest` has side
+// effects, so the locals it reads are copied before they can change
+static int lower_before(LoweringContext* ctx, int tree, ASTNode* rest) {
+    if (!lower_has_effects(rest)) return tree;
+
+    int value = isel_reduce_value(&ctx->tree, tree);
+    if (lower_is_local(ctx, value)) {
+        int copy = ir_new_vreg(ctx->fn);
+        ir_build_mov(ctx->fn, ir_vreg(copy), ir_vreg(value));
+        value = copy;
+    }
+    return isel_vreg(&ctx->tree, value);
+}
+
+static void lower_condition(LoweringContext* ctx, ASTNode* cond, IRBlock* if_true, IRBlock* if_false);
+
+// && and || as values: branch on the condition and set 1 or 0 on each side
+static int lower_logical_value(LoweringContext* ctx, ASTNode* node) {
+    IRFunction* fn = ctx->fn;
+    IRBlock* if_true = ir_create_block(fn);
+    IRBlock* if_false = ir_create_block(fn);
+    IRBlock* join = ir_create_block(fn);
+    int result = ir_new_vreg(fn);
+
+    lower_condition(ctx, node, if_true, if_false);
+    ir_set_block(fn, if_true);
+    ir_build_mov(fn, ir_vreg(result), ir_vreg(ir_build_mov_imm(fn, 1)));
+    ir_build_jmp(fn, join);
+    ir_set_block(fn, if_false);
+    ir_build_mov(fn, ir_vreg(result), ir_vreg(ir_build_mov_imm(fn, 0)));
+    ir_build_jmp(fn, join);
+    ir_set_block(fn, join);
+    return result;
+}
+
+// c ? a : b: a diamond where each arm copies its value into one vreg. Only
+// the chosen arm runs, and if-conversion turns the diamond into a select
+// when both arms are cheap and safe to run either way.
+static int lower_conditional_value(LoweringContext* ctx, ASTNode* node) {
+    IRFunction* fn = ctx->fn;
+    IRBlock* if_true = ir_create_block(fn);
+    IRBlock* if_false = ir_create_block(fn);
+    IRBlock* join = ir_create_block(fn);
+    int result = ir_new_vreg(fn);
+
+    lower_condition(ctx, node->data.if_stmt.cond, if_true, if_false);
+    ir_set_block(fn, if_true);
+    ir_build_mov(fn, ir_vreg(result), ir_vreg(lower_expression(ctx, node->data.if_stmt.then_branch)));
+    ir_build_jmp(fn, join);
+    ir_set_block(fn, if_false);
+    ir_build_mov(fn, ir_vreg(result), ir_vreg(lower_expression(ctx, node->data.if_stmt.else_branch)));
+    ir_build_jmp(fn, join);
+    ir_set_block(fn, join);
+    return result;
+}
+
+// Builds the selection tree of an expression. Assignments and calls are
+// lowered on the spot and enter the tree as the vreg holding their value.
+static int lower_tree(LoweringContext* ctx, ASTNode* node) {
+    IRFunction* fn = ctx->fn;
+    IselTree* tree = &ctx->tree;
+    if (!node) return isel_const(tree, 0);
+
+    switch (node->type) {
+        case AST_NUM:
+            return isel_const(tree, node->data.num_val);
+
+        case AST_VAR:
+            return isel_vreg(tree, lower_local(ctx, node->data.var_name));
+
+        case AST_ASSIGN: {
+            int value = lower_expression(ctx, node->data.assign.value);
+            LocalVar* local = lower_find_local(ctx, node->data.assign.var_name);
+            lower_check_store(ctx, local->name, local->size, node->data.assign.value);
+            ir_build_mov(fn, ir_vreg(local->vreg), ir_vreg(value));
+            return isel_vreg(tree, value);
+        }
+
+        case AST_ARRAY_ACCESS: {
+            // The named variable points to int or 8-byte elements, loaded at
+            // their width from base + (index << shift) + constant*size
+            long constant;
+            ASTNode* index = lower_split_index(node->data.array_access.index, &constant);
+            LocalVar* array = lower_find_local(ctx, node->data.array_access.array_name);
+            int elem_size = array->elem_size;
+            if (elem_size != 4 && elem_size != 8) {
+                fprintf(stderr, "%s:%d: error: '%s' does not point to int, long or a pointer\n",
+                        node->filename, node->line_number, array->name);
+                ctx->failed = true;
+                return isel_const(tree, 0);
+            }
+            int addr = isel_vreg(tree, array->vreg);
+            if (index) {
+                addr = lower_before(ctx, addr, index);
+                int scaled = isel_binary(tree, ISEL_SHL, lower_tree(ctx, index),
+                                         isel_const(tree, elem_size == 4 ? 2 : 3));
+                addr = isel_binary(tree, ISEL_ADD, addr, scaled);
+            }
+            if (constant != 0) addr = isel_binary(tree, ISEL_ADD, addr, isel_const(tree, constant * elem_size));
+            return isel_load(tree, elem_size == 4 ? MEM_S32 : MEM_WORD, addr);
+        }
+
+        case AST_CONDITIONAL:
+            return isel_vreg(tree, lower_conditional_value(ctx, node));
+
+        case AST_FUNC_CALL: {
+            // Evaluate every argument before filling the argument registers
+            int count = node->data.func_call.arg_count;
+            int* args = malloc(sizeof(int) * (count > 0 ? count : 1));
+            for (int i = 0; i < count; i++) {
+                args[i] = lower_expression(ctx, &node->data.func_call.args[i]);
+            }
+            for (int i = 0; i < count; i++) {
+                if (!ir_build_arg(fn, i, args[i])) {
+                    fprintf(stderr, "aletheia-full: %s: call to %s passes %d arguments, only %d fit in registers\n",
+                            fn->name, node->data.func_call.func_name, count,
+                            fn->backend->calling_convention->num_arg_registers);
+                    ctx->failed = true;
+                    break;
+                }
+            }
+            free(args);
+            return isel_vreg(tree, ir_build_call(fn, node->data.func_call.func_name, count));
+        }
+
+        case AST_BINARY_OP: {
+            if (lower_is_logical(node)) return isel_vreg(tree, lower_logical_value(ctx, node));
+            int lhs = lower_before(ctx, lower_tree(ctx, node->data.binary.left),
+                                   node->data.binary.right);
+            int rhs = lower_tree(ctx, node->data.binary.right);
+            switch (node->data.binary.op) {
+                case '+': return isel_binary(tree, ISEL_ADD, lhs, rhs);
+                case '-': return isel_binary(tree, ISEL_SUB, lhs, rhs);
+                case '*': return isel_binary(tree, ISEL_MUL, lhs, rhs);
+                case '/': return isel_binary(tree, ISEL_DIV, lhs, rhs);
+                case '<': return isel_compare(tree, COND_LT, lhs, rhs);
+                case '>': return isel_compare(tree, COND_GT, lhs, rhs);
+                case 'L': return isel_compare(tree, COND_LE, lhs, rhs);
+                case 'G': return isel_compare(tree, COND_GE, lhs, rhs);
+                case '=': return isel_compare(tree, COND_EQ, lhs, rhs);
+                case '!': return isel_compare(tree, COND_NE, lhs, rhs);
+                case '%': {
+                    // No target has a remainder in the IR: a - (a / b) * b
+                    int a = isel_reduce_value(tree, lhs);
+                    int b = isel_reduce_value(tree, rhs);
+                    int quotient = isel_binary(tree, ISEL_DIV, isel_vreg(tree, a), isel_vreg(tree, b));
+                    return isel_binary(tree, ISEL_SUB, isel_vreg(tree, a),
+                                       isel_binary(tree, ISEL_MUL, quotient, isel_vreg(tree, b)));
+                }
+            }
+            fprintf(stderr, "aletheia-full: unsupported binary operator '%c'\n", node->data.binary.op);
+            ctx->failed = true;
+            return lhs;
+        }
+
+        default:
+            fprintf(stderr, "aletheia-full: unsupported expression node %d\n", node->type);
+            ctx->failed = true;
+            return isel_const(tree, 0);
+    }
+}
+
+static int lower_expression(LoweringContext* ctx, ASTNode* node) {
+    return isel_reduce_value(&ctx->tree, lower_tree(ctx, node));
+}
+
+// Lowers a condition straight into a branch: the target's rules turn a
+// comparison into a single compare-and-branch, and anything else into a
+// branch on the value against zero. && and || branch on each operand in
+// turn, skipping the right one when the left decides; the block testing the
+// right operand goes right after the current one.
+static void lower_condition(LoweringContext* ctx, ASTNode* cond, IRBlock* if_true, IRBlock* if_false) {
+    IRFunction* fn = ctx->fn;
+
+    // !(a && b) swaps the targets instead of materializing the value
+    if (cond && cond->type == AST_BINARY_OP && cond->data.binary.op == '=' &&
+        lower_is_logical(cond->data.binary.left) && cond->data.binary.right &&
+        cond->data.binary.right->type == AST_NUM && cond->data.binary.right->data.num_val == 0) {
+        lower_condition(ctx, cond->data.binary.left, if_false, if_true);
+        return;
+    }
+    if (lower_is_logical(cond)) {
+        IRBlock* right = ir_create_block(fn);
+        ir_move_block_after(fn, right, fn->current);
+        if (cond->data.binary.op == '&') {
+            lower_condition(ctx, cond->data.binary.left, right, if_false);
+        } else {
+            lower_condition(ctx, cond->data.binary.left, if_true, right);
+        }
+        ir_set_block(fn, right);
+        lower_condition(ctx, cond->data.binary.right, if_true, if_false);
+        return;
+    }
+    isel_reduce_branch(&ctx->tree, lower_tree(ctx, cond), if_true, if_false);
+}
+
+// Reduction loops the vectorizer takes:
+//     while (i < n) { s = s + a[i + c] - b[i] ...; i = i + 1; }
+// n is a local or a constant and every other term an element of an array
+// indexed by i plus a constant. Adds wrap, so summing lane by lane gives
+// the same result as the scalar order.
+#define VECTOR_MAX_TERMS 8
+
+typedef struct {
+    const char* array;
+    int offset;             // Constant element offset from i
+    bool subtract;
+} VectorTerm;
+
+typedef struct {
+    const char* sum;
+    const char* index;
+    ASTNode* bound;
+    VectorTerm terms[VECTOR_MAX_TERMS];
+    int num_terms;
+    int sum_leaves;
+} VectorLoop;
+
+static bool vector_is_var(ASTNode* node, const char* name) {
+    return node && node->type == AST_VAR && strcmp(node->data.var_name, name) == 0;
+}
+
+static bool vector_collect(VectorLoop* loop, ASTNode* node, bool subtract) {
+    if (!node) return false;
+    if (node->type == AST_BINARY_OP &&
+        (node->data.binary.op == '+' || node->data.binary.op == '-')) {
+        bool flip = node->data.binary.op == '-';
+        return vector_collect(loop, node->data.binary.left, subtract) &&
+               vector_collect(loop, node->data.binary.right, flip ? !subtract : subtract);
+    }
+    if (vector_is_var(node, loop->sum)) {
+        loop->sum_leaves++;
+        return !subtract;
+    }
+    if (node->type != AST_ARRAY_ACCESS || loop->num_terms == VECTOR_MAX_TERMS) return false;
+
+    const char* array = node->data.array_access.array_name;
+    long constant;
+    ASTNode* index = lower_split_index(node->data.array_access.index, &constant);
+    if (strcmp(array, loop->sum) == 0 || strcmp(array, loop->index) == 0 ||
+        !vector_is_var(index, loop->index) || constant != (int)constant) {
+        return false;
+    }
+    VectorTerm* term = &loop->terms[loop->num_terms++];
+    term->array = array;
+    term->offset = constant;
+    term->subtract = subtract;
+    return true;
+}
+
+static bool match_vector_loop(ASTNode* node, VectorLoop* loop) {
+    memset(loop, 0, sizeof(*loop));
+    if (!node || node->type != AST_WHILE) return false;
+
+    ASTNode* cond = node->data.while_stmt.cond;
+    ASTNode* body = node->data.while_stmt.body;
+    if (!cond || cond->type != AST_BINARY_OP || cond->data.binary.op != '<' ||
+        !cond->data.binary.left || cond->data.binary.left->type != AST_VAR ||
+        !body || body->type != AST_BLOCK || body->data.block.stmt_count != 2) {
+        return false;
+    }
+    ASTNode* update = body->data.block.statements[0];
+    ASTNode* step = body->data.block.statements[1];
+    if (!update || update->type != AST_ASSIGN || !step || step->type != AST_ASSIGN) return false;
+
+    loop->index = cond->data.binary.left->data.var_name;
+    loop->sum = update->data.assign.var_name;
+    loop->bound = cond->data.binary.right;
+    if (strcmp(loop->sum, loop->index) == 0 ||
+        strcmp(step->data.assign.var_name, loop->index) != 0) {
+        return false;
+    }
+
+    // i = i + 1
+    ASTNode* next = step->data.assign.value;
+    if (!next || next->type != AST_BINARY_OP || next->data.binary.op != '+' ||
+        !vector_is_var(next->data.binary.left, loop->index) || !next->data.binary.right ||
+        next->data.binary.right->type != AST_NUM || next->data.binary.right->data.num_val != 1) {
+        return false;
+    }
+    if (!loop->bound) return false;
+    if (loop->bound->type == AST_VAR) {
+        if (strcmp(loop->bound->data.var_name, loop->sum) == 0 ||
+            strcmp(loop->bound->data.var_name, loop->index) == 0) {
+            return false;
+        }
+    } else if (loop->bound->type != AST_NUM) {
+        return false;
+    }
+    return vector_collect(loop, update->data.assign.value, false) &&
+           loop->sum_leaves == 1 && loop->num_terms > 0;
+}
+
+static bool contains_vector_loop(ASTNode* node) {
+    VectorLoop loop;
+    if (!node) return false;
+
+    switch (node->type) {
+        case AST_BLOCK:
+            for (int i = 0; i < node->data.block.stmt_count; i++) {
+                if (contains_vector_loop(node->data.block.statements[i])) return true;
+            }
+            return false;
+        case AST_IF:
+            return contains_vector_loop(node->data.if_stmt.then_branch) ||
+                   contains_vector_loop(node->data.if_stmt.else_branch);
+        case AST_WHILE:
+            return match_vector_loop(node, &loop) || contains_vector_loop(node->data.while_stmt.body);
+        default:
+            return false;
+    }
+}
+
+// Runs the loop a whole vector of elements at a time, then leaves s and i
+// for the scalar loop to finish the remainder. The bound is moved down by
+// lanes - 1 up front; when that wraps no whole vector is left.
+static void lower_vector_loop(LoweringContext* ctx, VectorLoop* loop) {
+    IRFunction* fn = ctx->fn;
+    int lanes = fn->vector_bits / 64;
+    int acc = ir_vector_register(fn, 0);
+    int bases[VECTOR_MAX_TERMS];
+
+    for (int t = 0; t < loop->num_terms; t++) {
+        bases[t] = lower_local(ctx, loop->terms[t].array);
+    }
+    int index = lower_local(ctx, loop->index);
+    int bound = loop->bound->type == AST_NUM
+                    ? ir_build_mov_imm(fn, loop->bound->data.num_val)
+                    : lower_local(ctx, loop->bound->data.var_name);
+    int last = ir_build_binary_imm(fn, IR_ADD, bound, -(lanes - 1));
+    ir_build_vzero(fn, acc);
+
+    IRBlock* check = ir_create_block(fn);
+    IRBlock* body = ir_create_block(fn);
+    IRBlock* done = ir_create_block(fn);
+    ir_build_branch(fn, COND_LT, last, bound, check, done);
+    ir_set_block(fn, check);
+    ir_build_branch(fn, COND_LT, index, last, body, done);
+
+    ir_set_block(fn, body);
+    for (int t = 0; t < loop->num_terms; t++) {
+        ir_build_vadd_indexed(fn, loop->terms[t].subtract ? IR_VSUB : IR_VADD, acc, bases[t],
+                              index, 3, loop->terms[t].offset * 8);
+    }
+    ir_build_mov(fn, ir_vreg(index), ir_vreg(ir_build_binary_imm(fn, IR_ADD, index, lanes)));
+    ir_build_branch(fn, COND_LT, index, last, body, done);
+
+    ir_set_block(fn, done);
+    int sum = lower_local(ctx, loop->sum);
+    ir_build_mov(fn, ir_vreg(sum), ir_vreg(ir_build_binary(fn, IR_ADD, sum, ir_build_vreduce(fn, acc))));
+}
+
+// The vector adds work on 64-bit lanes, so every array must hold 8-byte
+// elements; int arrays stay scalar
+static bool lower_vector_words(LoweringContext* ctx, VectorLoop* loop) {
+    for (int t = 0; t < loop->num_terms; t++) {
+        if (lower_find_local(ctx, loop->terms[t].array)->elem_size != 8) return false;
+    }
+    return true;
+}
+
+static void lower_statement(LoweringContext* ctx, ASTNode* node);
+
+// A missing test (for (;;)) always enters the body
+static void lower_loop_test(LoweringContext* ctx, ASTNode* cond, IRBlock* body, IRBlock* exit) {
+    if (cond) lower_condition(ctx, cond, body, exit);
+    else ir_build_jmp(ctx->fn, body);
+}
+
+// Rotated into a guarded do-while: the test is repeated at the bottom so an
+// iteration takes one branch instead of two. The latch (the step, then the
+// test) is where continue goes; it and the exit are created up front for
+// continue and break, then moved behind the body's blocks.
+static void lower_loop(LoweringContext* ctx, ASTNode* cond, ASTNode* body_stmt, ASTNode* step) {
+    IRFunction* fn = ctx->fn;
+    IRBlock* guard = fn->current;
+    IRBlock* body = ir_create_block(fn);
+    IRBlock* latch = ir_create_block(fn);
+    IRBlock* exit = ir_create_block(fn);
+    IRBlock* outer_break = ctx->break_target;
+    IRBlock* outer_continue = ctx->continue_target;
+
+    ctx->break_target = exit;
+    ctx->continue_target = latch;
+    ir_set_block(fn, body);
+    lower_statement(ctx, body_stmt);
+    if (!ir_block_terminated(fn->current)) ir_build_jmp(fn, latch);
+    ctx->break_target = outer_break;
+    ctx->continue_target = outer_continue;
+
+    ir_move_block_after(fn, latch, fn->blocks[fn->num_blocks - 1]);
+    ir_move_block_after(fn, exit, latch);
+    ir_set_block(fn, latch);
+    lower_statement(ctx, step);
+    lower_loop_test(ctx, cond, body, exit);
+
+    ir_set_block(fn, guard);
+    lower_loop_test(ctx, cond, body, exit);
+    ir_set_block(fn, exit);
+}
+
+static void lower_statement(LoweringContext* ctx, ASTNode* node) {
+    IRFunction* fn = ctx->fn;
+    int scope = ctx->local_count;
+    if (!node) return;
+
+    switch (node->type) {
+        case AST_BLOCK:
+            for (int i = 0; i < node->data.block.stmt_count; i++) {
+                lower_statement(ctx, node->data.block.statements[i]);
+            }
+            ctx->local_count = scope;
+            break;
+
+        case AST_VAR_DECL: {
+            // The initializer is lowered before the name is in scope
+            int value = node->data.var_decl.init_expr
+                            ? lower_expression(ctx, node->data.var_decl.init_expr) : -1;
+            lower_check_store(ctx, node->data.var_decl.var_name, node->data.var_decl.size,
+                              node->data.var_decl.init_expr);
+            int local = lower_declare_local(ctx, node->data.var_decl.var_name, ir_new_vreg(fn),
+                                            node->data.var_decl.size, node->data.var_decl.elem_size);
+            if (value >= 0) ir_build_mov(fn, ir_vreg(local), ir_vreg(value));
+            break;
+        }
+
+        case AST_RETURN:
+            ir_build_ret(fn, node->data.return_stmt.value ?
+                         lower_expression(ctx, node->data.return_stmt.value) : -1);
+            ir_set_block(fn, ir_create_block(fn));
+            break;
+
+        case AST_IF: {
+            IRBlock* then_block = ir_create_block(fn);
+            IRBlock* else_block = ir_create_block(fn);
+            IRBlock* end_block = node->data.if_stmt.else_branch ? ir_create_block(fn) : else_block;
+            lower_condition(ctx, node->data.if_stmt.cond, then_block, else_block);
+
+            ir_set_block(fn, then_block);
+            lower_statement(ctx, node->data.if_stmt.then_branch);
+            ir_build_jmp(fn, end_block);
+            if (node->data.if_stmt.else_branch) {
+                ir_set_block(fn, else_block);
+                lower_statement(ctx, node->data.if_stmt.else_branch);
+                ir_build_jmp(fn, end_block);
+            }
+            ir_set_block(fn, end_block);
+            break;
+        }
+
+        case AST_WHILE: {
+            VectorLoop loop;
+            if (ctx->vectorize && match_vector_loop(node, &loop) && lower_vector_words(ctx, &loop)) {
+                lower_vector_loop(ctx, &loop);
+            }
+            lower_loop(ctx, node->data.while_stmt.cond, node->data.while_stmt.body, NULL);
+            break;
+        }
+
+        case AST_FOR:
+            // The init's declarations are scoped to the loop
+            lower_statement(ctx, node->data.for_stmt.init);
+            lower_loop(ctx, node->data.for_stmt.cond, node->data.for_stmt.body, node->data.for_stmt.incr);
+            ctx->local_count = scope;
+            break;
+
+        case AST_BREAK:
+        case AST_CONTINUE: {
+            IRBlock* target = node->type == AST_BREAK ? ctx->break_target : ctx->continue_target;
+            if (!target) {
+                fprintf(stderr, "aletheia-full: %s: %s outside a loop\n", fn->name,
+                        node->type == AST_BREAK ? "break" : "continue");
+                ctx->failed = true;
+                break;
+            }
+            ir_build_jmp(fn, target);
+            ir_set_block(fn, ir_create_block(fn));
+            break;
+        }
+
+        default:
+            lower_expression(ctx, node);
+            break;
+    }
+}
+
+// Lowers `func` under symbol `name` for a CPU with `features`; with
+// `vectorize`, reduction loops use the widest vectors those allow
+IRFunction* lower_function(const TargetBackend* backend, ASTNode* func, const char* name,
+                           uint32_t features, bool vectorize) {
+    LoweringContext ctx = {0};
+    ctx.fn = ir_create_function(backend, name);
+    if (!ctx.fn) return NULL;
+    ir_set_function_features(ctx.fn, features);
+    ctx.vectorize = vectorize && ctx.fn->vector_bits > 0;
+
+    ir_create_block(ctx.fn);
+    isel_init(&ctx.tree, ctx.fn);
+
+    // Parameters arrive in the argument registers; copy them out first
+    for (int i = 0; i < func->data.func_decl.param_count; i++) {
+        ASTNode* param = func->data.func_decl.params[i];
+        const char* name = param->type == AST_VAR_DECL ? param->data.var_decl.var_name
+                                                       : param->data.var_name;
+        int vreg = ir_build_param(ctx.fn, i);
+        if (vreg < 0) {
+            fprintf(stderr, "aletheia-full: %s: %d parameters, only %d fit in registers\n",
+                    ctx.fn->name, func->data.func_decl.param_count, backend->calling_convention->num_arg_registers);
+            ctx.failed = true;
+            break;
+        }
+        if (param->type == AST_VAR_DECL) {
+            lower_declare_local(&ctx, name, vreg, param->data.var_decl.size, param->data.var_decl.elem_size);
+        } else {
+            lower_declare_local(&ctx, name, vreg, 8, 8);
+        }
+    }
+    if (!ctx.failed) lower_statement(&ctx, func->data.func_decl.body);
+
+    // Falling off the end of a function returns 0
+    if (!ir_block_terminated(ctx.fn->current)) {
+        ir_build_ret(ctx.fn, ir_build_mov_imm(ctx.fn, 0));
+    }
+
+    isel_free(&ctx.tree);
+    free(ctx.locals);
+    if (ctx.failed) {
+        ir_free_function(ctx.fn);
+        return NULL;
+    }
+    return ctx.fn;
+}
+
+// Simplifying the CFG first bypasses the empty join blocks that would hide
+// nested diamonds from if-conversion; the second round merges what the
+// conversion leaves as straight-line jumps. Sinking parameter copies last
+// keeps the entry block free of callee-saved registers for shrink-wrapping.
+static void optimize_function(IRFunction* fn, IRCFGStats* stats) {
+    ir_simplify_cfg(fn, stats);
+    if (ir_if_convert(fn) > 0) ir_simplify_cfg(fn, stats);
+    ir_sink_param_copies(fn);
+}
+
+// -O3 pays for graph coloring with coalescing; lower levels use linear scan
+static bool allocate_registers(ALETHEIAFullCompiler* compiler, IRFunction* fn) {
+    if (compiler->opt_config.level >= 3) {
+        return regalloc_graph_coloring(fn);
+    }
+    return regalloc_linear_scan(fn);
+}
+
+// One function's trip through the back end. A job writes only to itself
+// and reads the compiler configuration, so jobs can run on any thread; the
+// driver combines the results in source order, which keeps the output
+// identical to a serial run.
+typedef struct {
+    ASTNode* ast;           // NULL: the default "return 42" main
+    const char* name;       // Symbol to define, the function's own unless cloned
+    uint32_t features;      // Extensions the code may assume
+    EmitBuffer text;        // -S: the function's assembly
+    EmitBuffer peephole;
+    PeepholeRuleSet* peephole_rules;    // Rules run over text, with their hits
+    CodeBuffer code;        // Otherwise its machine code
+    IRCFGStats cfg_stats;
+    SchedStats sched_stats;
+    bool failed;
+} CodegenJob;
+
+typedef struct {
+    ALETHEIAFullCompiler* compiler;
+    const TargetBackend* backend;
+    const TargetTuning* tuning;
+    CodegenJob* jobs;
+} CodegenBatch;
+
+// Encodes an allocated function straight into machine code. With -S it is
+// printed instead, and above -O0 that text goes through the target's
+// peephole rules.
+static void emit_function(ALETHEIAFullCompiler* compiler, CodegenJob* job, IRFunction* fn) {
+    if (!compiler->emit_assembly) {
+        if (!ir_encode_function(fn, &job->code)) {
+            fprintf(stderr, "aletheia-full: failed to encode %s\n", fn->name);
+            job->failed = true;
+        }
+        return;
+    }
+
+    ir_emit_function(fn, &job->text);
+    if (compiler->opt_config.level > 0) {
+        // Swap so the rewritten text ends up in job->text
+        EmitBuffer original = job->text;
+        job->peephole_rules = peephole_create_rules(fn->backend->arch);
+        peephole_optimize_buffer(&original, &job->peephole, fn->backend->arch, job->peephole_rules);
+        job->text = job->peephole;
+        job->peephole = original;
+    }
+}
+
+static void run_codegen_job(void* context, int index) {
+    CodegenBatch* batch = (CodegenBatch*)context;
+    ALETHEIAFullCompiler* compiler = batch->compiler;
+    CodegenJob* job = &batch->jobs[index];
+    IRFunction* fn;
+
+    if (!job->ast) {
+        fn = ir_create_function(batch->backend, "main");
+        ir_create_block(fn);
+        ir_build_ret(fn, ir_build_mov_imm(fn, 42));
+        allocate_registers(compiler, fn);
+        emit_function(compiler, job, fn);
+        ir_free_function(fn);
+        return;
+    }
+
+    fn = lower_function(batch->backend, job->ast, job->name, job->features,
+                        compiler->opt_config.level >= 2 && compiler->opt_config.enable_vectorization);
+    if (fn && compiler->opt_config.level > 0) optimize_function(fn, &job->cfg_stats);
+    if (fn && compiler->opt_config.level >= 2) {
+        sched_function(fn, batch->tuning, &job->sched_stats);
+    }
+    if (fn && allocate_registers(compiler, fn)) {
+        emit_function(compiler, job, fn);
+    } else {
+        job->failed = true;
+    }
+    ir_free_function(fn);
+}
+
+static void add_cfg_stats(IRCFGStats* total, const IRCFGStats* stats) {
+    total->unreachable += stats->unreachable;
+    total->folded += stats->folded;
+    total->forwarders += stats->forwarders;
+    total->threaded += stats->threaded;
+    total->merged += stats->merged;
+}
+
+static void add_sched_stats(SchedStats* total, const SchedStats* stats) {
+    total->blocks += stats->blocks;
+    total->moved += stats->moved;
+    total->cycles_before += stats->cycles_before;
+    total->cycles_after += stats->cycles_after;
+}
+
+// Generates every job on the worker pool, then writes the functions out in
+// job order: assembly to stdout one write per function, or machine code
+// appended to the object
+static void generate_functions(ALETHEIAFullCompiler* compiler, const TargetBackend* backend,
+                               CodegenJob* jobs, int count) {
+    CodegenBatch batch = {compiler, backend, target_find_tuning(backend, compiler->tune_cpu), jobs};
+
+    for (int i = 0; i < count; i++) {
+        emit_buffer_init(&jobs[i].text);
+        emit_buffer_init(&jobs[i].peephole);
+        mcode_buffer_init(&jobs[i].code);
+        memset(&jobs[i].cfg_stats, 0, sizeof(IRCFGStats));
+        memset(&jobs[i].sched_stats, 0, sizeof(SchedStats));
+        jobs[i].peephole_rules = NULL;
+        jobs[i].failed = false;
+    }
+
+    parallel_run(count, compiler->workers, run_codegen_job, &batch);
+
+    for (int i = 0; i < count; i++) {
+        CodegenJob* job = &jobs[i];
+
+        add_cfg_stats(&compiler->cfg_stats, &job->cfg_stats);
+        add_sched_stats(&compiler->sched_stats, &job->sched_stats);
+        if (job->peephole_rules) {
+            if (!compiler->peephole_hits) compiler->peephole_hits = peephole_create_rules(backend->arch);
+            if (compiler->peephole_hits) peephole_add_hits(compiler->peephole_hits, job->peephole_rules);
+            peephole_free_rules(job->peephole_rules);
+        }
+        if (job->failed) compiler->error_count++;
+        if (compiler->emit_assembly) {
+            if (!emit_flush(&job->text, stdout)) {
+                fprintf(stderr, "aletheia-full: failed to write code for function %d\n", i);
+            }
+        } else if (!job->failed && !mcode_append(&compiler->code_buffer, &job->code)) {
+            compiler->error_count++;
+        }
+        emit_buffer_free(&job->text);
+        emit_buffer_free(&job->peephole);
+        mcode_buffer_free(&job->code);
+    }
+}
+
+static uint32_t object_string(char* strings, uint32_t* size, const char* name) {
+    uint32_t offset = *size;
+    size_t len = strlen(name) + 1;
+    memcpy(strings + offset, name, len);
+    *size += (uint32_t)len;
+    return offset;
+}
+
+// Packs the encoded functions into a GENO object: a function symbol per
+// function, an undefined symbol per outside callee and a relocation per
+// call site: a rel32 on x86-64, the bl offset on ARM64, the auipc/jalr
+// pair on RISC-V. The object owns
+// copies of everything, so it can go to geno_write_object or straight to
+// the linker.
+static GENO_Object* build_object(ALETHEIAFullCompiler* compiler) {
+    CodeBuffer* code = &compiler->code_buffer;
+    int max_symbols = code->num_symbols + code->num_relocs;
+    size_t string_bytes = 0;
+    GENO_Object* obj;
+
+    if (code->failed) return NULL;
+    for (int i = 0; i < code->num_symbols; i++) string_bytes += strlen(code->symbols[i].name) + 1;
+    for (int i = 0; i < code->num_relocs; i++) string_bytes += strlen(code->relocs[i].symbol) + 1;
+
+    obj = calloc(1, sizeof(GENO_Object));
+    if (!obj) return NULL;
+    switch (compiler->backend->arch) {
+        case TARGET_ARM64: obj->header.architecture = GENO_ARCH_ARM64; break;
+        case TARGET_RISCV64: obj->header.architecture = GENO_ARCH_RISCV64; break;
+        default: obj->header.architecture = GENO_ARCH_X86_64; break;
+    }
+    obj->symbols = calloc(max_symbols ? max_symbols : 1, sizeof(GENO_Symbol));
+    obj->relocations = calloc(code->num_relocs ? code->num_relocs : 1, sizeof(GENO_Relocation));
+    obj->string_table = malloc(string_bytes ? string_bytes : 1);
+    obj->code_section = malloc(code->size ? code->size : 1);
+    if (!obj->symbols || !obj->relocations || !obj->string_table || !obj->code_section) {
+        geno_free_object(obj);
+        return NULL;
+    }
+
+    for (int i = 0; i < code->num_symbols; i++) {
+        GENO_Symbol* sym = &obj->symbols[obj->header.symbol_count++];
+        sym->name_offset = object_string(obj->string_table, &obj->header.string_size, code->symbols[i].name);
+        sym->type = GENO_SYM_FUNCTION;
+        sym->address = (uint32_t)code->symbols[i].offset;
+        sym->size = (uint32_t)code->symbols[i].size;
+    }
+
+    for (int i = 0; i < code->num_relocs; i++) {
+        const char* name = code->relocs[i].symbol;
+        uint32_t index = 0;
+        while (index < obj->header.symbol_count &&
+               strcmp(obj->string_table + obj->symbols[index].name_offset, name) != 0) {
+            index++;
+        }
+        if (index == obj->header.symbol_count) {
+            GENO_Symbol* sym = &obj->symbols[obj->header.symbol_count++];
+            sym->name_offset = object_string(obj->string_table, &obj->header.string_size, name);
+            sym->type = GENO_SYM_UNDEFINED;
+        }
+
+        GENO_Relocation* reloc = &obj->relocations[obj->header.reloc_count++];
+        reloc->offset = (uint32_t)code->relocs[i].offset;
+        switch (code->relocs[i].kind) {
+            case MCODE_A64_BRANCH26: reloc->type = GENO_REL_BRANCH26; break;
+            case MCODE_RV_CALL: reloc->type = GENO_REL_RV_CALL; break;
+            case MCODE_ABS64: reloc->type = GENO_REL_ABSOLUTE; break;
+            default: reloc->type = GENO_REL_RELATIVE; break;
+        }
+        reloc->symbol_index = index;
+    }
+
+    obj->header.code_size = (uint32_t)code->size;
+    if (code->size > 0) memcpy(obj->code_section, code->data, code->size);
+    return obj;
+}
+
+// Source parser: a recursive-descent parser for the C subset the lowering
+// above handles. That is functions over integer and pointer scalars, with
+// if/else, while, for, break, continue, return and integer expressions
+// (arithmetic, comparisons, && and ||, calls and p[i] reads).
+// Everything is 8 bytes wide, as in the lowering. Preprocessor lines are
+// skipped. Anything outside the subset is reported as an error at its line
+// rather than miscompiled.
+typedef enum {
+    TOK_EOF,
+    TOK_NUM,
+    TOK_IDENT,
+    TOK_STRING,
+    TOK_PUNCT
+} TokenKind;
+
+typedef struct {
+    TokenKind kind;
+    long value;
+    char text[256];     // Identifier, string contents or punctuator
+    int line;
+} Token;
+
+typedef struct {
+    ALETHEIAFullCompiler* compiler;
+    const char* p;
+    int line;
+    bool line_start;    // Only whitespace since the last newline
+    Token tok;
+    bool failed;        // Parsing stops at the first error
+} Parser;
+
+static void parse_error(Parser* ps, const char* format, ...) {
+    va_list args;
+    if (ps->failed) return;
+
+    fprintf(stderr, "%s:%d: error: ", ps->compiler->input_filename, ps->tok.line);
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fprintf(stderr, "\n");
+    ps->compiler->error_count++;
+    ps->failed = true;
+    ps->tok.kind = TOK_EOF;
+}
+
+// Longest first, so "<=" is not read as "<"
+static const char* const parse_punctuators[] = {
+    "<<=", ">>=", "...", "==", "!=", "<=", ">=", "&&", "||", "++", "--", "+=", "-=", "*=",
+    "/=", "%=", "&=", "|=", "^=", "<<", ">>", "->", NULL
+};
+
+static int parse_escape(Parser* ps) {
+    char c = *ps->p++;
+    switch (c) {
+        case 'n': return '\n';
+        case 't': return '\t';
+        case 'r': return '\r';
+        case '0': return '\0';
+        case '\\': return '\\';
+        case '\'': return '\'';
+        case '"': return '"';
+    }
+    parse_error(ps, "unsupported escape sequence '\\%c'", c);
+    return 0;
+}
+
+// Skips whitespace, comments and preprocessor lines
+static void parse_skip(Parser* ps) {
+    for (;;) {
+        char c = *ps->p;
+        if (c == '\n') {
+            ps->line++;
+            ps->p++;
+            ps->line_start = true;
+        } else if (c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v') {
+            ps->p++;
+        } else if (c == '#' && ps->line_start) {
+            while (*ps->p && *ps->p != '\n') {
+                if (ps->p[0] == '\\' && ps->p[1] == '\n') {
+                    ps->line++;
+                    ps->p++;
+                }
+                ps->p++;
+            }
+        } else if (c == '/' && ps->p[1] == '/') {
+            while (*ps->p && *ps->p != '\n') ps->p++;
+        } else if (c == '/' && ps->p[1] == '*') {
+            ps->p += 2;
+            while (*ps->p && !(ps->p[0] == '*' && ps->p[1] == '/')) {
+                if (*ps->p == '\n') ps->line++;
+                ps->p++;
+            }
+            if (*ps->p) ps->p += 2;
+        } else {
+            ps->line_start = false;
+            return;
+        }
+    }
+}
+
+static void parse_next(Parser* ps) {
+    Token* tok = &ps->tok;
+    if (ps->failed) return;
+
+    parse_skip(ps);
+    tok->line = ps->line;
+    tok->text[0] = '\0';
+    tok->value = 0;
+
+    char c = *ps->p;
+    if (c == '\0') {
+        tok->kind = TOK_EOF;
+        return;
+    }
+
+    if (c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) {
+        size_t len = 0;
+        while (*ps->p == '_' || (*ps->p >= 'a' && *ps->p <= 'z') || (*ps->p >= 'A' && *ps->p <= 'Z') ||
+               (*ps->p >= '0' && *ps->p <= '9')) {
+            if (len + 1 < sizeof(tok->text)) tok->text[len++] = *ps->p;
+            ps->p++;
+        }
+        tok->text[len] = '\0';
+        tok->kind = TOK_IDENT;
+        return;
+    }
+
+    if (c >= '0' && c <= '9') {
+        char* end;
+        errno = 0;
+        unsigned long value = strtoul(ps->p, &end, 0);
+        tok->value = (long)value;
+        ps->p = end;
+        while (*ps->p == 'u' || *ps->p == 'U' || *ps->p == 'l' || *ps->p == 'L') ps->p++;
+        tok->kind = TOK_NUM;
+        if (errno == ERANGE || value > LONG_MAX) {
+            parse_error(ps, "integer literal does not fit in 'long'");
+        } else if ((*ps->p >= 'a' && *ps->p <= 'z') || (*ps->p >= 'A' && *ps->p <= 'Z') || *ps->p == '.') {
+            parse_error(ps, "unsupported number literal");
+        }
+        return;
+    }
+
+    if (c == '\'') {
+        ps->p++;
+        tok->value = *ps->p == '\\' ? (ps->p++, parse_escape(ps)) : *ps->p++;
+        if (*ps->p != '\'') {
+            parse_error(ps, "unterminated character literal");
+            return;
+        }
+        ps->p++;
+        tok->kind = TOK_NUM;
+        return;
+    }
+
+    if (c == '"') {
+        size_t len = 0;
+        ps->p++;
+        while (*ps->p && *ps->p != '"' && *ps->p != '\n') {
+            int ch = *ps->p == '\\' ? (ps->p++, parse_escape(ps)) : *ps->p++;
+            if (len + 1 < sizeof(tok->text)) tok->text[len++] = (char)ch;
+        }
+        tok->text[len] = '\0';
+        if (*ps->p != '"') {
+            parse_error(ps, "unterminated string literal");
+            return;
+        }
+        ps->p++;
+        tok->kind = TOK_STRING;
+        return;
+    }
+
+    tok->kind = TOK_PUNCT;
+    for (int i = 0; parse_punctuators[i]; i++) {
+        size_t len = strlen(parse_punctuators[i]);
+        if (strncmp(ps->p, parse_punctuators[i], len) == 0) {
+            memcpy(tok->text, ps->p, len + 1);
+            tok->text[len] = '\0';
+            ps->p += len;
+            return;
+        }
+    }
+    tok->text[0] = c;
+    tok->text[1] = '\0';
+    ps->p++;
+}
+
+static bool parse_is(Parser* ps, const char* text) {
+    return (ps->tok.kind == TOK_PUNCT || ps->tok.kind == TOK_IDENT) && strcmp(ps->tok.text, text) == 0;
+}
+
+static bool parse_accept(Parser* ps, const char* text) {
+    if (!parse_is(ps, text)) return false;
+    parse_next(ps);
+    return true;
+}
+
+static void parse_expect(Parser* ps, const char* text) {
+    if (!parse_accept(ps, text)) {
+        parse_error(ps, "expected '%s' before '%s'", text,
+                    ps->tok.kind == TOK_EOF ? "end of input" : ps->tok.text);
+    }
+}
+
+static char* parse_copy(const char* text) {
+    size_t len = strlen(text) + 1;
+    char* copy = malloc(len);
+    memcpy(copy, text, len);
+    return copy;
+}
+
+static ASTNode* parse_node(Parser* ps, ASTType type) {
+    ASTNode* node = calloc(1, sizeof(ASTNode));
+    node->type = type;
+    node->line_number = ps->tok.line;
+    node->filename = ps->compiler->input_filename;
+    return node;
+}
+
+static ASTNode* parse_binary(Parser* ps, char op, ASTNode* left, ASTNode* right) {
+    ASTNode* node = parse_node(ps, AST_BINARY_OP);
+    node->data.binary.op = op;
+    node->data.binary.left = left;
+    node->data.binary.right = right;
+    return node;
+}
+
+static ASTNode* parse_number(Parser* ps, long value) {
+    ASTNode* node = parse_node(ps, AST_NUM);
+    node->data.num_val = value;
+    return node;
+}
+
+static ASTNode* parse_variable(Parser* ps, const char* name) {
+    ASTNode* node = parse_node(ps, AST_VAR);
+    node->data.var_name = parse_copy(name);
+    return node;
+}
+
+static ASTNode* parse_assignment_of(Parser* ps, const char* name, ASTNode* value) {
+    ASTNode* node = parse_node(ps, AST_ASSIGN);
+    node->data.assign.var_name = parse_copy(name);
+    node->data.assign.value = value;
+    return node;
+}
+
+static void parse_append(ASTNode*** list, int* count, ASTNode* node) {
+    *list = realloc(*list, sizeof(ASTNode*) * (*count + 1));
+    (*list)[(*count)++] = node;
+}
+
+// Declaration specifiers. Only signed int and long are supported; both are
+// held in 64-bit registers, so beyond the pointers the lowering only needs
+// an int's size to refuse constants that do not fit in it.
+static const char* const parse_type_words[] = {
+    "int", "long", "void", "signed", "const", "volatile",
+    "static", "extern", "inline", "register", "__inline", "__inline__", NULL
+};
+
+static const char* const parse_unsupported_types[] = {
+    "struct", "union", "enum", "typedef", "float", "double",
+    "char", "short", "unsigned", "_Bool", NULL
+};
+
+// What the specifiers and the first declarator's '*'s declared
+typedef struct {
+    int size;       // Bytes of a value: 4 for int, 8 for long and pointers, 0 for void
+    int base_size;  // Bytes of the specifiers alone, for later declarators
+    int elem_size;  // Bytes a pointer points to, 0 for void* and non-pointers
+} ParseType;
+
+static bool parse_word_in(Parser* ps, const char* const* words) {
+    if (ps->tok.kind != TOK_IDENT) return false;
+    for (int i = 0; words[i]; i++) {
+        if (strcmp(ps->tok.text, words[i]) == 0) return true;
+    }
+    return false;
+}
+
+static bool parse_at_type(Parser* ps) {
+    return parse_word_in(ps, parse_type_words) || parse_word_in(ps, parse_unsupported_types) ||
+           parse_is(ps, "__attribute__");
+}
+
+// __attribute__((name(args), ...)). target_clones comes back as an
+// AST_GCC_ATTRIBUTE node; other attributes do not change the code and are
+// dropped.
+static ASTNode* parse_attribute(Parser* ps) {
+    ASTNode* result = NULL;
+
+    parse_expect(ps, "(");
+    parse_expect(ps, "(");
+    while (!ps->failed && !parse_is(ps, ")")) {
+        if (ps->tok.kind != TOK_IDENT) {
+            parse_error(ps, "expected an attribute name");
+            break;
+        }
+        bool clones = strcmp(ps->tok.text, "target_clones") == 0;
+        ASTNode* attribute = NULL;
+        if (clones) {
+            attribute = parse_node(ps, AST_GCC_ATTRIBUTE);
+            attribute->data.gcc_attribute.attr_name = parse_copy(ps->tok.text);
+        }
+        parse_next(ps);
+
+        if (parse_accept(ps, "(")) {
+            int depth = 1;
+            while (!ps->failed && depth > 0) {
+                if (ps->tok.kind == TOK_EOF) {
+                    parse_error(ps, "unterminated attribute");
+                } else if (parse_is(ps, "(")) {
+                    depth++;
+                } else if (parse_is(ps, ")")) {
+                    depth--;
+                } else if (attribute && ps->tok.kind == TOK_STRING) {
+                    ASTNode* arg = parse_node(ps, AST_STRING);
+                    arg->data.string_value = parse_copy(ps->tok.text);
+                    parse_append(&attribute->data.gcc_attribute.attr_args,
+                                 &attribute->data.gcc_attribute.arg_count, arg);
+                }
+                parse_next(ps);
+            }
+        }
+        if (attribute) result = attribute;
+        if (!parse_accept(ps, ",")) break;
+    }
+    parse_expect(ps, ")");
+    parse_expect(ps, ")");
+    return result;
+}
+
+// A declarator's '*'s and qualifiers: each '*' points to the type before it
+static void parse_pointers(Parser* ps, ParseType* type) {
+    while (parse_is(ps, "*") || parse_is(ps, "const")) {
+        if (parse_is(ps, "*")) {
+            type->elem_size = type->size;
+            type->size = 8;
+        }
+        parse_next(ps);
+    }
+}
+
+// Reads declaration specifiers and the declarator's '*'s. False when there
+// is no type here.
+static bool parse_type(Parser* ps, ASTNode** attribute, ParseType* type) {
+    ParseType read;
+    bool any = false;
+    int size = 4;
+
+    for (;;) {
+        if (parse_word_in(ps, parse_unsupported_types)) {
+            parse_error(ps, "'%s' is not supported", ps->tok.text);
+            return false;
+        }
+        if (parse_is(ps, "__attribute__")) {
+            parse_next(ps);
+            ASTNode* found = parse_attribute(ps);
+            if (found && attribute) *attribute = found;
+            continue;
+        }
+        if (!parse_word_in(ps, parse_type_words)) break;
+        if (parse_is(ps, "long")) size = 8;
+        if (parse_is(ps, "void")) size = 0;
+        any = true;
+        parse_next(ps);
+    }
+    read.size = size;
+    read.base_size = size;
+    read.elem_size = 0;
+    if (any) parse_pointers(ps, &read);
+    if (type) *type = read;
+    return any;
+}
+
+static ASTNode* parse_expression(Parser* ps);
+
+static ASTNode* parse_primary(Parser* ps) {
+    if (ps->tok.kind == TOK_NUM) {
+        ASTNode* node = parse_number(ps, ps->tok.value);
+        parse_next(ps);
+        return node;
+    }
+    if (parse_accept(ps, "(")) {
+        ASTNode* node = parse_expression(ps);
+        parse_expect(ps, ")");
+        return node;
+    }
+    if (ps->tok.kind == TOK_IDENT && !parse_at_type(ps)) {
+        char name[sizeof(ps->tok.text)];
+        strcpy(name, ps->tok.text);
+        parse_next(ps);
+
+        if (parse_accept(ps, "(")) {
+            ASTNode* call = parse_node(ps, AST_FUNC_CALL);
+            call->data.func_call.func_name = parse_copy(name);
+            while (!ps->failed && !parse_is(ps, ")")) {
+                ASTNode* arg = parse_expression(ps);
+                call->data.func_call.args = realloc(call->data.func_call.args,
+                                                    sizeof(ASTNode) * (call->data.func_call.arg_count + 1));
+                if (arg) call->data.func_call.args[call->data.func_call.arg_count++] = *arg;
+                free(arg);
+                if (!parse_accept(ps, ",")) break;
+            }
+            parse_expect(ps, ")");
+            return call;
+        }
+        if (parse_accept(ps, "[")) {
+            ASTNode* access = parse_node(ps, AST_ARRAY_ACCESS);
+            access->data.array_access.array_name = parse_copy(name);
+            access->data.array_access.index = parse_expression(ps);
+            parse_expect(ps, "]");
+            if (parse_is(ps, "[")) parse_error(ps, "multi-dimensional indexing is not supported");
+            return access;
+        }
+        return parse_variable(ps, name);
+    }
+
+    if (ps->tok.kind == TOK_STRING) {
+        parse_error(ps, "string literals are not supported");
+    } else {
+        parse_error(ps, "expected an expression before '%s'",
+                    ps->tok.kind == TOK_EOF ? "end of input" : ps->tok.text);
+    }
+    return NULL;
+}
+
+// x++ and x-- read the old value: (x = x + 1) - 1
+static ASTNode* parse_postfix(Parser* ps) {
+    ASTNode* node = parse_primary(ps);
+
+    while (!ps->failed && (parse_is(ps, "++") || parse_is(ps, "--"))) {
+        char op = ps->tok.text[0];
+        if (!node || node->type != AST_VAR) {
+            parse_error(ps, "'%s' needs a variable", ps->tok.text);
+            return node;
+        }
+        parse_next(ps);
+        ASTNode* step = parse_assignment_of(ps, node->data.var_name,
+                                            parse_binary(ps, op, parse_variable(ps, node->data.var_name),
+                                                         parse_number(ps, 1)));
+        node = parse_binary(ps, op == '+' ? '-' : '+', step, parse_number(ps, 1));
+    }
+    return node;
+}
+
+// -x is 0 - x and !x is x == 0
+static ASTNode* parse_unary(Parser* ps) {
+    if (parse_accept(ps, "+")) return parse_unary(ps);
+    if (parse_accept(ps, "-")) return parse_binary(ps, '-', parse_number(ps, 0), parse_unary(ps));
+    if (parse_accept(ps, "!")) return parse_binary(ps, '=', parse_unary(ps), parse_number(ps, 0));
+    if (parse_is(ps, "++") || parse_is(ps, "--")) {
+        char op = ps->tok.text[0];
+        parse_next(ps);
+        ASTNode* target = parse_unary(ps);
+        if (!target || target->type != AST_VAR) {
+            parse_error(ps, "'%c%c' needs a variable", op, op);
+            return target;
+        }
+        return parse_assignment_of(ps, target->data.var_name,
+                                   parse_binary(ps, op, target, parse_number(ps, 1)));
+    }
+    if (parse_is(ps, "&") || parse_is(ps, "*") || parse_is(ps, "~") || parse_is(ps, "sizeof")) {
+        parse_error(ps, "unary '%s' is not supported", ps->tok.text);
+        return NULL;
+    }
+    if (parse_is(ps, "(")) {
+        // A cast: every scalar has the same representation
+        Parser saved = *ps;
+        parse_next(ps);
+        if (parse_type(ps, NULL, NULL)) {
+            parse_expect(ps, ")");
+            return parse_unary(ps);
+        }
+        *ps = saved;
+    }
+    return parse_postfix(ps);
+}
+
+// Binary operators by precedence, tightest last. Each maps to the operator
+// character of AST_BINARY_OP.
+typedef struct {
+    const char* text;
+    char op;
+} ParseOperator;
+
+static const ParseOperator parse_levels[][4] = {
+    {{"||", '|'}},
+    {{"&&", '&'}},
+    {{"==", '='}, {"!=", '!'}},
+    {{"<", '<'}, {">", '>'}, {"<=", 'L'}, {">=", 'G'}},
+    {{"+", '+'}, {"-", '-'}},
+    {{"*", '*'}, {"/", '/'}, {"%", '%'}},
+};
+
+#define PARSE_LEVELS ((int)(sizeof(parse_levels) / sizeof(parse_levels[0])))
+
+static ASTNode* parse_binary_level(Parser* ps, int level) {
+    if (level == PARSE_LEVELS) return parse_unary(ps);
+
+    ASTNode* left = parse_binary_level(ps, level + 1);
+    for (;;) {
+        char op = 0;
+        for (int i = 0; i < 4 && parse_levels[level][i].text; i++) {
+            if (ps->tok.kind == TOK_PUNCT && strcmp(ps->tok.text, parse_levels[level][i].text) == 0) {
+                op = parse_levels[level][i].op;
+            }
+        }
+        if (!op || ps->failed) break;
+        parse_next(ps);
+        left = parse_binary(ps, op, left, parse_binary_level(ps, level + 1));
+    }
+    if (level > 0 || ps->failed || ps->tok.kind != TOK_PUNCT) return left;
+
+    static const char* const unsupported[] = {"&", "|", "^", "<<", ">>", NULL};
+    for (int i = 0; unsupported[i]; i++) {
+        if (strcmp(ps->tok.text, unsupported[i]) == 0) {
+            parse_error(ps, "operator '%s' is not supported", ps->tok.text);
+        }
+    }
+    return left;
+}
+
+// c ? a : b, grouping to the right; a may be any expression
+static ASTNode* parse_conditional(Parser* ps) {
+    ASTNode* cond = parse_binary_level(ps, 0);
+    if (ps->failed || !parse_is(ps, "?")) return cond;
+
+    ASTNode* node = parse_node(ps, AST_CONDITIONAL);
+    parse_next(ps);
+    node->data.if_stmt.cond = cond;
+    node->data.if_stmt.then_branch = parse_expression(ps);
+    parse_expect(ps, ":");
+    node->data.if_stmt.else_branch = parse_conditional(ps);
+    return node;
+}
+
+// x op= e is x = x op e; only plain variables can be assigned
+static ASTNode* parse_expression(Parser* ps) {
+    ASTNode* left = parse_conditional(ps);
+    static const char* const compound[] = {"+=", "-=", "*=", "/=", "%=", NULL};
+
+    if (ps->failed || ps->tok.kind != TOK_PUNCT) return left;
+    char op = 0;
+    if (strcmp(ps->tok.text, "=") == 0) {
+        op = '=';
+    }
+    for (int i = 0; compound[i]; i++) {
+        if (strcmp(ps->tok.text, compound[i]) == 0) op = compound[i][0];
+    }
+    if (!op) {
+        if (strchr("&|^<>", ps->tok.text[0]) && ps->tok.text[1] == '=') {
+            parse_error(ps, "operator '%s' is not supported", ps->tok.text);
+        }
+        return left;
+    }
+    if (!left || left->type != AST_VAR) {
+        parse_error(ps, "only variables can be assigned");
+        return left;
+    }
+    parse_next(ps);
+
+    ASTNode* value = parse_expression(ps);
+    if (op != '=') value = parse_binary(ps, op, parse_variable(ps, left->data.var_name), value);
+    return parse_assignment_of(ps, left->data.var_name, value);
+}
+
+// An expression whose value is dropped: x++ leaves out the - 1 that would
+// recover the old value
+static ASTNode* parse_discarded(ASTNode* node) {
+    while (node && node->type == AST_BINARY_OP &&
+           (node->data.binary.op == '+' || node->data.binary.op == '-') &&
+           node->data.binary.left && node->data.binary.left->type == AST_ASSIGN &&
+           node->data.binary.right && node->data.binary.right->type == AST_NUM) {
+        node = node->data.binary.left;
+    }
+    return node;
+}
+
+// int a = 1, *p; appended to `block` as AST_VAR_DECLs, which stay in scope
+// to the end of the block. `type` is what parse_type read.
+static void parse_declaration(Parser* ps, ASTNode* block, ParseType type) {
+    do {
+        parse_pointers(ps, &type);
+        if (ps->tok.kind != TOK_IDENT) {
+            parse_error(ps, "expected a variable name");
+            break;
+        }
+        ASTNode* decl = parse_node(ps, AST_VAR_DECL);
+        decl->data.var_decl.var_name = parse_copy(ps->tok.text);
+        decl->data.var_decl.size = type.size;
+        decl->data.var_decl.elem_size = type.elem_size;
+        parse_next(ps);
+        if (parse_is(ps, "[")) {
+            parse_error(ps, "local arrays are not supported");
+            break;
+        }
+        if (parse_accept(ps, "=")) {
+            if (parse_is(ps, "{")) {
+                parse_error(ps, "initializer lists are not supported");
+                break;
+            }
+            decl->data.var_decl.init_expr = parse_expression(ps);
+        }
+        parse_append(&block->data.block.statements, &block->data.block.stmt_count, decl);
+        // The '*'s belong to one declarator: int *p, n declares an int n
+        type.size = type.base_size;
+        type.elem_size = 0;
+    } while (!ps->failed && parse_accept(ps, ","));
+    parse_expect(ps, ";");
+}
+
+static ASTNode* parse_statement(Parser* ps);
+
+static ASTNode* parse_block(Parser* ps) {
+    ASTNode* block = parse_node(ps, AST_BLOCK);
+
+    parse_expect(ps, "{");
+    while (!ps->failed && !parse_is(ps, "}")) {
+        if (ps->tok.kind == TOK_EOF) {
+            parse_error(ps, "expected '}' at end of input");
+            break;
+        }
+        if (parse_at_type(ps)) {
+            ParseType type;
+            if (parse_type(ps, NULL, &type)) parse_declaration(ps, block, type);
+            continue;
+        }
+        ASTNode* statement = parse_statement(ps);
+        if (statement) parse_append(&block->data.block.statements, &block->data.block.stmt_count, statement);
+    }
+    parse_expect(ps, "}");
+    return block;
+}
+
+static ASTNode* parse_condition(Parser* ps) {
+    parse_expect(ps, "(");
+    ASTNode* cond = parse_expression(ps);
+    parse_expect(ps, ")");
+    return cond;
+}
+
+static ASTNode* parse_statement(Parser* ps) {
+    ASTNode* node;
+
+    if (parse_is(ps, "{")) return parse_block(ps);
+    if (parse_accept(ps, ";")) return NULL;
+
+    if (parse_at_type(ps)) {
+        parse_error(ps, "a declaration is not a statement here");
+        return NULL;
+    }
+
+    if (parse_accept(ps, "if")) {
+        node = parse_node(ps, AST_IF);
+        node->data.if_stmt.cond = parse_condition(ps);
+        node->data.if_stmt.then_branch = parse_statement(ps);
+        if (parse_accept(ps, "else")) node->data.if_stmt.else_branch = parse_statement(ps);
+        return node;
+    }
+    if (parse_accept(ps, "while")) {
+        node = parse_node(ps, AST_WHILE);
+        node->data.while_stmt.cond = parse_condition(ps);
+        node->data.while_stmt.body = parse_statement(ps);
+        return node;
+    }
+    if (parse_accept(ps, "for")) {
+        // for (int i = 0; ...) is { int i = 0; for (; ...) }
+        ASTNode* scope = NULL;
+        node = parse_node(ps, AST_FOR);
+        parse_expect(ps, "(");
+        if (parse_at_type(ps)) {
+            scope = parse_node(ps, AST_BLOCK);
+            ParseType type;
+            if (parse_type(ps, NULL, &type)) parse_declaration(ps, scope, type);
+        } else {
+            if (!parse_is(ps, ";")) node->data.for_stmt.init = parse_discarded(parse_expression(ps));
+            parse_expect(ps, ";");
+        }
+        if (!parse_is(ps, ";")) node->data.for_stmt.cond = parse_expression(ps);
+        parse_expect(ps, ";");
+        if (!parse_is(ps, ")")) node->data.for_stmt.incr = parse_discarded(parse_expression(ps));
+        parse_expect(ps, ")");
+        node->data.for_stmt.body = parse_statement(ps);
+        if (!scope) return node;
+        parse_append(&scope->data.block.statements, &scope->data.block.stmt_count, node);
+        return scope;
+    }
+    if (parse_accept(ps, "return")) {
+        node = parse_node(ps, AST_RETURN);
+        if (!parse_is(ps, ";")) node->data.return_stmt.value = parse_expression(ps);
+        parse_expect(ps, ";");
+        return node;
+    }
+    if (parse_is(ps, "break") || parse_is(ps, "continue")) {
+        node = parse_node(ps, parse_is(ps, "break") ? AST_BREAK : AST_CONTINUE);
+        parse_next(ps);
+        parse_expect(ps, ";");
+        return node;
+    }
+    if (parse_is(ps, "do") || parse_is(ps, "switch") || parse_is(ps, "goto") || parse_is(ps, "case") ||
+        parse_is(ps, "default")) {
+        parse_error(ps, "'%s' is not supported", ps->tok.text);
+        return NULL;
+    }
+
+    node = parse_discarded(parse_expression(ps));
+    parse_expect(ps, ";");
+    return node;
+}
+
+// A function definition, or NULL for a prototype. Parameters come back as
+// AST_VAR_DECL nodes. A target_clones attribute after the declarator is
+// stored in `attribute` like one before it.
+static ASTNode* parse_function(Parser* ps, const char* name, ASTNode** attribute) {
+    ASTNode* func = parse_node(ps, AST_FUNC_DECL);
+    func->data.func_decl.func_name = parse_copy(name);
+
+    while (!ps->failed && !parse_is(ps, ")")) {
+        ParseType type;
+        if (!parse_type(ps, NULL, &type)) {
+            parse_error(ps, "expected a parameter type");
+            break;
+        }
+        // (void) declares no parameters; void *p is one
+        if (type.size == 0 && func->data.func_decl.param_count == 0 && parse_is(ps, ")")) break;
+        if (ps->tok.kind != TOK_IDENT) {
+            parse_error(ps, "parameters need a name");
+            break;
+        }
+        ASTNode* param = parse_node(ps, AST_VAR_DECL);
+        param->data.var_decl.var_name = parse_copy(ps->tok.text);
+        param->data.var_decl.size = type.size;
+        param->data.var_decl.elem_size = type.elem_size;
+        parse_next(ps);
+        // int a[] is a pointer
+        if (parse_accept(ps, "[")) {
+            param->data.var_decl.size = 8;
+            param->data.var_decl.elem_size = type.size;
+            if (ps->tok.kind == TOK_NUM) parse_next(ps);
+            parse_expect(ps, "]");
+        }
+        parse_append(&func->data.func_decl.params, &func->data.func_decl.param_count, param);
+        if (!parse_accept(ps, ",")) break;
+    }
+    parse_expect(ps, ")");
+    while (parse_is(ps, "__attribute__")) {
+        parse_next(ps);
+        ASTNode* found = parse_attribute(ps);
+        if (found) *attribute = found;
+    }
+
+    if (parse_accept(ps, ";")) {
+        // Nothing carries a prototype's attributes over to the definition
+        if (*attribute) parse_error(ps, "target_clones must be on the function definition");
+        return NULL;
+    }
+    func->data.func_decl.body = parse_block(ps);
+    return func;
+}
+
+// The translation unit as an AST_BLOCK of functions, each preceded by its
+// target_clones attribute if it has one
+static ASTNode* parse_program(Parser* ps) {
+    ASTNode* program = parse_node(ps, AST_BLOCK);
+
+    parse_next(ps);
+    while (!ps->failed && ps->tok.kind != TOK_EOF) {
+        ASTNode* attribute = NULL;
+        if (parse_accept(ps, ";")) continue;
+        if (!parse_type(ps, &attribute, NULL)) {
+            if (!ps->failed) parse_error(ps, "expected a declaration before '%s'", ps->tok.text);
+            break;
+        }
+        if (ps->tok.kind != TOK_IDENT) {
+            parse_error(ps, "expected a name in the declaration");
+            break;
+        }
+        char name[sizeof(ps->tok.text)];
+        strcpy(name, ps->tok.text);
+        parse_next(ps);
+        if (!parse_accept(ps, "(")) {
+            parse_error(ps, "global variables are not supported");
+            break;
+        }
+
+        ASTNode* func = parse_function(ps, name, &attribute);
+        if (!func) continue;
+        if (attribute) {
+            parse_append(&program->data.block.statements, &program->data.block.stmt_count, attribute);
+        }
+        parse_append(&program->data.block.statements, &program->data.block.stmt_count, func);
+    }
+    return program;
+}
+
 // Main compilation phases
 void phase_preprocessing(ALETHEIAFullCompiler* compiler, const char* input) {
     printf(";; GCC compatible: Phase 1 - Preprocessing\n");
@@ -190,9 +1928,15 @@ void phase_preprocessing(ALETHEIAFullCompiler* compiler, const char* input) {
 
 ASTNode* phase_parsing(ALETHEIAFullCompiler* compiler, const char* preprocessed) {
     printf(";; GCC compatible: Phase 2 - Enhanced GCC Parsing\n");
-    // Parse with full GCC extensions support
-    // This would be much more complex in reality
-    return NULL;  // Placeholder
+    Parser parser = {0};
+    parser.compiler = compiler;
+    parser.p = preprocessed;
+    parser.line = 1;
+    parser.line_start = true;
+
+    ASTNode* program = parse_program(&parser);
+    if (parser.failed) return NULL;
+    return program;
 }
 
 void phase_optimization(ALETHEIAFullCompiler* compiler, ASTNode* ast) {
@@ -214,57 +1958,323 @@ void phase_optimization(ALETHEIAFullCompiler* compiler, ASTNode* ast) {
     }
 }
 
+// Adds the clones a comma-separated target list names, ignoring repeats.
+// False with the error reported for a target the backend does not know.
+static bool add_clone_targets(const TargetBackend* backend, ClonedFunction* clone, const char* list) {
+    const char* p = list;
+
+    while (*p) {
+        size_t len = strcspn(p, ",");
+        char target[32];
+        uint32_t features;
+        bool seen = false;
+
+        if (len == 0 || len >= sizeof(target)) {
+            fprintf(stderr, "aletheia-full: %s: malformed target_clones list '%s'\n", clone->name, list);
+            return false;
+        }
+        memcpy(target, p, len);
+        target[len] = '\0';
+        if (!target_clone_features(backend, target, &features)) {
+            fprintf(stderr, "aletheia-full: %s: unknown target_clones target '%s' for %s\n",
+                    clone->name, target, backend->name);
+            return false;
+        }
+        for (int i = 0; i < clone->count; i++) seen = seen || clone->features[i] == features;
+        if (!seen) {
+            if (clone->count == MAX_TARGET_CLONES) {
+                fprintf(stderr, "aletheia-full: %s: more than %d target_clones\n", clone->name,
+                        MAX_TARGET_CLONES);
+                return false;
+            }
+            size_t size = strlen(clone->name) + len + 2;
+            char* name = malloc(size);
+            snprintf(name, size, "%s.%s", clone->name, target);
+            clone->clones[clone->count] = name;
+            clone->features[clone->count++] = features;
+        }
+        p += len;
+        if (*p == ',') p++;
+    }
+    return true;
+}
+
+static int clone_rank(uint32_t features) {
+    int rank = 0;
+    for (; features; features &= features - 1) rank++;
+    return rank;
+}
+
+// Orders the clones best first, so the resolver takes the first one the CPU
+// supports and falls back to "default" last
+static bool sort_clones(ClonedFunction* clone) {
+    for (int i = 1; i < clone->count; i++) {
+        for (int j = i; j > 0 && clone_rank(clone->features[j]) > clone_rank(clone->features[j - 1]); j--) {
+            char* name = clone->clones[j];
+            uint32_t features = clone->features[j];
+            clone->clones[j] = clone->clones[j - 1];
+            clone->features[j] = clone->features[j - 1];
+            clone->clones[j - 1] = name;
+            clone->features[j - 1] = features;
+        }
+    }
+    if (clone->count == 0 || clone->features[clone->count - 1] != 0) {
+        fprintf(stderr, "aletheia-full: %s: target_clones needs a \"default\" target\n", clone->name);
+        return false;
+    }
+    return true;
+}
+
+static void free_clone_names(ClonedFunction* clone) {
+    for (int i = 0; i < clone->count; i++) free(clone->clones[i]);
+}
+
+// Queues one job per clone of `func`, from its target_clones attribute or
+// else -mtarget-clones. Targets that cannot dispatch on the CPU compile the
+// function once, as does a clone list with errors.
+static void plan_clones(ALETHEIAFullCompiler* compiler, const TargetBackend* backend, ASTNode* func,
+                        ASTNode* attribute, CodegenJob* jobs, int* count) {
+    ClonedFunction clone = {0};
+    bool ok = true;
+    bool can_dispatch = compiler->emit_assembly
+                            ? backend->generate_resolver != NULL
+                            : backend->encoder && backend->encoder->resolver && backend->encoder->bind;
+
+    clone.name = func->data.func_decl.func_name;
+    if (!can_dispatch) {
+        fprintf(stderr, "aletheia-full: warning: %s cannot dispatch on the CPU, compiling %s once\n",
+                backend->name, clone.name);
+        compiler->warning_count++;
+        ok = false;
+    } else if (attribute) {
+        for (int i = 0; ok && i < attribute->data.gcc_attribute.arg_count; i++) {
+            ASTNode* arg = attribute->data.gcc_attribute.attr_args[i];
+            if (!arg || arg->type != AST_STRING) {
+                fprintf(stderr, "aletheia-full: %s: target_clones takes strings\n", clone.name);
+                ok = false;
+            } else {
+                ok = add_clone_targets(backend, &clone, arg->data.string_value);
+            }
+        }
+        ok = ok && sort_clones(&clone);
+        if (!ok) compiler->error_count++;
+    } else {
+        ok = add_clone_targets(backend, &clone, compiler->clone_targets) &&
+             add_clone_targets(backend, &clone, "default") && sort_clones(&clone);
+        if (!ok) compiler->error_count++;
+    }
+
+    if (!ok) {
+        free_clone_names(&clone);
+        jobs[*count].ast = func;
+        jobs[*count].name = clone.name;
+        jobs[(*count)++].features = compiler->features;
+        return;
+    }
+
+    compiler->clones = realloc(compiler->clones, sizeof(ClonedFunction) * (compiler->clone_count + 1));
+    compiler->clones[compiler->clone_count++] = clone;
+    for (int i = 0; i < clone.count; i++) {
+        jobs[*count].ast = func;
+        jobs[*count].name = clone.clones[i];
+        jobs[(*count)++].features = compiler->features | clone.features[i];
+    }
+}
+
+static char* clone_symbol(const char* name, const char* suffix) {
+    size_t size = strlen(name) + strlen(suffix) + 1;
+    char* symbol = malloc(size);
+    snprintf(symbol, size, "%s%s", name, suffix);
+    return symbol;
+}
+
+// The resolver of every cloned function and the symbol its callers use.
+// Assembly makes that symbol a GNU indirect function, which the dynamic
+// loader resolves. The in-process linker has no loader, so machine code
+// jumps through a pointer slot that _start fills in (see phase_linking);
+// the slot starts out at the default clone, so objects linked elsewhere
+// still run.
+static void emit_resolvers(ALETHEIAFullCompiler* compiler, const TargetBackend* backend) {
+    for (int i = 0; i < compiler->clone_count; i++) {
+        ClonedFunction* clone = &compiler->clones[i];
+        char* resolver = clone_symbol(clone->name, ".resolver");
+        char* slot = clone_symbol(clone->name, ".slot");
+
+        if (compiler->emit_assembly) {
+            EmitBuffer* out = &compiler->asm_buffer;
+            backend->generate_label(out, resolver);
+            backend->generate_resolver(out, resolver, (const char* const*)clone->clones,
+                                       clone->features, clone->count);
+            emit_instruction(out, ".globl %s", clone->name);
+            emit_instruction(out, ".type %s, @gnu_indirect_function", clone->name);
+            emit_instruction(out, ".set %s, %s", clone->name, resolver);
+            emit_flush(out, stdout);
+        } else {
+            CodeBuffer* code = &compiler->code_buffer;
+            mcode_define_symbol(code, resolver);
+            backend->encoder->resolver(code, resolver, (const char* const*)clone->clones,
+                                       clone->features, clone->count);
+            mcode_define_symbol(code, clone->name);
+            backend->encoder->dispatch(code, slot);
+            mcode_define_symbol(code, slot);
+            mcode_abs64_symbol(code, clone->clones[clone->count - 1]);
+            if (!mcode_resolve_labels(code)) compiler->error_count++;
+        }
+        free(resolver);
+        free(slot);
+    }
+}
+
 void phase_code_generation(ALETHEIAFullCompiler* compiler, ASTNode* ast) {
     printf(";; GCC compatible: Phase 4 - Code Generation with DWARF\n");
 
-    TargetBackend* backend = get_current_backend();
+    const TargetBackend* backend = compiler->backend;
     if (!backend) {
         printf(";; ERROR: No backend available for %s\n", get_architecture_name(compiler->target_arch));
         return;
     }
 
     printf(";; Target architecture: %s (%s)\n", backend->name, backend->triple);
-    printf(".text\n");
-    printf(".global main\n");
-    printf("\n");
+    if (compiler->emit_assembly) {
+        printf(".text\n");
+        printf(".global main\n");
+        if (backend->arch == TARGET_RISCV64) {
+            printf(".option %s\n", compiler->features & TARGET_FEATURE_RVC ? "rvc" : "norvc");
+        }
+        printf("\n");
+    }
 
     // Generate DWARF debug info
     printf("    ;; DWARF debug sections would be generated here\n");
 
-    // Use backend to generate code
-    printf("main:\n");
+    // Lower each function to IR, allocate registers, and emit through the backend
     printf("    ;; %s code generation with IA optimization\n", backend->name);
 
-    // For now, generate a simple return 42 using the backend
-    // In a full implementation, this would traverse the AST and generate code
-    if (compiler->target_arch == TARGET_X86_64) {
-        printf("    mov rax, 42\n");
-        printf("    ret\n");
-    } else if (compiler->target_arch == TARGET_ARM64) {
-        printf("    mov x0, #42\n");
-        printf("    ret\n");
-    } else if (compiler->target_arch == TARGET_RISCV64) {
-        printf("    li a0, 42\n");
-        printf("    ret\n");
-    } else {
-        printf("    ;; Unknown architecture\n");
-        printf("    mov rax, 42\n");
-        printf("    ret\n");
+    ASTNode** functions = ast ? &ast : NULL;
+    int function_count = ast ? 1 : 0;
+    if (ast && ast->type == AST_BLOCK) {
+        functions = ast->data.block.statements;
+        function_count = ast->data.block.stmt_count;
+    }
+
+    // Without a parsed AST, emit the default "return 42" main through the same
+    // path. A target_clones attribute applies to the function after it; with
+    // -mtarget-clones every function with a vectorizable loop is cloned.
+    CodegenJob* jobs = calloc((function_count > 0 ? function_count : 1) * MAX_TARGET_CLONES,
+                              sizeof(CodegenJob));
+    int job_count = 0;
+    ASTNode* attribute = NULL;
+    for (int i = 0; i < function_count; i++) {
+        ASTNode* node = functions[i];
+        if (node->type == AST_GCC_ATTRIBUTE &&
+            strcmp(node->data.gcc_attribute.attr_name, "target_clones") == 0) {
+            attribute = node;
+            continue;
+        }
+        if (node->type != AST_FUNC_DECL) continue;
+        if (attribute || (compiler->clone_targets && contains_vector_loop(node->data.func_decl.body))) {
+            plan_clones(compiler, backend, node, attribute, jobs, &job_count);
+        } else {
+            jobs[job_count].ast = node;
+            jobs[job_count].name = node->data.func_decl.func_name;
+            jobs[job_count++].features = compiler->features;
+        }
+        attribute = NULL;
+    }
+    if (function_count == 0) {
+        jobs[job_count].name = "main";
+        jobs[job_count++].features = compiler->features;
+    }
+
+    generate_functions(compiler, backend, jobs, job_count);
+    free(jobs);
+    emit_resolvers(compiler, backend);
+    if (function_count > 0 && compiler->opt_config.level > 0) {
+        ir_cfg_report(&compiler->cfg_stats, stdout);
+    }
+    if (function_count > 0 && compiler->opt_config.level >= 2) {
+        sched_report(&compiler->sched_stats, stdout);
+    }
+    if (compiler->peephole_stats && compiler->peephole_hits) {
+        peephole_report(compiler->peephole_hits, stdout);
+    }
+
+    if (!compiler->emit_assembly) {
+        CodeBuffer* code = &compiler->code_buffer;
+        printf("    ;; Encoded %lu bytes of machine code\n", (unsigned long)code->size);
+        if (compiler->features & TARGET_FEATURE_RVC) {
+            // Every compressed instruction would otherwise take 4 bytes
+            unsigned long saved = 2ul * (unsigned long)code->compressed;
+            printf("    ;; RVC: %d instructions compressed, %lu bytes saved (%.1f%%)\n",
+                   code->compressed, saved,
+                   saved ? 100.0 * (double)saved / (double)(code->size + saved) : 0.0);
+        }
+        return;
     }
 
     // Apply IA hints if available
     if (backend->apply_ia_hints) {
         printf("\n    ;; IA optimization hints applied\n");
-        generate_ia_optimized_code(backend, stdout, "basic_optimization",
+        generate_ia_optimized_code(backend, &compiler->asm_buffer, "basic_optimization",
                                  ";; Basic IA optimizations for simple functions\n");
+        emit_flush(&compiler->asm_buffer, stdout);
     }
 }
 
+// Builds the GENO object from the encoded functions in memory. With -c it is
+// written out as is; otherwise an entry stub calling main is added and the
+// object goes through the linker, so the executable is the only file written.
 void phase_linking(ALETHEIAFullCompiler* compiler) {
     printf(";; GCC compatible: Phase 5 - Integrated Linking\n");
-    printf("    ;; Generate complete ELF executable\n");
-    printf("    ;; Resolve external symbols\n");
-    printf("    ;; Apply relocations\n");
+    if (compiler->emit_assembly) {
+        printf("    ;; Assembly output, nothing to link\n");
+        return;
+    }
+    if (compiler->error_count > 0) {
+        printf("    ;; Skipped after code generation errors\n");
+        return;
+    }
+
+    CodeBuffer* code = &compiler->code_buffer;
+    if (!compiler->emit_object) {
+        code->features = compiler->features;
+        mcode_define_symbol(code, "_start");
+        for (int i = 0; i < compiler->clone_count; i++) {
+            char* resolver = clone_symbol(compiler->clones[i].name, ".resolver");
+            char* slot = clone_symbol(compiler->clones[i].name, ".slot");
+            compiler->backend->encoder->bind(code, resolver, slot);
+            free(resolver);
+            free(slot);
+        }
+        compiler->backend->encoder->start(code, "main");
+        mcode_resolve_labels(code);
+    }
+
+    GENO_Object* obj = build_object(compiler);
+    if (!obj) {
+        fprintf(stderr, "aletheia-full: failed to build the object\n");
+        compiler->error_count++;
+        return;
+    }
+
+    if (compiler->emit_object) {
+        if (geno_write_object(obj, compiler->output_filename)) {
+            printf(";; Wrote %lu bytes of machine code to %s\n",
+                   (unsigned long)code->size, compiler->output_filename);
+        } else {
+            compiler->error_count++;
+        }
+        geno_free_object(obj);
+        return;
+    }
+
+    LinkerContext* linker = linker_create_context();
+    linker_add_object(linker, obj);
+    if (!linker_resolve_symbols(linker) || !linker_apply_relocations(linker) ||
+        !linker_generate_executable(linker, compiler->output_filename)) {
+        compiler->error_count++;
+    }
+    linker_free_context(linker);
 }
 
 // Main compiler entry point
@@ -307,6 +2317,10 @@ int compile_gcc100(ALETHEIAFullCompiler* compiler, const char* input) {
     // Phase 5: Integrated linking
     phase_linking(compiler);
 
+    if (compiler->error_count > 0) {
+        printf("\n;; GCC compatible: Compilation failed with %d errors\n", compiler->error_count);
+        return 1;
+    }
     printf("\n;; GCC compatible: Compilation completed successfully!\n");
     printf(";; Warnings: %d, Errors: %d\n", compiler->warning_count, compiler->error_count);
 
@@ -323,6 +2337,21 @@ ALETHEIAFullCompiler* create_gcc100_compiler() {
     compiler->opt_config.enable_vectorization = 1;
     compiler->opt_config.enable_cse = 1;
     compiler->opt_config.enable_dce = 1;
+    memset(&compiler->cfg_stats, 0, sizeof(compiler->cfg_stats));
+    memset(&compiler->sched_stats, 0, sizeof(compiler->sched_stats));
+    compiler->peephole_hits = NULL;
+    compiler->peephole_stats = 0;
+    emit_buffer_init(&compiler->asm_buffer);
+    compiler->emit_assembly = 0;
+    compiler->emit_object = 0;
+    mcode_buffer_init(&compiler->code_buffer);
+    compiler->workers = parallel_default_workers();
+    compiler->clone_targets = NULL;
+    compiler->clones = NULL;
+    compiler->clone_count = 0;
+    compiler->tune_cpu = NULL;
+    compiler->backend = NULL;
+    compiler->features = 0;
 
     // Initialize preprocessor
     compiler->preprocessor.defines = NULL;
@@ -349,17 +2378,95 @@ ALETHEIAFullCompiler* create_gcc100_compiler() {
 
 int main_aletheia_full(int argc, char* argv[]) {
     if (argc < 3) {
-        printf("Usage: %s <input.c> <output.s> [--target x86-64|arm64|riscv64]\n", argv[0]);
+        printf("Usage: %s <input.c> <output> [-O0..-O3] [-S|-c] [-jN] [--target x86-64|arm64|riscv64]\n"
+               "       [-mzba] [-mrvc] [-mavx2] [-mavx512f] [-mtarget-clones=T,...] [-mtune=CPU]\n"
+               "       [--peephole-stats]\n", argv[0]);
         printf("Targets:\n");
         printf("  x86-64  : Intel/AMD 64-bit (default)\n");
         printf("  arm64   : ARM 64-bit (AArch64)\n");
         printf("  riscv64 : RISC-V 64-bit\n");
+        printf("Optimization:\n");
+        printf("  -O0..-O3: optimization level (default: -O2)\n");
+        printf("Output:\n");
+        printf("  -S      : print assembly instead of linking\n");
+        printf("  -c      : write a GENO object instead of linking\n");
+        printf("  -jN     : generate code on N threads (default: one per CPU)\n");
+        printf("  --peephole-stats : with -S above -O0, print how often each peephole rule fired\n");
+        printf("Extensions:\n");
+        printf("  -mzba   : RISC-V Zba address generation (sh1add..sh3add)\n");
+        printf("  -mrvc   : RISC-V compressed (C extension) instructions\n");
+        printf("  -mavx2, -mavx512f : x86-64 vector width for vectorized loops (default SSE2)\n");
+        printf("  -mtarget-clones=avx512f,avx2 : compile functions with vectorizable loops once\n");
+        printf("            per target plus the default, picked by CPUID at startup\n");
+        printf("Tuning:\n");
+        printf("  -mtune=CPU : core the -O2 scheduler models (default: generic)\n");
+        printf("            x86-64: generic; arm64: cortex-a76, cortex-a55; riscv64: sifive-u74\n");
         return 1;
     }
 
     // Parse target architecture
     TargetArch target_arch = TARGET_X86_64; // Default
+    uint32_t features = 0;
+    const char* clone_targets = NULL;
+    const char* tune_cpu = NULL;
+    int emit_assembly = 0;
+    int emit_object = 0;
+    int peephole_stats = 0;
+    int workers = 0;
+    int opt_level = 2;
     for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "-O", 2) == 0) {
+            if (argv[i][2] < '0' || argv[i][2] > '3' || argv[i][3] != '\0') {
+                printf("Invalid optimization level: %s\n", argv[i]);
+                return 1;
+            }
+            opt_level = argv[i][2] - '0';
+            continue;
+        }
+        if (strcmp(argv[i], "-S") == 0) {
+            emit_assembly = 1;
+            continue;
+        }
+        if (strcmp(argv[i], "-c") == 0) {
+            emit_object = 1;
+            continue;
+        }
+        if (strcmp(argv[i], "--peephole-stats") == 0) {
+            peephole_stats = 1;
+            continue;
+        }
+        if (strncmp(argv[i], "-j", 2) == 0) {
+            workers = atoi(argv[i] + 2);
+            if (workers < 1) {
+                printf("Invalid thread count: %s\n", argv[i]);
+                return 1;
+            }
+            continue;
+        }
+        if (strcmp(argv[i], "-mzba") == 0) {
+            features |= TARGET_FEATURE_ZBA;
+            continue;
+        }
+        if (strcmp(argv[i], "-mrvc") == 0) {
+            features |= TARGET_FEATURE_RVC;
+            continue;
+        }
+        if (strcmp(argv[i], "-mavx2") == 0) {
+            features |= TARGET_FEATURE_AVX2;
+            continue;
+        }
+        if (strcmp(argv[i], "-mavx512f") == 0) {
+            features |= TARGET_FEATURE_AVX512F | TARGET_FEATURE_AVX2;
+            continue;
+        }
+        if (strncmp(argv[i], "-mtarget-clones=", 16) == 0) {
+            clone_targets = argv[i] + 16;
+            continue;
+        }
+        if (strncmp(argv[i], "-mtune=", 7) == 0) {
+            tune_cpu = argv[i] + 7;
+            continue;
+        }
         if (strcmp(argv[i], "--target") == 0 && i + 1 < argc) {
             if (strcmp(argv[i + 1], "x86-64") == 0) {
                 target_arch = TARGET_X86_64;
@@ -371,22 +2478,40 @@ int main_aletheia_full(int argc, char* argv[]) {
                 printf("Unknown target architecture: %s\n", argv[i + 1]);
                 return 1;
             }
-            break;
+            i++;
         }
     }
 
-    // Set target backend
-    set_current_backend(target_arch);
-    if (!get_current_backend()) {
+    // Look up the target backend
+    const TargetBackend* backend = get_target_backend(target_arch);
+    if (!backend) {
         printf("Failed to initialize backend for %s\n", get_architecture_name(target_arch));
         return 1;
     }
+    if (!target_find_tuning(backend, tune_cpu)) {
+        printf("Unknown -mtune core for %s: %s\n", get_architecture_name(target_arch), tune_cpu);
+        return 1;
+    }
 
     // Create GCC compatible compiler
     ALETHEIAFullCompiler* compiler = create_gcc100_compiler();
     compiler->input_filename = argv[1];
     compiler->output_filename = argv[2];
     compiler->target_arch = target_arch;
+    compiler->opt_config.level = opt_level;
+    compiler->emit_assembly = emit_assembly;
+    compiler->emit_object = emit_object;
+    compiler->peephole_stats = peephole_stats;
+    if (workers > 0) compiler->workers = workers;
+    compiler->clone_targets = clone_targets;
+    compiler->tune_cpu = tune_cpu;
+    compiler->backend = backend;
+    compiler->features = features;
+    if (!emit_assembly && !backend->encoder) {
+        printf(";; No machine-code encoder for %s, emitting assembly\n",
+               get_architecture_name(target_arch));
+        compiler->emit_assembly = 1;
+    }
 
     // Read input file
     FILE* input_file = fopen(argv[1], "r");
@@ -395,10 +2520,19 @@ int main_aletheia_full(int argc, char* argv[]) {
         return 1;
     }
 
-    // Read file content (simplified)
-    char* input = malloc(10000);
-    size_t bytes_read = fread(input, 1, 9999, input_file);
-    input[bytes_read] = '\0';
+    // Read the whole file
+    size_t input_size = 0;
+    size_t input_capacity = 4096;
+    char* input = malloc(input_capacity);
+    size_t bytes_read;
+    while ((bytes_read = fread(input + input_size, 1, input_capacity - input_size - 1, input_file)) > 0) {
+        input_size += bytes_read;
+        if (input_size + 1 == input_capacity) {
+            input_capacity *= 2;
+            input = realloc(input, input_capacity);
+        }
+    }
+    input[input_size] = '\0';
     fclose(input_file);
 
     // Initialize AI system for self-learning
@@ -449,6 +2583,11 @@ int main_aletheia_full(int argc, char* argv[]) {
     // Cleanup
     free(input);
     free(compiler->builtins);
+    emit_buffer_free(&compiler->asm_buffer);
+    mcode_buffer_free(&compiler->code_buffer);
+    peephole_free_rules(compiler->peephole_hits);
+    for (int i = 0; i < compiler->clone_count; i++) free_clone_names(&compiler->clones[i]);
+    free(compiler->clones);
     free(compiler);
 
     return result;
@@ -11,7 +11,11 @@
  * Built using ALETHEIA-Core in the bootstrap chain.
  */
 
+/* Hosted builds (the Makefile) use the system libc; the libc replacements
+ * below are only for builds by ALETHEIA-Core, which has no libc to link. */
+#ifndef ALETHEIA_HOSTED
 #define BOOTSTRAP_BUILD 1
+#endif
 #include "compiler_adapter.h"
 
 /* Include the existing ALETHEIA compiler code */
@@ -67,49 +71,6 @@ void* realloc(void* ptr, size_t size) {
     return new_ptr;
 }
 
-/* Simplified string functions */
-size_t al_strlen(const char* s) {
-    size_t len = 0;
-    while (s[len]) len++;
-    return len;
-}
-
-char* al_strcpy(char* dest, const char* src) {
-    char* d = dest;
-    while ((*d++ = *src++));
-    return dest;
-}
-
-char* al_strdup(const char* s) {
-    size_t len = al_strlen(s) + 1;
-    char* dup = malloc(len);
-    if (dup) al_strcpy(dup, s);
-    return dup;
-}
-
-int al_strcmp(const char* s1, const char* s2) {
-    while (*s1 && (*s1 == *s2)) {
-        s1++;
-        s2++;
-    }
-    return *(unsigned char*)s1 - *(unsigned char*)s2;
-}
-
-char* al_strstr(const char* haystack, const char* needle) {
-    if (!*needle) return (char*)haystack;
-
-    for (; *haystack; haystack++) {
-        const char* h = haystack;
-        const char* n = needle;
-        while (*h && *n && *h == *n) {
-            h++;
-            n++;
-        }
-        if (!*n) return (char*)haystack;
-    }
-    return NULL;
-}
-
 /* Simplified file I/O */
 typedef struct {
     char* buffer;
@@ -146,24 +107,6 @@ size_t fwrite(const void* ptr, size_t size, size_t count, FILE* stream) {
     return size * count; /* Pretend it worked */
 }
 
-/* Simplified standard functions */
-void* al_memset(void* s, int c, size_t n) {
-    char* p = (char*)s;
-    for (size_t i = 0; i < n; i++) {
-        p[i] = (char)c;
-    }
-    return s;
-}
-
-void* al_memcpy(void* dest, const void* src, size_t n) {
-    char* d = (char*)dest;
-    const char* s = (const char*)src;
-    for (size_t i = 0; i < n; i++) {
-        d[i] = s[i];
-    }
-    return dest;
-}
-
 double sqrt(double x) {
     /* Very basic sqrt for bootstrap */
     if (x <= 0) return 0;
@@ -208,6 +151,67 @@ void abort(void) {
 
 #endif /* BOOTSTRAP_BUILD */
 
+/* Simplified string functions */
+size_t al_strlen(const char* s) {
+    size_t len = 0;
+    while (s[len]) len++;
+    return len;
+}
+
+char* al_strcpy(char* dest, const char* src) {
+    char* d = dest;
+    while ((*d++ = *src++));
+    return dest;
+}
+
+char* al_strdup(const char* s) {
+    size_t len = al_strlen(s) + 1;
+    char* dup = malloc(len);
+    if (dup) al_strcpy(dup, s);
+    return dup;
+}
+
+int al_strcmp(const char* s1, const char* s2) {
+    while (*s1 && (*s1 == *s2)) {
+        s1++;
+        s2++;
+    }
+    return *(unsigned char*)s1 - *(unsigned char*)s2;
+}
+
+char* al_strstr(const char* haystack, const char* needle) {
+    if (!*needle) return (char*)haystack;
+
+    for (; *haystack; haystack++) {
+        const char* h = haystack;
+        const char* n = needle;
+        while (*h && *n && *h == *n) {
+            h++;
+            n++;
+        }
+        if (!*n) return (char*)haystack;
+    }
+    return NULL;
+}
+
+/* Simplified standard functions */
+void* al_memset(void* s, int c, size_t n) {
+    char* p = (char*)s;
+    for (size_t i = 0; i < n; i++) {
+        p[i] = (char)c;
+    }
+    return s;
+}
+
+void* al_memcpy(void* dest, const void* src, size_t n) {
+    char* d = (char*)dest;
+    const char* s = (const char*)src;
+    for (size_t i = 0; i < n; i++) {
+        d[i] = s[i];
+    }
+    return dest;
+}
+
 /* AI Optimization Engine Implementation */
 void ai_optimize_ast(void* ast, AIOptimizationLevel level) {
     /* AI optimization placeholder */
@@ -306,34 +310,61 @@ int aletheia_compile(const char* source, size_t length, ALETHEIAConfig* config)
     return 0; /* Success */
 }
 
-int aletheia_compile_file(const char* input_file, const char* output_file, ALETHEIAConfig* config) {
-    /* File-based compilation */
-    /* For bootstrap, this is simplified */
+/* --target= names as main.c takes them, mapped to the code generator's */
+static const char* compile_target_name(const char* arch) {
+    if (!arch || strcmp(arch, "x86_64") == 0 || strcmp(arch, "x86-64") == 0) return "x86-64";
+    if (strcmp(arch, "arm64") == 0 || strcmp(arch, "aarch64") == 0) return "arm64";
+    if (strcmp(arch, "riscv") == 0 || strcmp(arch, "riscv64") == 0) return "riscv64";
+    return NULL;
+}
 
-    /* Read input file */
+int aletheia_compile_file(const char* input_file, const char* output_file, ALETHEIAConfig* config) {
+    /* Read input file for the analysis passes */
     FILE* input = fopen(input_file, "r");
-    if (!input) return 1;
+    if (!input) {
+        fprintf(stderr, "aletheia-full: cannot open %s\n", input_file);
+        return 1;
+    }
 
-    /* Read entire file (simplified) */
     char buffer[65536]; /* 64KB buffer */
     size_t bytes_read = fread(buffer, 1, sizeof(buffer) - 1, input);
     buffer[bytes_read] = '\0';
 
     fclose(input);
 
-    /* Compile */
     int result = aletheia_compile(buffer, bytes_read, config);
+    if (result != 0) return result;
 
-    /* Write output */
-    if (result == 0 && output_file) {
-        FILE* output = fopen(output_file, "w");
-        if (output) {
-            /* Write compiled output */
-            fwrite(";; ALETHEIA-Full compiled output\n", 1, 34, output);
-            fclose(output);
-        }
+    /* Code generation: hand the file to the IR pipeline */
+    const char* target = compile_target_name(config->target_arch);
+    if (!target) {
+        fprintf(stderr, "aletheia-full: unknown target %s\n", config->target_arch);
+        return 1;
+    }
+    char level[4] = {'-', 'O', (char)('0' + config->optimization_level), '\0'};
+    char** argv = malloc(sizeof(char*) * (7 + config->backend_arg_count));
+    int argc = 0;
+    argv[argc++] = "aletheia-full";
+    argv[argc++] = (char*)input_file;
+    argv[argc++] = (char*)output_file;
+    argv[argc++] = level;
+    argv[argc++] = "--target";
+    argv[argc++] = (char*)target;
+
+    /* The code generator checks the core against the target's tunings */
+    char* tune = NULL;
+    if (config->tune_cpu) {
+        tune = malloc(strlen("-mtune=") + strlen(config->tune_cpu) + 1);
+        sprintf(tune, "-mtune=%s", config->tune_cpu);
+        argv[argc++] = tune;
+    }
+    for (int i = 0; i < config->backend_arg_count; i++) {
+        argv[argc++] = config->backend_args[i];
     }
 
+    result = main_aletheia_full(argc, argv);
+    free(tune);
+    free(argv);
     return result;
 }
 
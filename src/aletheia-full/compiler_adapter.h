@@ -26,19 +26,6 @@ void* malloc(size_t size);
 void free(void* ptr);
 void* realloc(void* ptr, size_t size);
 
-/* String functions - implemented locally to avoid system conflicts */
-size_t al_strlen(const char* s);
-char* al_strcpy(char* dest, const char* src);
-char* al_strdup(const char* s);
-int al_strcmp(const char* s1, const char* s2);
-char* al_strstr(const char* haystack, const char* needle);
-
-/* File I/O - using standard stdio.h */
-
-/* Standard library functions - implemented locally */
-void* al_memset(void* s, int c, size_t n);
-void* al_memcpy(void* dest, const void* src, size_t n);
-
 /* Math functions (basic) */
 double sqrt(double x);
 double pow(double base, double exp);
@@ -61,6 +48,17 @@ void abort(void);
 #include <time.h>
 #endif
 
+/* String functions - implemented locally to avoid system conflicts */
+size_t al_strlen(const char* s);
+char* al_strcpy(char* dest, const char* src);
+char* al_strdup(const char* s);
+int al_strcmp(const char* s1, const char* s2);
+char* al_strstr(const char* haystack, const char* needle);
+
+/* Standard library functions - implemented locally */
+void* al_memset(void* s, int c, size_t n);
+void* al_memcpy(void* dest, const void* src, size_t n);
+
 /* ALETHEIA-Full specific features */
 #define ALETHEIA_FULL_VERSION "1.0.0-full"
 
@@ -90,6 +88,9 @@ typedef struct {
     int security_scan;
     int performance_analysis;
     const char* target_arch;
+    const char* tune_cpu;       /* -mtune: core the scheduler models, NULL for the default */
+    char** backend_args;        /* Options for the code generator (-S, -c, -jN, -m...) */
+    int backend_arg_count;
 
     /* Bootstrap compatibility */
     int bootstrap_mode;
@@ -99,6 +100,9 @@ typedef struct {
 int aletheia_compile(const char* source, size_t length, ALETHEIAConfig* config);
 int aletheia_compile_file(const char* input_file, const char* output_file, ALETHEIAConfig* config);
 
+/* Parser, IR pipeline and linker (aletheia-full.c), driven by its own command line */
+int main_aletheia_full(int argc, char* argv[]);
+
 /* AI-powered optimization functions */
 void ai_optimize_ast(void* ast, AIOptimizationLevel level);
 void ai_predict_optimizations(const char* source, ALETHEIAConfig* config);
@@ -1,5 +1,7 @@
 /* ALETHEIA-Full: Lexer stub - adapted from existing code */
+#ifndef ALETHEIA_HOSTED
 #define BOOTSTRAP_BUILD 1
+#endif
 #include "compiler_adapter.h"
 /* Include existing lexer implementation - adapted for bootstrap */
 
@@ -4,7 +4,9 @@
  * Command-line interface for the complete AI-optimized C compiler.
  */
 
+#ifndef ALETHEIA_HOSTED
 #define BOOTSTRAP_BUILD 1
+#endif
 #include "compiler_adapter.h"
 
 /* Show usage information */
@@ -23,7 +25,9 @@ void show_usage() {
         "  --ai-advanced         Enable advanced AI optimization\n"
         "  --security-scan       Enable security vulnerability scanning\n"
         "  --performance         Enable performance analysis\n"
-        "  --target=<arch>       Target architecture (x86_64, arm64, riscv)\n"
+        "  --target=<arch>       Target architecture (x86_64, arm64, riscv64)\n"
+        "  -mtune=<cpu>          Core to schedule for (generic, cortex-a76, cortex-a55, sifive-u74)\n"
+        "  -S, -c, -jN, -m...    Passed to the code generator (see aletheia-full with no arguments)\n"
         "  --version             Show version information\n"
         "  --help                Show this help message\n"
         "\n"
@@ -49,6 +53,9 @@ ALETHEIAConfig parse_arguments(int argc, char* argv[]) {
         .security_scan = 0,
         .performance_analysis = 0,
         .target_arch = "x86_64",
+        .tune_cpu = NULL,
+        .backend_args = malloc(sizeof(char*) * argc),
+        .backend_arg_count = 0,
         .bootstrap_mode = 1
     };
 
@@ -65,6 +72,8 @@ ALETHEIAConfig parse_arguments(int argc, char* argv[]) {
         else if (strcmp(argv[i], "--security-scan") == 0) config.security_scan = 1;
         else if (strcmp(argv[i], "--performance") == 0) config.performance_analysis = 1;
         else if (strncmp(argv[i], "--target=", 9) == 0) config.target_arch = argv[i] + 9;
+        else if (strcmp(argv[i], "--target") == 0 && i + 1 < argc) config.target_arch = argv[++i];
+        else if (strncmp(argv[i], "-mtune=", 7) == 0) config.tune_cpu = argv[i] + 7;
         else if (strcmp(argv[i], "--version") == 0) {
             /* Version already handled above */
             exit(0);
@@ -73,6 +82,10 @@ ALETHEIAConfig parse_arguments(int argc, char* argv[]) {
             show_usage();
             exit(0);
         }
+        else if (argv[i][0] == '-') {
+            /* -S, -c, -jN, -mavx2 and the like belong to the code generator */
+            config.backend_args[config.backend_arg_count++] = argv[i];
+        }
         else if (!config.input_file) {
             config.input_file = argv[i];
         }
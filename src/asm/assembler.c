@@ -259,6 +259,31 @@ void encode_je_rel32(Instruction* instr, int32_t offset) {
     }
 }
 
+void encode_jmp_reg(Instruction* instr, int reg) {
+    int i = 0;
+    if (reg >= 8) instr->bytes[i++] = 0x41;  // REX.B
+    instr->bytes[i++] = 0xFF;
+    instr->bytes[i++] = 0xE0 | (reg & 7);  // JMP r/m64 (/4)
+    instr->size = i;
+}
+
+/* Conditional jumps: condition code for 0F 8x rel32 */
+const char* jcc_names[] = {
+    "jo", "jno", "jb", "jae", "je", "jne", "jbe", "ja",
+    "js", "jns", "jp", "jnp", "jl", "jge", "jle", "jg"
+};
+
+int find_jcc(const char* name) {
+    for (int i = 0; i < 16; i++) {
+        if (streq(jcc_names[i], name)) {
+            return i;
+        }
+    }
+    if (streq(name, "jc")) return 2;
+    if (streq(name, "jnc")) return 3;
+    return -1;
+}
+
 /* Assembly parsing */
 void parse_instruction(char* line, int address) {
     // Skip whitespace
@@ -386,22 +411,22 @@ void parse_instruction(char* line, int address) {
         encode_syscall(instr);
     } else if (streq(instr->mnemonic, "jmp")) {
         if (instr->operand_count == 1) {
-            // Forward reference
-            add_forward_ref(instr->operands[0], instruction_count - 1, 1);
-            encode_jmp_rel32(instr, 0);  // Placeholder
+            int reg = find_register(instr->operands[0]);
+            if (reg != -1) {
+                // Indirect jump through a register (switch jump tables)
+                encode_jmp_reg(instr, reg);
+            } else {
+                // Forward reference
+                add_forward_ref(instr->operands[0], instruction_count - 1, 1);
+                encode_jmp_rel32(instr, 0);  // Placeholder
+            }
         }
-    } else if (streq(instr->mnemonic, "je")) {
+    } else if (find_jcc(instr->mnemonic) != -1) {
         if (instr->operand_count == 1) {
             // Forward reference
             add_forward_ref(instr->operands[0], instruction_count - 1, 2);
             encode_je_rel32(instr, 0);  // Placeholder
-        }
-    } else if (streq(instr->mnemonic, "jne")) {
-        if (instr->operand_count == 1) {
-            // Forward reference
-            add_forward_ref(instr->operands[0], instruction_count - 1, 2);
-            encode_je_rel32(instr, 0);  // Placeholder (JNE is 0x85)
-            instr->bytes[1] = 0x85;  // JNE opcode
+            instr->bytes[1] = 0x80 | find_jcc(instr->mnemonic);
         }
     } else {
         fprintf(stderr, "Unknown instruction: '%s' (operands: %d)\n", instr->mnemonic, instr->operand_count);
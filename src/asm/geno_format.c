@@ -4,12 +4,20 @@
  * Implementation of the GENO object format and linker functionality.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <sys/stat.h>
 #include "geno_format.h"
 
+/* The executable is a single PT_LOAD segment mapped from file offset 0:
+ * ELF header, program header, code, then data */
+#define LINKER_LOAD_ADDRESS 0x400000
+#define LINKER_HEADERS_SIZE 0x78
+
 /* Utility functions */
 static void* safe_malloc(size_t size) {
     void* ptr = malloc(size);
@@ -58,7 +66,8 @@ GENO_Object* geno_load_object(const char* filename) {
         return NULL;
     }
 
-    if (obj->header.architecture != GENO_ARCH_X86_64) {
+    if (obj->header.architecture != GENO_ARCH_X86_64 && obj->header.architecture != GENO_ARCH_ARM64 &&
+        obj->header.architecture != GENO_ARCH_RISCV64) {
         fprintf(stderr, "Unsupported GENO architecture\n");
         free(obj);
         fclose(f);
@@ -133,6 +142,7 @@ GENO_Object* geno_load_object(const char* filename) {
     /* Initialize computed fields */
     obj->code_base_address = 0;
     obj->data_base_address = 0;
+    obj->symbol_base = 0;
 
     fclose(f);
     return obj;
@@ -149,6 +159,39 @@ void geno_free_object(GENO_Object* obj) {
     free(obj);
 }
 
+/* GENO Object Writing: the sections in file order, counts from the header */
+int geno_write_object(GENO_Object* obj, const char* filename) {
+    FILE* f = fopen(filename, "wb");
+    if (!f) {
+        perror("Failed to create GENO object file");
+        return 0;
+    }
+
+    memcpy(obj->header.magic, GENO_MAGIC, 4);
+    obj->header.version = GENO_VERSION;
+
+    int ok = fwrite(&obj->header, sizeof(GENO_Header), 1, f) == 1;
+    if (ok && obj->header.symbol_count > 0) {
+        ok = fwrite(obj->symbols, sizeof(GENO_Symbol), obj->header.symbol_count, f) == obj->header.symbol_count;
+    }
+    if (ok && obj->header.reloc_count > 0) {
+        ok = fwrite(obj->relocations, sizeof(GENO_Relocation), obj->header.reloc_count, f) == obj->header.reloc_count;
+    }
+    if (ok && obj->header.code_size > 0) {
+        ok = fwrite(obj->code_section, 1, obj->header.code_size, f) == obj->header.code_size;
+    }
+    if (ok && obj->header.data_size > 0) {
+        ok = fwrite(obj->data_section, 1, obj->header.data_size, f) == obj->header.data_size;
+    }
+    if (ok && obj->header.string_size > 0) {
+        ok = fwrite(obj->string_table, 1, obj->header.string_size, f) == obj->header.string_size;
+    }
+
+    if (fclose(f) != 0) ok = 0;
+    if (!ok) fprintf(stderr, "Failed to write GENO object %s\n", filename);
+    return ok;
+}
+
 void geno_dump_object(GENO_Object* obj) {
     if (!obj) return;
 
@@ -190,8 +233,9 @@ LinkerContext* linker_create_context() {
     ctx->code_size = 0;
     ctx->output_data = NULL;
     ctx->data_size = 0;
-    ctx->code_base = 0x1000;  /* Code starts at 0x1000 */
-    ctx->data_base = 0x2000;  /* Data starts at 0x2000 */
+    ctx->code_base = LINKER_LOAD_ADDRESS + LINKER_HEADERS_SIZE;
+    ctx->data_base = 0;       /* Placed after the code by linker_resolve_symbols */
+    ctx->architecture = 0;
     return ctx;
 }
 
@@ -210,12 +254,14 @@ void linker_free_context(LinkerContext* ctx) {
 
 void linker_add_object(LinkerContext* ctx, GENO_Object* obj) {
     /* Add object to context */
+    if (ctx->object_count == 0) ctx->architecture = obj->header.architecture;
     ctx->objects = realloc(ctx->objects, (ctx->object_count + 1) * sizeof(GENO_Object*));
     ctx->objects[ctx->object_count++] = obj;
 
     /* Set base addresses for this object */
     obj->code_base_address = ctx->code_base + ctx->code_size;
     obj->data_base_address = ctx->data_base + ctx->data_size;
+    obj->symbol_base = ctx->symbol_count;
 
     /* Expand output sections */
     ctx->output_code = realloc(ctx->output_code, ctx->code_size + obj->header.code_size);
@@ -248,11 +294,13 @@ void linker_add_object(LinkerContext* ctx, GENO_Object* obj) {
         link_sym->name = obj->string_table + sym->name_offset;
         link_sym->type = sym->type;
         link_sym->size = sym->size;
-        link_sym->defined = 1;
+        link_sym->defined = sym->type != GENO_SYM_UNDEFINED;
         link_sym->source_object = obj;
 
         /* Calculate absolute address */
-        if (sym->type == GENO_SYM_FUNCTION || sym->type == GENO_SYM_GLOBAL_VAR) {
+        if (sym->type == GENO_SYM_UNDEFINED) {
+            link_sym->address = 0;
+        } else if (sym->type == GENO_SYM_FUNCTION || sym->type == GENO_SYM_GLOBAL_VAR) {
             link_sym->address = obj->code_base_address + sym->address;
         } else {
             link_sym->address = obj->data_base_address + sym->address;
@@ -260,11 +308,57 @@ void linker_add_object(LinkerContext* ctx, GENO_Object* obj) {
     }
 }
 
+static LinkerSymbol* linker_find_symbol(LinkerContext* ctx, const char* name) {
+    for (int i = 0; i < ctx->symbol_count; i++) {
+        LinkerSymbol* sym = &ctx->global_symbols[i];
+        if (sym->defined && strcmp(sym->name, name) == 0) return sym;
+    }
+    return NULL;
+}
+
 int linker_resolve_symbols(LinkerContext* ctx) {
-    /* For now, assume all symbols are resolved within the objects */
-    /* Future: handle external symbols and libraries */
+    int unresolved = 0;
+
+    for (int i = 0; i < ctx->object_count; i++) {
+        if (ctx->objects[i]->header.architecture != ctx->architecture) {
+            fprintf(stderr, "Cannot link objects for different architectures\n");
+            return 0;
+        }
+    }
+
+    /* Data follows the code in the image, so its address is only known once
+     * every object has been added */
+    uint32_t data_base = ctx->code_base + ctx->code_size;
+    for (int i = 0; i < ctx->object_count; i++) {
+        ctx->objects[i]->data_base_address += data_base - ctx->data_base;
+    }
+    for (int i = 0; i < ctx->symbol_count; i++) {
+        if (ctx->global_symbols[i].type == GENO_SYM_LOCAL_VAR) {
+            ctx->global_symbols[i].address += data_base - ctx->data_base;
+        }
+    }
+    ctx->data_base = data_base;
+
+    /* Bind each external reference to the object that defines the name */
+    for (int i = 0; i < ctx->symbol_count; i++) {
+        LinkerSymbol* sym = &ctx->global_symbols[i];
+        if (sym->defined) continue;
+
+        LinkerSymbol* def = linker_find_symbol(ctx, sym->name);
+        if (!def) {
+            fprintf(stderr, "Undefined symbol: %s\n", sym->name);
+            unresolved++;
+            continue;
+        }
+        sym->type = def->type;
+        sym->address = def->address;
+        sym->size = def->size;
+        sym->defined = 1;
+        sym->source_object = def->source_object;
+    }
+
     printf("Symbol resolution: %d symbols processed\n", ctx->symbol_count);
-    return 1;  /* Success */
+    return unresolved == 0;
 }
 
 int linker_apply_relocations(LinkerContext* ctx) {
@@ -276,12 +370,13 @@ int linker_apply_relocations(LinkerContext* ctx) {
         for (uint32_t reloc_idx = 0; reloc_idx < obj->header.reloc_count; reloc_idx++) {
             GENO_Relocation* reloc = &obj->relocations[reloc_idx];
 
-            if (reloc->symbol_index >= ctx->symbol_count) {
+            /* Symbol indices are local to the object */
+            if (reloc->symbol_index >= obj->header.symbol_count) {
                 fprintf(stderr, "Invalid symbol index in relocation\n");
                 return 0;
             }
 
-            LinkerSymbol* sym = &ctx->global_symbols[reloc->symbol_index];
+            LinkerSymbol* sym = &ctx->global_symbols[obj->symbol_base + reloc->symbol_index];
             uint32_t target_address = sym->address;
 
             /* Apply relocation based on type */
@@ -310,6 +405,22 @@ int linker_apply_relocations(LinkerContext* ctx) {
 
                 int32_t offset = (int32_t)(target_address - current_addr);
                 *patch_location = (uint32_t)offset;
+
+            } else if (reloc->type == GENO_REL_BRANCH26) {
+                /* Word offset from the branch instruction, +-128 MiB */
+                uint32_t* patch_location = (uint32_t*)(ctx->output_code + (obj->code_base_address - ctx->code_base) + reloc->offset);
+                int32_t offset = (int32_t)(target_address - (obj->code_base_address + reloc->offset)) / 4;
+                *patch_location = (*patch_location & 0xFC000000) | ((uint32_t)offset & 0x03FFFFFF);
+
+            } else if (reloc->type == GENO_REL_RV_CALL) {
+                /* Byte offset from the auipc; jalr sign-extends its low 12 bits, so
+                 * the auipc part is rounded */
+                uint32_t* patch_location = (uint32_t*)(ctx->output_code + (obj->code_base_address - ctx->code_base) + reloc->offset);
+                int32_t offset = (int32_t)(target_address - (obj->code_base_address + reloc->offset));
+                uint32_t hi = ((uint32_t)offset + 0x800) & 0xFFFFF000;
+                uint32_t lo = (uint32_t)offset - hi;
+                patch_location[0] = (patch_location[0] & 0x00000FFF) | hi;
+                patch_location[1] = (patch_location[1] & 0x000FFFFF) | (lo & 0xFFF) << 20;
             }
 
             reloc_count++;
@@ -320,17 +431,22 @@ int linker_apply_relocations(LinkerContext* ctx) {
     return 1;  /* Success */
 }
 
-void linker_generate_executable(LinkerContext* ctx, const char* output_file) {
+int linker_generate_executable(LinkerContext* ctx, const char* output_file) {
     FILE* f = fopen(output_file, "wb");
     if (!f) {
         perror("Failed to create executable");
-        return;
+        return 0;
     }
 
     /* Calculate total size */
-    uint64_t code_start = 0x78;  /* After ELF headers */
+    uint64_t code_start = LINKER_HEADERS_SIZE;  /* After ELF headers */
     uint64_t data_start = code_start + ctx->code_size;
     uint64_t total_size = data_start + ctx->data_size;
+    uint64_t load_address = ctx->code_base - code_start;
+
+    /* Start at _start when an object provides one, else at the first byte */
+    LinkerSymbol* start = linker_find_symbol(ctx, "_start");
+    uint64_t entry = start ? start->address : ctx->code_base;
 
     /* ELF Header (64 bytes) */
     uint8_t elf_header[64] = {
@@ -352,8 +468,9 @@ void linker_generate_executable(LinkerContext* ctx, const char* output_file) {
         0, 0                   // Section header string table index
     };
 
-    /* Set entry point to start of code */
-    memcpy(&elf_header[24], &code_start, 8);
+    if (ctx->architecture == GENO_ARCH_ARM64) elf_header[18] = 0xB7;  // EM_AARCH64
+    if (ctx->architecture == GENO_ARCH_RISCV64) elf_header[18] = 0xF3;  // EM_RISCV
+    memcpy(&elf_header[24], &entry, 8);
 
     /* Program Header (56 bytes) */
     uint8_t program_header[56] = {
@@ -367,7 +484,9 @@ void linker_generate_executable(LinkerContext* ctx, const char* output_file) {
         0, 0, 0, 0, 0, 0, 0, 0   // Alignment
     };
 
-    /* Set file and memory sizes */
+    /* Map the whole file at the load address */
+    memcpy(&program_header[16], &load_address, 8);  // Virtual address
+    memcpy(&program_header[24], &load_address, 8);  // Physical address
     memcpy(&program_header[32], &total_size, 8);  // File size
     memcpy(&program_header[40], &total_size, 8);  // Memory size
 
@@ -376,21 +495,27 @@ void linker_generate_executable(LinkerContext* ctx, const char* output_file) {
     memcpy(&program_header[48], &alignment, 8);
 
     /* Write ELF header */
-    fwrite(elf_header, 1, 64, f);
+    int ok = fwrite(elf_header, 1, 64, f) == 64;
 
     /* Write program header */
-    fwrite(program_header, 1, 56, f);
+    ok = ok && fwrite(program_header, 1, 56, f) == 56;
 
     /* Write code section */
-    if (ctx->code_size > 0) {
-        fwrite(ctx->output_code, 1, ctx->code_size, f);
+    if (ok && ctx->code_size > 0) {
+        ok = fwrite(ctx->output_code, 1, ctx->code_size, f) == ctx->code_size;
     }
 
     /* Write data section */
-    if (ctx->data_size > 0) {
-        fwrite(ctx->output_data, 1, ctx->data_size, f);
+    if (ok && ctx->data_size > 0) {
+        ok = fwrite(ctx->output_data, 1, ctx->data_size, f) == ctx->data_size;
     }
 
-    fclose(f);
-    printf("Generated executable: %s (%lu bytes)\n", output_file, total_size);
+    if (fclose(f) != 0) ok = 0;
+    if (!ok) {
+        fprintf(stderr, "Failed to write executable %s\n", output_file);
+        return 0;
+    }
+    chmod(output_file, 0755);
+    printf("Generated executable: %s (%lu bytes)\n", output_file, (unsigned long)total_size);
+    return 1;
 }
@@ -16,6 +16,8 @@
 
 /* Architecture Codes */
 #define GENO_ARCH_X86_64 1
+#define GENO_ARCH_ARM64  2
+#define GENO_ARCH_RISCV64 3
 
 /* Symbol Types */
 #define GENO_SYM_UNDEFINED 0
@@ -27,6 +29,8 @@
 #define GENO_REL_ABSOLUTE 1  /* Absolute 64-bit address */
 #define GENO_REL_RELATIVE 2  /* Relative 32-bit offset */
 #define GENO_REL_PC_REL   3  /* PC-relative 32-bit offset */
+#define GENO_REL_BRANCH26 4  /* AArch64 b/bl: word offset in the low 26 bits */
+#define GENO_REL_RV_CALL  5  /* RISC-V auipc + jalr: offset split hi20/lo12 */
 
 /* GENO Header (64 bytes) */
 typedef struct {
@@ -85,6 +89,7 @@ typedef struct {
     /* Computed fields */
     uint32_t code_base_address;
     uint32_t data_base_address;
+    uint32_t symbol_base;   /* Index of symbol 0 in the linker's table */
 } GENO_Object;
 
 /* Linker symbol resolution */
@@ -93,7 +98,7 @@ typedef struct {
     uint32_t type;
     uint32_t address;
     uint32_t size;
-    int defined;  /* 1 if defined, 0 if external */
+    int defined;  /* 1 if defined, 0 if external until resolved */
     GENO_Object* source_object;
 } LinkerSymbol;
 
@@ -114,18 +119,21 @@ typedef struct {
     /* Base addresses for sections */
     uint32_t code_base;
     uint32_t data_base;
+
+    uint32_t architecture;  /* GENO_ARCH_* of the first object; all must match */
 } LinkerContext;
 
 /* API Functions */
 GENO_Object* geno_load_object(const char* filename);
 void geno_free_object(GENO_Object* obj);
+int geno_write_object(GENO_Object* obj, const char* filename);
 void geno_dump_object(GENO_Object* obj);
 
 LinkerContext* linker_create_context();
 void linker_add_object(LinkerContext* ctx, GENO_Object* obj);
 int linker_resolve_symbols(LinkerContext* ctx);
 int linker_apply_relocations(LinkerContext* ctx);
-void linker_generate_executable(LinkerContext* ctx, const char* output_file);
+int linker_generate_executable(LinkerContext* ctx, const char* output_file);
 void linker_free_context(LinkerContext* ctx);
 
 #endif /* GENO_FORMAT_H */
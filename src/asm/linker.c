@@ -65,7 +65,10 @@ int main(int argc, char* argv[]) {
     }
 
     /* Generate executable */
-    linker_generate_executable(ctx, output_file);
+    if (!linker_generate_executable(ctx, output_file)) {
+        linker_free_context(ctx);
+        return 1;
+    }
 
     /* Cleanup */
     linker_free_context(ctx);
@@ -2,171 +2,398 @@
 // AArch64 code generation for mobile and server platforms
 
 #include "../backend.h"
+#include "../isel.h"
 #include <stdlib.h>
 #include <string.h>
 
 // ARM64 registers (64-bit)
-static TargetRegister arm64_registers[] = {
+static const TargetRegister arm64_registers[] = {
     // General purpose registers
-    {"x0", REG_CLASS_GP, 0, false},   // Argument/return register
-    {"x1", REG_CLASS_GP, 1, false},   // Argument register
-    {"x2", REG_CLASS_GP, 2, false},   // Argument register
-    {"x3", REG_CLASS_GP, 3, false},   // Argument register
-    {"x4", REG_CLASS_GP, 4, false},   // Argument register
-    {"x5", REG_CLASS_GP, 5, false},   // Argument register
-    {"x6", REG_CLASS_GP, 6, false},   // Argument register
-    {"x7", REG_CLASS_GP, 7, false},   // Argument register
-    {"x8", REG_CLASS_GP, 8, false},   // Indirect result register
-    {"x9", REG_CLASS_GP, 9, false},   // Temporary register
-    {"x10", REG_CLASS_GP, 10, false}, // Temporary register
-    {"x11", REG_CLASS_GP, 11, false}, // Temporary register
-    {"x12", REG_CLASS_GP, 12, false}, // Temporary register
-    {"x13", REG_CLASS_GP, 13, false}, // Temporary register
-    {"x14", REG_CLASS_GP, 14, false}, // Temporary register
-    {"x15", REG_CLASS_GP, 15, false}, // Temporary register
-    {"x16", REG_CLASS_GP, 16, false}, // IP0 (intra-procedure-call)
-    {"x17", REG_CLASS_GP, 17, false}, // IP1 (intra-procedure-call)
-    {"x18", REG_CLASS_GP, 18, false}, // Platform register
-    {"x19", REG_CLASS_GP, 19, true},  // Callee-saved
-    {"x20", REG_CLASS_GP, 20, true},  // Callee-saved
-    {"x21", REG_CLASS_GP, 21, true},  // Callee-saved
-    {"x22", REG_CLASS_GP, 22, true},  // Callee-saved
-    {"x23", REG_CLASS_GP, 23, true},  // Callee-saved
-    {"x24", REG_CLASS_GP, 24, true},  // Callee-saved
-    {"x25", REG_CLASS_GP, 25, true},  // Callee-saved
-    {"x26", REG_CLASS_GP, 26, true},  // Callee-saved
-    {"x27", REG_CLASS_GP, 27, true},  // Callee-saved
-    {"x28", REG_CLASS_GP, 28, true},  // Callee-saved
-    {"x29", REG_CLASS_GP, 29, true},  // Frame pointer
-    {"x30", REG_CLASS_GP, 30, false}, // Link register
+    {"x0", REG_CLASS_GP, 0, false, false},   // Argument/return register
+    {"x1", REG_CLASS_GP, 1, false, false},   // Argument register
+    {"x2", REG_CLASS_GP, 2, false, false},   // Argument register
+    {"x3", REG_CLASS_GP, 3, false, false},   // Argument register
+    {"x4", REG_CLASS_GP, 4, false, false},   // Argument register
+    {"x5", REG_CLASS_GP, 5, false, false},   // Argument register
+    {"x6", REG_CLASS_GP, 6, false, false},   // Argument register
+    {"x7", REG_CLASS_GP, 7, false, false},   // Argument register
+    {"x8", REG_CLASS_GP, 8, false, false},   // Indirect result register
+    {"x9", REG_CLASS_GP, 9, false, false},   // Temporary register
+    {"x10", REG_CLASS_GP, 10, false, false}, // Temporary register
+    {"x11", REG_CLASS_GP, 11, false, false}, // Temporary register
+    {"x12", REG_CLASS_GP, 12, false, false}, // Temporary register
+    {"x13", REG_CLASS_GP, 13, false, false}, // Temporary register
+    {"x14", REG_CLASS_GP, 14, false, false}, // Temporary register
+    {"x15", REG_CLASS_GP, 15, false, false}, // Temporary register
+    {"x16", REG_CLASS_GP, 16, false, true}, // IP0 (intra-procedure-call)
+    {"x17", REG_CLASS_GP, 17, false, true}, // IP1 (intra-procedure-call)
+    {"x18", REG_CLASS_GP, 18, false, true}, // Platform register
+    {"x19", REG_CLASS_GP, 19, true, false},  // Callee-saved
+    {"x20", REG_CLASS_GP, 20, true, false},  // Callee-saved
+    {"x21", REG_CLASS_GP, 21, true, false},  // Callee-saved
+    {"x22", REG_CLASS_GP, 22, true, false},  // Callee-saved
+    {"x23", REG_CLASS_GP, 23, true, false},  // Callee-saved
+    {"x24", REG_CLASS_GP, 24, true, false},  // Callee-saved
+    {"x25", REG_CLASS_GP, 25, true, false},  // Callee-saved
+    {"x26", REG_CLASS_GP, 26, true, false},  // Callee-saved
+    {"x27", REG_CLASS_GP, 27, true, false},  // Callee-saved
+    {"x28", REG_CLASS_GP, 28, true, false},  // Callee-saved
+    {"x29", REG_CLASS_GP, 29, true, true},  // Frame pointer
+    {"x30", REG_CLASS_GP, 30, false, true}, // Link register
 
     // Special registers
-    {"sp", REG_CLASS_SP, 31, false},  // Stack pointer
-    {"pc", REG_CLASS_SP, 32, false},  // Program counter
+    {"sp", REG_CLASS_SP, 31, false, true},  // Stack pointer
+    {"pc", REG_CLASS_SP, 32, false, true},  // Program counter
 
     // SIMD registers (NEON)
-    {"v0", REG_CLASS_VEC, 0, false},   // SIMD register
-    {"v1", REG_CLASS_VEC, 1, false},   // SIMD register
-    {"v2", REG_CLASS_VEC, 2, false},   // SIMD register
-    {"v3", REG_CLASS_VEC, 3, false},   // SIMD register
-    {"v4", REG_CLASS_VEC, 4, false},   // SIMD register
-    {"v5", REG_CLASS_VEC, 5, false},   // SIMD register
-    {"v6", REG_CLASS_VEC, 6, false},   // SIMD register
-    {"v7", REG_CLASS_VEC, 7, false},   // SIMD register
+    {"v0", REG_CLASS_VEC, 0, false, false},   // SIMD register
+    {"v1", REG_CLASS_VEC, 1, false, false},   // SIMD register
+    {"v2", REG_CLASS_VEC, 2, false, false},   // SIMD register
+    {"v3", REG_CLASS_VEC, 3, false, false},   // SIMD register
+    {"v4", REG_CLASS_VEC, 4, false, false},   // SIMD register
+    {"v5", REG_CLASS_VEC, 5, false, false},   // SIMD register
+    {"v6", REG_CLASS_VEC, 6, false, false},   // SIMD register
+    {"v7", REG_CLASS_VEC, 7, false, false},   // SIMD register
     // ... (truncated for brevity, ARM64 has 32 SIMD registers)
 };
 
 #define NUM_ARM64_REGISTERS (sizeof(arm64_registers) / sizeof(TargetRegister))
 
 // ARM64 calling convention (AArch64 ABI)
-static CallingConvention arm64_calling_convention = {
-    .arg_registers = NULL, // Will be initialized
+static const TargetRegister* const arm64_arg_registers[] = {
+    &arm64_registers[0], &arm64_registers[1], &arm64_registers[2], &arm64_registers[3],
+    &arm64_registers[4], &arm64_registers[5], &arm64_registers[6], &arm64_registers[7],
+};
+
+static const CallingConvention arm64_calling_convention = {
+    .arg_registers = arm64_arg_registers,
     .num_arg_registers = 8,
     .return_register = &arm64_registers[0], // x0
     .stack_pointer = &arm64_registers[31],  // sp
     .frame_pointer = &arm64_registers[29],  // x29/fp
+    .locals_offset = 0,
+    .red_zone_size = 0,     // AAPCS64 has no red zone
     .stack_alignment = 16,
     .caller_cleanup = false
 };
 
+// add/sub take a 12-bit immediate, optionally shifted left by 12, so
+// frames up to 16 MiB take at most two instructions
+static void arm64_adjust_sp(EmitBuffer* out, const char* op, int amount) {
+    if (amount >> 12) emit_instruction(out, "%s sp, sp, #%d, lsl #12", op, amount >> 12);
+    if (amount & 0xfff) emit_instruction(out, "%s sp, sp, #%d", op, amount & 0xfff);
+}
+
 // ARM64 code generation functions
-static void arm64_generate_prologue(FILE* out, int stack_size) {
+static void arm64_generate_prologue(EmitBuffer* out, int stack_size) {
     emit_comment(out, "ARM64 function prologue");
     emit_instruction(out, "stp x29, x30, [sp, -16]!");  // Save FP and LR
     emit_instruction(out, "mov x29, sp");                // Set frame pointer
 
     if (stack_size > 0) {
         // Align stack size to 16 bytes
-        int aligned_size = (stack_size + 15) & ~15;
-        emit_instruction(out, "sub sp, sp, #%d", aligned_size);
+        arm64_adjust_sp(out, "sub", (stack_size + 15) & ~15);
     }
 }
 
-static void arm64_generate_epilogue(FILE* out, int stack_size) {
+static void arm64_generate_epilogue(EmitBuffer* out, int stack_size) {
     emit_comment(out, "ARM64 function epilogue");
 
     if (stack_size > 0) {
-        int aligned_size = (stack_size + 15) & ~15;
-        emit_instruction(out, "add sp, sp, #%d", aligned_size);
+        arm64_adjust_sp(out, "add", (stack_size + 15) & ~15);
     }
 
     emit_instruction(out, "ldp x29, x30, [sp], 16");  // Restore FP and LR
     emit_instruction(out, "ret");
 }
 
-static void arm64_generate_mov(FILE* out, const char* dest, const char* src) {
+// Leaf functions leave x29/x30 untouched: lr stays live until ret
+static void arm64_generate_leaf_prologue(EmitBuffer* out, int stack_size) {
+    if (stack_size > 0) {
+        arm64_adjust_sp(out, "sub", (stack_size + 15) & ~15);
+    }
+}
+
+static void arm64_generate_leaf_epilogue(EmitBuffer* out, int stack_size) {
+    if (stack_size > 0) {
+        arm64_adjust_sp(out, "add", (stack_size + 15) & ~15);
+    }
+    emit_instruction(out, "ret");
+}
+
+static void arm64_generate_mov(EmitBuffer* out, const char* dest, const char* src) {
     emit_instruction(out, "mov %s, %s", dest, src);
 }
 
-static void arm64_generate_add(FILE* out, const char* dest, const char* src1, const char* src2) {
+// Materializes any 64-bit constant with movz/movk when it is not a single mov
+static void arm64_generate_mov_imm(EmitBuffer* out, const char* dest, long imm) {
+    if (imm >= -65536 && imm <= 65535) {
+        emit_instruction(out, "mov %s, #%ld", dest, imm);
+        return;
+    }
+
+    unsigned long value = (unsigned long)imm;
+    emit_instruction(out, "movz %s, #%lu", dest, value & 0xffff);
+    for (int shift = 16; shift < 64; shift += 16) {
+        unsigned long chunk = (value >> shift) & 0xffff;
+        if (chunk != 0) {
+            emit_instruction(out, "movk %s, #%lu, lsl #%d", dest, chunk, shift);
+        }
+    }
+}
+
+static void arm64_generate_add(EmitBuffer* out, const char* dest, const char* src1, const char* src2) {
     emit_instruction(out, "add %s, %s, %s", dest, src1, src2);
 }
 
-static void arm64_generate_sub(FILE* out, const char* dest, const char* src1, const char* src2) {
+static void arm64_generate_sub(EmitBuffer* out, const char* dest, const char* src1, const char* src2) {
     emit_instruction(out, "sub %s, %s, %s", dest, src1, src2);
 }
 
-static void arm64_generate_mul(FILE* out, const char* dest, const char* src1, const char* src2) {
+// add/sub take an unsigned 12-bit immediate; a negative one flips the op
+static void arm64_generate_add_imm(EmitBuffer* out, const char* dest, const char* src, long imm) {
+    if (imm < 0) {
+        emit_instruction(out, "sub %s, %s, #%ld", dest, src, -imm);
+    } else {
+        emit_instruction(out, "add %s, %s, #%ld", dest, src, imm);
+    }
+}
+
+static void arm64_generate_mul(EmitBuffer* out, const char* dest, const char* src1, const char* src2) {
     emit_instruction(out, "mul %s, %s, %s", dest, src1, src2);
 }
 
-static void arm64_generate_div(FILE* out, const char* dest, const char* src1, const char* src2) {
+static void arm64_generate_div(EmitBuffer* out, const char* dest, const char* src1, const char* src2) {
     emit_instruction(out, "sdiv %s, %s, %s", dest, src1, src2);  // Signed division
 }
 
-static void arm64_generate_load(FILE* out, const char* dest, const char* addr, int offset) {
+// ldr/str take a signed 9-bit unscaled or an unsigned 12-bit offset scaled
+// by the access size
+static bool arm64_offset_encodable(int offset, int bytes) {
+    return (offset >= -256 && offset <= 255) ||
+           (offset >= 0 && offset % bytes == 0 && offset <= 4095 * bytes);
+}
+
+// Forms addr + offset in temp for offsets outside the addressing-mode range
+static void arm64_materialize_address(EmitBuffer* out, const char* temp, const char* addr, int offset) {
+    if (offset < 0 && -offset < 4096) {
+        emit_instruction(out, "sub %s, %s, #%d", temp, addr, -offset);
+    } else if (offset > 0 && offset < 4096) {
+        emit_instruction(out, "add %s, %s, #%d", temp, addr, offset);
+    } else {
+        arm64_generate_mov_imm(out, temp, offset);
+        emit_instruction(out, "add %s, %s, %s", temp, addr, temp);
+    }
+}
+
+// Bytes accessed, and the mnemonic and register view for each width.
+// Writing a w register zeroes the upper half, so zero-extending loads and
+// all narrow stores use it.
+static int arm64_width_bytes(MemoryWidth width) {
+    return width == MEM_WORD ? 8 : width == MEM_S8 || width == MEM_U8 ? 1 : 4;
+}
+
+static const char* arm64_load_mnemonic(MemoryWidth width) {
+    switch (width) {
+        case MEM_S32: return "ldrsw";
+        case MEM_S8: return "ldrsb";
+        case MEM_U8: return "ldrb";
+        default: return "ldr";
+    }
+}
+
+static const char* arm64_store_mnemonic(MemoryWidth width) {
+    return width == MEM_S8 || width == MEM_U8 ? "strb" : "str";
+}
+
+static const char* arm64_register_view(char* buffer, size_t size, const char* reg, bool w) {
+    if (!w || reg[0] != 'x') return reg;
+    snprintf(buffer, size, "w%s", reg + 1);
+    return buffer;
+}
+
+static void arm64_generate_load_sized(EmitBuffer* out, MemoryWidth width, const char* dest,
+                                      const char* addr, int offset) {
+    const char* op = arm64_load_mnemonic(width);
+    char view[8];
+    const char* reg = arm64_register_view(view, sizeof(view), dest, width == MEM_U32 || width == MEM_U8);
+
+    if (offset == 0) {
+        emit_instruction(out, "%s %s, [%s]", op, reg, addr);
+    } else if (arm64_offset_encodable(offset, arm64_width_bytes(width))) {
+        emit_instruction(out, "%s %s, [%s, #%d]", op, reg, addr, offset);
+    } else if (strcmp(dest, addr) == 0 && (offset <= -4096 || offset >= 4096)) {
+        // Building the offset in dest would lose the address; the other
+        // operands of an indexed load are consumed, so an IP register is free
+        const char* temp = strcmp(dest, "x17") == 0 ? "x16" : "x17";
+        arm64_generate_mov_imm(out, temp, offset);
+        emit_instruction(out, "%s %s, [%s, %s]", op, reg, addr, temp);
+    } else {
+        arm64_materialize_address(out, dest, addr, offset);
+        emit_instruction(out, "%s %s, [%s]", op, reg, dest);
+    }
+}
+
+// The register-offset form scales the index by the access size only; other
+// scales, or a displacement on top, form the address in dest first
+static void arm64_generate_load_indexed(EmitBuffer* out, MemoryWidth width, const char* dest,
+                                        const char* base, const char* index, int shift,
+                                        int offset) {
+    const char* op = arm64_load_mnemonic(width);
+    char view[8];
+    const char* reg = arm64_register_view(view, sizeof(view), dest, width == MEM_U32 || width == MEM_U8);
+
+    if (offset == 0 && shift == 0) {
+        emit_instruction(out, "%s %s, [%s, %s]", op, reg, base, index);
+    } else if (offset == 0 && (1 << shift) == arm64_width_bytes(width)) {
+        emit_instruction(out, "%s %s, [%s, %s, lsl #%d]", op, reg, base, index, shift);
+    } else {
+        emit_instruction(out, "add %s, %s, %s, lsl #%d", dest, base, index, shift);
+        arm64_generate_load_sized(out, width, dest, dest, offset);
+    }
+}
+
+static void arm64_generate_store_sized(EmitBuffer* out, MemoryWidth width, const char* src,
+                                       const char* addr, int offset) {
+    const char* op = arm64_store_mnemonic(width);
+    char view[8];
+    const char* reg = arm64_register_view(view, sizeof(view), src, width != MEM_WORD);
+
     if (offset == 0) {
-        emit_instruction(out, "ldr %s, [%s]", dest, addr);
+        emit_instruction(out, "%s %s, [%s]", op, reg, addr);
+    } else if (arm64_offset_encodable(offset, arm64_width_bytes(width))) {
+        emit_instruction(out, "%s %s, [%s, #%d]", op, reg, addr, offset);
     } else {
-        emit_instruction(out, "ldr %s, [%s, #%d]", dest, addr, offset);
+        // x17 (IP1) is only ever loaded, never stored, by spill code
+        const char* temp = strcmp(src, "x17") == 0 ? "x16" : "x17";
+        arm64_materialize_address(out, temp, addr, offset);
+        emit_instruction(out, "%s %s, [%s]", op, reg, temp);
     }
 }
 
-static void arm64_generate_store(FILE* out, const char* src, const char* addr, int offset) {
+// stp/ldp take a signed 7-bit offset scaled by 8
+static bool arm64_pair_encodable(int offset) {
+    return offset >= -512 && offset <= 504 && offset % 8 == 0;
+}
+
+static void arm64_generate_pair(EmitBuffer* out, const char* op, const char* first,
+                                const char* second, const char* addr, int offset) {
+    if (!arm64_pair_encodable(offset)) {
+        // Only callee-saved registers are paired, so x16 (IP0) is free
+        arm64_materialize_address(out, "x16", addr, offset);
+        addr = "x16";
+        offset = 0;
+    }
     if (offset == 0) {
-        emit_instruction(out, "str %s, [%s]", src, addr);
+        emit_instruction(out, "%s %s, %s, [%s]", op, first, second, addr);
     } else {
-        emit_instruction(out, "str %s, [%s, #%d]", src, addr, offset);
+        emit_instruction(out, "%s %s, %s, [%s, #%d]", op, first, second, addr, offset);
     }
 }
 
-static void arm64_generate_cmp(FILE* out, const char* op1, const char* op2) {
+static void arm64_generate_store_pair(EmitBuffer* out, const char* first, const char* second,
+                                      const char* addr, int offset) {
+    arm64_generate_pair(out, "stp", first, second, addr, offset);
+}
+
+static void arm64_generate_load_pair(EmitBuffer* out, const char* first, const char* second,
+                                     const char* addr, int offset) {
+    arm64_generate_pair(out, "ldp", first, second, addr, offset);
+}
+
+static void arm64_generate_load(EmitBuffer* out, const char* dest, const char* addr, int offset) {
+    arm64_generate_load_sized(out, MEM_WORD, dest, addr, offset);
+}
+
+static void arm64_generate_store(EmitBuffer* out, const char* src, const char* addr, int offset) {
+    arm64_generate_store_sized(out, MEM_WORD, src, addr, offset);
+}
+
+static void arm64_generate_cmp(EmitBuffer* out, const char* op1, const char* op2) {
     emit_instruction(out, "cmp %s, %s", op1, op2);
 }
 
-static void arm64_generate_jmp(FILE* out, const char* label) {
+static void arm64_generate_jmp(EmitBuffer* out, const char* label) {
     emit_instruction(out, "b %s", label);
 }
 
-static void arm64_generate_je(FILE* out, const char* label) {
+static void arm64_generate_je(EmitBuffer* out, const char* label) {
     emit_instruction(out, "b.eq %s", label);
 }
 
-static void arm64_generate_jne(FILE* out, const char* label) {
+static void arm64_generate_jne(EmitBuffer* out, const char* label) {
     emit_instruction(out, "b.ne %s", label);
 }
 
-static void arm64_generate_jl(FILE* out, const char* label) {
+static void arm64_generate_jl(EmitBuffer* out, const char* label) {
     emit_instruction(out, "b.lt %s", label);
 }
 
-static void arm64_generate_jg(FILE* out, const char* label) {
+static void arm64_generate_jg(EmitBuffer* out, const char* label) {
     emit_instruction(out, "b.gt %s", label);
 }
 
-static void arm64_generate_call(FILE* out, const char* function) {
+static const char* arm64_condition_code(CompareCondition cond) {
+    switch (cond) {
+        case COND_EQ: return "eq";
+        case COND_NE: return "ne";
+        case COND_LT: return "lt";
+        case COND_LE: return "le";
+        case COND_GT: return "gt";
+        case COND_GE: return "ge";
+    }
+    return "eq";
+}
+
+static void arm64_generate_setcc(EmitBuffer* out, CompareCondition cond, const char* dest,
+                                 const char* op1, const char* op2) {
+    emit_instruction(out, "cmp %s, %s", op1, op2);
+    emit_instruction(out, "cset %s, %s", dest, arm64_condition_code(cond));
+}
+
+static void arm64_generate_select(EmitBuffer* out, CompareCondition cond, const char* dest,
+                                  const char* op1, const char* op2,
+                                  const char* if_true, const char* if_false) {
+    emit_instruction(out, "cmp %s, %s", op1, op2 ? op2 : "#0");
+    emit_instruction(out, "csel %s, %s, %s, %s", dest, if_true, if_false,
+                     arm64_condition_code(cond));
+}
+
+static void arm64_generate_branch(EmitBuffer* out, CompareCondition cond, const char* op1,
+                                  const char* op2, const char* label) {
+    emit_instruction(out, "cmp %s, %s", op1, op2);
+    emit_instruction(out, "b.%s %s", arm64_condition_code(cond), label);
+}
+
+static void arm64_generate_branch_zero(EmitBuffer* out, CompareCondition cond, const char* op,
+                                       const char* label) {
+    if (cond == COND_EQ) {
+        emit_instruction(out, "cbz %s, %s", op, label);
+    } else if (cond == COND_NE) {
+        emit_instruction(out, "cbnz %s, %s", op, label);
+    } else if (cond == COND_LT) {
+        emit_instruction(out, "tbnz %s, #63, %s", op, label);
+    } else if (cond == COND_GE) {
+        emit_instruction(out, "tbz %s, #63, %s", op, label);
+    } else {
+        emit_instruction(out, "cmp %s, #0", op);
+        emit_instruction(out, "b.%s %s", arm64_condition_code(cond), label);
+    }
+}
+
+static void arm64_generate_call(EmitBuffer* out, const char* function) {
     emit_instruction(out, "bl %s", function);
 }
 
-static void arm64_generate_ret(FILE* out) {
+static void arm64_generate_ret(EmitBuffer* out) {
     emit_instruction(out, "ret");
 }
 
-static void arm64_generate_label(FILE* out, const char* label) {
+static void arm64_generate_label(EmitBuffer* out, const char* label) {
     emit_label(out, label);
 }
 
-static void arm64_apply_ia_hints(FILE* out, const char* optimization_type) {
+static void arm64_apply_ia_hints(EmitBuffer* out, const char* optimization_type) {
     emit_comment(out, "ARM64 IA optimization hints");
 
     if (strcmp(optimization_type, "loop_unroll") == 0) {
@@ -183,7 +410,7 @@ static void arm64_apply_ia_hints(FILE* out, const char* optimization_type) {
 }
 
 // ARM64 instruction set (subset for basic operations)
-static TargetInstruction arm64_instructions[] = {
+static const TargetInstruction arm64_instructions[] = {
     {"add", 3, true},
     {"sub", 3, true},
     {"mul", 3, false},
@@ -202,8 +429,65 @@ static TargetInstruction arm64_instructions[] = {
 
 #define NUM_ARM64_INSTRUCTIONS (sizeof(arm64_instructions) / sizeof(TargetInstruction))
 
+// ARM64 selection rules, costs in cycles on a Cortex-A76 class core. There
+// is no multiply-immediate. The register-offset load scales by the access
+// size only, so an index plus a displacement costs an extra add.
+static const IselRule arm64_isel_rules[] = {
+    ISEL_LEAF(ISEL_NT_REG, ISEL_CONST, 1, ISEL_ACT_MOV_IMM),
+    ISEL_LEAF(ISEL_NT_REG, ISEL_VREG, 0, ISEL_ACT_VREG),
+    ISEL_LEAF(ISEL_NT_REG, ISEL_SLOT, 4, ISEL_ACT_LOAD_SLOT),
+    ISEL_IMM(ISEL_NT_ADDIMM, -4095, 4095),               // add/sub #uimm12
+    ISEL_IMM(ISEL_NT_SUBIMM, -4095, 4095),
+    ISEL_IMM(ISEL_NT_ZERO, 0, 0),
+    ISEL_IMM(ISEL_NT_SCALE, 0, 3),
+    ISEL_IMM(ISEL_NT_DISP, INT_MIN, INT_MAX),
+    ISEL_RULE(ISEL_NT_REG, ISEL_ADD, ISEL_NT_REG, ISEL_NT_REG, 1, ISEL_ACT_OP),
+    ISEL_RULE(ISEL_NT_REG, ISEL_ADD, ISEL_NT_REG, ISEL_NT_ADDIMM, 1, ISEL_ACT_OP_IMM),
+    ISEL_RULE(ISEL_NT_REG, ISEL_SUB, ISEL_NT_REG, ISEL_NT_REG, 1, ISEL_ACT_OP),
+    ISEL_RULE(ISEL_NT_REG, ISEL_SUB, ISEL_NT_REG, ISEL_NT_SUBIMM, 1, ISEL_ACT_SUB_IMM),
+    ISEL_RULE(ISEL_NT_REG, ISEL_MUL, ISEL_NT_REG, ISEL_NT_REG, 4, ISEL_ACT_OP),
+    ISEL_RULE(ISEL_NT_REG, ISEL_DIV, ISEL_NT_REG, ISEL_NT_REG, 12, ISEL_ACT_OP),
+    ISEL_RULE(ISEL_NT_REG, ISEL_SHL, ISEL_NT_REG, ISEL_NT_SCALE, 5, ISEL_ACT_SHL),
+    ISEL_RULE(ISEL_NT_REG, ISEL_CMP, ISEL_NT_REG, ISEL_NT_REG, 2, ISEL_ACT_SETCC),
+    ISEL_RULE(ISEL_NT_INDEX, ISEL_SHL, ISEL_NT_REG, ISEL_NT_SCALE, 0, ISEL_ACT_INDEX),
+    ISEL_CHAIN(ISEL_NT_INDEX, ISEL_NT_REG, 0, ISEL_ACT_INDEX_REG),
+    ISEL_RULE(ISEL_NT_BASEIDX, ISEL_ADD, ISEL_NT_REG, ISEL_NT_INDEX, 1, ISEL_ACT_BASE_INDEX),
+    ISEL_CHAIN(ISEL_NT_ADDR, ISEL_NT_REG, 0, ISEL_ACT_BASE),
+    ISEL_CHAIN(ISEL_NT_ADDR, ISEL_NT_BASEIDX, 0, ISEL_ACT_KEEP),
+    ISEL_RULE(ISEL_NT_ADDR, ISEL_ADD, ISEL_NT_REG, ISEL_NT_DISP, 0, ISEL_ACT_BASE_DISP),
+    ISEL_RULE(ISEL_NT_ADDR, ISEL_ADD, ISEL_NT_BASEIDX, ISEL_NT_DISP, 2, ISEL_ACT_ADD_DISP),
+    ISEL_RULE(ISEL_NT_REG, ISEL_LOAD, ISEL_NT_ADDR, ISEL_NT_REG, 4, ISEL_ACT_LOAD),
+    ISEL_RULE(ISEL_NT_BRANCH, ISEL_CMP, ISEL_NT_REG, ISEL_NT_REG, 1, ISEL_ACT_BRANCH),
+    ISEL_RULE(ISEL_NT_BRANCH, ISEL_CMP, ISEL_NT_REG, ISEL_NT_ZERO, 1, ISEL_ACT_BRANCH_ZERO),
+};
+
+// Cortex-A76 issues four instructions a cycle out of order, with two
+// load pipes and one multiply/divide pipe. Cortex-A55 is the dual-issue
+// in-order little core: a load stalls its first user, so whole blocks are
+// scheduled for it.
+static const TargetTuning arm64_tunings[] = {
+    {"cortex-a76", 4, 32, {
+        [SCHED_ALU] = {1, 3, 1},
+        [SCHED_MUL] = {4, 1, 1},
+        [SCHED_DIV] = {12, 1, 12},
+        [SCHED_LOAD] = {4, 2, 1},
+        [SCHED_STORE] = {4, 2, 1},
+        [SCHED_VECTOR] = {6, 2, 1},
+        [SCHED_BRANCH] = {1, 2, 1},
+    }},
+    {"cortex-a55", 2, 0, {
+        [SCHED_ALU] = {1, 2, 1},
+        [SCHED_MUL] = {4, 1, 1},
+        [SCHED_DIV] = {20, 1, 20},
+        [SCHED_LOAD] = {3, 1, 1},
+        [SCHED_STORE] = {3, 1, 1},
+        [SCHED_VECTOR] = {5, 1, 1},
+        [SCHED_BRANCH] = {1, 1, 1},
+    }},
+};
+
 // Create ARM64 backend
-TargetBackend* create_arm64_backend(void) {
+const TargetBackend* create_arm64_backend(void) {
     TargetBackend* backend = (TargetBackend*)malloc(sizeof(TargetBackend));
     if (!backend) return NULL;
 
@@ -211,48 +495,75 @@ TargetBackend* create_arm64_backend(void) {
     backend->name = "ARM64";
     backend->triple = "aarch64-linux-gnu";
 
-    // Allocate and copy registers
-    backend->registers = (TargetRegister**)malloc(NUM_ARM64_REGISTERS * sizeof(TargetRegister*));
-    for (int i = 0; i < NUM_ARM64_REGISTERS; i++) {
-        backend->registers[i] = &arm64_registers[i];
+    // Allocate and copy registers and instructions
+    const TargetRegister** registers = malloc(NUM_ARM64_REGISTERS * sizeof(const TargetRegister*));
+    const TargetInstruction** instructions =
+        malloc(NUM_ARM64_INSTRUCTIONS * sizeof(TargetInstruction*));
+    if (!registers || !instructions) {
+        free(registers);
+        free(instructions);
+        free(backend);
+        return NULL;
+    }
+    for (int i = 0; i < (int)NUM_ARM64_REGISTERS; i++) {
+        registers[i] = &arm64_registers[i];
+    }
+    for (int i = 0; i < (int)NUM_ARM64_INSTRUCTIONS; i++) {
+        instructions[i] = &arm64_instructions[i];
     }
+    backend->registers = registers;
     backend->num_registers = NUM_ARM64_REGISTERS;
+    backend->scratch_registers[0] = &arm64_registers[16]; // x16 (IP0)
+    backend->scratch_registers[1] = &arm64_registers[17]; // x17 (IP1)
 
-    // Set up calling convention
     backend->calling_convention = &arm64_calling_convention;
-    backend->calling_convention->arg_registers = (TargetRegister**)malloc(
-        backend->calling_convention->num_arg_registers * sizeof(TargetRegister*));
-    for (int i = 0; i < backend->calling_convention->num_arg_registers; i++) {
-        backend->calling_convention->arg_registers[i] = &arm64_registers[i];
-    }
 
-    // Allocate and copy instructions
-    backend->instructions = (TargetInstruction**)malloc(NUM_ARM64_INSTRUCTIONS * sizeof(TargetInstruction*));
-    for (int i = 0; i < NUM_ARM64_INSTRUCTIONS; i++) {
-        backend->instructions[i] = &arm64_instructions[i];
-    }
+    backend->instructions = instructions;
     backend->num_instructions = NUM_ARM64_INSTRUCTIONS;
+    backend->isel_rules = arm64_isel_rules;
+    backend->num_isel_rules = sizeof(arm64_isel_rules) / sizeof(IselRule);
+    backend->tunings = arm64_tunings;
+    backend->num_tunings = sizeof(arm64_tunings) / sizeof(TargetTuning);
 
     // Initialize function pointers
     backend->generate_prologue = arm64_generate_prologue;
     backend->generate_epilogue = arm64_generate_epilogue;
+    backend->generate_leaf_prologue = arm64_generate_leaf_prologue;
+    backend->generate_leaf_epilogue = arm64_generate_leaf_epilogue;
     backend->generate_mov = arm64_generate_mov;
+    backend->generate_mov_imm = arm64_generate_mov_imm;
     backend->generate_add = arm64_generate_add;
     backend->generate_sub = arm64_generate_sub;
     backend->generate_mul = arm64_generate_mul;
     backend->generate_div = arm64_generate_div;
+    backend->generate_add_imm = arm64_generate_add_imm;
+    backend->generate_mul_imm = NULL;
     backend->generate_load = arm64_generate_load;
     backend->generate_store = arm64_generate_store;
+    backend->generate_load_sized = arm64_generate_load_sized;
+    backend->generate_store_sized = arm64_generate_store_sized;
+    backend->generate_load_indexed = arm64_generate_load_indexed;
+    backend->generate_store_pair = arm64_generate_store_pair;
+    backend->generate_load_pair = arm64_generate_load_pair;
     backend->generate_cmp = arm64_generate_cmp;
     backend->generate_jmp = arm64_generate_jmp;
     backend->generate_je = arm64_generate_je;
     backend->generate_jne = arm64_generate_jne;
     backend->generate_jl = arm64_generate_jl;
     backend->generate_jg = arm64_generate_jg;
+    backend->generate_setcc = arm64_generate_setcc;
+    backend->generate_branch = arm64_generate_branch;
+    backend->generate_branch_zero = arm64_generate_branch_zero;
+    backend->generate_select = arm64_generate_select;
+    backend->generate_vzero = NULL;
+    backend->generate_vadd_indexed = NULL;
+    backend->generate_vreduce = NULL;
+    backend->generate_resolver = NULL;
     backend->generate_call = arm64_generate_call;
     backend->generate_ret = arm64_generate_ret;
     backend->generate_label = arm64_generate_label;
     backend->apply_ia_hints = arm64_apply_ia_hints;
+    backend->encoder = &arm64_encoder;
 
     return backend;
 }
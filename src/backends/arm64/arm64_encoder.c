@@ -0,0 +1,352 @@
+// ALETHEIA ARM64 Machine Code Encoder
+// Encodes the instruction sequences the ARM64 text callbacks in
+// arm64_backend.c print, one 32-bit word per instruction. Registers are
+// hardware numbers; 31 is sp as a base or add/sub-immediate operand and
+// xzr everywhere else.
+
+#include "../backend.h"
+
+#define A64_X16 16
+#define A64_X17 17
+#define A64_FP 29
+#define A64_SP 31
+#define A64_XZR 31
+
+// Load/store size and opc fields for each access width
+typedef struct {
+    uint32_t size;
+    uint32_t opc;
+} A64Access;
+
+static uint32_t a64_cc(CompareCondition cond) {
+    switch (cond) {
+        case COND_EQ: return 0x0;
+        case COND_NE: return 0x1;
+        case COND_GE: return 0xA;
+        case COND_LT: return 0xB;
+        case COND_GT: return 0xC;
+        case COND_LE: return 0xD;
+    }
+    return 0x0;
+}
+
+static int a64_width_bytes(MemoryWidth width) {
+    return width == MEM_WORD ? 8 : width == MEM_S8 || width == MEM_U8 ? 1 : 4;
+}
+
+// ldrsw and ldrsb sign-extend into the x register; ldr w and ldrb zero the
+// upper half
+static A64Access a64_load_access(MemoryWidth width) {
+    switch (width) {
+        case MEM_S32: return (A64Access){2, 2};
+        case MEM_U32: return (A64Access){2, 1};
+        case MEM_S8: return (A64Access){0, 2};
+        case MEM_U8: return (A64Access){0, 1};
+        default: return (A64Access){3, 1};
+    }
+}
+
+static A64Access a64_store_access(MemoryWidth width) {
+    switch (width) {
+        case MEM_S32:
+        case MEM_U32: return (A64Access){2, 0};
+        case MEM_S8:
+        case MEM_U8: return (A64Access){0, 0};
+        default: return (A64Access){3, 0};
+    }
+}
+
+static void a64_insn(CodeBuffer* out, uint32_t insn) {
+    mcode_u32(out, insn);
+}
+
+// add/sub (immediate) with a 12-bit unsigned immediate, optionally lsl #12
+static void a64_add_sub_imm(CodeBuffer* out, bool sub, int rd, int rn, uint32_t imm, bool high) {
+    a64_insn(out, (sub ? 0xD1000000u : 0x91000000u) | (high ? 1u << 22 : 0) |
+                  (imm & 0xFFF) << 10 | (uint32_t)rn << 5 | (uint32_t)rd);
+}
+
+// add/sub/subs (shifted register), lsl only
+static void a64_add_sub_reg(CodeBuffer* out, uint32_t base, int rd, int rn, int rm, int shift) {
+    a64_insn(out, base | (uint32_t)rm << 16 | (uint32_t)shift << 10 | (uint32_t)rn << 5 |
+                  (uint32_t)rd);
+}
+
+static void a64_cmp(CodeBuffer* out, int rn, int rm) {
+    a64_add_sub_reg(out, 0xEB000000u, A64_XZR, rn, rm, 0);
+}
+
+static void a64_cmp_zero(CodeBuffer* out, int rn) {
+    a64_insn(out, 0xF1000000u | (uint32_t)rn << 5 | A64_XZR);  // subs xzr, rn, #0
+}
+
+static void a64_mov_wide(CodeBuffer* out, uint32_t opcode, int rd, uint32_t imm16, int shift) {
+    a64_insn(out, opcode | (uint32_t)(shift / 16) << 21 | (imm16 & 0xFFFF) << 5 | (uint32_t)rd);
+}
+
+// Same sequence as arm64_generate_mov_imm: mov (movz or movn) for small
+// values, else movz plus a movk per nonzero halfword
+static void a64_enc_mov_imm(CodeBuffer* out, int dest, long imm) {
+    if (imm >= 0 && imm <= 65535) {
+        a64_mov_wide(out, 0xD2800000u, dest, (uint32_t)imm, 0);
+        return;
+    }
+    if (imm < 0 && imm >= -65536) {
+        a64_mov_wide(out, 0x92800000u, dest, (uint32_t)~imm, 0);
+        return;
+    }
+
+    unsigned long value = (unsigned long)imm;
+    a64_mov_wide(out, 0xD2800000u, dest, (uint32_t)(value & 0xFFFF), 0);
+    for (int shift = 16; shift < 64; shift += 16) {
+        uint32_t chunk = (uint32_t)((value >> shift) & 0xFFFF);
+        if (chunk != 0) a64_mov_wide(out, 0xF2800000u, dest, chunk, shift);
+    }
+}
+
+// mov to or from sp is an add of 0, otherwise an orr with xzr
+static void a64_enc_mov(CodeBuffer* out, int dest, int src) {
+    if (dest == A64_SP || src == A64_SP) {
+        a64_add_sub_imm(out, false, dest, src, 0, false);
+    } else {
+        a64_insn(out, 0xAA0003E0u | (uint32_t)src << 16 | (uint32_t)dest);
+    }
+}
+
+// Same split as arm64_adjust_sp
+static void a64_adjust_sp(CodeBuffer* out, bool sub, int amount) {
+    if (amount >> 12) a64_add_sub_imm(out, sub, A64_SP, A64_SP, (uint32_t)(amount >> 12), true);
+    if (amount & 0xFFF) a64_add_sub_imm(out, sub, A64_SP, A64_SP, (uint32_t)(amount & 0xFFF), false);
+}
+
+static void a64_enc_prologue(CodeBuffer* out, int stack_size) {
+    a64_insn(out, 0xA9BF7BFDu);  // stp x29, x30, [sp, -16]!
+    a64_enc_mov(out, A64_FP, A64_SP);
+    if (stack_size > 0) a64_adjust_sp(out, true, (stack_size + 15) & ~15);
+}
+
+static void a64_enc_epilogue(CodeBuffer* out, int stack_size) {
+    if (stack_size > 0) a64_adjust_sp(out, false, (stack_size + 15) & ~15);
+    a64_insn(out, 0xA8C17BFDu);  // ldp x29, x30, [sp], 16
+    a64_insn(out, 0xD65F03C0u);  // ret
+}
+
+static void a64_enc_leaf_prologue(CodeBuffer* out, int stack_size) {
+    if (stack_size > 0) a64_adjust_sp(out, true, (stack_size + 15) & ~15);
+}
+
+static void a64_enc_leaf_epilogue(CodeBuffer* out, int stack_size) {
+    if (stack_size > 0) a64_adjust_sp(out, false, (stack_size + 15) & ~15);
+    a64_insn(out, 0xD65F03C0u);
+}
+
+static void a64_enc_add(CodeBuffer* out, int dest, int src1, int src2) {
+    a64_add_sub_reg(out, 0x8B000000u, dest, src1, src2, 0);
+}
+
+static void a64_enc_sub(CodeBuffer* out, int dest, int src1, int src2) {
+    a64_add_sub_reg(out, 0xCB000000u, dest, src1, src2, 0);
+}
+
+static void a64_enc_add_imm(CodeBuffer* out, int dest, int src, long imm) {
+    if (imm < 0) a64_add_sub_imm(out, true, dest, src, (uint32_t)-imm, false);
+    else a64_add_sub_imm(out, false, dest, src, (uint32_t)imm, false);
+}
+
+static void a64_enc_mul(CodeBuffer* out, int dest, int src1, int src2) {
+    // madd dest, src1, src2, xzr
+    a64_insn(out, 0x9B007C00u | (uint32_t)src2 << 16 | (uint32_t)src1 << 5 | (uint32_t)dest);
+}
+
+static void a64_enc_div(CodeBuffer* out, int dest, int src1, int src2) {
+    a64_insn(out, 0x9AC00C00u | (uint32_t)src2 << 16 | (uint32_t)src1 << 5 | (uint32_t)dest);
+}
+
+// Forms addr + offset in temp, as arm64_materialize_address does
+static void a64_materialize_address(CodeBuffer* out, int temp, int addr, int offset) {
+    if (offset < 0 && -offset < 4096) {
+        a64_add_sub_imm(out, true, temp, addr, (uint32_t)-offset, false);
+    } else if (offset > 0 && offset < 4096) {
+        a64_add_sub_imm(out, false, temp, addr, (uint32_t)offset, false);
+    } else {
+        a64_enc_mov_imm(out, temp, offset);
+        if (addr == A64_SP) {
+            // The shifted-register form reads 31 as xzr; add temp, sp, temp, uxtx
+            a64_insn(out, 0x8B206000u | (uint32_t)temp << 16 | (uint32_t)addr << 5 | (uint32_t)temp);
+        } else {
+            a64_add_sub_reg(out, 0x8B000000u, temp, addr, temp, 0);
+        }
+    }
+}
+
+// The scaled unsigned-offset form where it fits, as assemblers pick it,
+// else the unscaled signed 9-bit one
+static void a64_access_imm(CodeBuffer* out, A64Access access, int rt, int rn, int offset) {
+    int bytes = 1 << access.size;
+    uint32_t op = access.size << 30 | access.opc << 22 | (uint32_t)rn << 5 | (uint32_t)rt;
+
+    if (offset >= 0 && offset % bytes == 0 && offset / bytes <= 4095) {
+        a64_insn(out, 0x39000000u | op | (uint32_t)(offset / bytes) << 10);
+    } else {
+        a64_insn(out, 0x38000000u | op | ((uint32_t)offset & 0x1FF) << 12);
+    }
+}
+
+static bool a64_offset_encodable(int offset, int bytes) {
+    return (offset >= -256 && offset <= 255) ||
+           (offset >= 0 && offset % bytes == 0 && offset <= 4095 * bytes);
+}
+
+static void a64_enc_load(CodeBuffer* out, MemoryWidth width, int dest, int base, int offset) {
+    A64Access access = a64_load_access(width);
+
+    if (a64_offset_encodable(offset, a64_width_bytes(width))) {
+        a64_access_imm(out, access, dest, base, offset);
+    } else if (dest == base && (offset <= -4096 || offset >= 4096)) {
+        int temp = dest == A64_X17 ? A64_X16 : A64_X17;
+        a64_enc_mov_imm(out, temp, offset);
+        a64_insn(out, 0x38206800u | access.size << 30 | access.opc << 22 | (uint32_t)temp << 16 |
+                      (uint32_t)base << 5 | (uint32_t)dest);
+    } else {
+        a64_materialize_address(out, dest, base, offset);
+        a64_access_imm(out, access, dest, dest, 0);
+    }
+}
+
+static void a64_enc_store(CodeBuffer* out, MemoryWidth width, int src, int base, int offset) {
+    A64Access access = a64_store_access(width);
+
+    if (a64_offset_encodable(offset, a64_width_bytes(width))) {
+        a64_access_imm(out, access, src, base, offset);
+    } else {
+        int temp = src == A64_X17 ? A64_X16 : A64_X17;
+        a64_materialize_address(out, temp, base, offset);
+        a64_access_imm(out, access, src, temp, 0);
+    }
+}
+
+static void a64_enc_load_indexed(CodeBuffer* out, MemoryWidth width, int dest, int base,
+                                 int index, int shift, int offset) {
+    A64Access access = a64_load_access(width);
+    uint32_t op = access.size << 30 | access.opc << 22 | (uint32_t)index << 16 |
+                  (uint32_t)base << 5 | (uint32_t)dest;
+
+    if (offset == 0 && shift == 0) {
+        a64_insn(out, 0x38206800u | op);  // [base, index]
+    } else if (offset == 0 && (1 << shift) == a64_width_bytes(width)) {
+        a64_insn(out, 0x38207800u | op);  // [base, index, lsl #shift]
+    } else {
+        a64_add_sub_reg(out, 0x8B000000u, dest, base, index, shift);
+        a64_enc_load(out, width, dest, dest, offset);
+    }
+}
+
+static bool a64_pair_encodable(int offset) {
+    return offset >= -512 && offset <= 504 && offset % 8 == 0;
+}
+
+// stp/ldp with a signed offset, through x16 as arm64_generate_pair does
+static void a64_pair(CodeBuffer* out, uint32_t opcode, int first, int second, int base, int offset) {
+    if (!a64_pair_encodable(offset)) {
+        a64_materialize_address(out, A64_X16, base, offset);
+        base = A64_X16;
+        offset = 0;
+    }
+    a64_insn(out, opcode | ((uint32_t)(offset / 8) & 0x7F) << 15 | (uint32_t)second << 10 |
+                  (uint32_t)base << 5 | (uint32_t)first);
+}
+
+static void a64_enc_store_pair(CodeBuffer* out, int first, int second, int base, int offset) {
+    a64_pair(out, 0xA9000000u, first, second, base, offset);
+}
+
+static void a64_enc_load_pair(CodeBuffer* out, int first, int second, int base, int offset) {
+    a64_pair(out, 0xA9400000u, first, second, base, offset);
+}
+
+// cset dest, cond is csinc dest, xzr, xzr with the inverted condition
+static void a64_enc_setcc(CodeBuffer* out, CompareCondition cond, int dest, int op1, int op2) {
+    a64_cmp(out, op1, op2);
+    a64_insn(out, 0x9A9F07E0u | (a64_cc(cond) ^ 1) << 12 | (uint32_t)dest);
+}
+
+static void a64_bcond(CodeBuffer* out, CompareCondition cond, int label) {
+    mcode_insn_label(out, 0x54000000u | a64_cc(cond), MCODE_A64_BRANCH19, label);
+}
+
+static void a64_enc_branch(CodeBuffer* out, CompareCondition cond, int op1, int op2, int label) {
+    a64_cmp(out, op1, op2);
+    a64_bcond(out, cond, label);
+}
+
+// cbz/cbnz for equality, a test of the sign bit for lt/ge
+static void a64_enc_branch_zero(CodeBuffer* out, CompareCondition cond, int op, int label) {
+    switch (cond) {
+        case COND_EQ:
+            mcode_insn_label(out, 0xB4000000u | (uint32_t)op, MCODE_A64_BRANCH19, label);
+            break;
+        case COND_NE:
+            mcode_insn_label(out, 0xB5000000u | (uint32_t)op, MCODE_A64_BRANCH19, label);
+            break;
+        case COND_LT:
+            mcode_insn_label(out, 0xB7F80000u | (uint32_t)op, MCODE_A64_BRANCH14, label);
+            break;
+        case COND_GE:
+            mcode_insn_label(out, 0xB6F80000u | (uint32_t)op, MCODE_A64_BRANCH14, label);
+            break;
+        default:
+            a64_cmp_zero(out, op);
+            a64_bcond(out, cond, label);
+            break;
+    }
+}
+
+static void a64_enc_select(CodeBuffer* out, CompareCondition cond, int dest, int op1, int op2,
+                           int if_true, int if_false) {
+    if (op2 >= 0) a64_cmp(out, op1, op2);
+    else a64_cmp_zero(out, op1);
+    a64_insn(out, 0x9A800000u | (uint32_t)if_false << 16 | a64_cc(cond) << 12 |
+                  (uint32_t)if_true << 5 | (uint32_t)dest);
+}
+
+static void a64_enc_jmp(CodeBuffer* out, int label) {
+    mcode_insn_label(out, 0x14000000u, MCODE_A64_BRANCH26, label);
+}
+
+static void a64_enc_call(CodeBuffer* out, const char* function) {
+    mcode_insn_symbol(out, 0x94000000u, MCODE_A64_BRANCH26, function);
+}
+
+// Linux exit(2): the callee's return value is already in x0
+static void a64_enc_start(CodeBuffer* out, const char* function) {
+    a64_enc_call(out, function);
+    a64_enc_mov_imm(out, 8, 93);
+    a64_insn(out, 0xD4000001u);  // svc #0
+}
+
+const MachineEncoder arm64_encoder = {
+    .prologue = a64_enc_prologue,
+    .epilogue = a64_enc_epilogue,
+    .leaf_prologue = a64_enc_leaf_prologue,
+    .leaf_epilogue = a64_enc_leaf_epilogue,
+    .mov = a64_enc_mov,
+    .mov_imm = a64_enc_mov_imm,
+    .add = a64_enc_add,
+    .sub = a64_enc_sub,
+    .mul = a64_enc_mul,
+    .div = a64_enc_div,
+    .add_imm = a64_enc_add_imm,
+    .mul_imm = NULL,
+    .load = a64_enc_load,
+    .store = a64_enc_store,
+    .load_indexed = a64_enc_load_indexed,
+    .store_pair = a64_enc_store_pair,
+    .load_pair = a64_enc_load_pair,
+    .setcc = a64_enc_setcc,
+    .branch = a64_enc_branch,
+    .branch_zero = a64_enc_branch_zero,
+    .select = a64_enc_select,
+    .jmp = a64_enc_jmp,
+    .call = a64_enc_call,
+    .start = a64_enc_start,
+};
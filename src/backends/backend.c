@@ -2,40 +2,91 @@
 // Architecture-independent code generation system
 
 #include "backend.h"
+#include "isel.h"
 #include <stdarg.h>
 #include <string.h>
 #include <assert.h>
 #include <stdlib.h>
+#include <pthread.h>
 
-// Global current backend
-static TargetBackend* backends[3] = {NULL, NULL, NULL};
-TargetBackend* current_backend = NULL;
-
-// Forward declarations for backend creation functions
-TargetBackend* create_x86_64_backend(void);
-TargetBackend* create_arm64_backend(void);
-TargetBackend* create_riscv64_backend(void);
-
-// Backend management
-void set_current_backend(TargetArch arch) {
-    if (!backends[arch]) {
-        switch (arch) {
-            case TARGET_X86_64:
-                backends[arch] = create_x86_64_backend();
-                break;
-            case TARGET_ARM64:
-                backends[arch] = create_arm64_backend();
-                break;
-            case TARGET_RISCV64:
-                backends[arch] = create_riscv64_backend();
-                break;
-        }
+// Shared descriptors, each built by the first get_target_backend call for
+// its target and never written again
+static const TargetBackend* backends[3];
+static pthread_once_t backends_once[3] = {PTHREAD_ONCE_INIT, PTHREAD_ONCE_INIT,
+                                          PTHREAD_ONCE_INIT};
+
+static void build_x86_64_backend(void) {
+    backends[TARGET_X86_64] = create_x86_64_backend();
+}
+
+static void build_arm64_backend(void) {
+    backends[TARGET_ARM64] = create_arm64_backend();
+}
+
+static void build_riscv64_backend(void) {
+    backends[TARGET_RISCV64] = create_riscv64_backend();
+}
+
+const TargetBackend* get_target_backend(TargetArch arch) {
+    switch (arch) {
+        case TARGET_X86_64:
+            pthread_once(&backends_once[arch], build_x86_64_backend);
+            break;
+        case TARGET_ARM64:
+            pthread_once(&backends_once[arch], build_arm64_backend);
+            break;
+        case TARGET_RISCV64:
+            pthread_once(&backends_once[arch], build_riscv64_backend);
+            break;
+        default:
+            return NULL;
+    }
+    return backends[arch];
+}
+
+// Widest vector the features allow, 0 where loops are not vectorized
+int target_vector_bits(const TargetBackend* backend, uint32_t features) {
+    if (!backend || backend->arch != TARGET_X86_64) return 0;
+    if (features & TARGET_FEATURE_AVX512F) return 512;
+    if (features & TARGET_FEATURE_AVX2) return 256;
+    return 128;  // SSE2 is part of the x86-64 baseline
+}
+
+// Features a target_clones entry names; "default" is the baseline. False
+// for names the target does not know.
+bool target_clone_features(const TargetBackend* backend, const char* name, uint32_t* features) {
+    if (strcmp(name, "default") == 0) {
+        *features = 0;
+        return true;
     }
-    current_backend = backends[arch];
+    if (!backend || backend->arch != TARGET_X86_64) return false;
+    if (strcmp(name, "avx2") == 0) {
+        *features = TARGET_FEATURE_AVX2;
+        return true;
+    }
+    if (strcmp(name, "avx512f") == 0) {
+        *features = TARGET_FEATURE_AVX512F | TARGET_FEATURE_AVX2;
+        return true;
+    }
+    return false;
 }
 
-TargetBackend* get_current_backend(void) {
-    return current_backend;
+// The cost model -mtune names; "generic" or NULL is the target's default.
+// NULL for cores the target has no model of.
+const TargetTuning* target_find_tuning(const TargetBackend* backend, const char* name) {
+    if (!backend || backend->num_tunings == 0) return NULL;
+    if (!name || strcmp(name, "generic") == 0) return &backend->tunings[0];
+    for (int i = 0; i < backend->num_tunings; i++) {
+        if (strcmp(backend->tunings[i].name, name) == 0) return &backend->tunings[i];
+    }
+    return NULL;
+}
+
+int find_backend_register(const TargetBackend* backend, const char* name) {
+    for (int i = 0; i < backend->num_registers; i++) {
+        if (strcmp(backend->registers[i]->name, name) == 0) return i;
+    }
+    return -1;
 }
 
 // Architecture detection
@@ -71,24 +122,27 @@ const char* get_architecture_triple(TargetArch arch) {
 }
 
 // Code generation helpers
-void emit_instruction(FILE* out, const char* format, ...) {
+void emit_instruction(EmitBuffer* out, const char* format, ...) {
     va_list args;
     va_start(args, format);
-    vfprintf(out, format, args);
+    emit_vformat(out, format, args);
     va_end(args);
-    fprintf(out, "\n");
+    emit_char(out, '\n');
 }
 
-void emit_label(FILE* out, const char* label) {
-    fprintf(out, "%s:\n", label);
+void emit_label(EmitBuffer* out, const char* label) {
+    emit_put(out, label);
+    emit_putn(out, ":\n", 2);
 }
 
-void emit_comment(FILE* out, const char* comment) {
-    fprintf(out, ";; %s\n", comment);
+void emit_comment(EmitBuffer* out, const char* comment) {
+    emit_putn(out, ";; ", 3);
+    emit_put(out, comment);
+    emit_char(out, '\n');
 }
 
 // IA-aware code generation
-void generate_ia_optimized_code(TargetBackend* backend, FILE* out,
+void generate_ia_optimized_code(const TargetBackend* backend, EmitBuffer* out,
                                const char* optimization_type,
                                const char* code_pattern) {
     if (!backend || !backend->apply_ia_hints) {
@@ -101,11 +155,68 @@ void generate_ia_optimized_code(TargetBackend* backend, FILE* out,
 
     // Emit optimized code pattern
     emit_comment(out, "IA-optimized code pattern applied");
-    fprintf(out, "%s", code_pattern);
+    emit_put(out, code_pattern);
 }
 
+// x86-64 registers, numbered by their hardware encoding
+static const TargetRegister x86_64_registers[] = {
+    {"rax", REG_CLASS_GP, 0, false, true},   // Return value, implicit in div/setcc
+    {"rcx", REG_CLASS_GP, 1, false, false},  // Argument register
+    {"rdx", REG_CLASS_GP, 2, false, true},   // Argument register, implicit in div
+    {"rbx", REG_CLASS_GP, 3, true, false},   // Callee-saved
+    {"rsp", REG_CLASS_SP, 4, true, true},    // Stack pointer
+    {"rbp", REG_CLASS_GP, 5, true, true},    // Frame pointer
+    {"rsi", REG_CLASS_GP, 6, false, false},  // Argument register
+    {"rdi", REG_CLASS_GP, 7, false, false},  // Argument register
+    {"r8", REG_CLASS_GP, 8, false, false},   // Argument register
+    {"r9", REG_CLASS_GP, 9, false, false},   // Argument register
+    {"r10", REG_CLASS_GP, 10, false, true},  // Spill scratch
+    {"r11", REG_CLASS_GP, 11, false, true},  // Spill scratch
+    {"r12", REG_CLASS_GP, 12, true, false},  // Callee-saved
+    {"r13", REG_CLASS_GP, 13, true, false},  // Callee-saved
+    {"r14", REG_CLASS_GP, 14, true, false},  // Callee-saved
+    {"r15", REG_CLASS_GP, 15, true, false},  // Callee-saved
+    // Vector registers, named by their 128-bit view; all caller-saved
+    {"xmm0", REG_CLASS_VEC, 0, false, false},
+    {"xmm1", REG_CLASS_VEC, 1, false, false},
+    {"xmm2", REG_CLASS_VEC, 2, false, false},
+    {"xmm3", REG_CLASS_VEC, 3, false, false},
+    {"xmm4", REG_CLASS_VEC, 4, false, false},
+    {"xmm5", REG_CLASS_VEC, 5, false, false},
+    {"xmm6", REG_CLASS_VEC, 6, false, false},
+    {"xmm7", REG_CLASS_VEC, 7, false, false},
+    {"xmm8", REG_CLASS_VEC, 8, false, false},
+    {"xmm9", REG_CLASS_VEC, 9, false, false},
+    {"xmm10", REG_CLASS_VEC, 10, false, false},
+    {"xmm11", REG_CLASS_VEC, 11, false, false},
+    {"xmm12", REG_CLASS_VEC, 12, false, false},
+    {"xmm13", REG_CLASS_VEC, 13, false, false},
+    {"xmm14", REG_CLASS_VEC, 14, false, false},
+    {"xmm15", REG_CLASS_VEC, 15, false, true},  // Vector scratch
+};
+
+#define NUM_X86_64_REGISTERS (sizeof(x86_64_registers) / sizeof(TargetRegister))
+
+// System V AMD64 calling convention
+static const TargetRegister* const x86_64_arg_registers[] = {
+    &x86_64_registers[7], &x86_64_registers[6], &x86_64_registers[2], // rdi, rsi, rdx
+    &x86_64_registers[1], &x86_64_registers[8], &x86_64_registers[9], // rcx, r8, r9
+};
+
+static const CallingConvention x86_64_calling_convention = {
+    .arg_registers = x86_64_arg_registers,
+    .num_arg_registers = 6,
+    .return_register = &x86_64_registers[0], // rax
+    .stack_pointer = &x86_64_registers[4],   // rsp
+    .frame_pointer = &x86_64_registers[5],   // rbp
+    .locals_offset = 0,
+    .red_zone_size = 128,   // System V
+    .stack_alignment = 16,
+    .caller_cleanup = true
+};
+
 // Placeholder implementations for x86-64 backend (existing functionality)
-static void x86_64_generate_prologue(FILE* out, int stack_size) {
+static void x86_64_generate_prologue(EmitBuffer* out, int stack_size) {
     emit_instruction(out, "push rbp");
     emit_instruction(out, "mov rbp, rsp");
     if (stack_size > 0) {
@@ -113,7 +224,7 @@ static void x86_64_generate_prologue(FILE* out, int stack_size) {
     }
 }
 
-static void x86_64_generate_epilogue(FILE* out, int stack_size) {
+static void x86_64_generate_epilogue(EmitBuffer* out, int stack_size) {
     if (stack_size > 0) {
         emit_instruction(out, "add rsp, %d", stack_size);
     }
@@ -121,86 +232,415 @@ static void x86_64_generate_epilogue(FILE* out, int stack_size) {
     emit_instruction(out, "ret");
 }
 
-static void x86_64_generate_mov(FILE* out, const char* dest, const char* src) {
+static void x86_64_generate_leaf_prologue(EmitBuffer* out, int stack_size) {
+    if (stack_size > 0) {
+        emit_instruction(out, "sub rsp, %d", stack_size);
+    }
+}
+
+static void x86_64_generate_leaf_epilogue(EmitBuffer* out, int stack_size) {
+    if (stack_size > 0) {
+        emit_instruction(out, "add rsp, %d", stack_size);
+    }
+    emit_instruction(out, "ret");
+}
+
+static void x86_64_generate_mov(EmitBuffer* out, const char* dest, const char* src) {
     emit_instruction(out, "mov %s, %s", dest, src);
 }
 
-static void x86_64_generate_add(FILE* out, const char* dest, const char* src1, const char* src2) {
-    emit_instruction(out, "mov %s, %s", dest, src1);
+static void x86_64_generate_mov_imm(EmitBuffer* out, const char* dest, long imm) {
+    emit_instruction(out, "mov %s, %ld", dest, imm);
+}
+
+// Two-address forms: dest may alias either source after register allocation
+static void x86_64_generate_add(EmitBuffer* out, const char* dest, const char* src1, const char* src2) {
+    if (strcmp(dest, src2) == 0) {
+        emit_instruction(out, "add %s, %s", dest, src1);
+        return;
+    }
+    if (strcmp(dest, src1) != 0) emit_instruction(out, "mov %s, %s", dest, src1);
     emit_instruction(out, "add %s, %s", dest, src2);
 }
 
-static void x86_64_generate_sub(FILE* out, const char* dest, const char* src1, const char* src2) {
-    emit_instruction(out, "mov %s, %s", dest, src1);
+static void x86_64_generate_sub(EmitBuffer* out, const char* dest, const char* src1, const char* src2) {
+    if (strcmp(dest, src2) == 0 && strcmp(dest, src1) != 0) {
+        emit_instruction(out, "neg %s", dest);
+        emit_instruction(out, "add %s, %s", dest, src1);
+        return;
+    }
+    if (strcmp(dest, src1) != 0) emit_instruction(out, "mov %s, %s", dest, src1);
     emit_instruction(out, "sub %s, %s", dest, src2);
 }
 
-static void x86_64_generate_mul(FILE* out, const char* dest, const char* src1, const char* src2) {
-    emit_instruction(out, "mov rax, %s", src1);
-    emit_instruction(out, "imul %s", src2);
-    emit_instruction(out, "mov %s, rax", dest);
+static void x86_64_generate_mul(EmitBuffer* out, const char* dest, const char* src1, const char* src2) {
+    if (strcmp(dest, src2) == 0) {
+        emit_instruction(out, "imul %s, %s", dest, src1);
+        return;
+    }
+    if (strcmp(dest, src1) != 0) emit_instruction(out, "mov %s, %s", dest, src1);
+    emit_instruction(out, "imul %s, %s", dest, src2);
 }
 
-static void x86_64_generate_div(FILE* out, const char* dest, const char* src1, const char* src2) {
+static void x86_64_generate_div(EmitBuffer* out, const char* dest, const char* src1, const char* src2) {
     emit_instruction(out, "mov rax, %s", src1);
     emit_instruction(out, "cqo");
     emit_instruction(out, "idiv %s", src2);
     emit_instruction(out, "mov %s, rax", dest);
 }
 
-static void x86_64_generate_load(FILE* out, const char* dest, const char* addr, int offset) {
-    if (offset == 0) {
-        emit_instruction(out, "mov %s, [%s]", dest, addr);
-    } else {
-        emit_instruction(out, "mov %s, [%s + %d]", dest, addr, offset);
+// 32-bit and low-byte views of each register, by hardware encoding
+static const char* x86_64_dword_names[16] = {
+    "eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
+    "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"
+};
+static const char* x86_64_byte_names[16] = {
+    "al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil",
+    "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b"
+};
+
+static const char* x86_64_narrow_name(const char* reg, MemoryWidth width) {
+    for (size_t i = 0; i < NUM_X86_64_REGISTERS; i++) {
+        if (strcmp(x86_64_registers[i].name, reg) != 0) continue;
+        int number = x86_64_registers[i].number;
+        if (width == MEM_S8 || width == MEM_U8) return x86_64_byte_names[number];
+        if (width == MEM_S32 || width == MEM_U32) return x86_64_dword_names[number];
+        break;
     }
+    return reg;
 }
 
-static void x86_64_generate_store(FILE* out, const char* src, const char* addr, int offset) {
+static void x86_64_format_address(char* buffer, size_t size, const char* addr, int offset) {
     if (offset == 0) {
-        emit_instruction(out, "mov [%s], %s", addr, src);
+        snprintf(buffer, size, "[%s]", addr);
+    } else if (offset < 0) {
+        snprintf(buffer, size, "[%s - %d]", addr, -offset);
     } else {
-        emit_instruction(out, "mov [%s + %d], %s", addr, src, offset);
+        snprintf(buffer, size, "[%s + %d]", addr, offset);
+    }
+}
+
+// add in place, otherwise lea as a three-address add that leaves the flags
+static void x86_64_generate_add_imm(EmitBuffer* out, const char* dest, const char* src, long imm) {
+    char mem[64];
+
+    if (strcmp(dest, src) == 0) {
+        emit_instruction(out, "add %s, %ld", dest, imm);
+        return;
     }
+    x86_64_format_address(mem, sizeof(mem), src, (int)imm);
+    emit_instruction(out, "lea %s, %s", dest, mem);
 }
 
-static void x86_64_generate_cmp(FILE* out, const char* op1, const char* op2) {
+static void x86_64_generate_mul_imm(EmitBuffer* out, const char* dest, const char* src, long imm) {
+    emit_instruction(out, "imul %s, %s, %ld", dest, src, imm);
+}
+
+// int loads zero-extend for free through the 32-bit register; signed ones
+// need movsxd. Byte loads go through movsx/movzx.
+static void x86_64_generate_load_sized(EmitBuffer* out, MemoryWidth width, const char* dest,
+                                       const char* addr, int offset) {
+    char mem[64];
+    x86_64_format_address(mem, sizeof(mem), addr, offset);
+
+    switch (width) {
+        case MEM_S32:
+            emit_instruction(out, "movsxd %s, dword ptr %s", dest, mem);
+            break;
+        case MEM_U32:
+            emit_instruction(out, "mov %s, dword ptr %s", x86_64_narrow_name(dest, width), mem);
+            break;
+        case MEM_S8:
+            emit_instruction(out, "movsx %s, byte ptr %s", dest, mem);
+            break;
+        case MEM_U8:
+            emit_instruction(out, "movzx %s, byte ptr %s", x86_64_narrow_name(dest, MEM_U32), mem);
+            break;
+        default:
+            emit_instruction(out, "mov %s, %s", dest, mem);
+            break;
+    }
+}
+
+static void x86_64_generate_store_sized(EmitBuffer* out, MemoryWidth width, const char* src,
+                                        const char* addr, int offset) {
+    char mem[64];
+    x86_64_format_address(mem, sizeof(mem), addr, offset);
+
+    switch (width) {
+        case MEM_S32:
+        case MEM_U32:
+            emit_instruction(out, "mov dword ptr %s, %s", mem, x86_64_narrow_name(src, width));
+            break;
+        case MEM_S8:
+        case MEM_U8:
+            emit_instruction(out, "mov byte ptr %s, %s", mem, x86_64_narrow_name(src, width));
+            break;
+        default:
+            emit_instruction(out, "mov %s, %s", mem, src);
+            break;
+    }
+}
+
+// base + index*scale + disp is a single SIB operand on every load form
+static void x86_64_generate_load_indexed(EmitBuffer* out, MemoryWidth width, const char* dest,
+                                         const char* base, const char* index, int shift,
+                                         int offset) {
+    char mem[64];
+    char sib[32];
+    snprintf(sib, sizeof(sib), "%s + %s*%d", base, index, 1 << shift);
+    x86_64_format_address(mem, sizeof(mem), sib, offset);
+
+    switch (width) {
+        case MEM_S32:
+            emit_instruction(out, "movsxd %s, dword ptr %s", dest, mem);
+            break;
+        case MEM_U32:
+            emit_instruction(out, "mov %s, dword ptr %s", x86_64_narrow_name(dest, width), mem);
+            break;
+        case MEM_S8:
+            emit_instruction(out, "movsx %s, byte ptr %s", dest, mem);
+            break;
+        case MEM_U8:
+            emit_instruction(out, "movzx %s, byte ptr %s", x86_64_narrow_name(dest, MEM_U32), mem);
+            break;
+        default:
+            emit_instruction(out, "mov %s, %s", dest, mem);
+            break;
+    }
+}
+
+static void x86_64_generate_load(EmitBuffer* out, const char* dest, const char* addr, int offset) {
+    x86_64_generate_load_sized(out, MEM_WORD, dest, addr, offset);
+}
+
+static void x86_64_generate_store(EmitBuffer* out, const char* src, const char* addr, int offset) {
+    x86_64_generate_store_sized(out, MEM_WORD, src, addr, offset);
+}
+
+static void x86_64_generate_cmp(EmitBuffer* out, const char* op1, const char* op2) {
     emit_instruction(out, "cmp %s, %s", op1, op2);
 }
 
-static void x86_64_generate_jmp(FILE* out, const char* label) {
+static void x86_64_generate_jmp(EmitBuffer* out, const char* label) {
     emit_instruction(out, "jmp %s", label);
 }
 
-static void x86_64_generate_je(FILE* out, const char* label) {
+static void x86_64_generate_je(EmitBuffer* out, const char* label) {
     emit_instruction(out, "je %s", label);
 }
 
-static void x86_64_generate_jne(FILE* out, const char* label) {
+static void x86_64_generate_jne(EmitBuffer* out, const char* label) {
     emit_instruction(out, "jne %s", label);
 }
 
-static void x86_64_generate_jl(FILE* out, const char* label) {
+static void x86_64_generate_jl(EmitBuffer* out, const char* label) {
     emit_instruction(out, "jl %s", label);
 }
 
-static void x86_64_generate_jg(FILE* out, const char* label) {
+static void x86_64_generate_jg(EmitBuffer* out, const char* label) {
     emit_instruction(out, "jg %s", label);
 }
 
-static void x86_64_generate_call(FILE* out, const char* function) {
+static const char* x86_64_condition_suffix(CompareCondition cond) {
+    switch (cond) {
+        case COND_EQ: return "e";
+        case COND_NE: return "ne";
+        case COND_LT: return "l";
+        case COND_LE: return "le";
+        case COND_GT: return "g";
+        case COND_GE: return "ge";
+    }
+    return "e";
+}
+
+static const char* x86_64_inverse_suffix(CompareCondition cond) {
+    switch (cond) {
+        case COND_EQ: return "ne";
+        case COND_NE: return "e";
+        case COND_LT: return "ge";
+        case COND_LE: return "g";
+        case COND_GT: return "le";
+        case COND_GE: return "l";
+    }
+    return "ne";
+}
+
+static void x86_64_generate_setcc(EmitBuffer* out, CompareCondition cond, const char* dest,
+                                  const char* op1, const char* op2) {
+    emit_instruction(out, "cmp %s, %s", op1, op2);
+    emit_instruction(out, "set%s al", x86_64_condition_suffix(cond));
+    emit_instruction(out, "movzx %s, al", dest);
+}
+
+static void x86_64_generate_branch(EmitBuffer* out, CompareCondition cond, const char* op1,
+                                   const char* op2, const char* label) {
+    emit_instruction(out, "cmp %s, %s", op1, op2);
+    emit_instruction(out, "j%s %s", x86_64_condition_suffix(cond), label);
+}
+
+// test sets the same flags as cmp against zero and has a shorter encoding
+static void x86_64_generate_branch_zero(EmitBuffer* out, CompareCondition cond, const char* op,
+                                        const char* label) {
+    emit_instruction(out, "test %s, %s", op, op);
+    emit_instruction(out, "j%s %s", x86_64_condition_suffix(cond), label);
+}
+
+// mov leaves the flags alone, so the false value can be placed after the
+// compare; when dest already holds the true value, select on the inverse
+static void x86_64_generate_select(EmitBuffer* out, CompareCondition cond, const char* dest,
+                                   const char* op1, const char* op2,
+                                   const char* if_true, const char* if_false) {
+    if (op2) {
+        emit_instruction(out, "cmp %s, %s", op1, op2);
+    } else {
+        emit_instruction(out, "test %s, %s", op1, op1);
+    }
+    if (strcmp(dest, if_true) == 0) {
+        if (strcmp(dest, if_false) != 0) {
+            emit_instruction(out, "cmov%s %s, %s", x86_64_inverse_suffix(cond), dest, if_false);
+        }
+        return;
+    }
+    if (strcmp(dest, if_false) != 0) emit_instruction(out, "mov %s, %s", dest, if_false);
+    emit_instruction(out, "cmov%s %s, %s", x86_64_condition_suffix(cond), dest, if_true);
+}
+
+// xmm, ymm or zmm view of a vector register for a `bits`-wide operation
+static const char* x86_64_vector_name(char* buffer, size_t size, const char* reg, int bits) {
+    char prefix = bits == 512 ? 'z' : bits == 256 ? 'y' : 'x';
+    snprintf(buffer, size, "%cmm%s", prefix, reg + 3);
+    return buffer;
+}
+
+// SSE2 forms at 128 bits; VEX and EVEX three-operand forms above, where the
+// 128-bit vpxor also clears the upper lanes
+static void x86_64_generate_vzero(EmitBuffer* out, int bits, const char* dest) {
+    if (bits == 128) emit_instruction(out, "pxor %s, %s", dest, dest);
+    else emit_instruction(out, "vpxor %s, %s, %s", dest, dest, dest);
+}
+
+// SSE2 arithmetic needs aligned memory operands, so unaligned elements go
+// through xmm15 first
+static void x86_64_generate_vadd_indexed(EmitBuffer* out, int bits, bool subtract,
+                                         const char* dest, const char* base, const char* index,
+                                         int shift, int offset) {
+    char mem[64];
+    char sib[32];
+    char vec[8];
+    const char* op = subtract ? "psubq" : "paddq";
+    snprintf(sib, sizeof(sib), "%s + %s*%d", base, index, 1 << shift);
+    x86_64_format_address(mem, sizeof(mem), sib, offset);
+
+    if (bits == 128) {
+        emit_instruction(out, "movdqu xmm15, xmmword ptr %s", mem);
+        emit_instruction(out, "%s %s, xmm15", op, dest);
+        return;
+    }
+    x86_64_vector_name(vec, sizeof(vec), dest, bits);
+    emit_instruction(out, "v%s %s, %s, %s %s", op, vec, vec,
+                     bits == 512 ? "zmmword ptr" : "ymmword ptr", mem);
+}
+
+// Halves the vector until one lane is left, then leaves the AVX state clean
+// for SSE code the caller may run. The scratch goes first in vpaddq, which
+// keeps it out of ModRM.rm and the VEX prefix in its two-byte form.
+static void x86_64_generate_vreduce(EmitBuffer* out, int bits, const char* dest, const char* src) {
+    char wide[8];
+    char half[8];
+
+    if (bits == 128) {
+        emit_instruction(out, "pshufd xmm15, %s, 78", src);
+        emit_instruction(out, "paddq %s, xmm15", src);
+        emit_instruction(out, "movq %s, %s", dest, src);
+        return;
+    }
+    x86_64_vector_name(half, sizeof(half), src, 256);
+    if (bits == 512) {
+        x86_64_vector_name(wide, sizeof(wide), src, 512);
+        emit_instruction(out, "vextracti64x4 ymm15, %s, 1", wide);
+        emit_instruction(out, "vpaddq %s, ymm15, %s", half, half);
+    }
+    emit_instruction(out, "vextracti128 xmm15, %s, 1", half);
+    emit_instruction(out, "vpaddq %s, xmm15, %s", src, src);
+    emit_instruction(out, "vpshufd xmm15, %s, 78", src);
+    emit_instruction(out, "vpaddq %s, xmm15, %s", src, src);
+    emit_instruction(out, "vmovq %s, %s", dest, src);
+    emit_instruction(out, "vzeroupper");
+}
+
+// CPUID dispatch. r8d collects the TARGET_FEATURE_* bits the CPU and OS
+// support: AVX state needs OSXSAVE and AVX (leaf 1) plus the XMM/YMM bits
+// of XCR0, AVX-512 additionally the opmask and ZMM bits. rbx is the only
+// callee-saved register cpuid writes.
+static void x86_64_generate_resolver(EmitBuffer* out, const char* name, const char* const* clones,
+                                     const uint32_t* features, int count) {
+    char label[160];
+
+    emit_instruction(out, "push rbx");
+    emit_instruction(out, "xor r8d, r8d");
+    emit_instruction(out, "xor eax, eax");
+    emit_instruction(out, "cpuid");
+    emit_instruction(out, "cmp eax, 7");
+    emit_instruction(out, "jl .L%s_pick", name);
+    emit_instruction(out, "mov eax, 1");
+    emit_instruction(out, "cpuid");
+    emit_instruction(out, "and ecx, %d", 0x18000000);
+    emit_instruction(out, "cmp ecx, %d", 0x18000000);
+    emit_instruction(out, "jne .L%s_pick", name);
+    emit_instruction(out, "xor ecx, ecx");
+    emit_instruction(out, "xgetbv");
+    emit_instruction(out, "mov r9d, eax");
+    emit_instruction(out, "mov eax, 7");
+    emit_instruction(out, "xor ecx, ecx");
+    emit_instruction(out, "cpuid");
+    emit_instruction(out, "mov eax, r9d");
+    emit_instruction(out, "and eax, 6");
+    emit_instruction(out, "cmp eax, 6");
+    emit_instruction(out, "jne .L%s_pick", name);
+    emit_instruction(out, "test ebx, 32");
+    emit_instruction(out, "je .L%s_avx512", name);
+    emit_instruction(out, "or r8d, %u", TARGET_FEATURE_AVX2);
+    snprintf(label, sizeof(label), ".L%s_avx512", name);
+    emit_label(out, label);
+    emit_instruction(out, "and r9d, 230");
+    emit_instruction(out, "cmp r9d, 230");
+    emit_instruction(out, "jne .L%s_pick", name);
+    emit_instruction(out, "test ebx, 65536");
+    emit_instruction(out, "je .L%s_pick", name);
+    emit_instruction(out, "or r8d, %u", TARGET_FEATURE_AVX512F);
+    snprintf(label, sizeof(label), ".L%s_pick", name);
+    emit_label(out, label);
+    emit_instruction(out, "pop rbx");
+    for (int i = 0; i < count; i++) {
+        if (i + 1 < count) {
+            emit_instruction(out, "mov eax, r8d");
+            emit_instruction(out, "and eax, %u", features[i]);
+            emit_instruction(out, "cmp eax, %u", features[i]);
+            emit_instruction(out, "jne .L%s_%d", name, i + 1);
+        }
+        emit_instruction(out, "lea rax, [rip + %s]", clones[i]);
+        emit_instruction(out, "ret");
+        if (i + 1 < count) {
+            snprintf(label, sizeof(label), ".L%s_%d", name, i + 1);
+            emit_label(out, label);
+        }
+    }
+}
+
+static void x86_64_generate_call(EmitBuffer* out, const char* function) {
     emit_instruction(out, "call %s", function);
 }
 
-static void x86_64_generate_ret(FILE* out) {
+static void x86_64_generate_ret(EmitBuffer* out) {
     emit_instruction(out, "ret");
 }
 
-static void x86_64_generate_label(FILE* out, const char* label) {
+static void x86_64_generate_label(EmitBuffer* out, const char* label) {
     emit_label(out, label);
 }
 
-static void x86_64_apply_ia_hints(FILE* out, const char* optimization_type) {
+static void x86_64_apply_ia_hints(EmitBuffer* out, const char* optimization_type) {
     if (strcmp(optimization_type, "loop_unroll") == 0) {
         emit_comment(out, "IA: Loop unrolling optimization hint");
     } else if (strcmp(optimization_type, "vectorize") == 0) {
@@ -212,8 +652,59 @@ static void x86_64_apply_ia_hints(FILE* out, const char* optimization_type) {
     }
 }
 
+// x86-64 selection rules. Costs are latencies in cycles on a recent core:
+// immediates and displacements are free, an index register adds a cycle to
+// the 4-cycle L1 load, and cmp+jcc fuse into one branch. Displacements stop
+// short of INT_MIN, which the printed [reg - disp] form cannot spell.
+static const IselRule x86_64_isel_rules[] = {
+    ISEL_LEAF(ISEL_NT_REG, ISEL_CONST, 1, ISEL_ACT_MOV_IMM),
+    ISEL_LEAF(ISEL_NT_REG, ISEL_VREG, 0, ISEL_ACT_VREG),
+    ISEL_LEAF(ISEL_NT_REG, ISEL_SLOT, 4, ISEL_ACT_LOAD_SLOT),
+    ISEL_IMM(ISEL_NT_ADDIMM, -INT_MAX, INT_MAX),         // add r, simm32 / lea
+    ISEL_IMM(ISEL_NT_SUBIMM, -INT_MAX, INT_MAX),
+    ISEL_IMM(ISEL_NT_MULIMM, INT_MIN, INT_MAX),          // imul r, r, simm32
+    ISEL_IMM(ISEL_NT_ZERO, 0, 0),
+    ISEL_IMM(ISEL_NT_SCALE, 0, 3),                      // SIB scale 1, 2, 4, 8
+    ISEL_IMM(ISEL_NT_DISP, -INT_MAX, INT_MAX),           // disp32
+    ISEL_RULE(ISEL_NT_REG, ISEL_ADD, ISEL_NT_REG, ISEL_NT_REG, 1, ISEL_ACT_OP),
+    ISEL_RULE(ISEL_NT_REG, ISEL_ADD, ISEL_NT_REG, ISEL_NT_ADDIMM, 1, ISEL_ACT_OP_IMM),
+    ISEL_RULE(ISEL_NT_REG, ISEL_SUB, ISEL_NT_REG, ISEL_NT_REG, 1, ISEL_ACT_OP),
+    ISEL_RULE(ISEL_NT_REG, ISEL_SUB, ISEL_NT_REG, ISEL_NT_SUBIMM, 1, ISEL_ACT_SUB_IMM),
+    ISEL_RULE(ISEL_NT_REG, ISEL_MUL, ISEL_NT_REG, ISEL_NT_REG, 3, ISEL_ACT_OP),
+    ISEL_RULE(ISEL_NT_REG, ISEL_MUL, ISEL_NT_REG, ISEL_NT_MULIMM, 3, ISEL_ACT_OP_IMM),
+    ISEL_RULE(ISEL_NT_REG, ISEL_DIV, ISEL_NT_REG, ISEL_NT_REG, 40, ISEL_ACT_OP),
+    ISEL_RULE(ISEL_NT_REG, ISEL_SHL, ISEL_NT_REG, ISEL_NT_SCALE, 4, ISEL_ACT_SHL),
+    ISEL_RULE(ISEL_NT_REG, ISEL_CMP, ISEL_NT_REG, ISEL_NT_REG, 3, ISEL_ACT_SETCC),
+    ISEL_RULE(ISEL_NT_INDEX, ISEL_SHL, ISEL_NT_REG, ISEL_NT_SCALE, 0, ISEL_ACT_INDEX),
+    ISEL_CHAIN(ISEL_NT_INDEX, ISEL_NT_REG, 0, ISEL_ACT_INDEX_REG),
+    ISEL_RULE(ISEL_NT_BASEIDX, ISEL_ADD, ISEL_NT_REG, ISEL_NT_INDEX, 1, ISEL_ACT_BASE_INDEX),
+    ISEL_CHAIN(ISEL_NT_ADDR, ISEL_NT_REG, 0, ISEL_ACT_BASE),
+    ISEL_CHAIN(ISEL_NT_ADDR, ISEL_NT_BASEIDX, 0, ISEL_ACT_KEEP),
+    ISEL_RULE(ISEL_NT_ADDR, ISEL_ADD, ISEL_NT_REG, ISEL_NT_DISP, 0, ISEL_ACT_BASE_DISP),
+    ISEL_RULE(ISEL_NT_ADDR, ISEL_ADD, ISEL_NT_BASEIDX, ISEL_NT_DISP, 0, ISEL_ACT_ADD_DISP),
+    ISEL_RULE(ISEL_NT_REG, ISEL_LOAD, ISEL_NT_ADDR, ISEL_NT_REG, 4, ISEL_ACT_LOAD),
+    ISEL_RULE(ISEL_NT_BRANCH, ISEL_CMP, ISEL_NT_REG, ISEL_NT_REG, 1, ISEL_ACT_BRANCH),
+    ISEL_RULE(ISEL_NT_BRANCH, ISEL_CMP, ISEL_NT_REG, ISEL_NT_ZERO, 1, ISEL_ACT_BRANCH_ZERO),
+};
+
+// Generic x86-64 is a 4-wide out-of-order core in the Zen 3 / Golden Cove
+// mould: four ALUs, two load ports, one multiplier and a divider that
+// blocks for most of its 64-bit latency. The 48-entry window lets the
+// scheduler lift loads well clear of their uses.
+static const TargetTuning x86_64_tunings[] = {
+    {"generic", 4, 48, {
+        [SCHED_ALU] = {1, 4, 1},
+        [SCHED_MUL] = {3, 1, 1},
+        [SCHED_DIV] = {40, 1, 20},
+        [SCHED_LOAD] = {5, 2, 1},
+        [SCHED_STORE] = {5, 2, 1},
+        [SCHED_VECTOR] = {6, 2, 1},
+        [SCHED_BRANCH] = {1, 2, 1},
+    }},
+};
+
 // Create x86-64 backend
-TargetBackend* create_x86_64_backend(void) {
+const TargetBackend* create_x86_64_backend(void) {
     TargetBackend* backend = (TargetBackend*)malloc(sizeof(TargetBackend));
     if (!backend) return NULL;
 
@@ -221,26 +712,68 @@ TargetBackend* create_x86_64_backend(void) {
     backend->name = "x86-64";
     backend->triple = "x86_64-linux-gnu";
 
+    // Allocate and copy registers
+    const TargetRegister** registers = malloc(NUM_X86_64_REGISTERS * sizeof(const TargetRegister*));
+    if (!registers) {
+        free(backend);
+        return NULL;
+    }
+    for (int i = 0; i < (int)NUM_X86_64_REGISTERS; i++) {
+        registers[i] = &x86_64_registers[i];
+    }
+    backend->registers = registers;
+    backend->num_registers = NUM_X86_64_REGISTERS;
+    backend->scratch_registers[0] = &x86_64_registers[10]; // r10
+    backend->scratch_registers[1] = &x86_64_registers[11]; // r11
+
+    backend->calling_convention = &x86_64_calling_convention;
+
+    backend->instructions = NULL;
+    backend->num_instructions = 0;
+    backend->isel_rules = x86_64_isel_rules;
+    backend->num_isel_rules = sizeof(x86_64_isel_rules) / sizeof(IselRule);
+    backend->tunings = x86_64_tunings;
+    backend->num_tunings = sizeof(x86_64_tunings) / sizeof(TargetTuning);
+
     // Initialize function pointers
     backend->generate_prologue = x86_64_generate_prologue;
     backend->generate_epilogue = x86_64_generate_epilogue;
+    backend->generate_leaf_prologue = x86_64_generate_leaf_prologue;
+    backend->generate_leaf_epilogue = x86_64_generate_leaf_epilogue;
     backend->generate_mov = x86_64_generate_mov;
+    backend->generate_mov_imm = x86_64_generate_mov_imm;
     backend->generate_add = x86_64_generate_add;
     backend->generate_sub = x86_64_generate_sub;
     backend->generate_mul = x86_64_generate_mul;
     backend->generate_div = x86_64_generate_div;
+    backend->generate_add_imm = x86_64_generate_add_imm;
+    backend->generate_mul_imm = x86_64_generate_mul_imm;
     backend->generate_load = x86_64_generate_load;
     backend->generate_store = x86_64_generate_store;
+    backend->generate_load_sized = x86_64_generate_load_sized;
+    backend->generate_store_sized = x86_64_generate_store_sized;
+    backend->generate_load_indexed = x86_64_generate_load_indexed;
+    backend->generate_store_pair = NULL;
+    backend->generate_load_pair = NULL;
     backend->generate_cmp = x86_64_generate_cmp;
     backend->generate_jmp = x86_64_generate_jmp;
     backend->generate_je = x86_64_generate_je;
     backend->generate_jne = x86_64_generate_jne;
     backend->generate_jl = x86_64_generate_jl;
     backend->generate_jg = x86_64_generate_jg;
+    backend->generate_setcc = x86_64_generate_setcc;
+    backend->generate_branch = x86_64_generate_branch;
+    backend->generate_branch_zero = x86_64_generate_branch_zero;
+    backend->generate_select = x86_64_generate_select;
+    backend->generate_vzero = x86_64_generate_vzero;
+    backend->generate_vadd_indexed = x86_64_generate_vadd_indexed;
+    backend->generate_vreduce = x86_64_generate_vreduce;
+    backend->generate_resolver = x86_64_generate_resolver;
     backend->generate_call = x86_64_generate_call;
     backend->generate_ret = x86_64_generate_ret;
     backend->generate_label = x86_64_generate_label;
     backend->apply_ia_hints = x86_64_apply_ia_hints;
+    backend->encoder = &x86_64_encoder;
 
     return backend;
 }
@@ -7,6 +7,8 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include "emit.h"
+#include "mcode.h"
 
 // Target architecture enumeration
 typedef enum {
@@ -28,15 +30,46 @@ typedef struct {
     RegisterClass class;
     int number;
     bool preserved; // Callee-saved
+    bool reserved;  // Never handed out by the register allocator
 } TargetRegister;
 
+// Signed comparison conditions for compare/set/branch callbacks
+typedef enum {
+    COND_EQ,
+    COND_NE,
+    COND_LT,
+    COND_LE,
+    COND_GT,
+    COND_GE
+} CompareCondition;
+
+// Width of a memory access. Narrow loads fill the whole register, sign- or
+// zero-extended; narrow stores write the low bytes (signedness is ignored).
+typedef enum {
+    MEM_WORD,   // 64 bits
+    MEM_S32,
+    MEM_U32,
+    MEM_S8,
+    MEM_U8
+} MemoryWidth;
+
+// Optional ISA extensions. They belong to a compilation, not to a backend:
+// see IRFunction.features, EmitBuffer.features and CodeBuffer.features.
+#define TARGET_FEATURE_ZBA (1u << 0) // RISC-V address generation (sh1add..sh3add)
+#define TARGET_FEATURE_RVC (1u << 1) // RISC-V 16-bit compressed encodings
+#define TARGET_FEATURE_AVX2 (1u << 2) // x86-64 256-bit integer vectors
+#define TARGET_FEATURE_AVX512F (1u << 3) // x86-64 512-bit vectors
+
 // Calling convention information
 typedef struct {
-    TargetRegister** arg_registers;  // Registers for arguments
+    const TargetRegister* const* arg_registers; // Registers for arguments
     int num_arg_registers;
-    TargetRegister* return_register; // Return value register
-    TargetRegister* stack_pointer;   // Stack pointer
-    TargetRegister* frame_pointer;   // Frame pointer (optional)
+    const TargetRegister* return_register; // Return value register
+    const TargetRegister* stack_pointer;   // Stack pointer
+    const TargetRegister* frame_pointer;   // Frame pointer (optional)
+    int locals_offset;              // Bytes between frame pointer and first local slot
+    bool slots_from_sp;             // Framed functions address slots upwards from sp
+    int red_zone_size;              // Bytes below sp usable without moving it
     int stack_alignment;            // Stack alignment requirement
     bool caller_cleanup;           // Who cleans up stack
 } CallingConvention;
@@ -48,63 +81,211 @@ typedef struct {
     bool supports_immediate;
 } TargetInstruction;
 
-// Backend interface
+// Scheduling classes: the groups of IR instructions a core costs alike
+typedef enum {
+    SCHED_ALU,      // Moves, add/sub, compares, selects
+    SCHED_MUL,
+    SCHED_DIV,
+    SCHED_LOAD,     // Frame slot and indexed loads
+    SCHED_STORE,    // Latency is store-to-load forwarding
+    SCHED_VECTOR,   // Vector accumulate (with its load) and reduction
+    SCHED_BRANCH,   // Branches, jumps, calls and returns
+    SCHED_NUM_CLASSES
+} SchedClass;
+
+typedef struct {
+    int latency;    // Cycles until a dependent instruction can start
+    int units;      // Pipes that accept the class
+    int interval;   // Cycles a pipe stays busy (1 when fully pipelined)
+} SchedCost;
+
+// Cost model of one core, picked with -mtune. `window` bounds how far the
+// scheduler pulls an instruction ahead of source order: out-of-order cores
+// reorder within their own window, in-order cores (0) need the whole block
+// scheduled for them.
+typedef struct {
+    const char* name;
+    int issue_width;
+    int window;
+    SchedCost costs[SCHED_NUM_CLASSES];
+} TargetTuning;
+
+// Direct machine-code emission. Each callback encodes what the generate_*
+// callback of the same name prints, with registers given by
+// TargetRegister.number and branch targets as CodeBuffer labels. The
+// extensions an encoder may use arrive in CodeBuffer.features.
+typedef struct {
+    void (*prologue)(CodeBuffer* out, int stack_size);
+    void (*epilogue)(CodeBuffer* out, int stack_size);
+    void (*leaf_prologue)(CodeBuffer* out, int stack_size);
+    void (*leaf_epilogue)(CodeBuffer* out, int stack_size);
+    void (*mov)(CodeBuffer* out, int dest, int src);
+    void (*mov_imm)(CodeBuffer* out, int dest, long imm);
+    void (*add)(CodeBuffer* out, int dest, int src1, int src2);
+    void (*sub)(CodeBuffer* out, int dest, int src1, int src2);
+    void (*mul)(CodeBuffer* out, int dest, int src1, int src2);
+    void (*div)(CodeBuffer* out, int dest, int src1, int src2);
+    void (*add_imm)(CodeBuffer* out, int dest, int src, long imm);
+    void (*mul_imm)(CodeBuffer* out, int dest, int src, long imm);
+    void (*load)(CodeBuffer* out, MemoryWidth width, int dest, int base, int offset);
+    void (*store)(CodeBuffer* out, MemoryWidth width, int src, int base, int offset);
+    void (*load_indexed)(CodeBuffer* out, MemoryWidth width, int dest, int base, int index,
+                         int shift, int offset);
+    void (*store_pair)(CodeBuffer* out, int first, int second, int base, int offset);
+    void (*load_pair)(CodeBuffer* out, int first, int second, int base, int offset);
+    void (*setcc)(CodeBuffer* out, CompareCondition cond, int dest, int op1, int op2);
+    void (*branch)(CodeBuffer* out, CompareCondition cond, int op1, int op2, int label);
+    void (*branch_zero)(CodeBuffer* out, CompareCondition cond, int op, int label);
+    // op2 is -1 to compare against zero
+    void (*select)(CodeBuffer* out, CompareCondition cond, int dest, int op1, int op2,
+                   int if_true, int if_false);
+    void (*jmp)(CodeBuffer* out, int label);
+    void (*call)(CodeBuffer* out, const char* function);
+    // Process entry code: calls `function` and exits with its return value
+    void (*start)(CodeBuffer* out, const char* function);
+
+    // Vector reductions and clone resolvers, NULL where the text callbacks are
+    void (*vzero)(CodeBuffer* out, int bits, int dest);
+    void (*vadd_indexed)(CodeBuffer* out, int bits, bool subtract, int dest, int base,
+                         int index, int shift, int offset);
+    void (*vreduce)(CodeBuffer* out, int bits, int dest, int src);
+    void (*resolver)(CodeBuffer* out, const char* name, const char* const* clones,
+                     const uint32_t* features, int count);
+    // Startup binding for linkers without ifunc support: `dispatch` jumps
+    // through the pointer at symbol `slot`, `bind` stores what `resolver`
+    // returns there
+    void (*dispatch)(CodeBuffer* out, const char* slot);
+    void (*bind)(CodeBuffer* out, const char* resolver, const char* slot);
+} MachineEncoder;
+
+// Backend interface. A backend is an immutable descriptor, built once per
+// target and shared by every compilation and thread in the process; all
+// per-compilation state lives in the IRFunction and the output buffers.
 typedef struct {
     TargetArch arch;
     const char* name;
     const char* triple; // LLVM-style triple (e.g., "aarch64-linux-gnu")
 
     // Registers
-    TargetRegister** registers;
+    const TargetRegister* const* registers;
     int num_registers;
+    const TargetRegister* scratch_registers[2]; // Reserved for spill and reload code
 
     // Calling convention
-    CallingConvention* calling_convention;
+    const CallingConvention* calling_convention;
 
     // Instructions
-    TargetInstruction** instructions;
+    const TargetInstruction* const* instructions;
     int num_instructions;
 
+    // Instruction selection rules, see isel.h
+    const struct IselRule* isel_rules;
+    int num_isel_rules;
+
+    // Cores the scheduler can tune for, the default first
+    const TargetTuning* tunings;
+    int num_tunings;
+
     // Code generation functions
-    void (*generate_prologue)(FILE* out, int stack_size);
-    void (*generate_epilogue)(FILE* out, int stack_size);
-    void (*generate_mov)(FILE* out, const char* dest, const char* src);
-    void (*generate_add)(FILE* out, const char* dest, const char* src1, const char* src2);
-    void (*generate_sub)(FILE* out, const char* dest, const char* src1, const char* src2);
-    void (*generate_mul)(FILE* out, const char* dest, const char* src1, const char* src2);
-    void (*generate_div)(FILE* out, const char* dest, const char* src1, const char* src2);
-    void (*generate_load)(FILE* out, const char* dest, const char* addr, int offset);
-    void (*generate_store)(FILE* out, const char* src, const char* addr, int offset);
-    void (*generate_cmp)(FILE* out, const char* op1, const char* op2);
-    void (*generate_jmp)(FILE* out, const char* label);
-    void (*generate_je)(FILE* out, const char* label);
-    void (*generate_jne)(FILE* out, const char* label);
-    void (*generate_jl)(FILE* out, const char* label);
-    void (*generate_jg)(FILE* out, const char* label);
-    void (*generate_call)(FILE* out, const char* function);
-    void (*generate_ret)(FILE* out);
-    void (*generate_label)(FILE* out, const char* label);
+    void (*generate_prologue)(EmitBuffer* out, int stack_size);
+    void (*generate_epilogue)(EmitBuffer* out, int stack_size);
+    void (*generate_leaf_prologue)(EmitBuffer* out, int stack_size);  // No frame pointer or link save
+    void (*generate_leaf_epilogue)(EmitBuffer* out, int stack_size);
+    void (*generate_mov)(EmitBuffer* out, const char* dest, const char* src);
+    void (*generate_mov_imm)(EmitBuffer* out, const char* dest, long imm);
+    void (*generate_add)(EmitBuffer* out, const char* dest, const char* src1, const char* src2);
+    void (*generate_sub)(EmitBuffer* out, const char* dest, const char* src1, const char* src2);
+    void (*generate_mul)(EmitBuffer* out, const char* dest, const char* src1, const char* src2);
+    void (*generate_div)(EmitBuffer* out, const char* dest, const char* src1, const char* src2);
+    // dest = src op imm for the immediates the target's isel rules accept;
+    // generate_mul_imm is NULL when no rule selects it
+    void (*generate_add_imm)(EmitBuffer* out, const char* dest, const char* src, long imm);
+    void (*generate_mul_imm)(EmitBuffer* out, const char* dest, const char* src, long imm);
+    void (*generate_load)(EmitBuffer* out, const char* dest, const char* addr, int offset);
+    void (*generate_store)(EmitBuffer* out, const char* src, const char* addr, int offset);
+    void (*generate_load_sized)(EmitBuffer* out, MemoryWidth width, const char* dest,
+                                const char* addr, int offset);
+    void (*generate_store_sized)(EmitBuffer* out, MemoryWidth width, const char* src,
+                                 const char* addr, int offset);
+    // dest = width load of [base + (index << shift) + offset] in as few
+    // instructions as the addressing modes allow. dest may alias base or index.
+    void (*generate_load_indexed)(EmitBuffer* out, MemoryWidth width, const char* dest,
+                                  const char* base, const char* index, int shift,
+                                  int offset);
+    // Two words at [addr + offset] and [addr + offset + 8] in one instruction,
+    // for saving and restoring callee-saved registers; NULL when the target
+    // has no paired access
+    void (*generate_store_pair)(EmitBuffer* out, const char* first, const char* second,
+                                const char* addr, int offset);
+    void (*generate_load_pair)(EmitBuffer* out, const char* first, const char* second,
+                               const char* addr, int offset);
+    void (*generate_cmp)(EmitBuffer* out, const char* op1, const char* op2);
+    void (*generate_jmp)(EmitBuffer* out, const char* label);
+    void (*generate_je)(EmitBuffer* out, const char* label);
+    void (*generate_jne)(EmitBuffer* out, const char* label);
+    void (*generate_jl)(EmitBuffer* out, const char* label);
+    void (*generate_jg)(EmitBuffer* out, const char* label);
+    void (*generate_setcc)(EmitBuffer* out, CompareCondition cond, const char* dest,
+                           const char* op1, const char* op2);
+    void (*generate_branch)(EmitBuffer* out, CompareCondition cond, const char* op1,
+                            const char* op2, const char* label);
+    void (*generate_branch_zero)(EmitBuffer* out, CompareCondition cond, const char* op,
+                                 const char* label);
+    // dest = (op1 cond op2) ? if_true : if_false without branching; op2 is NULL
+    // to compare against zero. dest may alias any operand. Only called when no
+    // operand lives in a scratch register, so both scratch registers are free.
+    void (*generate_select)(EmitBuffer* out, CompareCondition cond, const char* dest,
+                            const char* op1, const char* op2,
+                            const char* if_true, const char* if_false);
+    // Vector reductions for vectorized loops, NULL without SIMD lowering.
+    // `bits` is the width target_vector_bits picked; vector operands name
+    // REG_CLASS_VEC registers and vreduce's dest a general register. The
+    // target may clobber a vector scratch register of its own.
+    void (*generate_vzero)(EmitBuffer* out, int bits, const char* dest);
+    // dest +=/-= the lanes at [base + (index << shift) + offset]
+    void (*generate_vadd_indexed)(EmitBuffer* out, int bits, bool subtract, const char* dest,
+                                  const char* base, const char* index, int shift, int offset);
+    // dest = sum of the 64-bit lanes of src, which is left clobbered
+    void (*generate_vreduce)(EmitBuffer* out, int bits, const char* dest, const char* src);
+    // Function multiversioning: the body of resolver `name`, which returns
+    // the address of the first of `clones` whose `features` the running CPU
+    // has; the last clone is the fallback. NULL when the target cannot
+    // dispatch on the CPU.
+    void (*generate_resolver)(EmitBuffer* out, const char* name, const char* const* clones,
+                              const uint32_t* features, int count);
+    void (*generate_call)(EmitBuffer* out, const char* function);
+    void (*generate_ret)(EmitBuffer* out);
+    void (*generate_label)(EmitBuffer* out, const char* label);
 
     // IA integration
-    void (*apply_ia_hints)(FILE* out, const char* optimization_type);
+    void (*apply_ia_hints)(EmitBuffer* out, const char* optimization_type);
+
+    // Machine-code encoder, NULL when the target can only print assembly
+    const MachineEncoder* encoder;
 
 } TargetBackend;
 
-// Global backend registry
-extern TargetBackend* current_backend;
+// The shared descriptor for `arch`, built on first use; safe to call from
+// any thread. NULL if it could not be built.
+const TargetBackend* get_target_backend(TargetArch arch);
 
-// Backend management functions
-TargetBackend* create_x86_64_backend(void);
-TargetBackend* create_arm64_backend(void);
-TargetBackend* create_riscv64_backend(void);
+// Backend constructors, called once per target by get_target_backend
+const TargetBackend* create_x86_64_backend(void);
+const TargetBackend* create_arm64_backend(void);
+const TargetBackend* create_riscv64_backend(void);
+extern const MachineEncoder x86_64_encoder;
+extern const MachineEncoder arm64_encoder;
+extern const MachineEncoder riscv64_encoder;
 
-void set_current_backend(TargetArch arch);
-TargetBackend* get_current_backend(void);
+int target_vector_bits(const TargetBackend* backend, uint32_t features);
+bool target_clone_features(const TargetBackend* backend, const char* name, uint32_t* features);
+const TargetTuning* target_find_tuning(const TargetBackend* backend, const char* name);
+int find_backend_register(const TargetBackend* backend, const char* name);
 
 // Code generation helpers
-void emit_instruction(FILE* out, const char* format, ...);
-void emit_label(FILE* out, const char* label);
-void emit_comment(FILE* out, const char* comment);
+void emit_instruction(EmitBuffer* out, const char* format, ...);
+void emit_label(EmitBuffer* out, const char* label);
+void emit_comment(EmitBuffer* out, const char* comment);
 
 // Architecture detection and setup
 TargetArch detect_host_architecture(void);
@@ -112,7 +293,7 @@ const char* get_architecture_name(TargetArch arch);
 const char* get_architecture_triple(TargetArch arch);
 
 // IA-aware code generation
-void generate_ia_optimized_code(TargetBackend* backend, FILE* out,
+void generate_ia_optimized_code(const TargetBackend* backend, EmitBuffer* out,
                                const char* optimization_type,
                                const char* code_pattern);
 
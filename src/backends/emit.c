@@ -0,0 +1,171 @@
+// ALETHEIA Assembly Emitter
+// Append-only text buffer with a small hand-rolled formatter
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "emit.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define EMIT_INITIAL_CAPACITY 4096
+
+void emit_buffer_init(EmitBuffer* buf) {
+    buf->data = NULL;
+    buf->size = 0;
+    buf->capacity = 0;
+    buf->failed = false;
+    buf->features = 0;
+}
+
+void emit_buffer_free(EmitBuffer* buf) {
+    free(buf->data);
+    emit_buffer_init(buf);
+}
+
+void emit_buffer_reset(EmitBuffer* buf) {
+    buf->size = 0;
+    buf->failed = false;
+}
+
+static bool emit_reserve(EmitBuffer* buf, size_t extra) {
+    if (buf->failed) return false;
+    if (buf->size + extra <= buf->capacity) return true;
+
+    size_t capacity = buf->capacity ? buf->capacity : EMIT_INITIAL_CAPACITY;
+    while (capacity < buf->size + extra) capacity *= 2;
+    char* data = (char*)realloc(buf->data, capacity);
+    if (!data) {
+        buf->failed = true;
+        return false;
+    }
+    buf->data = data;
+    buf->capacity = capacity;
+    return true;
+}
+
+void emit_putn(EmitBuffer* buf, const char* text, size_t length) {
+    if (!emit_reserve(buf, length)) return;
+    memcpy(buf->data + buf->size, text, length);
+    buf->size += length;
+}
+
+void emit_put(EmitBuffer* buf, const char* text) {
+    emit_putn(buf, text, strlen(text));
+}
+
+void emit_char(EmitBuffer* buf, char c) {
+    if (!emit_reserve(buf, 1)) return;
+    buf->data[buf->size++] = c;
+}
+
+void emit_uint(EmitBuffer* buf, unsigned long value) {
+    char digits[24];
+    int count = 0;
+    do {
+        digits[sizeof(digits) - 1 - count++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+    emit_putn(buf, digits + sizeof(digits) - count, count);
+}
+
+// Negated through unsigned so LONG_MIN prints correctly
+static void emit_signed(EmitBuffer* buf, long value, bool plus) {
+    if (value < 0) {
+        emit_char(buf, '-');
+        emit_uint(buf, 0UL - (unsigned long)value);
+        return;
+    }
+    if (plus) emit_char(buf, '+');
+    emit_uint(buf, (unsigned long)value);
+}
+
+void emit_int(EmitBuffer* buf, long value) {
+    emit_signed(buf, value, false);
+}
+
+void emit_vformat(EmitBuffer* buf, const char* format, va_list args) {
+    const char* run = format;
+    const char* p = format;
+
+    while (*p) {
+        if (*p != '%') {
+            p++;
+            continue;
+        }
+        emit_putn(buf, run, (size_t)(p - run));
+
+        const char* spec = p++;
+        bool plus = false;
+        bool is_long = false;
+        if (*p == '+') {
+            plus = true;
+            p++;
+        }
+        if (*p == 'l') {
+            is_long = true;
+            p++;
+        }
+
+        switch (*p) {
+            case 's': {
+                const char* s = va_arg(args, const char*);
+                emit_put(buf, s ? s : "(null)");
+                break;
+            }
+            case 'c':
+                emit_char(buf, (char)va_arg(args, int));
+                break;
+            case 'd':
+                emit_signed(buf, is_long ? va_arg(args, long) : va_arg(args, int), plus);
+                break;
+            case 'u':
+                emit_uint(buf, is_long ? va_arg(args, unsigned long) : va_arg(args, unsigned int));
+                break;
+            case '%':
+                emit_char(buf, '%');
+                break;
+            default:
+                // Unsupported conversion: keep the text so it shows up in review
+                if (!*p) {
+                    emit_put(buf, spec);
+                    return;
+                }
+                emit_putn(buf, spec, (size_t)(p + 1 - spec));
+                break;
+        }
+        run = ++p;
+    }
+    emit_putn(buf, run, (size_t)(p - run));
+}
+
+void emit_format(EmitBuffer* buf, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    emit_vformat(buf, format, args);
+    va_end(args);
+}
+
+bool emit_flush(EmitBuffer* buf, FILE* out) {
+    bool ok = !buf->failed;
+    size_t done = 0;
+    int fd;
+
+    if (fflush(out) != 0) ok = false;
+    fd = fileno(out);
+    if (fd < 0) {
+        // Memory streams have no descriptor
+        if (ok && buf->size && fwrite(buf->data, 1, buf->size, out) != buf->size) ok = false;
+    } else {
+        while (ok && done < buf->size) {
+            ssize_t n = write(fd, buf->data + done, buf->size - done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) ok = false;
+            else done += (size_t)n;
+        }
+    }
+
+    emit_buffer_reset(buf);
+    return ok;
+}
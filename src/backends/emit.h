@@ -0,0 +1,42 @@
+// ALETHEIA Assembly Emitter
+// Append-only in-memory text buffer for generated assembly. Code generators
+// format into it without going through stdio and flush it with one write.
+
+#ifndef ALETHEIA_EMIT_H
+#define ALETHEIA_EMIT_H
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    char* data;
+    size_t size;
+    size_t capacity;
+    bool failed;    // An allocation failed; later output is dropped
+    uint32_t features;  // TARGET_FEATURE_* extensions the printed code may use
+} EmitBuffer;
+
+void emit_buffer_init(EmitBuffer* buf);
+void emit_buffer_free(EmitBuffer* buf);
+void emit_buffer_reset(EmitBuffer* buf);
+
+// Raw appends
+void emit_putn(EmitBuffer* buf, const char* text, size_t length);
+void emit_put(EmitBuffer* buf, const char* text);
+void emit_char(EmitBuffer* buf, char c);
+void emit_int(EmitBuffer* buf, long value);
+void emit_uint(EmitBuffer* buf, unsigned long value);
+
+// printf-like formatting without going through printf. Understands %s, %c,
+// %d, %u, %ld, %lu, %+d, %+ld and %%; anything else is copied verbatim.
+void emit_format(EmitBuffer* buf, const char* format, ...);
+void emit_vformat(EmitBuffer* buf, const char* format, va_list args);
+
+// Writes the whole buffer to out's descriptor in one write (after flushing
+// anything out already holds) and empties it. Returns false on error.
+bool emit_flush(EmitBuffer* buf, FILE* out);
+
+#endif // ALETHEIA_EMIT_H
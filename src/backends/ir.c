@@ -0,0 +1,1951 @@
+// ALETHEIA Backend IR Implementation
+// Builders, liveness and callback-driven emission for the shared machine IR
+
+#include "ir.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Function and block construction
+IRFunction* ir_create_function(const TargetBackend* backend, const char* name) {
+    IRFunction* fn = (IRFunction*)calloc(1, sizeof(IRFunction));
+    if (!fn) return NULL;
+
+    fn->name = name;
+    fn->backend = backend;
+    ir_set_function_features(fn, 0);
+    return fn;
+}
+
+// Narrows or widens what one function may assume, e.g. for a clone that is
+// only entered once the CPU has been checked
+void ir_set_function_features(IRFunction* fn, uint32_t features) {
+    fn->features = features;
+    fn->vector_bits = target_vector_bits(fn->backend, features);
+}
+
+void ir_free_function(IRFunction* fn) {
+    if (!fn) return;
+
+    for (int i = 0; i < fn->num_blocks; i++) {
+        free(fn->blocks[i]->instrs);
+        free(fn->blocks[i]->live_in);
+        free(fn->blocks[i]->live_out);
+        free(fn->blocks[i]);
+    }
+    free(fn->blocks);
+    free(fn->vreg_reg);
+    free(fn->vreg_slot);
+    free(fn->saved_regs);
+    free(fn->saved_slots);
+    free(fn);
+}
+
+IRBlock* ir_create_block(IRFunction* fn) {
+    if (fn->num_blocks == fn->block_capacity) {
+        int capacity = fn->block_capacity ? fn->block_capacity * 2 : 8;
+        IRBlock** blocks = (IRBlock**)realloc(fn->blocks, capacity * sizeof(IRBlock*));
+        if (!blocks) return NULL;
+        fn->blocks = blocks;
+        fn->block_capacity = capacity;
+    }
+
+    IRBlock* block = (IRBlock*)calloc(1, sizeof(IRBlock));
+    if (!block) return NULL;
+
+    block->id = fn->next_block_id++;
+    fn->blocks[fn->num_blocks++] = block;
+    if (!fn->current) fn->current = block;
+    return block;
+}
+
+void ir_set_block(IRFunction* fn, IRBlock* block) {
+    fn->current = block;
+}
+
+void ir_move_block_after(IRFunction* fn, IRBlock* block, IRBlock* after) {
+    int from = -1;
+    int to = -1;
+
+    for (int i = 0; i < fn->num_blocks; i++) {
+        if (fn->blocks[i] == block) from = i;
+        if (fn->blocks[i] == after) to = i;
+    }
+    if (from < 0 || to < 0 || from == to) return;
+
+    if (from < to) {
+        memmove(&fn->blocks[from], &fn->blocks[from + 1], (to - from) * sizeof(IRBlock*));
+        fn->blocks[to] = block;
+    } else {
+        memmove(&fn->blocks[to + 2], &fn->blocks[to + 1], (from - to - 1) * sizeof(IRBlock*));
+        fn->blocks[to + 1] = block;
+    }
+}
+
+IRBlock* ir_find_block(IRFunction* fn, int id) {
+    for (int i = 0; i < fn->num_blocks; i++) {
+        if (fn->blocks[i]->id == id) return fn->blocks[i];
+    }
+    return NULL;
+}
+
+int ir_new_vreg(IRFunction* fn) {
+    return fn->num_vregs++;
+}
+
+int ir_new_slot(IRFunction* fn) {
+    return fn->num_slots++;
+}
+
+bool ir_block_terminated(IRBlock* block) {
+    if (block->num_instrs == 0) return false;
+
+    IROpcode op = block->instrs[block->num_instrs - 1].op;
+    return op == IR_BRANCH || op == IR_JMP || op == IR_RET;
+}
+
+CompareCondition ir_invert_condition(CompareCondition cond) {
+    switch (cond) {
+        case COND_EQ: return COND_NE;
+        case COND_NE: return COND_EQ;
+        case COND_LT: return COND_GE;
+        case COND_LE: return COND_GT;
+        case COND_GT: return COND_LE;
+        case COND_GE: return COND_LT;
+    }
+    return cond;
+}
+
+static IRInstr* ir_append(IRFunction* fn, IROpcode op) {
+    IRBlock* block = fn->current;
+    if (!block) block = ir_create_block(fn);
+    if (!block) return NULL;
+
+    if (block->num_instrs == block->capacity) {
+        int capacity = block->capacity ? block->capacity * 2 : 16;
+        IRInstr* instrs = (IRInstr*)realloc(block->instrs, capacity * sizeof(IRInstr));
+        if (!instrs) return NULL;
+        block->instrs = instrs;
+        block->capacity = capacity;
+    }
+
+    IRInstr* instr = &block->instrs[block->num_instrs++];
+    memset(instr, 0, sizeof(IRInstr));
+    instr->op = op;
+    instr->target = -1;
+    instr->target_false = -1;
+    return instr;
+}
+
+// Instruction builders
+IROperand ir_vreg(int vreg) {
+    IROperand operand = {IR_OPND_VREG, vreg};
+    return operand;
+}
+
+IROperand ir_preg(int index) {
+    IROperand operand = {IR_OPND_PREG, index};
+    return operand;
+}
+
+IROperand ir_imm(long value) {
+    IROperand operand = {IR_OPND_IMM, value};
+    return operand;
+}
+
+static IROperand ir_slot(int slot) {
+    IROperand operand = {IR_OPND_SLOT, slot};
+    return operand;
+}
+
+int ir_build_mov_imm(IRFunction* fn, long value) {
+    int dst = ir_new_vreg(fn);
+    ir_build_mov(fn, ir_vreg(dst), ir_imm(value));
+    return dst;
+}
+
+void ir_build_mov(IRFunction* fn, IROperand dst, IROperand src) {
+    IRInstr* instr = ir_append(fn, IR_MOV);
+    if (!instr) return;
+    instr->dst = dst;
+    instr->src1 = src;
+}
+
+int ir_build_binary(IRFunction* fn, IROpcode op, int lhs, int rhs) {
+    int dst = ir_new_vreg(fn);
+    IRInstr* instr = ir_append(fn, op);
+    if (!instr) return dst;
+    instr->dst = ir_vreg(dst);
+    instr->src1 = ir_vreg(lhs);
+    instr->src2 = ir_vreg(rhs);
+    return dst;
+}
+
+// IR_ADD and IR_MUL only, for immediates the target's isel rules accept
+int ir_build_binary_imm(IRFunction* fn, IROpcode op, int lhs, long imm) {
+    int dst = ir_new_vreg(fn);
+    IRInstr* instr = ir_append(fn, op);
+    if (!instr) return dst;
+    instr->dst = ir_vreg(dst);
+    instr->src1 = ir_vreg(lhs);
+    instr->src2 = ir_imm(imm);
+    return dst;
+}
+
+int ir_build_load(IRFunction* fn, int slot) {
+    return ir_build_load_sized(fn, slot, MEM_WORD);
+}
+
+void ir_build_store(IRFunction* fn, int slot, int vreg) {
+    ir_build_store_sized(fn, slot, vreg, MEM_WORD);
+}
+
+// Slots stay 8 bytes apart; a char or int slot is accessed through its low
+// bytes only
+int ir_build_load_sized(IRFunction* fn, int slot, MemoryWidth width) {
+    int dst = ir_new_vreg(fn);
+    IRInstr* instr = ir_append(fn, IR_LOAD);
+    if (!instr) return dst;
+    instr->dst = ir_vreg(dst);
+    instr->src1 = ir_slot(slot);
+    instr->width = width;
+    return dst;
+}
+
+void ir_build_store_sized(IRFunction* fn, int slot, int vreg, MemoryWidth width) {
+    IRInstr* instr = ir_append(fn, IR_STORE);
+    if (!instr) return;
+    instr->dst = ir_slot(slot);
+    instr->src1 = ir_vreg(vreg);
+    instr->width = width;
+}
+
+// Element access folded into one addressing mode; pass index -1 for a
+// constant offset from base
+int ir_build_load_indexed(IRFunction* fn, int base, int index, int shift, int disp,
+                          MemoryWidth width) {
+    int dst = ir_new_vreg(fn);
+    IRInstr* instr = ir_append(fn, IR_LOAD_INDEXED);
+    if (!instr) return dst;
+    instr->dst = ir_vreg(dst);
+    instr->src1 = ir_vreg(base);
+    if (index >= 0) instr->src2 = ir_vreg(index);
+    instr->shift = shift;
+    instr->disp = disp;
+    instr->width = width;
+    return dst;
+}
+
+int ir_build_setcc(IRFunction* fn, CompareCondition cond, int lhs, int rhs) {
+    int dst = ir_new_vreg(fn);
+    IRInstr* instr = ir_append(fn, IR_SETCC);
+    if (!instr) return dst;
+    instr->cond = cond;
+    instr->dst = ir_vreg(dst);
+    instr->src1 = ir_vreg(lhs);
+    instr->src2 = ir_vreg(rhs);
+    return dst;
+}
+
+void ir_build_branch(IRFunction* fn, CompareCondition cond, int lhs, int rhs,
+                     IRBlock* if_true, IRBlock* if_false) {
+    IRInstr* instr = ir_append(fn, IR_BRANCH);
+    if (!instr) return;
+    instr->cond = cond;
+    instr->src1 = ir_vreg(lhs);
+    instr->src2 = ir_vreg(rhs);
+    instr->target = if_true->id;
+    instr->target_false = if_false->id;
+}
+
+// Compares against zero, letting targets use cbz/beqz-style branches
+void ir_build_branch_zero(IRFunction* fn, CompareCondition cond, int vreg,
+                          IRBlock* if_true, IRBlock* if_false) {
+    IRInstr* instr = ir_append(fn, IR_BRANCH);
+    if (!instr) return;
+    instr->cond = cond;
+    instr->src1 = ir_vreg(vreg);
+    instr->src2 = ir_imm(0);
+    instr->target = if_true->id;
+    instr->target_false = if_false->id;
+}
+
+void ir_build_jmp(IRFunction* fn, IRBlock* target) {
+    IRInstr* instr = ir_append(fn, IR_JMP);
+    if (!instr) return;
+    instr->target = target->id;
+}
+
+// Copies an evaluated argument into its argument register. Evaluate every
+// argument first: a nested call would clobber registers already filled.
+// Arguments are only passed in registers; returns false for one that would
+// go on the stack so the caller can reject the call.
+bool ir_build_arg(IRFunction* fn, int index, int vreg) {
+    const CallingConvention* cc = fn->backend->calling_convention;
+
+    if (index >= cc->num_arg_registers) return false;
+    ir_build_mov(fn, ir_preg(find_backend_register(fn->backend, cc->arg_registers[index]->name)),
+                 ir_vreg(vreg));
+    return true;
+}
+
+// Receives a parameter from its argument register; call in the entry block
+// before anything that could clobber it. Returns -1 for a parameter passed
+// on the stack, which is not supported.
+int ir_build_param(IRFunction* fn, int index) {
+    const CallingConvention* cc = fn->backend->calling_convention;
+
+    if (index >= cc->num_arg_registers) return -1;
+    int result = ir_new_vreg(fn);
+    ir_build_mov(fn, ir_vreg(result),
+                 ir_preg(find_backend_register(fn->backend, cc->arg_registers[index]->name)));
+    return result;
+}
+
+// Arguments must already be in the first num_args argument registers
+int ir_build_call(IRFunction* fn, const char* symbol, int num_args) {
+    const CallingConvention* cc = fn->backend->calling_convention;
+    IRInstr* instr = ir_append(fn, IR_CALL);
+    if (instr) {
+        instr->symbol = symbol;
+        instr->num_args = num_args;
+    }
+
+    int result = ir_new_vreg(fn);
+    ir_build_mov(fn, ir_vreg(result),
+                 ir_preg(find_backend_register(fn->backend, cc->return_register->name)));
+    return result;
+}
+
+void ir_build_ret(IRFunction* fn, int vreg) {
+    const CallingConvention* cc = fn->backend->calling_convention;
+    int ret = find_backend_register(fn->backend, cc->return_register->name);
+
+    if (vreg >= 0) {
+        ir_build_mov(fn, ir_preg(ret), ir_vreg(vreg));
+    }
+    IRInstr* instr = ir_append(fn, IR_RET);
+    if (!instr) return;
+    instr->src1 = ir_preg(ret);
+}
+
+// n-th vector register the target leaves free for vectorized loops
+int ir_vector_register(IRFunction* fn, int n) {
+    const TargetBackend* backend = fn->backend;
+
+    for (int i = 0; i < backend->num_registers; i++) {
+        const TargetRegister* reg = backend->registers[i];
+        if (reg->class == REG_CLASS_VEC && !reg->reserved && n-- == 0) return i;
+    }
+    fprintf(stderr, "ir: %s: out of vector registers\n", fn->name);
+    return -1;
+}
+
+void ir_build_vzero(IRFunction* fn, int vec) {
+    IRInstr* instr = ir_append(fn, IR_VZERO);
+    if (!instr) return;
+    instr->dst = ir_preg(vec);
+}
+
+// op is IR_VADD or IR_VSUB; vec accumulates fn->vector_bits worth of
+// elements starting at base + (index << shift) + disp
+void ir_build_vadd_indexed(IRFunction* fn, IROpcode op, int vec, int base, int index, int shift,
+                           int disp) {
+    IRInstr* instr = ir_append(fn, op);
+    if (!instr) return;
+    instr->dst = ir_preg(vec);
+    instr->src1 = ir_vreg(base);
+    instr->src2 = ir_vreg(index);
+    instr->shift = shift;
+    instr->disp = disp;
+}
+
+int ir_build_vreduce(IRFunction* fn, int vec) {
+    int dst = ir_new_vreg(fn);
+    IRInstr* instr = ir_append(fn, IR_VREDUCE);
+    if (!instr) return dst;
+    instr->dst = ir_vreg(dst);
+    instr->src1 = ir_preg(vec);
+    return dst;
+}
+
+// Operand helpers
+int ir_num_live_ids(IRFunction* fn) {
+    return fn->num_vregs + fn->backend->num_registers;
+}
+
+int ir_live_id(IRFunction* fn, IROperand* operand) {
+    if (operand->kind == IR_OPND_VREG) return (int)operand->value;
+    if (operand->kind == IR_OPND_PREG) return fn->num_vregs + (int)operand->value;
+    return -1;
+}
+
+bool ir_register_allocatable(const TargetBackend* backend, int index) {
+    const TargetRegister* reg = backend->registers[index];
+    return reg->class == REG_CLASS_GP && !reg->reserved;
+}
+
+int ir_instr_use_ids(IRFunction* fn, IRInstr* instr, int* ids) {
+    int count = 0;
+    int id;
+
+    switch (instr->op) {
+        case IR_STORE:
+        case IR_MOV:
+        case IR_RET:
+            if ((id = ir_live_id(fn, &instr->src1)) >= 0) ids[count++] = id;
+            break;
+        case IR_CALL: {
+            const CallingConvention* cc = fn->backend->calling_convention;
+            for (int i = 0; i < instr->num_args && i < cc->num_arg_registers; i++) {
+                ids[count++] = fn->num_vregs +
+                    find_backend_register(fn->backend, cc->arg_registers[i]->name);
+            }
+            break;
+        }
+        case IR_LOAD:
+        case IR_JMP:
+            break;
+        case IR_VADD:
+        case IR_VSUB:
+            // Accumulates into dst
+            if ((id = ir_live_id(fn, &instr->dst)) >= 0) ids[count++] = id;
+            if ((id = ir_live_id(fn, &instr->src1)) >= 0) ids[count++] = id;
+            if ((id = ir_live_id(fn, &instr->src2)) >= 0) ids[count++] = id;
+            break;
+        case IR_SELECT:
+            if ((id = ir_live_id(fn, &instr->if_true)) >= 0) ids[count++] = id;
+            if ((id = ir_live_id(fn, &instr->if_false)) >= 0) ids[count++] = id;
+            // fall through
+        default:
+            if ((id = ir_live_id(fn, &instr->src1)) >= 0) ids[count++] = id;
+            if ((id = ir_live_id(fn, &instr->src2)) >= 0) ids[count++] = id;
+            break;
+    }
+    return count;
+}
+
+// Calls define the return register and clobber every caller-saved register
+int ir_instr_def_ids(IRFunction* fn, IRInstr* instr, int* ids) {
+    int count = 0;
+    int id;
+
+    switch (instr->op) {
+        case IR_CALL:
+            for (int i = 0; i < fn->backend->num_registers; i++) {
+                const TargetRegister* reg = fn->backend->registers[i];
+                if (reg->class == REG_CLASS_GP && !reg->preserved) {
+                    ids[count++] = fn->num_vregs + i;
+                }
+            }
+            break;
+        case IR_STORE:
+        case IR_BRANCH:
+        case IR_JMP:
+        case IR_RET:
+            break;
+        default:
+            if ((id = ir_live_id(fn, &instr->dst)) >= 0) ids[count++] = id;
+            break;
+    }
+    return count;
+}
+
+int ir_block_successors(IRFunction* fn, int index, int* succ) {
+    IRBlock* block = fn->blocks[index];
+    IRInstr* last = block->num_instrs ? &block->instrs[block->num_instrs - 1] : NULL;
+    int count = 0;
+
+    if (last && last->op == IR_RET) return 0;
+    if (last && last->op == IR_JMP) {
+        succ[count++] = last->target;
+        return count;
+    }
+    if (last && last->op == IR_BRANCH) {
+        succ[count++] = last->target;
+        succ[count++] = last->target_false;
+        return count;
+    }
+    if (index + 1 < fn->num_blocks) {
+        succ[count++] = fn->blocks[index + 1]->id;
+    }
+    return count;
+}
+
+// Liveness analysis (backward dataflow to a fixed point)
+#define BIT_SET(bits, i) ((bits)[(i) / 64] |= (1ULL << ((i) % 64)))
+#define BIT_CLEAR(bits, i) ((bits)[(i) / 64] &= ~(1ULL << ((i) % 64)))
+#define BIT_TEST(bits, i) (((bits)[(i) / 64] >> ((i) % 64)) & 1ULL)
+
+void ir_compute_liveness(IRFunction* fn) {
+    int words = (ir_num_live_ids(fn) + 63) / 64;
+    int* ids = (int*)malloc((fn->backend->num_registers + IR_MAX_USES) * sizeof(int));
+    uint64_t* live = (uint64_t*)malloc(words * sizeof(uint64_t));
+
+    for (int b = 0; b < fn->num_blocks; b++) {
+        IRBlock* block = fn->blocks[b];
+        free(block->live_in);
+        free(block->live_out);
+        block->live_in = (uint64_t*)calloc(words, sizeof(uint64_t));
+        block->live_out = (uint64_t*)calloc(words, sizeof(uint64_t));
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int b = fn->num_blocks - 1; b >= 0; b--) {
+            IRBlock* block = fn->blocks[b];
+            int succ[2];
+            int num_succ = ir_block_successors(fn, b, succ);
+
+            for (int s = 0; s < num_succ; s++) {
+                IRBlock* target = ir_find_block(fn, succ[s]);
+                if (!target) continue;
+                for (int w = 0; w < words; w++) {
+                    block->live_out[w] |= target->live_in[w];
+                }
+            }
+
+            memcpy(live, block->live_out, words * sizeof(uint64_t));
+            for (int i = block->num_instrs - 1; i >= 0; i--) {
+                IRInstr* instr = &block->instrs[i];
+                int count = ir_instr_def_ids(fn, instr, ids);
+                for (int k = 0; k < count; k++) BIT_CLEAR(live, ids[k]);
+                count = ir_instr_use_ids(fn, instr, ids);
+                for (int k = 0; k < count; k++) BIT_SET(live, ids[k]);
+            }
+
+            for (int w = 0; w < words; w++) {
+                if (live[w] != block->live_in[w]) {
+                    block->live_in[w] = live[w];
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    free(live);
+    free(ids);
+}
+
+// Loop nesting analysis
+static int ir_block_index(IRFunction* fn, int id) {
+    for (int i = 0; i < fn->num_blocks; i++) {
+        if (fn->blocks[i]->id == id) return i;
+    }
+    return -1;
+}
+
+// Iterative dominators over the layout order. Returns one bitset of
+// `words` words per block, bit d of block b set when d dominates b, and
+// marks the blocks reachable from the entry in `reachable`.
+static uint64_t* ir_compute_dominators(IRFunction* fn, bool* reachable, int words) {
+    int n = fn->num_blocks;
+    uint64_t* dom = (uint64_t*)calloc((size_t)n * words, sizeof(uint64_t));
+    uint64_t* next = (uint64_t*)malloc(words * sizeof(uint64_t));
+    int* stack = (int*)malloc((n + 1) * sizeof(int));
+    int succ[2];
+    int top = 0;
+
+    // Reachability from the entry block
+    memset(reachable, 0, n * sizeof(bool));
+    reachable[0] = true;
+    stack[top++] = 0;
+    while (top > 0) {
+        int b = stack[--top];
+        int count = ir_block_successors(fn, b, succ);
+        for (int s = 0; s < count; s++) {
+            int t = ir_block_index(fn, succ[s]);
+            if (t >= 0 && !reachable[t]) {
+                reachable[t] = true;
+                stack[top++] = t;
+            }
+        }
+    }
+
+    // dom(b) = {b} | intersection of dom(pred)
+    for (int b = 0; b < n; b++) {
+        for (int w = 0; w < words; w++) dom[b * words + w] = b == 0 ? 0 : ~0ULL;
+    }
+    BIT_SET(dom, 0);
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int b = 1; b < n; b++) {
+            if (!reachable[b]) continue;
+            for (int w = 0; w < words; w++) next[w] = ~0ULL;
+            for (int p = 0; p < n; p++) {
+                if (!reachable[p]) continue;
+                int count = ir_block_successors(fn, p, succ);
+                for (int s = 0; s < count; s++) {
+                    if (succ[s] != fn->blocks[b]->id) continue;
+                    for (int w = 0; w < words; w++) next[w] &= dom[p * words + w];
+                }
+            }
+            BIT_SET(next + 0, b);
+            for (int w = 0; w < words; w++) {
+                if (next[w] != dom[b * words + w]) {
+                    dom[b * words + w] = next[w];
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    free(stack);
+    free(next);
+    return dom;
+}
+
+void ir_compute_loop_depths(IRFunction* fn) {
+    int n = fn->num_blocks;
+    int words = (n + 63) / 64;
+    if (n == 0) return;
+
+    bool* reachable = (bool*)malloc(n * sizeof(bool));
+    uint64_t* dom = ir_compute_dominators(fn, reachable, words);
+    int* stack = (int*)malloc((n + 1) * sizeof(int));
+    int succ[2];
+    int top = 0;
+
+    for (int b = 0; b < n; b++) {
+        fn->blocks[b]->loop_depth = 0;
+    }
+
+    // Every back edge tail -> header adds one level to its natural loop body
+    bool* in_loop = (bool*)malloc(n * sizeof(bool));
+    for (int tail = 0; tail < n; tail++) {
+        if (!reachable[tail]) continue;
+        int tail_succ[2];
+        int count = ir_block_successors(fn, tail, tail_succ);
+        for (int s = 0; s < count; s++) {
+            int header = ir_block_index(fn, tail_succ[s]);
+            if (header < 0 || !BIT_TEST(dom + tail * words, header)) continue;
+
+            memset(in_loop, 0, n * sizeof(bool));
+            in_loop[header] = true;
+            top = 0;
+            if (!in_loop[tail]) {
+                in_loop[tail] = true;
+                stack[top++] = tail;
+            }
+            while (top > 0) {
+                int b = stack[--top];
+                for (int p = 0; p < n; p++) {
+                    if (!reachable[p] || in_loop[p]) continue;
+                    int pcount = ir_block_successors(fn, p, succ);
+                    for (int k = 0; k < pcount; k++) {
+                        if (succ[k] == fn->blocks[b]->id) {
+                            in_loop[p] = true;
+                            stack[top++] = p;
+                            break;
+                        }
+                    }
+                }
+            }
+            for (int b = 0; b < n; b++) {
+                if (in_loop[b]) fn->blocks[b]->loop_depth++;
+            }
+        }
+    }
+
+    free(in_loop);
+    free(stack);
+    free(reachable);
+    free(dom);
+}
+
+// If-conversion
+static void ir_remove_block(IRFunction* fn, int index) {
+    IRBlock* block = fn->blocks[index];
+
+    for (int i = index + 1; i < fn->num_blocks; i++) {
+        fn->blocks[i - 1] = fn->blocks[i];
+    }
+    fn->num_blocks--;
+    if (fn->current == block) fn->current = fn->num_blocks ? fn->blocks[fn->num_blocks - 1] : NULL;
+
+    free(block->instrs);
+    free(block->live_in);
+    free(block->live_out);
+    free(block);
+}
+
+// Number of edges into every block, indexed by layout position
+static int* ir_count_preds(IRFunction* fn) {
+    int* preds = (int*)calloc(fn->num_blocks > 0 ? fn->num_blocks : 1, sizeof(int));
+    int succ[2];
+
+    for (int b = 0; b < fn->num_blocks; b++) {
+        int count = ir_block_successors(fn, b, succ);
+        for (int s = 0; s < count; s++) {
+            int index = ir_block_index(fn, succ[s]);
+            if (index >= 0) preds[index]++;
+        }
+    }
+    return preds;
+}
+
+// Instructions that may run on both paths: no stores, calls or traps (div)
+static bool ir_speculatable(IRInstr* instr) {
+    switch (instr->op) {
+        case IR_MOV:
+            return instr->dst.kind == IR_OPND_VREG && instr->src1.kind != IR_OPND_PREG;
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        case IR_LOAD:
+        case IR_SETCC:
+        case IR_SELECT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Layout index of the one block each vreg appears in, or -1 for a vreg seen
+// in several blocks (a local, or a value live across blocks)
+static int* ir_vreg_blocks(IRFunction* fn) {
+    int* blocks = (int*)malloc((fn->num_vregs > 0 ? fn->num_vregs : 1) * sizeof(int));
+    int* ids = (int*)malloc((fn->backend->num_registers + IR_MAX_USES) * sizeof(int));
+
+    for (int v = 0; v < fn->num_vregs; v++) blocks[v] = -2;
+    for (int b = 0; b < fn->num_blocks; b++) {
+        for (int i = 0; i < fn->blocks[b]->num_instrs; i++) {
+            IRInstr* instr = &fn->blocks[b]->instrs[i];
+            int count = ir_instr_use_ids(fn, instr, ids);
+            count += ir_instr_def_ids(fn, instr, ids + count);
+            for (int k = 0; k < count; k++) {
+                if (ids[k] >= fn->num_vregs) continue;
+                blocks[ids[k]] = blocks[ids[k]] == -2 || blocks[ids[k]] == b ? b : -1;
+            }
+        }
+    }
+    free(ids);
+    return blocks;
+}
+
+// An arm is speculatable work ending in one store to a slot, or one copy to
+// a vreg, and a jump to the join. The work may only define vregs used
+// nowhere else, since it runs on both paths once converted.
+static bool ir_select_arm(IRFunction* fn, int index, int* vreg_blocks, IROperand* target,
+                          IROperand* value, int* join, MemoryWidth* width) {
+    IRBlock* block = fn->blocks[index];
+    int n = block->num_instrs;
+    if (n < 2) return false;
+
+    IRInstr* jmp = &block->instrs[n - 1];
+    IRInstr* last = &block->instrs[n - 2];
+    if (jmp->op != IR_JMP || last->src1.kind != IR_OPND_VREG) return false;
+    if (last->op != IR_STORE && (last->op != IR_MOV || last->dst.kind != IR_OPND_VREG)) return false;
+    for (int i = 0; i < n - 2; i++) {
+        IRInstr* instr = &block->instrs[i];
+        if (!ir_speculatable(instr) || vreg_blocks[instr->dst.value] != index) return false;
+    }
+
+    *target = last->dst;
+    *value = last->src1;
+    *join = jmp->target;
+    *width = last->op == IR_STORE ? last->width : MEM_WORD;
+    return true;
+}
+
+// Speculated instructions both arms may add before a branch is cheaper. The
+// RISC-V select is a five-instruction mask sequence, so it gets less room.
+static int ir_select_budget(const TargetBackend* backend) {
+    if (!backend->generate_select) return 0;
+    return backend->arch == TARGET_RISCV64 ? 4 : 6;
+}
+
+static void ir_copy_instrs(IRFunction* fn, IRBlock* from, int count) {
+    for (int i = 0; i < count; i++) {
+        IRInstr* instr = ir_append(fn, from->instrs[i].op);
+        if (instr) *instr = from->instrs[i];
+    }
+}
+
+// Rewrites the branch ending layout block `index` into a select if its arms
+// fit. Returns true when blocks were removed.
+static bool ir_convert_branch(IRFunction* fn, int index, int* preds, int* vreg_blocks, int budget) {
+    IRBlock* block = fn->blocks[index];
+    IRInstr branch = block->instrs[block->num_instrs - 1];
+    int t = ir_block_index(fn, branch.target);
+    int f = ir_block_index(fn, branch.target_false);
+    if (t < 0 || f < 0 || t == f || t == index || f == index) return false;
+
+    int t_join = -1, f_join = -1;
+    IROperand t_target, f_target, t_value, f_value;
+    MemoryWidth t_width = MEM_WORD, f_width = MEM_WORD;
+    bool t_arm = preds[t] == 1 &&
+                 ir_select_arm(fn, t, vreg_blocks, &t_target, &t_value, &t_join, &t_width);
+    bool f_arm = preds[f] == 1 &&
+                 ir_select_arm(fn, f, vreg_blocks, &f_target, &f_value, &f_join, &f_width);
+
+    // Diamond: both arms set the same slot or vreg and meet. Triangle: one
+    // arm sets it and jumps to the other target, which keeps its value.
+    IROperand target;
+    int join;
+    if (t_arm && f_arm && t_target.kind == f_target.kind && t_target.value == f_target.value &&
+        t_join == f_join && t_width == f_width) {
+        target = t_target;
+        join = t_join;
+    } else if (t_arm && t_join == branch.target_false) {
+        target = t_target;
+        join = t_join;
+        f_arm = false;
+    } else if (f_arm && f_join == branch.target) {
+        target = f_target;
+        join = f_join;
+        t_arm = false;
+    } else {
+        return false;
+    }
+    bool to_slot = target.kind == IR_OPND_SLOT;
+    int slot = (int)target.value;
+    if (join == block->id) return false;
+    MemoryWidth width = t_arm ? t_width : f_width;
+
+    int cost = (t_arm ? fn->blocks[t]->num_instrs - 2 : 0) +
+               (f_arm ? fn->blocks[f]->num_instrs - 2 : 0);
+    if (cost > budget) return false;
+
+    IRBlock* saved = fn->current;
+    ir_set_block(fn, block);
+    block->num_instrs--;
+    if (t_arm) ir_copy_instrs(fn, fn->blocks[t], fn->blocks[t]->num_instrs - 2);
+    else t_value = to_slot ? ir_vreg(ir_build_load_sized(fn, slot, width)) : target;
+    if (f_arm) ir_copy_instrs(fn, fn->blocks[f], fn->blocks[f]->num_instrs - 2);
+    else f_value = to_slot ? ir_vreg(ir_build_load_sized(fn, slot, width)) : target;
+
+    int result = ir_new_vreg(fn);
+    IRInstr* select = ir_append(fn, IR_SELECT);
+    if (select) {
+        select->cond = branch.cond;
+        select->dst = ir_vreg(result);
+        select->src1 = branch.src1;
+        select->src2 = branch.src2;
+        select->if_true = t_value;
+        select->if_false = f_value;
+    }
+    if (to_slot) ir_build_store_sized(fn, slot, result, width);
+    else ir_build_mov(fn, target, ir_vreg(result));
+    ir_build_jmp(fn, ir_find_block(fn, join));
+    fn->current = saved;
+
+    IRBlock* t_block = fn->blocks[t];
+    IRBlock* f_block = fn->blocks[f];
+    if (t_arm) ir_remove_block(fn, ir_block_index(fn, t_block->id));
+    if (f_arm) ir_remove_block(fn, ir_block_index(fn, f_block->id));
+    return true;
+}
+
+int ir_if_convert(IRFunction* fn) {
+    int budget = ir_select_budget(fn->backend);
+    int converted = 0;
+    bool changed = budget > 0;
+
+    while (changed) {
+        int n = fn->num_blocks;
+        int* preds = ir_count_preds(fn);
+        int* vreg_blocks = ir_vreg_blocks(fn);
+        changed = false;
+
+        // Innermost diamonds come last in layout; converting them first lets
+        // the enclosing ones match on the next sweep
+        for (int b = n - 1; b >= 0 && !changed; b--) {
+            IRBlock* block = fn->blocks[b];
+            if (block->num_instrs == 0 || block->instrs[block->num_instrs - 1].op != IR_BRANCH) {
+                continue;
+            }
+            if (ir_convert_branch(fn, b, preds, vreg_blocks, budget)) {
+                converted++;
+                changed = true;
+            }
+        }
+        free(vreg_blocks);
+        free(preds);
+    }
+    return converted;
+}
+
+// CFG simplification
+// Gives every block an explicit terminator, so blocks can be removed or
+// merged without changing where their layout predecessor falls through to
+static void ir_terminate_fallthrough(IRFunction* fn) {
+    IRBlock* saved = fn->current;
+    for (int b = 0; b + 1 < fn->num_blocks; b++) {
+        if (ir_block_terminated(fn->blocks[b])) continue;
+        ir_set_block(fn, fn->blocks[b]);
+        ir_build_jmp(fn, fn->blocks[b + 1]);
+    }
+    fn->current = saved;
+}
+
+static void ir_make_jmp(IRInstr* instr, int target) {
+    memset(instr, 0, sizeof(IRInstr));
+    instr->op = IR_JMP;
+    instr->target = target;
+    instr->target_false = -1;
+}
+
+// Points every edge into block `from` at block `to`
+static void ir_retarget(IRFunction* fn, int from, int to) {
+    for (int b = 0; b < fn->num_blocks; b++) {
+        IRBlock* block = fn->blocks[b];
+        if (block->num_instrs == 0) continue;
+        IRInstr* last = &block->instrs[block->num_instrs - 1];
+        if (last->op != IR_JMP && last->op != IR_BRANCH) continue;
+        if (last->target == from) last->target = to;
+        if (last->op == IR_BRANCH && last->target_false == from) last->target_false = to;
+    }
+}
+
+// Traces an operand of the branch ending `block` to a constant (an IMM
+// operand), to a load of a slot the block does not store to afterwards (a
+// SLOT operand) or to a vreg the block does not set, which holds the value
+// it had on entry (a VREG operand). Anything else comes back as
+// IR_OPND_NONE.
+static IROperand ir_branch_value(IRBlock* block, IROperand* operand) {
+    IROperand unknown = {IR_OPND_NONE, 0};
+    if (operand->kind == IR_OPND_IMM) return *operand;
+    if (operand->kind != IR_OPND_VREG) return unknown;
+
+    for (int i = block->num_instrs - 2; i >= 0; i--) {
+        IRInstr* instr = &block->instrs[i];
+        if (instr->dst.kind != IR_OPND_VREG || instr->dst.value != operand->value) continue;
+
+        if (instr->op == IR_MOV && instr->src1.kind == IR_OPND_IMM) return instr->src1;
+        if (instr->op != IR_LOAD) return unknown;
+        for (int j = i + 1; j < block->num_instrs; j++) {
+            IRInstr* store = &block->instrs[j];
+            if (store->op == IR_STORE && store->dst.value == instr->src1.value) return unknown;
+        }
+        return instr->src1;
+    }
+    return *operand;
+}
+
+static bool ir_same_value(IROperand a, IROperand b) {
+    return a.kind != IR_OPND_NONE && a.kind == b.kind && a.value == b.value;
+}
+
+// Outcomes a comparison accepts: bit 0 less, bit 1 equal, bit 2 greater
+static int ir_condition_outcomes(CompareCondition cond) {
+    switch (cond) {
+        case COND_EQ: return 2;
+        case COND_NE: return 5;
+        case COND_LT: return 1;
+        case COND_LE: return 3;
+        case COND_GT: return 4;
+        case COND_GE: return 6;
+    }
+    return 7;
+}
+
+// The same outcomes with the operands swapped
+static int ir_mirror_outcomes(int outcomes) {
+    return ((outcomes & 1) << 2) | (outcomes & 2) | ((outcomes & 4) >> 2);
+}
+
+// Whether the branch ending `block` is taken (1), not taken (0) or unknown
+// (-1) when control arrives along the `taken` edge of the branch ending
+// `pred`. Two constants decide it on their own; otherwise the branches must
+// compare the same slots and constants.
+static int ir_branch_outcome(IRBlock* pred, bool taken, IRBlock* block) {
+    IRInstr* branch = &block->instrs[block->num_instrs - 1];
+    IROperand q1 = ir_branch_value(block, &branch->src1);
+    IROperand q2 = ir_branch_value(block, &branch->src2);
+    int query = ir_condition_outcomes(branch->cond);
+    int fact;
+
+    if (q1.kind == IR_OPND_IMM && q2.kind == IR_OPND_IMM) {
+        fact = q1.value < q2.value ? 1 : q1.value == q2.value ? 2 : 4;
+    } else if (pred) {
+        IRInstr* known = &pred->instrs[pred->num_instrs - 1];
+        IROperand k1 = ir_branch_value(pred, &known->src1);
+        IROperand k2 = ir_branch_value(pred, &known->src2);
+        fact = ir_condition_outcomes(taken ? known->cond : ir_invert_condition(known->cond));
+        if (ir_same_value(k1, q2) && ir_same_value(k2, q1)) {
+            query = ir_mirror_outcomes(query);
+        } else if (!ir_same_value(k1, q1) || !ir_same_value(k2, q2)) {
+            return -1;
+        }
+    } else {
+        return -1;
+    }
+
+    if ((fact & ~query) == 0) return 1;
+    if ((fact & query) == 0) return 0;
+    return -1;
+}
+
+// A block can be jumped past when, besides its branch, it only computes vregs
+// that no other block reads
+static bool ir_block_skippable(IRFunction* fn, int index) {
+    IRBlock* block = fn->blocks[index];
+    bool* defined = (bool*)calloc(fn->num_vregs > 0 ? fn->num_vregs : 1, sizeof(bool));
+    int* ids = (int*)malloc((fn->backend->num_registers + IR_MAX_USES) * sizeof(int));
+    bool skippable = true;
+
+    for (int i = 0; i < block->num_instrs - 1 && skippable; i++) {
+        IRInstr* instr = &block->instrs[i];
+        if (!ir_speculatable(instr)) skippable = false;
+        else defined[instr->dst.value] = true;
+    }
+    for (int b = 0; b < fn->num_blocks && skippable; b++) {
+        if (b == index) continue;
+        for (int i = 0; i < fn->blocks[b]->num_instrs && skippable; i++) {
+            int count = ir_instr_use_ids(fn, &fn->blocks[b]->instrs[i], ids);
+            for (int k = 0; k < count; k++) {
+                if (ids[k] < fn->num_vregs && defined[ids[k]]) skippable = false;
+            }
+        }
+    }
+
+    free(ids);
+    free(defined);
+    return skippable;
+}
+
+static int ir_remove_unreachable(IRFunction* fn) {
+    int n = fn->num_blocks;
+    bool* reachable = (bool*)calloc(n, sizeof(bool));
+    int* stack = (int*)malloc((n + 1) * sizeof(int));
+    int succ[2];
+    int top = 0;
+    int removed = 0;
+
+    reachable[0] = true;
+    stack[top++] = 0;
+    while (top > 0) {
+        int count = ir_block_successors(fn, stack[--top], succ);
+        for (int s = 0; s < count; s++) {
+            int t = ir_block_index(fn, succ[s]);
+            if (t >= 0 && !reachable[t]) {
+                reachable[t] = true;
+                stack[top++] = t;
+            }
+        }
+    }
+
+    for (int b = n - 1; b > 0; b--) {
+        if (reachable[b]) continue;
+        ir_remove_block(fn, b);
+        removed++;
+    }
+
+    free(stack);
+    free(reachable);
+    return removed;
+}
+
+// Branches with both edges to one block, or on two constants, become jumps
+static int ir_fold_branches(IRFunction* fn) {
+    int folded = 0;
+
+    for (int b = 0; b < fn->num_blocks; b++) {
+        IRBlock* block = fn->blocks[b];
+        if (block->num_instrs == 0) continue;
+        IRInstr* last = &block->instrs[block->num_instrs - 1];
+        if (last->op != IR_BRANCH) continue;
+
+        int outcome = last->target == last->target_false ? 1 : ir_branch_outcome(NULL, false, block);
+        if (outcome < 0) continue;
+        ir_make_jmp(last, outcome ? last->target : last->target_false);
+        folded++;
+    }
+    return folded;
+}
+
+// Blocks holding nothing but a jump: their predecessors jump straight on
+static int ir_remove_forwarders(IRFunction* fn) {
+    int removed = 0;
+
+    for (int b = fn->num_blocks - 1; b > 0; b--) {
+        IRBlock* block = fn->blocks[b];
+        if (block->num_instrs != 1 || block->instrs[0].op != IR_JMP) continue;
+        if (block->instrs[0].target == block->id) continue;
+
+        ir_retarget(fn, block->id, block->instrs[0].target);
+        ir_remove_block(fn, b);
+        removed++;
+    }
+    return removed;
+}
+
+// Redirects branch edges into blocks whose own branch the edge already
+// decides, e.g. the inner test of `if (x) { if (x) ... }`
+static int ir_thread_jumps(IRFunction* fn) {
+    int threaded = 0;
+
+    for (int p = 0; p < fn->num_blocks; p++) {
+        IRBlock* pred = fn->blocks[p];
+        if (pred->num_instrs == 0) continue;
+        IRInstr* last = &pred->instrs[pred->num_instrs - 1];
+        if (last->op != IR_BRANCH) continue;
+
+        for (int edge = 0; edge < 2; edge++) {
+            int* target = edge ? &last->target_false : &last->target;
+            int b = ir_block_index(fn, *target);
+            if (b < 0 || b == p) continue;
+            IRBlock* block = fn->blocks[b];
+            if (block->num_instrs == 0 || block->instrs[block->num_instrs - 1].op != IR_BRANCH) {
+                continue;
+            }
+
+            int outcome = ir_branch_outcome(pred, edge == 0, block);
+            if (outcome < 0) continue;
+            IRInstr* branch = &block->instrs[block->num_instrs - 1];
+            int dest = outcome ? branch->target : branch->target_false;
+            if (dest == block->id || !ir_block_skippable(fn, b)) continue;
+
+            *target = dest;
+            threaded++;
+        }
+    }
+    return threaded;
+}
+
+// Appends a block to its only predecessor when that predecessor jumps to it
+static int ir_merge_blocks(IRFunction* fn) {
+    int* preds = ir_count_preds(fn);
+    IRBlock* saved = fn->current;
+    int merged = 0;
+
+    for (int a = 0; a < fn->num_blocks; a++) {
+        IRBlock* block = fn->blocks[a];
+        if (block->num_instrs == 0) continue;
+        IRInstr* last = &block->instrs[block->num_instrs - 1];
+        if (last->op != IR_JMP) continue;
+
+        int b = ir_block_index(fn, last->target);
+        if (b <= 0 || b == a || preds[b] != 1) continue;
+
+        IRBlock* next = fn->blocks[b];
+        ir_set_block(fn, block);
+        block->num_instrs--;
+        ir_copy_instrs(fn, next, next->num_instrs);
+        if (saved == next) saved = block;
+        ir_remove_block(fn, b);
+        memmove(preds + b, preds + b + 1, (fn->num_blocks - b) * sizeof(int));
+        if (b < a) a--;
+        a--;  // The merged block may end in another jump worth following
+        merged++;
+    }
+
+    fn->current = saved;
+    free(preds);
+    return merged;
+}
+
+int ir_simplify_cfg(IRFunction* fn, IRCFGStats* stats) {
+    IRCFGStats local;
+    int total = 0;
+    bool changed = fn->num_blocks > 0;
+
+    if (!stats) {
+        memset(&local, 0, sizeof(local));
+        stats = &local;
+    }
+    if (changed) ir_terminate_fallthrough(fn);
+
+    while (changed) {
+        int unreachable = ir_remove_unreachable(fn);
+        int folded = ir_fold_branches(fn);
+        int forwarders = ir_remove_forwarders(fn);
+        int threaded = ir_thread_jumps(fn);
+        int merged = ir_merge_blocks(fn);
+
+        stats->unreachable += unreachable;
+        stats->folded += folded;
+        stats->forwarders += forwarders;
+        stats->threaded += threaded;
+        stats->merged += merged;
+        changed = unreachable + folded + forwarders + threaded + merged > 0;
+        total += unreachable + folded + forwarders + threaded + merged;
+    }
+    return total;
+}
+
+void ir_cfg_report(IRCFGStats* stats, FILE* out) {
+    fprintf(out, ";; cfg %-14s %d\n", "unreachable", stats->unreachable);
+    fprintf(out, ";; cfg %-14s %d\n", "folded", stats->folded);
+    fprintf(out, ";; cfg %-14s %d\n", "forwarders", stats->forwarders);
+    fprintf(out, ";; cfg %-14s %d\n", "threaded", stats->threaded);
+    fprintf(out, ";; cfg %-14s %d\n", "merged", stats->merged);
+}
+
+// Parameter copy sinking
+static void ir_rename_operand(IROperand* operand, int from, int to) {
+    if (operand->kind == IR_OPND_VREG && operand->value == from) operand->value = to;
+}
+
+static void ir_rename_vreg(IRInstr* instr, int from, int to) {
+    ir_rename_operand(&instr->dst, from, to);
+    ir_rename_operand(&instr->src1, from, to);
+    ir_rename_operand(&instr->src2, from, to);
+    ir_rename_operand(&instr->if_true, from, to);
+    ir_rename_operand(&instr->if_false, from, to);
+}
+
+static bool ir_block_has_call(IRBlock* block) {
+    for (int i = 0; i < block->num_instrs; i++) {
+        if (block->instrs[i].op == IR_CALL) return true;
+    }
+    return false;
+}
+
+static void ir_prepend_mov(IRFunction* fn, IRBlock* block, IROperand dst, IROperand src) {
+    IRBlock* current = fn->current;
+    int count = block->num_instrs;
+
+    fn->current = block;
+    ir_build_mov(fn, dst, src);
+    fn->current = current;
+    if (block->num_instrs == count) return;
+
+    IRInstr mov = block->instrs[count];
+    memmove(&block->instrs[1], &block->instrs[0], count * sizeof(IRInstr));
+    block->instrs[0] = mov;
+}
+
+int ir_sink_param_copies(IRFunction* fn) {
+    if (fn->num_blocks < 2) return 0;
+
+    IRBlock* entry = fn->blocks[0];
+    if (entry->num_instrs == 0 || entry->instrs[entry->num_instrs - 1].op != IR_BRANCH) return 0;
+    if (ir_block_has_call(entry)) return 0;
+
+    // Both arms must be entered from the entry block only, and nothing may
+    // branch back into the entry
+    IRInstr* branch = &entry->instrs[entry->num_instrs - 1];
+    int* preds = ir_count_preds(fn);
+    int arms[2] = {ir_block_index(fn, branch->target), ir_block_index(fn, branch->target_false)};
+    bool ok = preds[0] == 0 && arms[0] > 0 && arms[1] > 0 && arms[0] != arms[1] &&
+              preds[arms[0]] == 1 && preds[arms[1]] == 1;
+    free(preds);
+    if (!ok) return 0;
+
+    ir_compute_liveness(fn);
+
+    int sunk = 0;
+    int count = entry->num_instrs;
+    for (int i = 0; i < count; i++) {
+        IRInstr* instr = &entry->instrs[i];
+        if (instr->op != IR_MOV || instr->dst.kind != IR_OPND_VREG ||
+            instr->src1.kind != IR_OPND_PREG) {
+            continue;
+        }
+        int vreg = (int)instr->dst.value;
+        if (!BIT_TEST(entry->live_out, vreg)) continue;
+
+        // The entry block keeps a short-lived copy that needs no saved register
+        int temp = ir_new_vreg(fn);
+        for (int k = i; k < count; k++) ir_rename_vreg(&entry->instrs[k], vreg, temp);
+
+        for (int a = 0; a < 2; a++) {
+            IRBlock* arm = fn->blocks[arms[a]];
+            if (!BIT_TEST(arm->live_in, vreg)) continue;
+            if (!BIT_TEST(arm->live_out, vreg) && !ir_block_has_call(arm)) {
+                for (int k = 0; k < arm->num_instrs; k++) ir_rename_vreg(&arm->instrs[k], vreg, temp);
+            } else {
+                ir_prepend_mov(fn, arm, ir_vreg(vreg), ir_vreg(temp));
+            }
+        }
+        sunk++;
+    }
+    return sunk;
+}
+
+// Emission
+int ir_frame_offset(IRFunction* fn, int slot) {
+    return fn->frame_bias - (fn->backend->calling_convention->locals_offset + (slot + 1) * 8);
+}
+
+void ir_block_label(IRFunction* fn, int block_id, char* buffer, size_t size) {
+    snprintf(buffer, size, ".L%s_%d", fn->name, block_id);
+}
+
+static int ir_frame_size(IRFunction* fn) {
+    int align = fn->backend->calling_convention->stack_alignment;
+    int size = fn->num_slots * 8;
+    return (size + align - 1) & ~(align - 1);
+}
+
+// Functions without calls need no frame pointer or return-address save.
+// Their slots live in the red zone when it is large enough; otherwise sp is
+// lowered once and slots are addressed upwards from it. Framed functions
+// address slots down from the frame pointer, or up from sp on targets whose
+// short loads and stores only take positive sp offsets.
+static void ir_layout_frame(IRFunction* fn) {
+    const CallingConvention* cc = fn->backend->calling_convention;
+
+    fn->is_leaf = fn->backend->generate_leaf_prologue != NULL;
+    for (int b = 0; b < fn->num_blocks && fn->is_leaf; b++) {
+        for (int i = 0; i < fn->blocks[b]->num_instrs; i++) {
+            if (fn->blocks[b]->instrs[i].op == IR_CALL) {
+                fn->is_leaf = false;
+                break;
+            }
+        }
+    }
+
+    fn->frame_base = cc->frame_pointer;
+    fn->frame_bias = 0;
+    fn->leaf_reserve = 0;
+    if (!fn->is_leaf) {
+        if (cc->slots_from_sp) {
+            fn->frame_base = cc->stack_pointer;
+            fn->frame_bias = ir_frame_size(fn) + cc->locals_offset;
+        }
+        return;
+    }
+
+    // Nothing is saved below the incoming sp, so slots start right under it
+    int needed = fn->num_slots * 8;
+    if (needed > cc->red_zone_size) {
+        fn->leaf_reserve = (needed + cc->stack_alignment - 1) & ~(cc->stack_alignment - 1);
+    }
+    fn->frame_base = cc->stack_pointer;
+    fn->frame_bias = fn->leaf_reserve + cc->locals_offset;
+}
+
+static bool ir_operand_needs_frame(IRFunction* fn, IROperand* operand) {
+    int reg;
+
+    if (operand->kind == IR_OPND_VREG) {
+        reg = fn->vreg_reg[operand->value];
+        if (reg < 0) return true;
+    } else if (operand->kind == IR_OPND_PREG) {
+        reg = (int)operand->value;
+    } else {
+        return false;
+    }
+    for (int i = 0; i < fn->num_saved_regs; i++) {
+        if (fn->saved_regs[i] == reg) return true;
+    }
+    return false;
+}
+
+// Slot accesses count as frame uses: shrink-wrapping only runs when slots
+// are addressed from the frame pointer or from an sp the prologue lowered.
+// Parameters reach the body in vregs, see ir_sink_param_copies.
+static bool ir_block_needs_frame(IRFunction* fn, IRBlock* block) {
+    for (int i = 0; i < block->num_instrs; i++) {
+        IRInstr* instr = &block->instrs[i];
+        if (instr->op == IR_CALL || instr->op == IR_LOAD || instr->op == IR_STORE) return true;
+        if (ir_operand_needs_frame(fn, &instr->dst) ||
+            ir_operand_needs_frame(fn, &instr->src1) ||
+            ir_operand_needs_frame(fn, &instr->src2)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Shrink-wrapping: the prologue and callee-saved stores move down to the
+// nearest block dominating every use of the frame, hoisted out of loops.
+// Returns that reach no such block then leave without touching the stack.
+// Falls back to the entry block when a framed path could reach a return
+// that the save block does not dominate.
+static void ir_shrink_wrap(IRFunction* fn) {
+    int n = fn->num_blocks;
+    int words = (n + 63) / 64;
+    int save = -1;
+    int succ[2];
+
+    fn->prologue_block = 0;
+    for (int b = 0; b < n; b++) fn->blocks[b]->framed = true;
+    if (n < 2 || !fn->backend->generate_leaf_epilogue) return;
+    if (fn->is_leaf && fn->leaf_reserve == 0) return;
+
+    bool* reachable = (bool*)malloc(n * sizeof(bool));
+    uint64_t* dom = ir_compute_dominators(fn, reachable, words);
+    uint64_t* common = (uint64_t*)malloc(words * sizeof(uint64_t));
+    for (int w = 0; w < words; w++) common[w] = ~0ULL;
+
+    bool any = false;
+    for (int b = 0; b < n; b++) {
+        if (!reachable[b] || !ir_block_needs_frame(fn, fn->blocks[b])) continue;
+        for (int w = 0; w < words; w++) common[w] &= dom[b * words + w];
+        any = true;
+    }
+
+    // The deepest common dominator is the one dominated by all the others
+    if (any) {
+        ir_compute_loop_depths(fn);
+        for (int b = 0; b < n; b++) {
+            if (!BIT_TEST(common, b)) continue;
+            if (save < 0 || BIT_TEST(dom + b * words, save)) save = b;
+        }
+        while (save > 0 && fn->blocks[save]->loop_depth > 0) {
+            int idom = -1;
+            for (int d = 0; d < n; d++) {
+                if (d == save || !BIT_TEST(dom + save * words, d)) continue;
+                if (idom < 0 || BIT_TEST(dom + d * words, idom)) idom = d;
+            }
+            save = idom;
+        }
+    }
+
+    if (save > 0) {
+        // Every return reachable from the save block must restore the frame
+        bool* seen = (bool*)calloc(n, sizeof(bool));
+        int* stack = (int*)malloc((n + 1) * sizeof(int));
+        int top = 0;
+        seen[save] = true;
+        stack[top++] = save;
+        while (top > 0 && save > 0) {
+            int b = stack[--top];
+            if (!BIT_TEST(dom + b * words, save)) {
+                IRBlock* block = fn->blocks[b];
+                if (block->num_instrs > 0 && block->instrs[block->num_instrs - 1].op == IR_RET) {
+                    save = 0;
+                }
+            }
+            int count = ir_block_successors(fn, b, succ);
+            for (int s = 0; s < count; s++) {
+                int t = ir_block_index(fn, succ[s]);
+                if (t >= 0 && !seen[t]) {
+                    seen[t] = true;
+                    stack[top++] = t;
+                }
+            }
+        }
+        free(stack);
+        free(seen);
+    }
+
+    if (save > 0) {
+        fn->prologue_block = save;
+        for (int b = 0; b < n; b++) {
+            fn->blocks[b]->framed = BIT_TEST(dom + b * words, save);
+        }
+    }
+
+    free(common);
+    free(dom);
+    free(reachable);
+}
+
+// Where emission goes: assembly text through the backend's generate_*
+// callbacks, or machine code through its encoder. Exactly one of text and
+// code is set.
+typedef struct {
+    const TargetBackend* backend;
+    const MachineEncoder* enc;
+    EmitBuffer* text;
+    CodeBuffer* code;
+    int label_base;     // CodeBuffer label of block id 0
+} IREmitter;
+
+// Branch target: its name when printing, a CodeBuffer label when encoding
+typedef struct {
+    char name[128];
+    int id;
+} IRLabel;
+
+static void ir_block_target(IRFunction* fn, IREmitter* em, int block_id, IRLabel* label) {
+    if (em->code) label->id = em->label_base + block_id;
+    else ir_block_label(fn, block_id, label->name, sizeof(label->name));
+}
+
+static void ir_out_label(IREmitter* em, IRLabel* label) {
+    if (em->code) mcode_bind(em->code, label->id);
+    else em->backend->generate_label(em->text, label->name);
+}
+
+static void ir_out_mov(IREmitter* em, const TargetRegister* dest, const TargetRegister* src) {
+    if (em->code) em->enc->mov(em->code, dest->number, src->number);
+    else em->backend->generate_mov(em->text, dest->name, src->name);
+}
+
+static void ir_out_mov_imm(IREmitter* em, const TargetRegister* dest, long imm) {
+    if (em->code) em->enc->mov_imm(em->code, dest->number, imm);
+    else em->backend->generate_mov_imm(em->text, dest->name, imm);
+}
+
+static void ir_out_arith(IREmitter* em, IROpcode op, const TargetRegister* dest, const TargetRegister* src1,
+                         const TargetRegister* src2) {
+    if (em->code) {
+        void (*encode)(CodeBuffer*, int, int, int) = em->enc->div;
+        if (op == IR_ADD) encode = em->enc->add;
+        else if (op == IR_SUB) encode = em->enc->sub;
+        else if (op == IR_MUL) encode = em->enc->mul;
+        encode(em->code, dest->number, src1->number, src2->number);
+        return;
+    }
+
+    const TargetBackend* backend = em->backend;
+    if (op == IR_ADD) backend->generate_add(em->text, dest->name, src1->name, src2->name);
+    else if (op == IR_SUB) backend->generate_sub(em->text, dest->name, src1->name, src2->name);
+    else if (op == IR_MUL) backend->generate_mul(em->text, dest->name, src1->name, src2->name);
+    else backend->generate_div(em->text, dest->name, src1->name, src2->name);
+}
+
+static void ir_out_arith_imm(IREmitter* em, IROpcode op, const TargetRegister* dest, const TargetRegister* src,
+                             long imm) {
+    if (em->code) {
+        if (op == IR_MUL) em->enc->mul_imm(em->code, dest->number, src->number, imm);
+        else em->enc->add_imm(em->code, dest->number, src->number, imm);
+        return;
+    }
+
+    if (op == IR_MUL) em->backend->generate_mul_imm(em->text, dest->name, src->name, imm);
+    else em->backend->generate_add_imm(em->text, dest->name, src->name, imm);
+}
+
+static void ir_out_load(IREmitter* em, MemoryWidth width, const TargetRegister* dest,
+                        const TargetRegister* base, int offset) {
+    const TargetBackend* backend = em->backend;
+
+    if (em->code) {
+        em->enc->load(em->code, width, dest->number, base->number, offset);
+    } else if (width != MEM_WORD && backend->generate_load_sized) {
+        backend->generate_load_sized(em->text, width, dest->name, base->name, offset);
+    } else {
+        backend->generate_load(em->text, dest->name, base->name, offset);
+    }
+}
+
+static void ir_out_store(IREmitter* em, MemoryWidth width, const TargetRegister* src,
+                         const TargetRegister* base, int offset) {
+    const TargetBackend* backend = em->backend;
+
+    if (em->code) {
+        em->enc->store(em->code, width, src->number, base->number, offset);
+    } else if (width != MEM_WORD && backend->generate_store_sized) {
+        backend->generate_store_sized(em->text, width, src->name, base->name, offset);
+    } else {
+        backend->generate_store(em->text, src->name, base->name, offset);
+    }
+}
+
+static void ir_out_load_indexed(IREmitter* em, MemoryWidth width, const TargetRegister* dest,
+                                const TargetRegister* base, const TargetRegister* index, int shift,
+                                int offset) {
+    if (em->code) {
+        em->enc->load_indexed(em->code, width, dest->number, base->number, index->number,
+                              shift, offset);
+    } else {
+        em->backend->generate_load_indexed(em->text, width, dest->name, base->name, index->name,
+                                           shift, offset);
+    }
+}
+
+static void ir_out_vzero(IREmitter* em, int bits, const TargetRegister* dest) {
+    if (em->code) em->enc->vzero(em->code, bits, dest->number);
+    else em->backend->generate_vzero(em->text, bits, dest->name);
+}
+
+static void ir_out_vadd_indexed(IREmitter* em, int bits, bool subtract, const TargetRegister* dest,
+                                const TargetRegister* base, const TargetRegister* index, int shift,
+                                int offset) {
+    if (em->code) {
+        em->enc->vadd_indexed(em->code, bits, subtract, dest->number, base->number,
+                              index->number, shift, offset);
+    } else {
+        em->backend->generate_vadd_indexed(em->text, bits, subtract, dest->name, base->name,
+                                           index->name, shift, offset);
+    }
+}
+
+static void ir_out_vreduce(IREmitter* em, int bits, const TargetRegister* dest, const TargetRegister* src) {
+    if (em->code) em->enc->vreduce(em->code, bits, dest->number, src->number);
+    else em->backend->generate_vreduce(em->text, bits, dest->name, src->name);
+}
+
+static void ir_out_setcc(IREmitter* em, CompareCondition cond, const TargetRegister* dest,
+                         const TargetRegister* op1, const TargetRegister* op2) {
+    if (em->code) em->enc->setcc(em->code, cond, dest->number, op1->number, op2->number);
+    else em->backend->generate_setcc(em->text, cond, dest->name, op1->name, op2->name);
+}
+
+// op2 is NULL to branch on op1 against zero
+static void ir_out_branch(IREmitter* em, CompareCondition cond, const TargetRegister* op1,
+                          const TargetRegister* op2, IRLabel* label) {
+    if (em->code) {
+        if (op2) em->enc->branch(em->code, cond, op1->number, op2->number, label->id);
+        else em->enc->branch_zero(em->code, cond, op1->number, label->id);
+    } else {
+        if (op2) em->backend->generate_branch(em->text, cond, op1->name, op2->name, label->name);
+        else em->backend->generate_branch_zero(em->text, cond, op1->name, label->name);
+    }
+}
+
+static void ir_out_jmp(IREmitter* em, IRLabel* label) {
+    if (em->code) em->enc->jmp(em->code, label->id);
+    else em->backend->generate_jmp(em->text, label->name);
+}
+
+static void ir_out_call(IREmitter* em, const char* symbol) {
+    if (em->code) em->enc->call(em->code, symbol);
+    else em->backend->generate_call(em->text, symbol);
+}
+
+static void ir_out_frame(IREmitter* em, bool leaf, bool enter, int stack_size) {
+    const TargetBackend* backend = em->backend;
+    const MachineEncoder* enc = em->enc;
+
+    if (em->code) {
+        if (leaf && enter) enc->leaf_prologue(em->code, stack_size);
+        else if (leaf) enc->leaf_epilogue(em->code, stack_size);
+        else if (enter) enc->prologue(em->code, stack_size);
+        else enc->epilogue(em->code, stack_size);
+    } else {
+        if (leaf && enter) backend->generate_leaf_prologue(em->text, stack_size);
+        else if (leaf) backend->generate_leaf_epilogue(em->text, stack_size);
+        else if (enter) backend->generate_prologue(em->text, stack_size);
+        else backend->generate_epilogue(em->text, stack_size);
+    }
+}
+
+// Resolves a register operand, reloading spilled vregs into a scratch register
+static const TargetRegister* ir_use_operand(IRFunction* fn, IREmitter* em, IROperand* operand, int* scratch) {
+    const TargetBackend* backend = fn->backend;
+
+    if (operand->kind == IR_OPND_PREG) {
+        return backend->registers[operand->value];
+    }
+
+    int reg = fn->vreg_reg[operand->value];
+    if (reg >= 0) return backend->registers[reg];
+
+    const TargetRegister* temp = backend->scratch_registers[(*scratch)++];
+    ir_out_load(em, MEM_WORD, temp, fn->frame_base,
+                ir_frame_offset(fn, fn->vreg_slot[operand->value]));
+    return temp;
+}
+
+static const TargetRegister* ir_def_operand(IRFunction* fn, IROperand* operand) {
+    const TargetBackend* backend = fn->backend;
+
+    if (operand->kind == IR_OPND_PREG) {
+        return backend->registers[operand->value];
+    }
+
+    int reg = fn->vreg_reg[operand->value];
+    if (reg >= 0) return backend->registers[reg];
+    return backend->scratch_registers[0];
+}
+
+static void ir_finish_def(IRFunction* fn, IREmitter* em, IROperand* operand) {
+    if (operand->kind == IR_OPND_VREG && fn->vreg_reg[operand->value] < 0) {
+        ir_out_store(em, MEM_WORD, fn->backend->scratch_registers[0], fn->frame_base,
+                     ir_frame_offset(fn, fn->vreg_slot[operand->value]));
+    }
+}
+
+static bool ir_has_pairs(IREmitter* em) {
+    if (em->code) return em->enc->store_pair != NULL && em->enc->load_pair != NULL;
+    return em->backend->generate_store_pair != NULL && em->backend->generate_load_pair != NULL;
+}
+
+// first at [base + offset], second in the word above it
+static void ir_out_pair(IREmitter* em, bool load, const TargetRegister* first, const TargetRegister* second,
+                        const TargetRegister* base, int offset) {
+    const TargetBackend* backend = em->backend;
+
+    if (em->code && load) {
+        em->enc->load_pair(em->code, first->number, second->number, base->number, offset);
+    } else if (em->code) {
+        em->enc->store_pair(em->code, first->number, second->number, base->number, offset);
+    } else if (load) {
+        backend->generate_load_pair(em->text, first->name, second->name, base->name, offset);
+    } else {
+        backend->generate_store_pair(em->text, first->name, second->name, base->name, offset);
+    }
+}
+
+// Registers whose slots are adjacent go out as one paired access where the
+// target has them
+static void ir_emit_saved_registers(IRFunction* fn, IREmitter* em, bool restore) {
+    const TargetBackend* backend = fn->backend;
+    bool pairs = ir_has_pairs(em);
+
+    for (int i = 0; i < fn->num_saved_regs; i++) {
+        const TargetRegister* reg = backend->registers[fn->saved_regs[i]];
+        int offset = ir_frame_offset(fn, fn->saved_slots[i]);
+        if (pairs && i + 1 < fn->num_saved_regs &&
+            ir_frame_offset(fn, fn->saved_slots[i + 1]) == offset - 8) {
+            // Slots grow downwards, so the next register is the lower word
+            ir_out_pair(em, restore, backend->registers[fn->saved_regs[i + 1]], reg,
+                        fn->frame_base, offset - 8);
+            i++;
+            continue;
+        }
+        if (restore) {
+            ir_out_load(em, MEM_WORD, reg, fn->frame_base, offset);
+        } else {
+            ir_out_store(em, MEM_WORD, reg, fn->frame_base, offset);
+        }
+    }
+}
+
+static bool ir_operand_spilled(IRFunction* fn, IROperand* operand) {
+    return operand->kind == IR_OPND_VREG && fn->vreg_reg[operand->value] < 0;
+}
+
+// Branchless through the backend when every operand has a register; with
+// spills the scratch registers are taken, so fall back to a short diamond
+static void ir_emit_select(IRFunction* fn, IREmitter* em, IRBlock* block, IRInstr* instr) {
+    const TargetBackend* backend = fn->backend;
+    IRLabel label;
+    IRLabel done;
+    int scratch = 0;
+    const TargetRegister* a = ir_use_operand(fn, em, &instr->src1, &scratch);
+    const TargetRegister* b = instr->src2.kind == IR_OPND_IMM ? NULL
+                                                       : ir_use_operand(fn, em, &instr->src2, &scratch);
+    const TargetRegister* d;
+    const TargetRegister* v;
+
+    bool has_select = em->code ? em->enc->select != NULL : backend->generate_select != NULL;
+    if (has_select && !ir_operand_spilled(fn, &instr->dst) &&
+        !ir_operand_spilled(fn, &instr->src1) && !ir_operand_spilled(fn, &instr->src2) &&
+        !ir_operand_spilled(fn, &instr->if_true) && !ir_operand_spilled(fn, &instr->if_false)) {
+        const TargetRegister* t = ir_use_operand(fn, em, &instr->if_true, &scratch);
+        const TargetRegister* f = ir_use_operand(fn, em, &instr->if_false, &scratch);
+        d = ir_def_operand(fn, &instr->dst);
+        if (em->code) {
+            em->enc->select(em->code, instr->cond, d->number, a->number, b ? b->number : -1,
+                            t->number, f->number);
+        } else {
+            backend->generate_select(em->text, instr->cond, d->name, a->name,
+                                     b ? b->name : NULL, t->name, f->name);
+        }
+        return;
+    }
+
+    int index = (int)(instr - block->instrs);
+    if (em->code) {
+        label.id = mcode_new_labels(em->code, 2);
+        done.id = label.id + 1;
+    } else {
+        snprintf(label.name, sizeof(label.name), ".L%s_%d_sel%d", fn->name, block->id, index);
+        snprintf(done.name, sizeof(done.name), ".L%s_%d_sel%d_done", fn->name, block->id, index);
+    }
+    ir_out_branch(em, instr->cond, a, b, &label);
+
+    IROperand* values[2] = {&instr->if_false, &instr->if_true};
+    for (int i = 0; i < 2; i++) {
+        if (i == 1) ir_out_label(em, &label);
+        scratch = 0;
+        v = ir_use_operand(fn, em, values[i], &scratch);
+        d = ir_def_operand(fn, &instr->dst);
+        if (d != v) ir_out_mov(em, d, v);
+        ir_finish_def(fn, em, &instr->dst);
+        if (i == 0) ir_out_jmp(em, &done);
+    }
+    ir_out_label(em, &done);
+}
+
+static void ir_emit_instr(IRFunction* fn, IREmitter* em, IRBlock* block, IRInstr* instr, int next_block) {
+    const TargetRegister* fp = fn->frame_base;
+    IRLabel label;
+    int scratch = 0;
+    const TargetRegister* a;
+    const TargetRegister* b;
+    const TargetRegister* d;
+
+    switch (instr->op) {
+        case IR_MOV:
+            if (instr->src1.kind == IR_OPND_IMM) {
+                d = ir_def_operand(fn, &instr->dst);
+                ir_out_mov_imm(em, d, instr->src1.value);
+                ir_finish_def(fn, em, &instr->dst);
+                break;
+            }
+            a = ir_use_operand(fn, em, &instr->src1, &scratch);
+            if (instr->dst.kind == IR_OPND_VREG && fn->vreg_reg[instr->dst.value] < 0) {
+                ir_out_store(em, MEM_WORD, a, fp,
+                             ir_frame_offset(fn, fn->vreg_slot[instr->dst.value]));
+                break;
+            }
+            d = ir_def_operand(fn, &instr->dst);
+            if (d != a) ir_out_mov(em, d, a);
+            break;
+
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        case IR_DIV:
+            a = ir_use_operand(fn, em, &instr->src1, &scratch);
+            if (instr->src2.kind == IR_OPND_IMM) {
+                d = ir_def_operand(fn, &instr->dst);
+                ir_out_arith_imm(em, instr->op, d, a, instr->src2.value);
+                ir_finish_def(fn, em, &instr->dst);
+                break;
+            }
+            b = ir_use_operand(fn, em, &instr->src2, &scratch);
+            d = ir_def_operand(fn, &instr->dst);
+            ir_out_arith(em, instr->op, d, a, b);
+            ir_finish_def(fn, em, &instr->dst);
+            break;
+
+        case IR_LOAD:
+            d = ir_def_operand(fn, &instr->dst);
+            ir_out_load(em, instr->width, d, fp, ir_frame_offset(fn, (int)instr->src1.value));
+            ir_finish_def(fn, em, &instr->dst);
+            break;
+
+        case IR_LOAD_INDEXED:
+            a = ir_use_operand(fn, em, &instr->src1, &scratch);
+            d = ir_def_operand(fn, &instr->dst);
+            if (instr->src2.kind == IR_OPND_NONE) {
+                ir_out_load(em, instr->width, d, a, instr->disp);
+            } else {
+                b = ir_use_operand(fn, em, &instr->src2, &scratch);
+                ir_out_load_indexed(em, instr->width, d, a, b, instr->shift, instr->disp);
+            }
+            ir_finish_def(fn, em, &instr->dst);
+            break;
+
+        case IR_VZERO:
+            ir_out_vzero(em, fn->vector_bits, ir_def_operand(fn, &instr->dst));
+            break;
+
+        case IR_VADD:
+        case IR_VSUB:
+            a = ir_use_operand(fn, em, &instr->src1, &scratch);
+            b = ir_use_operand(fn, em, &instr->src2, &scratch);
+            ir_out_vadd_indexed(em, fn->vector_bits, instr->op == IR_VSUB,
+                                ir_def_operand(fn, &instr->dst), a, b, instr->shift, instr->disp);
+            break;
+
+        case IR_VREDUCE:
+            d = ir_def_operand(fn, &instr->dst);
+            ir_out_vreduce(em, fn->vector_bits, d, ir_use_operand(fn, em, &instr->src1, &scratch));
+            ir_finish_def(fn, em, &instr->dst);
+            break;
+
+        case IR_STORE:
+            a = ir_use_operand(fn, em, &instr->src1, &scratch);
+            ir_out_store(em, instr->width, a, fp, ir_frame_offset(fn, (int)instr->dst.value));
+            break;
+
+        case IR_SETCC:
+            a = ir_use_operand(fn, em, &instr->src1, &scratch);
+            b = ir_use_operand(fn, em, &instr->src2, &scratch);
+            d = ir_def_operand(fn, &instr->dst);
+            ir_out_setcc(em, instr->cond, d, a, b);
+            ir_finish_def(fn, em, &instr->dst);
+            break;
+
+        case IR_SELECT:
+            ir_emit_select(fn, em, block, instr);
+            break;
+
+        case IR_BRANCH: {
+            // Branch on the inverted condition when the true target falls through
+            CompareCondition cond = instr->cond;
+            int taken = instr->target;
+            int other = instr->target_false;
+            if (taken == next_block) {
+                cond = ir_invert_condition(cond);
+                taken = instr->target_false;
+                other = instr->target;
+            }
+
+            a = ir_use_operand(fn, em, &instr->src1, &scratch);
+            b = instr->src2.kind == IR_OPND_IMM ? NULL
+                                                : ir_use_operand(fn, em, &instr->src2, &scratch);
+            ir_block_target(fn, em, taken, &label);
+            ir_out_branch(em, cond, a, b, &label);
+            if (other != next_block) {
+                ir_block_target(fn, em, other, &label);
+                ir_out_jmp(em, &label);
+            }
+            break;
+        }
+
+        case IR_JMP:
+            if (instr->target != next_block) {
+                ir_block_target(fn, em, instr->target, &label);
+                ir_out_jmp(em, &label);
+            }
+            break;
+
+        case IR_CALL:
+            ir_out_call(em, instr->symbol);
+            break;
+
+        case IR_RET:
+            if (!block->framed) {
+                ir_out_frame(em, true, false, 0);
+                break;
+            }
+            ir_emit_saved_registers(fn, em, true);
+            if (fn->is_leaf) {
+                ir_out_frame(em, true, false, fn->leaf_reserve);
+            } else {
+                ir_out_frame(em, false, false, ir_frame_size(fn));
+            }
+            break;
+    }
+}
+
+static void ir_emit_frame_setup(IRFunction* fn, IREmitter* em) {
+    if (fn->is_leaf) {
+        ir_out_frame(em, true, true, fn->leaf_reserve);
+    } else {
+        ir_out_frame(em, false, true, ir_frame_size(fn));
+    }
+    ir_emit_saved_registers(fn, em, false);
+}
+
+static bool ir_emit_body(IRFunction* fn, IREmitter* em) {
+    IRLabel label;
+
+    if (!fn->vreg_reg && fn->num_vregs > 0) {
+        fprintf(stderr, "ir: function %s emitted before register allocation\n", fn->name);
+        return false;
+    }
+
+    ir_layout_frame(fn);
+    ir_shrink_wrap(fn);
+    if (em->code) {
+        mcode_define_symbol(em->code, fn->name);
+        em->label_base = mcode_new_labels(em->code, fn->next_block_id);
+    } else {
+        em->backend->generate_label(em->text, fn->name);
+    }
+    if (fn->prologue_block == 0) ir_emit_frame_setup(fn, em);
+
+    for (int b = 0; b < fn->num_blocks; b++) {
+        IRBlock* block = fn->blocks[b];
+        int next_block = b + 1 < fn->num_blocks ? fn->blocks[b + 1]->id : -1;
+
+        ir_block_target(fn, em, block->id, &label);
+        ir_out_label(em, &label);
+        if (b > 0 && b == fn->prologue_block) ir_emit_frame_setup(fn, em);
+        for (int i = 0; i < block->num_instrs; i++) {
+            ir_emit_instr(fn, em, block, &block->instrs[i], next_block);
+        }
+    }
+    return true;
+}
+
+void ir_emit_function(IRFunction* fn, EmitBuffer* out) {
+    IREmitter em = {fn->backend, NULL, out, NULL, 0};
+    out->features = fn->features;
+    ir_emit_body(fn, &em);
+}
+
+// Emitted again from the start while mcode_relax widens branches that
+// cannot reach their label
+bool ir_encode_function(IRFunction* fn, CodeBuffer* out) {
+    IREmitter em = {fn->backend, fn->backend->encoder, NULL, out, 0};
+    MCodeMark mark;
+
+    if (!em.enc) {
+        fprintf(stderr, "ir: no machine-code encoder for %s\n", fn->backend->name);
+        return false;
+    }
+    out->features = fn->features;
+    mcode_mark(out, &mark);
+    do {
+        mcode_rewind(out, &mark);
+        if (!ir_emit_body(fn, &em)) return false;
+    } while (mcode_relax(out));
+    return mcode_resolve_labels(out);
+}
@@ -0,0 +1,206 @@
+// ALETHEIA Backend IR
+// Target-independent machine IR over virtual registers, shared by all targets
+
+#ifndef ALETHEIA_IR_H
+#define ALETHEIA_IR_H
+
+#include "backend.h"
+
+// IR opcodes
+typedef enum {
+    IR_MOV,     // dst = src1 (register or immediate)
+    IR_ADD,     // dst = src1 + src2 (src2 may be an immediate)
+    IR_SUB,     // dst = src1 - src2
+    IR_MUL,     // dst = src1 * src2 (src2 may be an immediate)
+    IR_DIV,     // dst = src1 / src2 (signed)
+    IR_LOAD,    // dst = frame slot src1 (extended from `width`)
+    IR_STORE,   // frame slot dst = src1 (low `width` bytes)
+    IR_LOAD_INDEXED, // dst = memory at src1 + (src2 << shift) + disp (src2 may be none)
+    IR_VZERO,   // vector dst = 0
+    IR_VADD,    // vector dst += 64-bit lanes at src1 + (src2 << shift) + disp
+    IR_VSUB,    // vector dst -= 64-bit lanes at src1 + (src2 << shift) + disp
+    IR_VREDUCE, // dst = sum of the 64-bit lanes of vector src1 (clobbered)
+    IR_SETCC,   // dst = (src1 cond src2) ? 1 : 0
+    IR_SELECT,  // dst = (src1 cond src2) ? if_true : if_false (src2 may be imm 0)
+    IR_BRANCH,  // if (src1 cond src2) goto target else goto target_false (src2 may be imm 0)
+    IR_JMP,     // goto target
+    IR_CALL,    // call symbol, clobbers caller-saved registers
+    IR_RET      // epilogue and return (value already in the return register)
+} IROpcode;
+
+// Operand kinds
+typedef enum {
+    IR_OPND_NONE,
+    IR_OPND_VREG,   // Virtual register number
+    IR_OPND_PREG,   // Index into backend->registers
+    IR_OPND_IMM,    // Immediate value
+    IR_OPND_SLOT    // Frame slot index
+} IROperandKind;
+
+typedef struct {
+    IROperandKind kind;
+    long value;
+} IROperand;
+
+typedef struct {
+    IROpcode op;
+    CompareCondition cond;
+    IROperand dst;
+    IROperand src1;
+    IROperand src2;
+    IROperand if_true;  // IR_SELECT values
+    IROperand if_false;
+    int target;         // Block id for IR_BRANCH/IR_JMP
+    int target_false;   // Fall-through block id for IR_BRANCH
+    const char* symbol; // Callee for IR_CALL
+    int num_args;       // Argument registers read by IR_CALL
+    MemoryWidth width;  // IR_LOAD/IR_STORE/IR_LOAD_INDEXED access size, MEM_WORD by default
+    int shift;          // IR_LOAD_INDEXED/IR_VADD/IR_VSUB index scale as a shift count (0-3)
+    int disp;           // IR_LOAD_INDEXED/IR_VADD/IR_VSUB constant displacement
+} IRInstr;
+
+typedef struct {
+    int id;
+    IRInstr* instrs;
+    int num_instrs;
+    int capacity;
+    int loop_depth;
+    bool framed;        // Runs with the frame set up, see ir_emit_function
+    uint64_t* live_in;  // Filled by ir_compute_liveness
+    uint64_t* live_out;
+} IRBlock;
+
+typedef struct {
+    const char* name;
+    const TargetBackend* backend;
+    uint32_t features;  // Extensions this function may use, baseline ISA by default
+    int vector_bits;    // Vector width for those features, 0 without SIMD lowering
+
+    IRBlock** blocks;   // Layout order
+    int num_blocks;
+    int block_capacity;
+    int next_block_id;  // Ids stay unique when passes remove blocks
+    IRBlock* current;   // Insertion point for builders
+
+    int num_vregs;
+    int num_slots;
+
+    // Register allocation results
+    int* vreg_reg;      // Backend register index, or -1 if spilled
+    int* vreg_slot;     // Spill slot for spilled vregs
+    int* saved_regs;    // Callee-saved registers written by the function
+    int num_saved_regs;
+    int* saved_slots;
+    int num_spilled;
+
+    // Frame addressing, chosen by ir_emit_function. Leaf functions skip the
+    // frame pointer and address slots from the stack pointer instead.
+    bool is_leaf;
+    const TargetRegister* frame_base;
+    int frame_bias;     // Added to every slot offset
+    int leaf_reserve;   // Bytes a leaf function moves sp by
+    int prologue_block; // Layout index the prologue is shrink-wrapped into
+} IRFunction;
+
+// Function and block construction
+IRFunction* ir_create_function(const TargetBackend* backend, const char* name);
+void ir_set_function_features(IRFunction* fn, uint32_t features);
+void ir_free_function(IRFunction* fn);
+IRBlock* ir_create_block(IRFunction* fn);
+void ir_set_block(IRFunction* fn, IRBlock* block);
+// Moves `block` to right after `after` in the layout, for front ends that
+// create a block before the code that should precede it
+void ir_move_block_after(IRFunction* fn, IRBlock* block, IRBlock* after);
+IRBlock* ir_find_block(IRFunction* fn, int id);
+int ir_new_vreg(IRFunction* fn);
+int ir_new_slot(IRFunction* fn);
+bool ir_block_terminated(IRBlock* block);
+
+// Instruction builders (append at the insertion point)
+IROperand ir_vreg(int vreg);
+IROperand ir_preg(int index);
+IROperand ir_imm(long value);
+int ir_build_mov_imm(IRFunction* fn, long value);
+void ir_build_mov(IRFunction* fn, IROperand dst, IROperand src);
+int ir_build_binary(IRFunction* fn, IROpcode op, int lhs, int rhs);
+int ir_build_binary_imm(IRFunction* fn, IROpcode op, int lhs, long imm);
+int ir_build_load(IRFunction* fn, int slot);
+void ir_build_store(IRFunction* fn, int slot, int vreg);
+int ir_build_load_sized(IRFunction* fn, int slot, MemoryWidth width);
+void ir_build_store_sized(IRFunction* fn, int slot, int vreg, MemoryWidth width);
+int ir_build_load_indexed(IRFunction* fn, int base, int index, int shift, int disp,
+                          MemoryWidth width);
+int ir_build_setcc(IRFunction* fn, CompareCondition cond, int lhs, int rhs);
+void ir_build_branch(IRFunction* fn, CompareCondition cond, int lhs, int rhs,
+                     IRBlock* if_true, IRBlock* if_false);
+void ir_build_branch_zero(IRFunction* fn, CompareCondition cond, int vreg,
+                          IRBlock* if_true, IRBlock* if_false);
+void ir_build_jmp(IRFunction* fn, IRBlock* target);
+bool ir_build_arg(IRFunction* fn, int index, int vreg);
+int ir_build_param(IRFunction* fn, int index);
+int ir_build_call(IRFunction* fn, const char* symbol, int num_args);
+void ir_build_ret(IRFunction* fn, int vreg);
+
+// Vector operands are fixed REG_CLASS_VEC registers rather than vregs; the
+// allocators leave them alone. Only valid when fn->vector_bits is nonzero.
+int ir_vector_register(IRFunction* fn, int n);
+void ir_build_vzero(IRFunction* fn, int vec);
+void ir_build_vadd_indexed(IRFunction* fn, IROpcode op, int vec, int base, int index, int shift,
+                           int disp);
+int ir_build_vreduce(IRFunction* fn, int vec);
+
+CompareCondition ir_invert_condition(CompareCondition cond);
+
+// Operand helpers shared by the register allocators. Live ids number the
+// vregs first, followed by every backend register.
+#define IR_MAX_USES 16
+int ir_num_live_ids(IRFunction* fn);
+int ir_live_id(IRFunction* fn, IROperand* operand);
+int ir_instr_use_ids(IRFunction* fn, IRInstr* instr, int* ids);
+int ir_instr_def_ids(IRFunction* fn, IRInstr* instr, int* ids);
+bool ir_register_allocatable(const TargetBackend* backend, int index);
+int ir_block_successors(IRFunction* fn, int index, int* succ);
+
+// Dataflow liveness over vregs and backend registers
+void ir_compute_liveness(IRFunction* fn);
+
+// Natural-loop nesting depth of every block (from dominators and back edges)
+void ir_compute_loop_depths(IRFunction* fn);
+
+// If-conversion: collapses small side-effect-free diamonds and triangles that
+// store to one slot into an IR_SELECT. Run before register allocation.
+int ir_if_convert(IRFunction* fn);
+
+// CFG simplification: removes unreachable blocks and empty forwarders, folds
+// branches with a known outcome, threads branch edges past blocks whose test
+// the edge decides, and merges blocks into their only predecessor. Run before
+// register allocation. Counts accumulate into `stats` (may be NULL); returns
+// the number of changes.
+typedef struct {
+    int unreachable;    // Blocks no path from the entry reaches
+    int folded;         // Branches turned into jumps
+    int forwarders;     // Jump-only blocks bypassed
+    int threaded;       // Branch edges redirected past a decided test
+    int merged;         // Blocks appended to their only predecessor
+} IRCFGStats;
+
+int ir_simplify_cfg(IRFunction* fn, IRCFGStats* stats);
+void ir_cfg_report(IRCFGStats* stats, FILE* out);
+
+// Moves parameter copies that outlive an entry block ending in a branch into
+// the arms that need them, so an early exit does not touch the callee-saved
+// register a value living across calls is given. Run after CFG
+// simplification; returns the number of copies sunk.
+int ir_sink_param_copies(IRFunction* fn);
+
+// Emission through the backend callbacks (after register allocation)
+int ir_frame_offset(IRFunction* fn, int slot);
+void ir_block_label(IRFunction* fn, int block_id, char* buffer, size_t size);
+void ir_emit_function(IRFunction* fn, EmitBuffer* out);
+
+// Same emission encoded straight into machine code through the backend's
+// encoder; block branches are resolved before returning. False when the
+// target has no encoder or a label could not be resolved.
+bool ir_encode_function(IRFunction* fn, CodeBuffer* out);
+
+#endif // ALETHEIA_IR_H
@@ -0,0 +1,309 @@
+// ALETHEIA Instruction Selection
+// Dynamic-programming tree labeling and reduction over a target rule table
+
+#include "isel.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ISEL_INFINITE (1 << 28)
+
+// Everything a reduced nonterminal can deliver: a register, an immediate,
+// or the parts of an address
+typedef struct {
+    int reg;
+    long imm;
+    int base;
+    int index;      // -1 for none
+    int shift;
+    long disp;
+} IselValue;
+
+void isel_init(IselTree* tree, IRFunction* fn) {
+    memset(tree, 0, sizeof(IselTree));
+    tree->fn = fn;
+    tree->rules = fn->backend->isel_rules;
+    tree->num_rules = fn->backend->num_isel_rules;
+}
+
+void isel_free(IselTree* tree) {
+    free(tree->nodes);
+    tree->nodes = NULL;
+    tree->num_nodes = 0;
+    tree->capacity = 0;
+}
+
+static int isel_new_node(IselTree* tree, IselOp op) {
+    if (tree->num_nodes == tree->capacity) {
+        int capacity = tree->capacity ? tree->capacity * 2 : 64;
+        IselNode* nodes = (IselNode*)realloc(tree->nodes, capacity * sizeof(IselNode));
+        if (!nodes) return -1;
+        tree->nodes = nodes;
+        tree->capacity = capacity;
+    }
+
+    IselNode* node = &tree->nodes[tree->num_nodes];
+    memset(node, 0, sizeof(IselNode));
+    node->op = op;
+    node->kids[0] = node->kids[1] = -1;
+    return tree->num_nodes++;
+}
+
+static int isel_leaf(IselTree* tree, IselOp op, long value) {
+    int index = isel_new_node(tree, op);
+    if (index >= 0) tree->nodes[index].value = value;
+    return index;
+}
+
+int isel_const(IselTree* tree, long value) {
+    return isel_leaf(tree, ISEL_CONST, value);
+}
+
+int isel_vreg(IselTree* tree, int vreg) {
+    return isel_leaf(tree, ISEL_VREG, vreg);
+}
+
+int isel_slot(IselTree* tree, int slot) {
+    return isel_leaf(tree, ISEL_SLOT, slot);
+}
+
+static bool isel_is_const(IselTree* tree, int node) {
+    return tree->nodes[node].op == ISEL_CONST;
+}
+
+// Commutative operators keep a constant on the right, where the rules
+// expect immediates; adding 0 or multiplying by 1 leaves the operand as is
+int isel_binary(IselTree* tree, IselOp op, int lhs, int rhs) {
+    if (lhs < 0 || rhs < 0) return -1;
+    if ((op == ISEL_ADD || op == ISEL_MUL) && isel_is_const(tree, lhs) && !isel_is_const(tree, rhs)) {
+        int swap = lhs;
+        lhs = rhs;
+        rhs = swap;
+    }
+    if (isel_is_const(tree, rhs)) {
+        long value = tree->nodes[rhs].value;
+        if ((op == ISEL_ADD || op == ISEL_SUB || op == ISEL_SHL) && value == 0) return lhs;
+        if ((op == ISEL_MUL || op == ISEL_DIV) && value == 1) return lhs;
+    }
+
+    int index = isel_new_node(tree, op);
+    if (index < 0) return -1;
+    tree->nodes[index].kids[0] = lhs;
+    tree->nodes[index].kids[1] = rhs;
+    return index;
+}
+
+// Swapping the operands of a comparison mirrors its condition
+static CompareCondition isel_mirror_condition(CompareCondition cond) {
+    switch (cond) {
+        case COND_LT: return COND_GT;
+        case COND_LE: return COND_GE;
+        case COND_GT: return COND_LT;
+        case COND_GE: return COND_LE;
+        default: return cond;
+    }
+}
+
+int isel_compare(IselTree* tree, CompareCondition cond, int lhs, int rhs) {
+    if (lhs < 0 || rhs < 0) return -1;
+    if (isel_is_const(tree, lhs) && !isel_is_const(tree, rhs)) {
+        int swap = lhs;
+        lhs = rhs;
+        rhs = swap;
+        cond = isel_mirror_condition(cond);
+    }
+
+    int index = isel_binary(tree, ISEL_CMP, lhs, rhs);
+    if (index >= 0) tree->nodes[index].cond = cond;
+    return index;
+}
+
+int isel_load(IselTree* tree, MemoryWidth width, int addr) {
+    if (addr < 0) return -1;
+    int index = isel_new_node(tree, ISEL_LOAD);
+    if (index < 0) return -1;
+    tree->nodes[index].kids[0] = addr;
+    tree->nodes[index].width = width;
+    return index;
+}
+
+static int isel_arity(IselOp op) {
+    switch (op) {
+        case ISEL_CONST:
+        case ISEL_VREG:
+        case ISEL_SLOT:
+            return 0;
+        case ISEL_LOAD:
+            return 1;
+        default:
+            return 2;
+    }
+}
+
+static bool isel_rule_enabled(IselTree* tree, const IselRule* rule) {
+    return (tree->fn->features & rule->features) == rule->features;
+}
+
+static bool isel_record(IselNode* node, IselNonterm nt, int cost, int rule) {
+    if (cost >= node->cost[nt]) return false;
+    node->cost[nt] = cost;
+    node->rule[nt] = (short)rule;
+    return true;
+}
+
+// Bottom-up: the cheapest rule for every nonterminal at every node, then
+// chain rules closed until nothing gets cheaper
+static void isel_label(IselTree* tree, int index) {
+    IselNode* node = &tree->nodes[index];
+    int arity = isel_arity(node->op);
+
+    for (int k = 0; k < arity; k++) isel_label(tree, node->kids[k]);
+    for (int nt = 0; nt < ISEL_NUM_NTS; nt++) {
+        node->cost[nt] = ISEL_INFINITE;
+        node->rule[nt] = -1;
+    }
+
+    for (int r = 0; r < tree->num_rules; r++) {
+        const IselRule* rule = &tree->rules[r];
+        if (rule->op != (int)node->op || !isel_rule_enabled(tree, rule)) continue;
+        if (node->op == ISEL_CONST && (node->value < rule->min || node->value > rule->max)) continue;
+
+        int cost = rule->cost;
+        for (int k = 0; k < arity && cost < ISEL_INFINITE; k++) {
+            cost += tree->nodes[node->kids[k]].cost[rule->kids[k]];
+        }
+        if (cost < ISEL_INFINITE) isel_record(node, rule->lhs, cost, r);
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int r = 0; r < tree->num_rules; r++) {
+            const IselRule* rule = &tree->rules[r];
+            if (rule->op != ISEL_CHAIN_OP || !isel_rule_enabled(tree, rule)) continue;
+            if (node->cost[rule->kids[0]] >= ISEL_INFINITE) continue;
+            if (isel_record(node, rule->lhs, node->cost[rule->kids[0]] + rule->cost, r)) {
+                changed = true;
+            }
+        }
+    }
+}
+
+static IROpcode isel_ir_opcode(IselOp op) {
+    switch (op) {
+        case ISEL_SUB: return IR_SUB;
+        case ISEL_MUL: return IR_MUL;
+        case ISEL_DIV: return IR_DIV;
+        default: return IR_ADD;
+    }
+}
+
+// Top-down: reduces the kids to the nonterminals the chosen rule names, left
+// to right, then builds the rule's own instructions
+static IselValue isel_reduce(IselTree* tree, int index, IselNonterm nt, IRBlock** targets) {
+    IRFunction* fn = tree->fn;
+    IselNode* node = &tree->nodes[index];
+    IselValue value = {-1, 0, -1, -1, 0, 0};
+    IselValue kids[2] = {{-1, 0, -1, -1, 0, 0}, {-1, 0, -1, -1, 0, 0}};
+
+    if (node->rule[nt] < 0) {
+        fprintf(stderr, "isel: no rule covers operator %d as nonterminal %d\n", node->op, nt);
+        value.reg = ir_build_mov_imm(fn, 0);
+        return value;
+    }
+
+    const IselRule* rule = &tree->rules[node->rule[nt]];
+    if (rule->op == ISEL_CHAIN_OP) {
+        kids[0] = isel_reduce(tree, index, rule->kids[0], targets);
+    } else {
+        for (int k = 0; k < isel_arity(node->op); k++) {
+            kids[k] = isel_reduce(tree, node->kids[k], rule->kids[k], targets);
+        }
+    }
+
+    switch (rule->action) {
+        case ISEL_ACT_IMM:
+            value.imm = node->value;
+            break;
+        case ISEL_ACT_MOV_IMM:
+            value.reg = ir_build_mov_imm(fn, node->value);
+            break;
+        case ISEL_ACT_VREG:
+            value.reg = (int)node->value;
+            break;
+        case ISEL_ACT_LOAD_SLOT:
+            value.reg = ir_build_load(fn, (int)node->value);
+            break;
+        case ISEL_ACT_OP:
+            value.reg = ir_build_binary(fn, isel_ir_opcode(node->op), kids[0].reg, kids[1].reg);
+            break;
+        case ISEL_ACT_OP_IMM:
+            value.reg = ir_build_binary_imm(fn, isel_ir_opcode(node->op), kids[0].reg, kids[1].imm);
+            break;
+        case ISEL_ACT_SUB_IMM:
+            value.reg = ir_build_binary_imm(fn, IR_ADD, kids[0].reg, -kids[1].imm);
+            break;
+        case ISEL_ACT_SHL:
+            value.reg = ir_build_binary(fn, IR_MUL, kids[0].reg,
+                                        ir_build_mov_imm(fn, 1L << kids[1].imm));
+            break;
+        case ISEL_ACT_SETCC:
+            value.reg = ir_build_setcc(fn, node->cond, kids[0].reg, kids[1].reg);
+            break;
+        case ISEL_ACT_INDEX:
+            value.index = kids[0].reg;
+            value.shift = (int)kids[1].imm;
+            break;
+        case ISEL_ACT_INDEX_REG:
+            value.index = kids[0].reg;
+            break;
+        case ISEL_ACT_BASE_INDEX:
+            value = kids[1];
+            value.base = kids[0].reg;
+            break;
+        case ISEL_ACT_BASE:
+            value.base = kids[0].reg;
+            break;
+        case ISEL_ACT_BASE_DISP:
+            value.base = kids[0].reg;
+            value.disp = kids[1].imm;
+            break;
+        case ISEL_ACT_KEEP:
+            value = kids[0];
+            break;
+        case ISEL_ACT_ADD_DISP:
+            value = kids[0];
+            value.disp += kids[1].imm;
+            break;
+        case ISEL_ACT_LOAD:
+            value.reg = ir_build_load_indexed(fn, kids[0].base, kids[0].index, kids[0].shift,
+                                              (int)kids[0].disp, node->width);
+            break;
+        case ISEL_ACT_BRANCH:
+            ir_build_branch(fn, node->cond, kids[0].reg, kids[1].reg, targets[0], targets[1]);
+            break;
+        case ISEL_ACT_BRANCH_ZERO:
+            ir_build_branch_zero(fn, node->cond, kids[0].reg, targets[0], targets[1]);
+            break;
+    }
+    return value;
+}
+
+int isel_reduce_value(IselTree* tree, int node) {
+    if (node < 0) return ir_build_mov_imm(tree->fn, 0);
+    isel_label(tree, node);
+    return isel_reduce(tree, node, ISEL_NT_REG, NULL).reg;
+}
+
+void isel_reduce_branch(IselTree* tree, int node, IRBlock* if_true, IRBlock* if_false) {
+    IRBlock* targets[2] = {if_true, if_false};
+
+    if (node >= 0 && tree->nodes[node].op != ISEL_CMP) {
+        node = isel_compare(tree, COND_NE, node, isel_const(tree, 0));
+    }
+    if (node < 0) {
+        ir_build_jmp(tree->fn, if_false);
+        return;
+    }
+    isel_label(tree, node);
+    isel_reduce(tree, node, ISEL_NT_BRANCH, targets);
+}
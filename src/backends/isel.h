@@ -0,0 +1,138 @@
+// ALETHEIA Instruction Selection
+// Bottom-up rewrite (BURS) selection over expression trees. Each target
+// describes its instructions as a table of tree-pattern rules with latency
+// costs; a dynamic-programming labeler finds the cheapest cover of a tree
+// and the reducer builds the IR for it. The front end builds one tree per
+// side-effect-free expression and reduces it where the value is needed.
+
+#ifndef ALETHEIA_ISEL_H
+#define ALETHEIA_ISEL_H
+
+#include <limits.h>
+#include "ir.h"
+
+// Tree node operators. Binary nodes read kids[0] and kids[1], ISEL_LOAD
+// only kids[0].
+typedef enum {
+    ISEL_CONST, // Constant value
+    ISEL_VREG,  // Value already computed into vreg `value` (calls, assignments)
+    ISEL_SLOT,  // Local variable in frame slot `value`, loaded when reduced
+    ISEL_ADD,
+    ISEL_SUB,
+    ISEL_MUL,
+    ISEL_DIV,
+    ISEL_SHL,   // kids[0] << constant kids[1]
+    ISEL_CMP,   // kids[0] `cond` kids[1], 0 or 1
+    ISEL_LOAD,  // `width` load from the address kids[0]
+    ISEL_NUM_OPS
+} IselOp;
+
+// Nonterminals: the forms a subtree's value can be delivered in
+typedef enum {
+    ISEL_NT_REG,     // Value in a register
+    ISEL_NT_ADDIMM,  // Constant an add-immediate encodes
+    ISEL_NT_SUBIMM,  // Constant whose negation an add-immediate encodes
+    ISEL_NT_MULIMM,  // Constant a multiply-immediate encodes
+    ISEL_NT_ZERO,    // Constant zero
+    ISEL_NT_SCALE,   // Shift count an indexed load scales its index by
+    ISEL_NT_DISP,    // Constant displacement of a load
+    ISEL_NT_INDEX,   // Register shifted by a SCALE
+    ISEL_NT_BASEIDX, // Base register plus an INDEX
+    ISEL_NT_ADDR,    // Base register, optional scaled index, displacement
+    ISEL_NT_BRANCH,  // Conditional branch on a comparison
+    ISEL_NUM_NTS
+} IselNonterm;
+
+// What reducing a rule builds
+typedef enum {
+    ISEL_ACT_IMM,         // Constant kept as an immediate
+    ISEL_ACT_MOV_IMM,     // Constant materialized into a register
+    ISEL_ACT_VREG,
+    ISEL_ACT_LOAD_SLOT,
+    ISEL_ACT_OP,          // Register-register arithmetic
+    ISEL_ACT_OP_IMM,      // Register-immediate add or multiply
+    ISEL_ACT_SUB_IMM,     // Subtraction as an add of the negated immediate
+    ISEL_ACT_SHL,         // Shift as a multiply by the power of two
+    ISEL_ACT_SETCC,
+    ISEL_ACT_INDEX,       // INDEX from SHL(REG, SCALE)
+    ISEL_ACT_INDEX_REG,   // INDEX from a plain register, shift 0
+    ISEL_ACT_BASE_INDEX,  // BASEIDX from ADD(REG, INDEX)
+    ISEL_ACT_BASE,        // ADDR from a plain register
+    ISEL_ACT_BASE_DISP,   // ADDR from ADD(REG, DISP)
+    ISEL_ACT_KEEP,        // ADDR from a BASEIDX as is
+    ISEL_ACT_ADD_DISP,    // ADDR from ADD(BASEIDX, DISP)
+    ISEL_ACT_LOAD,
+    ISEL_ACT_BRANCH,
+    ISEL_ACT_BRANCH_ZERO
+} IselAction;
+
+#define ISEL_CHAIN_OP (-1)
+
+// One tree pattern: `op` with its kids delivered as the given nonterminals
+// produces `lhs`. Chain rules (op ISEL_CHAIN_OP) turn kids[0] into lhs
+// without consuming a node. A leaf rule on ISEL_CONST only matches values
+// within [min, max].
+typedef struct IselRule {
+    IselNonterm lhs;
+    int op;
+    IselNonterm kids[2];
+    long min;
+    long max;
+    int cost;           // Latency in cycles
+    IselAction action;
+    uint32_t features;  // TARGET_FEATURE_* bits the rule needs
+} IselRule;
+
+#define ISEL_ANY_MIN LONG_MIN
+#define ISEL_ANY_MAX LONG_MAX
+
+#define ISEL_LEAF(lhs, op, cost, action) \
+    {lhs, op, {ISEL_NT_REG, ISEL_NT_REG}, ISEL_ANY_MIN, ISEL_ANY_MAX, cost, action, 0}
+#define ISEL_IMM(lhs, min, max) \
+    {lhs, ISEL_CONST, {ISEL_NT_REG, ISEL_NT_REG}, min, max, 0, ISEL_ACT_IMM, 0}
+#define ISEL_RULE(lhs, op, kid0, kid1, cost, action) \
+    {lhs, op, {kid0, kid1}, 0, 0, cost, action, 0}
+#define ISEL_CHAIN(lhs, from, cost, action) \
+    {lhs, ISEL_CHAIN_OP, {from, ISEL_NT_REG}, 0, 0, cost, action, 0}
+#define ISEL_RULE_IF(features, lhs, op, kid0, kid1, cost, action) \
+    {lhs, op, {kid0, kid1}, 0, 0, cost, action, features}
+
+typedef struct {
+    IselOp op;
+    CompareCondition cond;  // ISEL_CMP
+    MemoryWidth width;      // ISEL_LOAD
+    long value;             // ISEL_CONST value, ISEL_VREG vreg, ISEL_SLOT slot
+    int kids[2];
+    int cost[ISEL_NUM_NTS]; // Cheapest cover per nonterminal, set by labeling
+    short rule[ISEL_NUM_NTS];
+} IselNode;
+
+// Node pool for one function; trees are built bottom-up and referred to by
+// node index. Reducing a tree does not free its nodes.
+typedef struct {
+    IRFunction* fn;
+    const IselRule* rules;
+    int num_rules;
+    IselNode* nodes;
+    int num_nodes;
+    int capacity;
+} IselTree;
+
+void isel_init(IselTree* tree, IRFunction* fn);
+void isel_free(IselTree* tree);
+
+// Node builders; they return -1 once an allocation has failed
+int isel_const(IselTree* tree, long value);
+int isel_vreg(IselTree* tree, int vreg);
+int isel_slot(IselTree* tree, int slot);
+int isel_binary(IselTree* tree, IselOp op, int lhs, int rhs);
+int isel_compare(IselTree* tree, CompareCondition cond, int lhs, int rhs);
+int isel_load(IselTree* tree, MemoryWidth width, int addr);
+
+// Covers the tree rooted at `node` at minimum cost and builds it at the
+// insertion point. isel_reduce_value returns the vreg holding the value;
+// isel_reduce_branch ends the block with a branch on the tree being nonzero.
+int isel_reduce_value(IselTree* tree, int node);
+void isel_reduce_branch(IselTree* tree, int node, IRBlock* if_true, IRBlock* if_false);
+
+#endif // ALETHEIA_ISEL_H
@@ -0,0 +1,402 @@
+// ALETHEIA Machine Code Buffer
+// Byte buffer plus label fixups, relocations and symbols for encoders
+
+#include "mcode.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MCODE_INITIAL_CAPACITY 4096
+
+void mcode_buffer_init(CodeBuffer* buf) {
+    memset(buf, 0, sizeof(CodeBuffer));
+}
+
+void mcode_buffer_free(CodeBuffer* buf) {
+    for (int i = 0; i < buf->num_relocs; i++) free(buf->relocs[i].symbol);
+    for (int i = 0; i < buf->num_symbols; i++) free(buf->symbols[i].name);
+    free(buf->data);
+    free(buf->labels);
+    free(buf->fixups);
+    free(buf->widened);
+    free(buf->relocs);
+    free(buf->symbols);
+    mcode_buffer_init(buf);
+}
+
+void mcode_buffer_reset(CodeBuffer* buf) {
+    for (int i = 0; i < buf->num_relocs; i++) free(buf->relocs[i].symbol);
+    for (int i = 0; i < buf->num_symbols; i++) free(buf->symbols[i].name);
+    buf->size = 0;
+    buf->failed = false;
+    buf->compressed = 0;
+    buf->num_labels = 0;
+    buf->num_fixups = 0;
+    buf->num_widened = 0;
+    buf->num_relocs = 0;
+    buf->num_symbols = 0;
+}
+
+// Grows an array of `item` sized elements to hold `needed` of them
+static bool mcode_grow(CodeBuffer* buf, void** items, int* capacity, int needed, size_t item) {
+    if (needed <= *capacity) return true;
+
+    int count = *capacity ? *capacity : 16;
+    while (count < needed) count *= 2;
+    void* grown = realloc(*items, (size_t)count * item);
+    if (!grown) {
+        buf->failed = true;
+        return false;
+    }
+    *items = grown;
+    *capacity = count;
+    return true;
+}
+
+static bool mcode_reserve(CodeBuffer* buf, size_t extra) {
+    if (buf->failed) return false;
+    if (buf->size + extra <= buf->capacity) return true;
+
+    size_t capacity = buf->capacity ? buf->capacity : MCODE_INITIAL_CAPACITY;
+    while (capacity < buf->size + extra) capacity *= 2;
+    uint8_t* data = (uint8_t*)realloc(buf->data, capacity);
+    if (!data) {
+        buf->failed = true;
+        return false;
+    }
+    buf->data = data;
+    buf->capacity = capacity;
+    return true;
+}
+
+void mcode_byte(CodeBuffer* buf, uint8_t byte) {
+    if (!mcode_reserve(buf, 1)) return;
+    buf->data[buf->size++] = byte;
+}
+
+void mcode_bytes(CodeBuffer* buf, const uint8_t* bytes, size_t length) {
+    if (!mcode_reserve(buf, length)) return;
+    memcpy(buf->data + buf->size, bytes, length);
+    buf->size += length;
+}
+
+void mcode_u16(CodeBuffer* buf, uint16_t value) {
+    if (!mcode_reserve(buf, 2)) return;
+    buf->data[buf->size++] = (uint8_t)value;
+    buf->data[buf->size++] = (uint8_t)(value >> 8);
+}
+
+void mcode_u32(CodeBuffer* buf, uint32_t value) {
+    if (!mcode_reserve(buf, 4)) return;
+    for (int i = 0; i < 4; i++) buf->data[buf->size++] = (uint8_t)(value >> (i * 8));
+}
+
+void mcode_u64(CodeBuffer* buf, uint64_t value) {
+    if (!mcode_reserve(buf, 8)) return;
+    for (int i = 0; i < 8; i++) buf->data[buf->size++] = (uint8_t)(value >> (i * 8));
+}
+
+int mcode_new_labels(CodeBuffer* buf, int count) {
+    int first = buf->num_labels;
+    if (!mcode_grow(buf, (void**)&buf->labels, &buf->label_capacity, first + count, sizeof(long))) {
+        return 0;
+    }
+    for (int i = 0; i < count; i++) buf->labels[first + i] = -1;
+    buf->num_labels += count;
+    return first;
+}
+
+void mcode_bind(CodeBuffer* buf, int label) {
+    if (label < 0 || label >= buf->num_labels) {
+        buf->failed = true;
+        return;
+    }
+    buf->labels[label] = (long)buf->size;
+}
+
+// Records a fixup at the current offset; the caller appends the field
+static void mcode_add_fixup(CodeBuffer* buf, int label, MCodeFieldKind kind) {
+    int n = buf->num_fixups;
+    if (!mcode_grow(buf, (void**)&buf->fixups, &buf->fixup_capacity, n + 1, sizeof(MCodeFixup))) {
+        return;
+    }
+    buf->fixups[n].label = label;
+    buf->fixups[n].offset = buf->size;
+    buf->fixups[n].kind = kind;
+    buf->num_fixups++;
+}
+
+void mcode_rel32_label(CodeBuffer* buf, int label) {
+    mcode_add_fixup(buf, label, MCODE_REL32);
+    mcode_u32(buf, 0);
+}
+
+void mcode_insn_label(CodeBuffer* buf, uint32_t insn, MCodeFieldKind kind, int label) {
+    mcode_add_fixup(buf, label, kind);
+    mcode_u32(buf, insn);
+}
+
+void mcode_insn16_label(CodeBuffer* buf, uint16_t insn, MCodeFieldKind kind, int label) {
+    mcode_add_fixup(buf, label, kind);
+    mcode_u16(buf, insn);
+}
+
+static char* mcode_strdup(CodeBuffer* buf, const char* s) {
+    size_t len = strlen(s);
+    char* copy = (char*)malloc(len + 1);
+    if (!copy) {
+        buf->failed = true;
+        return NULL;
+    }
+    memcpy(copy, s, len + 1);
+    return copy;
+}
+
+static void mcode_add_reloc(CodeBuffer* buf, const char* symbol, MCodeFieldKind kind) {
+    int n = buf->num_relocs;
+    if (!mcode_grow(buf, (void**)&buf->relocs, &buf->reloc_capacity, n + 1, sizeof(MCodeReloc))) {
+        return;
+    }
+    buf->relocs[n].symbol = mcode_strdup(buf, symbol);
+    if (!buf->relocs[n].symbol) return;
+    buf->relocs[n].offset = buf->size;
+    buf->relocs[n].kind = kind;
+    buf->num_relocs++;
+}
+
+void mcode_rel32_symbol(CodeBuffer* buf, const char* symbol) {
+    mcode_add_reloc(buf, symbol, MCODE_REL32);
+    mcode_u32(buf, 0);
+}
+
+void mcode_abs64_symbol(CodeBuffer* buf, const char* symbol) {
+    mcode_add_reloc(buf, symbol, MCODE_ABS64);
+    mcode_u64(buf, 0);
+}
+
+void mcode_insn_symbol(CodeBuffer* buf, uint32_t insn, MCodeFieldKind kind, const char* symbol) {
+    mcode_add_reloc(buf, symbol, kind);
+    mcode_u32(buf, insn);
+}
+
+static void mcode_close_symbol(CodeBuffer* buf) {
+    if (buf->num_symbols == 0) return;
+    MCodeSymbol* last = &buf->symbols[buf->num_symbols - 1];
+    last->size = buf->size - last->offset;
+}
+
+void mcode_define_symbol(CodeBuffer* buf, const char* name) {
+    int n = buf->num_symbols;
+    mcode_close_symbol(buf);
+    if (!mcode_grow(buf, (void**)&buf->symbols, &buf->symbol_capacity, n + 1, sizeof(MCodeSymbol))) {
+        return;
+    }
+    buf->symbols[n].name = mcode_strdup(buf, name);
+    if (!buf->symbols[n].name) return;
+    buf->symbols[n].offset = buf->size;
+    buf->symbols[n].size = 0;
+    buf->num_symbols++;
+}
+
+// Width in bits of a branch field and how many low bits of the distance
+// it drops: AArch64 counts words, RISC-V counts bytes with bit 0 implied
+static int mcode_field_bits(MCodeFieldKind kind, int* scale) {
+    *scale = 1;
+    switch (kind) {
+        case MCODE_A64_BRANCH26: *scale = 4; return 26;
+        case MCODE_A64_BRANCH19: *scale = 4; return 19;
+        case MCODE_A64_BRANCH14: *scale = 4; return 14;
+        case MCODE_RV_BRANCH: return 13;
+        case MCODE_RV_JAL: return 21;
+        case MCODE_RV_CBRANCH: return 9;
+        case MCODE_RV_CJUMP: return 12;
+        default: return 32;
+    }
+}
+
+static bool mcode_reaches(MCodeFieldKind kind, size_t offset, long target) {
+    int scale;
+    int bits = mcode_field_bits(kind, &scale);
+    long delta = target - (long)offset;
+
+    if (kind == MCODE_REL32 || kind == MCODE_RV_CALL) return true;
+    return delta % scale == 0 && delta / scale >= -(1L << (bits - 1)) &&
+           delta / scale < (1L << (bits - 1));
+}
+
+// Bits hi..lo of a RISC-V branch offset, moved down to bit `to`
+static uint32_t mcode_rv_bits(uint32_t offset, int hi, int lo, int to) {
+    return ((offset >> lo) & ((1u << (hi - lo + 1)) - 1)) << to;
+}
+
+// RISC-V scatters the byte offset over the instruction in an order each
+// format fixes
+static uint32_t mcode_rv_scatter(MCodeFieldKind kind, uint32_t d) {
+    switch (kind) {
+        case MCODE_RV_BRANCH:
+            return mcode_rv_bits(d, 12, 12, 31) | mcode_rv_bits(d, 10, 5, 25) |
+                   mcode_rv_bits(d, 4, 1, 8) | mcode_rv_bits(d, 11, 11, 7);
+        case MCODE_RV_JAL:
+            return mcode_rv_bits(d, 20, 20, 31) | mcode_rv_bits(d, 10, 1, 21) |
+                   mcode_rv_bits(d, 11, 11, 20) | mcode_rv_bits(d, 19, 12, 12);
+        case MCODE_RV_CBRANCH:
+            return mcode_rv_bits(d, 8, 8, 12) | mcode_rv_bits(d, 4, 3, 10) |
+                   mcode_rv_bits(d, 7, 6, 5) | mcode_rv_bits(d, 2, 1, 3) |
+                   mcode_rv_bits(d, 5, 5, 2);
+        default:
+            return mcode_rv_bits(d, 11, 11, 12) | mcode_rv_bits(d, 4, 4, 11) |
+                   mcode_rv_bits(d, 9, 8, 9) | mcode_rv_bits(d, 10, 10, 8) |
+                   mcode_rv_bits(d, 6, 6, 7) | mcode_rv_bits(d, 7, 7, 6) |
+                   mcode_rv_bits(d, 3, 1, 3) | mcode_rv_bits(d, 5, 5, 2);
+    }
+}
+
+// Writes the distance to `target` into the field at `offset`; false when
+// the target is out of the field's reach
+static bool mcode_patch(CodeBuffer* buf, size_t offset, MCodeFieldKind kind, long target) {
+    uint8_t* field = buf->data + offset;
+    int scale;
+    int bits = mcode_field_bits(kind, &scale);
+    long delta;
+
+    if (kind == MCODE_REL32) {
+        delta = target - (long)(offset + 4);
+        for (int j = 0; j < 4; j++) field[j] = (uint8_t)((uint32_t)delta >> (j * 8));
+        return true;
+    }
+    if (!mcode_reaches(kind, offset, target)) return false;
+
+    delta = target - (long)offset;
+    if (kind == MCODE_RV_CBRANCH || kind == MCODE_RV_CJUMP) {
+        uint16_t keep = kind == MCODE_RV_CBRANCH ? 0xE383 : 0xE003;
+        uint16_t insn = (uint16_t)(field[0] | field[1] << 8);
+        insn = (uint16_t)((insn & keep) | mcode_rv_scatter(kind, (uint32_t)delta));
+        field[0] = (uint8_t)insn;
+        field[1] = (uint8_t)(insn >> 8);
+        return true;
+    }
+
+    uint32_t insn = (uint32_t)field[0] | (uint32_t)field[1] << 8 |
+                    (uint32_t)field[2] << 16 | (uint32_t)field[3] << 24;
+    if (kind == MCODE_RV_BRANCH) {
+        insn = (insn & 0x01FFF07F) | mcode_rv_scatter(kind, (uint32_t)delta);
+    } else if (kind == MCODE_RV_JAL) {
+        insn = (insn & 0x00000FFF) | mcode_rv_scatter(kind, (uint32_t)delta);
+    } else {
+        int shift = kind == MCODE_A64_BRANCH26 ? 0 : 5;
+        uint32_t mask = ((1u << bits) - 1) << shift;
+        insn = (insn & ~mask) | (((uint32_t)(delta / scale) << shift) & mask);
+    }
+    for (int j = 0; j < 4; j++) field[j] = (uint8_t)(insn >> (j * 8));
+    return true;
+}
+
+int mcode_branch_form(CodeBuffer* buf) {
+    return buf->num_fixups < buf->num_widened ? buf->widened[buf->num_fixups] : 0;
+}
+
+bool mcode_relax(CodeBuffer* buf) {
+    bool widened = false;
+
+    for (int i = 0; i < buf->num_fixups && !buf->failed; i++) {
+        MCodeFixup* fixup = &buf->fixups[i];
+        if (fixup->kind != MCODE_RV_BRANCH && fixup->kind != MCODE_RV_CBRANCH &&
+            fixup->kind != MCODE_RV_CJUMP) {
+            continue;
+        }
+        // Unbound labels are left for mcode_resolve_labels to report
+        if (fixup->label < 0 || fixup->label >= buf->num_labels || buf->labels[fixup->label] < 0 ||
+            mcode_reaches(fixup->kind, fixup->offset, buf->labels[fixup->label])) {
+            continue;
+        }
+
+        int n = buf->num_widened;
+        if (i >= n) {
+            if (!mcode_grow(buf, (void**)&buf->widened, &buf->widened_capacity, i + 1, 1)) break;
+            memset(buf->widened + n, 0, (size_t)(i + 1 - n));
+            buf->num_widened = i + 1;
+        }
+        buf->widened[i]++;
+        widened = true;
+    }
+    return widened && !buf->failed;
+}
+
+void mcode_mark(CodeBuffer* buf, MCodeMark* mark) {
+    mark->size = buf->size;
+    mark->compressed = buf->compressed;
+    mark->num_labels = buf->num_labels;
+    mark->num_fixups = buf->num_fixups;
+    mark->num_relocs = buf->num_relocs;
+    mark->num_symbols = buf->num_symbols;
+}
+
+void mcode_rewind(CodeBuffer* buf, const MCodeMark* mark) {
+    for (int i = mark->num_relocs; i < buf->num_relocs; i++) free(buf->relocs[i].symbol);
+    for (int i = mark->num_symbols; i < buf->num_symbols; i++) free(buf->symbols[i].name);
+    buf->size = mark->size;
+    buf->compressed = mark->compressed;
+    buf->num_labels = mark->num_labels;
+    buf->num_fixups = mark->num_fixups;
+    buf->num_relocs = mark->num_relocs;
+    buf->num_symbols = mark->num_symbols;
+}
+
+bool mcode_resolve_labels(CodeBuffer* buf) {
+    bool ok = !buf->failed;
+
+    for (int i = 0; i < buf->num_fixups && ok; i++) {
+        MCodeFixup* fixup = &buf->fixups[i];
+        if (fixup->label < 0 || fixup->label >= buf->num_labels || buf->labels[fixup->label] < 0) {
+            fprintf(stderr, "mcode: branch to unbound label %d\n", fixup->label);
+            ok = false;
+            break;
+        }
+        if (!mcode_patch(buf, fixup->offset, fixup->kind, buf->labels[fixup->label])) {
+            fprintf(stderr, "mcode: branch to label %d out of range\n", fixup->label);
+            ok = false;
+            break;
+        }
+    }
+
+    mcode_close_symbol(buf);
+    buf->num_labels = 0;
+    buf->num_fixups = 0;
+    buf->num_widened = 0;
+    if (!ok) buf->failed = true;
+    return ok;
+}
+
+bool mcode_append(CodeBuffer* dst, const CodeBuffer* src) {
+    size_t base = dst->size;
+
+    if (src->failed) dst->failed = true;
+    if (dst->failed) return false;
+
+    mcode_close_symbol(dst);
+    if (src->size > 0) mcode_bytes(dst, src->data, src->size);
+    dst->compressed += src->compressed;
+    for (int i = 0; i < src->num_relocs && !dst->failed; i++) {
+        int n = dst->num_relocs;
+        if (!mcode_grow(dst, (void**)&dst->relocs, &dst->reloc_capacity, n + 1, sizeof(MCodeReloc))) {
+            break;
+        }
+        dst->relocs[n].symbol = mcode_strdup(dst, src->relocs[i].symbol);
+        if (!dst->relocs[n].symbol) break;
+        dst->relocs[n].offset = base + src->relocs[i].offset;
+        dst->relocs[n].kind = src->relocs[i].kind;
+        dst->num_relocs++;
+    }
+    for (int i = 0; i < src->num_symbols && !dst->failed; i++) {
+        int n = dst->num_symbols;
+        if (!mcode_grow(dst, (void**)&dst->symbols, &dst->symbol_capacity, n + 1, sizeof(MCodeSymbol))) {
+            break;
+        }
+        dst->symbols[n].name = mcode_strdup(dst, src->symbols[i].name);
+        if (!dst->symbols[n].name) break;
+        dst->symbols[n].offset = base + src->symbols[i].offset;
+        dst->symbols[n].size = src->symbols[i].size;
+        dst->num_symbols++;
+    }
+    return !dst->failed;
+}
@@ -0,0 +1,138 @@
+// ALETHEIA Machine Code Buffer
+// Append-only byte buffer for directly encoded instructions. Branches to
+// function-local labels are patched once the function is complete; calls
+// and function entry points become relocations and symbols for the object
+// writer.
+
+#ifndef ALETHEIA_MCODE_H
+#define ALETHEIA_MCODE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// How a PC-relative field is patched: a rel32 counted from the end of the
+// field, or the offset field of an AArch64 or RISC-V branch instruction
+// counted from the instruction itself (in words on AArch64, bytes on RISC-V)
+typedef enum {
+    MCODE_REL32,
+    MCODE_A64_BRANCH26,  // b, bl
+    MCODE_A64_BRANCH19,  // b.cond, cbz, cbnz
+    MCODE_A64_BRANCH14,  // tbz, tbnz
+    MCODE_RV_BRANCH,     // beq..bge, +-4KB
+    MCODE_RV_JAL,        // jal, +-1MB
+    MCODE_RV_CALL,       // auipc + jalr pair, relocations only
+    MCODE_RV_CBRANCH,    // c.beqz, c.bnez (16-bit), +-256 bytes
+    MCODE_RV_CJUMP,      // c.j (16-bit), +-2KB
+    MCODE_ABS64          // 64-bit address of a symbol, relocations only
+} MCodeFieldKind;
+
+// Field waiting for a local label
+typedef struct {
+    int label;
+    size_t offset;
+    MCodeFieldKind kind;
+} MCodeFixup;
+
+// Field referring to a symbol
+typedef struct {
+    char* symbol;
+    size_t offset;
+    MCodeFieldKind kind;
+} MCodeReloc;
+
+// Function entry point; size is known once the next symbol starts
+typedef struct {
+    char* name;
+    size_t offset;
+    size_t size;
+} MCodeSymbol;
+
+typedef struct {
+    uint8_t* data;
+    size_t size;
+    size_t capacity;
+    bool failed;        // An allocation failed or a label was never bound
+    uint32_t features;  // TARGET_FEATURE_* extensions the encoder may use
+    int compressed;     // Instructions emitted in a 16-bit form
+
+    long* labels;       // Bound offset per label id, -1 while unbound
+    int num_labels;
+    int label_capacity;
+    MCodeFixup* fixups;
+    int num_fixups;
+    int fixup_capacity;
+    uint8_t* widened;   // Times the branch of each fixup ordinal was widened
+    int num_widened;
+    int widened_capacity;
+
+    MCodeReloc* relocs;
+    int num_relocs;
+    int reloc_capacity;
+    MCodeSymbol* symbols;
+    int num_symbols;
+    int symbol_capacity;
+} CodeBuffer;
+
+// Everything emission appends to, saved so a function can be emitted again
+typedef struct {
+    size_t size;
+    int compressed;
+    int num_labels;
+    int num_fixups;
+    int num_relocs;
+    int num_symbols;
+} MCodeMark;
+
+void mcode_buffer_init(CodeBuffer* buf);
+void mcode_buffer_free(CodeBuffer* buf);
+void mcode_buffer_reset(CodeBuffer* buf);
+
+// Raw appends, little-endian
+void mcode_byte(CodeBuffer* buf, uint8_t byte);
+void mcode_bytes(CodeBuffer* buf, const uint8_t* bytes, size_t length);
+void mcode_u16(CodeBuffer* buf, uint16_t value);
+void mcode_u32(CodeBuffer* buf, uint32_t value);
+void mcode_u64(CodeBuffer* buf, uint64_t value);
+
+// Local labels: allocate `count` consecutive ids, bind one to the current
+// offset, or append a rel32 placeholder that mcode_resolve_labels patches
+int mcode_new_labels(CodeBuffer* buf, int count);
+void mcode_bind(CodeBuffer* buf, int label);
+void mcode_rel32_label(CodeBuffer* buf, int label);
+
+// Appends a rel32 placeholder recorded as a relocation against `symbol`
+void mcode_rel32_symbol(CodeBuffer* buf, const char* symbol);
+
+// Appends an 8-byte word the linker fills with the address of `symbol`
+void mcode_abs64_symbol(CodeBuffer* buf, const char* symbol);
+
+// Fixed-width targets: appends the instruction word `insn` whose branch
+// field, as given by `kind`, is patched to reach the label or symbol
+void mcode_insn_label(CodeBuffer* buf, uint32_t insn, MCodeFieldKind kind, int label);
+void mcode_insn_symbol(CodeBuffer* buf, uint32_t insn, MCodeFieldKind kind, const char* symbol);
+void mcode_insn16_label(CodeBuffer* buf, uint16_t insn, MCodeFieldKind kind, int label);
+
+// Branch relaxation for targets with short and long branch forms. An encoder
+// starts every branch in its shortest form and widens it once for each time
+// mcode_branch_form reports; mcode_relax widens the branches whose label
+// turned out to be out of reach and returns true when the function must be
+// emitted again from its mark. Widening only grows code, so this terminates.
+int mcode_branch_form(CodeBuffer* buf);
+bool mcode_relax(CodeBuffer* buf);
+void mcode_mark(CodeBuffer* buf, MCodeMark* mark);
+void mcode_rewind(CodeBuffer* buf, const MCodeMark* mark);
+
+// Starts a function symbol at the current offset
+void mcode_define_symbol(CodeBuffer* buf, const char* name);
+
+// Patches every pending label fixup and forgets the labels and widened
+// branches, so the next function starts numbering from zero. Returns false
+// if a label was unbound or out of reach.
+bool mcode_resolve_labels(CodeBuffer* buf);
+
+// Appends src's bytes, relocations and symbols to dst, rebasing their
+// offsets. src must have its labels resolved. Returns false on failure.
+bool mcode_append(CodeBuffer* dst, const CodeBuffer* src);
+
+#endif // ALETHEIA_MCODE_H
@@ -0,0 +1,71 @@
+// ALETHEIA Parallel Job Runner
+// Worker threads claiming job indices from a shared counter
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "parallel.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define PARALLEL_MAX_WORKERS 64
+
+typedef struct {
+    pthread_mutex_t lock;
+    int next;           // First index nobody has claimed
+    int count;
+    ParallelJob job;
+    void* context;
+} ParallelQueue;
+
+static int parallel_claim(ParallelQueue* queue) {
+    pthread_mutex_lock(&queue->lock);
+    int index = queue->next < queue->count ? queue->next++ : -1;
+    pthread_mutex_unlock(&queue->lock);
+    return index;
+}
+
+static void* parallel_worker(void* arg) {
+    ParallelQueue* queue = (ParallelQueue*)arg;
+    int index;
+
+    while ((index = parallel_claim(queue)) >= 0) {
+        queue->job(queue->context, index);
+    }
+    return NULL;
+}
+
+int parallel_default_workers(void) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    if (online < 1) return 1;
+    if (online > PARALLEL_MAX_WORKERS) return PARALLEL_MAX_WORKERS;
+    return (int)online;
+}
+
+void parallel_run(int count, int workers, ParallelJob job, void* context) {
+    pthread_t threads[PARALLEL_MAX_WORKERS];
+    ParallelQueue queue;
+    int started = 0;
+
+    if (workers > count) workers = count;
+    if (workers > PARALLEL_MAX_WORKERS) workers = PARALLEL_MAX_WORKERS;
+    if (workers <= 1) {
+        for (int i = 0; i < count; i++) job(context, i);
+        return;
+    }
+
+    pthread_mutex_init(&queue.lock, NULL);
+    queue.next = 0;
+    queue.count = count;
+    queue.job = job;
+    queue.context = context;
+
+    // The calling thread is one of the workers
+    while (started < workers - 1 &&
+           pthread_create(&threads[started], NULL, parallel_worker, &queue) == 0) {
+        started++;
+    }
+    parallel_worker(&queue);
+    for (int i = 0; i < started; i++) pthread_join(threads[i], NULL);
+    pthread_mutex_destroy(&queue.lock);
+}
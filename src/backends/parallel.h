@@ -0,0 +1,20 @@
+// ALETHEIA Parallel Job Runner
+// Runs independent, indexed jobs on a small pool of worker threads. Callers
+// keep each job's results in its own slot and combine them in index order,
+// so the outcome does not depend on scheduling.
+
+#ifndef ALETHEIA_PARALLEL_H
+#define ALETHEIA_PARALLEL_H
+
+typedef void (*ParallelJob)(void* context, int index);
+
+// Number of worker threads worth starting on this machine (at least 1)
+int parallel_default_workers(void);
+
+// Calls job(context, i) once for every i in [0, count) on up to `workers`
+// threads, including the caller. Idle workers take the next unclaimed
+// index, so long jobs do not hold up the rest. With one worker, or if no
+// thread can be started, the jobs run in order on the calling thread.
+void parallel_run(int count, int workers, ParallelJob job, void* context);
+
+#endif // ALETHEIA_PARALLEL_H
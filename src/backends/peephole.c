@@ -0,0 +1,682 @@
+// ALETHEIA Peephole Optimizer Implementation
+// Parses generated assembly into an instruction list and rewrites short
+// windows with per-target rule tables until nothing changes.
+
+#include "peephole.h"
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define PEEPHOLE_MAX_PASSES 16
+
+static char* peephole_strdup(const char* s) {
+    size_t len = strlen(s);
+    char* copy = (char*)malloc(len + 1);
+    if (copy) memcpy(copy, s, len + 1);
+    return copy;
+}
+
+static void copy_trimmed(char* dest, size_t size, const char* start, const char* end) {
+    while (start < end && isspace((unsigned char)*start)) start++;
+    while (end > start && isspace((unsigned char)end[-1])) end--;
+    size_t len = (size_t)(end - start);
+    if (len >= size) len = size - 1;
+    memcpy(dest, start, len);
+    dest[len] = '\0';
+}
+
+// A trimmed copy of [start, end) of any length, or NULL
+static char* strdup_trimmed(const char* start, const char* end) {
+    while (start < end && isspace((unsigned char)*start)) start++;
+    while (end > start && isspace((unsigned char)end[-1])) end--;
+    size_t len = (size_t)(end - start);
+    char* copy = (char*)malloc(len + 1);
+    if (!copy) return NULL;
+    memcpy(copy, start, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+static void free_operands(PeepholeInstr* instr) {
+    for (int i = 0; i < instr->num_operands; i++) free(instr->operands[i]);
+    instr->num_operands = 0;
+}
+
+// Instruction list
+PeepholeList* peephole_create_list(TargetArch arch) {
+    PeepholeList* list = (PeepholeList*)calloc(1, sizeof(PeepholeList));
+    if (!list) return NULL;
+    list->arch = arch;
+    return list;
+}
+
+void peephole_free_list(PeepholeList* list) {
+    if (!list) return;
+
+    for (int i = 0; i < list->count; i++) {
+        free(list->instrs[i].text);
+        free(list->instrs[i].comment);
+        free_operands(&list->instrs[i]);
+    }
+    free(list->instrs);
+    free(list);
+}
+
+static PeepholeInstr* peephole_append(PeepholeList* list, PeepholeKind kind) {
+    if (list->count == list->capacity) {
+        int capacity = list->capacity ? list->capacity * 2 : 64;
+        PeepholeInstr* instrs = (PeepholeInstr*)realloc(list->instrs, capacity * sizeof(PeepholeInstr));
+        if (!instrs) return NULL;
+        list->instrs = instrs;
+        list->capacity = capacity;
+    }
+
+    PeepholeInstr* instr = &list->instrs[list->count++];
+    memset(instr, 0, sizeof(PeepholeInstr));
+    instr->kind = kind;
+    return instr;
+}
+
+// ';' and "//" start comments everywhere; '#' does too except on ARM64,
+// where it prefixes immediates.
+static const char* find_comment(const char* line, TargetArch arch) {
+    for (const char* p = line; *p; p++) {
+        if (*p == ';') return p;
+        if (p[0] == '/' && p[1] == '/') return p;
+        if (*p == '#' && arch != TARGET_ARM64) return p;
+    }
+    return NULL;
+}
+
+static bool is_directive_word(const char* word) {
+    static const char* words[] = {"section", "global", "extern", "bits", "default", "align", NULL};
+    for (int i = 0; words[i]; i++) {
+        if (strcmp(word, words[i]) == 0) return true;
+    }
+    return false;
+}
+
+// One line of `len` bytes, not necessarily NUL-terminated
+static void peephole_parse_text(PeepholeList* list, const char* line, size_t len) {
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) len--;
+
+    char* buffer = (char*)malloc(len + 1);
+    if (!buffer) return;
+    memcpy(buffer, line, len);
+    buffer[len] = '\0';
+
+    const char* comment = find_comment(buffer, list->arch);
+    const char* end = comment ? comment : buffer + len;
+    char* body = strdup_trimmed(buffer, end);
+    if (!body) {
+        free(buffer);
+        return;
+    }
+
+    PeepholeInstr* instr;
+    if (body[0] == '\0') {
+        instr = peephole_append(list, PEEP_COMMENT);
+        if (instr) instr->text = buffer;
+        free(body);
+        return;
+    }
+
+    size_t body_len = strlen(body);
+    if (body[body_len - 1] == ':' && !strpbrk(body, " \t,[(")) {
+        instr = peephole_append(list, PEEP_LABEL);
+        if (instr) instr->text = buffer;
+        free(body);
+        return;
+    }
+
+    // Split the mnemonic from the operand list
+    char* p = body;
+    while (*p && !isspace((unsigned char)*p)) p++;
+    size_t mnemonic_len = (size_t)(p - body);
+
+    char mnemonic[32];
+    copy_trimmed(mnemonic, sizeof(mnemonic), body, p);
+    if (body[0] == '.' || is_directive_word(mnemonic) || mnemonic_len >= sizeof(mnemonic)) {
+        instr = peephole_append(list, PEEP_DIRECTIVE);
+        if (instr) instr->text = buffer;
+        free(body);
+        return;
+    }
+
+    // Operands are separated by commas outside brackets and parentheses
+    char* operands[PEEPHOLE_MAX_OPERANDS];
+    int num_operands = 0;
+    int depth = 0;
+    const char* start = p;
+    bool overflow = false;
+    for (const char* q = p; ; q++) {
+        if (*q == '[' || *q == '(' || *q == '{') depth++;
+        if (*q == ']' || *q == ')' || *q == '}') depth--;
+        if (*q == '\0' || (*q == ',' && depth == 0)) {
+            if (num_operands == PEEPHOLE_MAX_OPERANDS) {
+                overflow = true;
+                break;
+            }
+            operands[num_operands] = strdup_trimmed(start, q);
+            if (!operands[num_operands]) {
+                overflow = true;
+                break;
+            }
+            if (operands[num_operands][0] != '\0' || *q == ',') {
+                num_operands++;
+            } else {
+                free(operands[num_operands]);
+            }
+            if (*q == '\0') break;
+            start = q + 1;
+        }
+    }
+
+    free(body);
+    if (overflow) {
+        for (int i = 0; i < num_operands; i++) free(operands[i]);
+        instr = peephole_append(list, PEEP_DIRECTIVE);
+        if (instr) instr->text = buffer;
+        return;
+    }
+
+    instr = peephole_append(list, PEEP_INSTRUCTION);
+    if (!instr) {
+        for (int i = 0; i < num_operands; i++) free(operands[i]);
+        free(buffer);
+        return;
+    }
+    size_t indent = strspn(buffer, " \t");
+    if (indent >= sizeof(instr->indent)) indent = sizeof(instr->indent) - 1;
+    memcpy(instr->indent, buffer, indent);
+    instr->indent[indent] = '\0';
+    strcpy(instr->mnemonic, mnemonic);
+    for (int i = 0; i < num_operands; i++) instr->operands[i] = operands[i];
+    instr->num_operands = num_operands;
+    if (comment) instr->comment = peephole_strdup(comment);
+    free(buffer);
+}
+
+void peephole_parse_line(PeepholeList* list, const char* line) {
+    peephole_parse_text(list, line, strlen(line));
+}
+
+void peephole_parse_buffer(PeepholeList* list, const EmitBuffer* in) {
+    const char* p = in->data;
+    const char* end = p ? p + in->size : p;
+    while (p < end) {
+        const char* eol = memchr(p, '\n', (size_t)(end - p));
+        size_t len = eol ? (size_t)(eol - p) : (size_t)(end - p);
+        peephole_parse_text(list, p, len);
+        p += len + (eol ? 1 : 0);
+    }
+}
+
+void peephole_write(PeepholeList* list, EmitBuffer* out) {
+    for (int i = 0; i < list->count; i++) {
+        PeepholeInstr* instr = &list->instrs[i];
+        if (instr->deleted) continue;
+
+        if (instr->kind != PEEP_INSTRUCTION) {
+            emit_put(out, instr->text);
+            emit_char(out, '\n');
+            continue;
+        }
+
+        emit_put(out, instr->indent);
+        emit_put(out, instr->mnemonic);
+        for (int op = 0; op < instr->num_operands; op++) {
+            emit_put(out, op == 0 ? " " : ", ");
+            emit_put(out, instr->operands[op]);
+        }
+        if (instr->comment) {
+            emit_putn(out, "  ", 2);
+            emit_put(out, instr->comment);
+        }
+        emit_char(out, '\n');
+    }
+}
+
+// Helpers for rule implementations
+bool peephole_is(PeepholeInstr* instr, const char* mnemonic) {
+    return instr->kind == PEEP_INSTRUCTION && strcmp(instr->mnemonic, mnemonic) == 0;
+}
+
+// Operand comparison ignores whitespace, so "[rbp - 8]" equals "[rbp-8]"
+static bool same_operand(const char* a, const char* b) {
+    for (;;) {
+        while (isspace((unsigned char)*a)) a++;
+        while (isspace((unsigned char)*b)) b++;
+        if (*a != *b) return false;
+        if (*a == '\0') return true;
+        a++;
+        b++;
+    }
+}
+
+bool peephole_operand_is(PeepholeInstr* instr, int index, const char* operand) {
+    return index < instr->num_operands && same_operand(instr->operands[index], operand);
+}
+
+// True if any operand names `reg` as a whole word
+bool peephole_mentions(PeepholeInstr* instr, const char* reg) {
+    size_t len = strlen(reg);
+    for (int op = 0; op < instr->num_operands; op++) {
+        const char* s = instr->operands[op];
+        for (const char* p = strstr(s, reg); p; p = strstr(p + 1, reg)) {
+            bool start_ok = p == s || !isalnum((unsigned char)p[-1]);
+            bool end_ok = !isalnum((unsigned char)p[len]);
+            if (start_ok && end_ok) return true;
+        }
+    }
+    return false;
+}
+
+void peephole_set(PeepholeInstr* instr, const char* mnemonic, int num_operands, ...) {
+    va_list args;
+    char* operands[PEEPHOLE_MAX_OPERANDS];
+
+    // Copy first: operands may point into the instruction being rewritten
+    if (num_operands > PEEPHOLE_MAX_OPERANDS) num_operands = PEEPHOLE_MAX_OPERANDS;
+    va_start(args, num_operands);
+    for (int i = 0; i < num_operands; i++) {
+        operands[i] = peephole_strdup(va_arg(args, const char*));
+    }
+    va_end(args);
+
+    instr->kind = PEEP_INSTRUCTION;
+    snprintf(instr->mnemonic, sizeof(instr->mnemonic), "%s", mnemonic);
+    free_operands(instr);
+    instr->num_operands = num_operands;
+    for (int i = 0; i < num_operands; i++) instr->operands[i] = operands[i];
+    free(instr->comment);
+    instr->comment = NULL;
+}
+
+void peephole_delete(PeepholeInstr* instr) {
+    instr->deleted = true;
+}
+
+static bool is_memory(const char* operand) {
+    return strchr(operand, '[') != NULL || strchr(operand, '(') != NULL;
+}
+
+static bool is_label_named(PeepholeInstr* instr, const char* name) {
+    if (instr->kind != PEEP_LABEL) return false;
+    size_t len = strcspn(instr->text + strspn(instr->text, " \t"), ":");
+    const char* label = instr->text + strspn(instr->text, " \t");
+    return strlen(name) == len && strncmp(label, name, len) == 0;
+}
+
+// Shared rules, parameterized by the target's move/jump mnemonics
+static bool drop_self_move(PeepholeInstr* instr, const char* mov) {
+    if (!peephole_is(instr, mov) || instr->num_operands != 2) return false;
+    if (!same_operand(instr->operands[0], instr->operands[1])) return false;
+    peephole_delete(instr);
+    return true;
+}
+
+static bool drop_jump_to_next(PeepholeInstr** w, const char* jmp) {
+    if (!peephole_is(w[0], jmp) || w[0]->num_operands != 1) return false;
+    if (!is_label_named(w[1], w[0]->operands[0])) return false;
+    peephole_delete(w[0]);
+    return true;
+}
+
+// Nothing after an unconditional transfer is reachable until the next label
+static bool drop_unreachable(PeepholeInstr** w, const char* jmp) {
+    if (!peephole_is(w[0], jmp) && !peephole_is(w[0], "ret")) return false;
+    if (w[1]->kind != PEEP_INSTRUCTION) return false;
+    peephole_delete(w[1]);
+    return true;
+}
+
+// x86-64 rules
+static bool x86_self_move(PeepholeInstr** w, int count) {
+    (void)count;
+    return drop_self_move(w[0], "mov");
+}
+
+static bool x86_jump_to_next(PeepholeInstr** w, int count) {
+    (void)count;
+    return drop_jump_to_next(w, "jmp");
+}
+
+static bool x86_unreachable(PeepholeInstr** w, int count) {
+    (void)count;
+    return drop_unreachable(w, "jmp");
+}
+
+// push R1; mov R1, X; pop R2  =>  mov R2, R1; mov R1, X
+static bool x86_push_mov_pop(PeepholeInstr** w, int count) {
+    (void)count;
+    if (!peephole_is(w[0], "push") || !peephole_is(w[1], "mov") || !peephole_is(w[2], "pop")) return false;
+    if (w[0]->num_operands != 1 || w[1]->num_operands != 2 || w[2]->num_operands != 1) return false;
+
+    const char* r1 = w[0]->operands[0];
+    const char* r2 = w[2]->operands[0];
+    if (!same_operand(w[1]->operands[0], r1) || is_memory(r1) || is_memory(r2)) return false;
+    if (peephole_mentions(w[1], "rsp")) return false;
+
+    if (same_operand(r1, r2)) {
+        peephole_delete(w[0]);
+        peephole_delete(w[1]);
+        peephole_delete(w[2]);
+        return true;
+    }
+    if (peephole_mentions(w[1], r2)) return false;
+
+    // peephole_set copies its operands first; R1 is w[0]'s second afterwards
+    peephole_set(w[0], "mov", 2, r2, r1);
+    peephole_set(w[1], "mov", 2, w[0]->operands[1], w[1]->operands[1]);
+    peephole_delete(w[2]);
+    return true;
+}
+
+// Width in bytes of a general register name, 0 for anything else
+static int x86_register_width(const char* operand) {
+    static const char* legacy[][4] = {
+        {"rax", "eax", "ax", "al"}, {"rcx", "ecx", "cx", "cl"}, {"rdx", "edx", "dx", "dl"},
+        {"rbx", "ebx", "bx", "bl"}, {"rsp", "esp", "sp", "spl"}, {"rbp", "ebp", "bp", "bpl"},
+        {"rsi", "esi", "si", "sil"}, {"rdi", "edi", "di", "dil"}
+    };
+    static const int widths[4] = {8, 4, 2, 1};
+
+    for (size_t i = 0; i < sizeof(legacy) / sizeof(legacy[0]); i++) {
+        for (int w = 0; w < 4; w++) {
+            if (strcmp(operand, legacy[i][w]) == 0) return widths[w];
+        }
+    }
+    if (operand[0] != 'r' || !isdigit((unsigned char)operand[1])) return 0;
+
+    const char* suffix = operand + 1;
+    while (isdigit((unsigned char)*suffix)) suffix++;
+    if (*suffix == '\0') return 8;
+    if (strcmp(suffix, "d") == 0) return 4;
+    if (strcmp(suffix, "w") == 0) return 2;
+    if (strcmp(suffix, "b") == 0) return 1;
+    return 0;
+}
+
+// Bytes a register-memory mov moves: the "byte/word/dword/qword ptr" size
+// when given, otherwise the register's. `address` is set to the bracketed part.
+static int x86_access_width(const char* memory, const char* reg, const char** address) {
+    static const char* sizes[] = {"byte", "word", "dword", "qword"};
+    static const int widths[] = {1, 2, 4, 8};
+    int width = x86_register_width(reg);
+
+    *address = strchr(memory, '[');
+    for (int i = 0; i < 4; i++) {
+        size_t len = strlen(sizes[i]);
+        if (strncmp(memory, sizes[i], len) == 0 && isspace((unsigned char)memory[len])) {
+            return widths[i] == width ? width : 0;
+        }
+    }
+    return width;
+}
+
+// mov [M], R1; mov R2, [M]  =>  mov [M], R1; mov R2, R1 (dropped when R1 == R2)
+// Only for accesses of one width: a narrower store leaves the rest of a
+// wider load to memory, and mixed-width register moves do not exist.
+static bool x86_store_load(PeepholeInstr** w, int count) {
+    (void)count;
+    if (!peephole_is(w[0], "mov") || !peephole_is(w[1], "mov")) return false;
+    if (w[0]->num_operands != 2 || w[1]->num_operands != 2) return false;
+    if (!is_memory(w[0]->operands[0]) || is_memory(w[0]->operands[1])) return false;
+    if (!is_memory(w[1]->operands[1])) return false;
+
+    const char* stored;
+    const char* loaded;
+    int width = x86_access_width(w[0]->operands[0], w[0]->operands[1], &stored);
+    if (width == 0 || x86_access_width(w[1]->operands[1], w[1]->operands[0], &loaded) != width) {
+        return false;
+    }
+    if (!stored || !loaded || !same_operand(stored, loaded)) return false;
+
+    if (same_operand(w[0]->operands[1], w[1]->operands[0])) {
+        peephole_delete(w[1]);
+    } else {
+        peephole_set(w[1], "mov", 2, w[1]->operands[0], w[0]->operands[1]);
+    }
+    return true;
+}
+
+static const char* x86_inverse_condition(const char* cc) {
+    static const char* pairs[][2] = {
+        {"e", "ne"}, {"z", "nz"}, {"l", "ge"}, {"g", "le"},
+        {"b", "ae"}, {"a", "be"}, {NULL, NULL}
+    };
+    for (int i = 0; pairs[i][0]; i++) {
+        if (strcmp(cc, pairs[i][0]) == 0) return pairs[i][1];
+        if (strcmp(cc, pairs[i][1]) == 0) return pairs[i][0];
+    }
+    return NULL;
+}
+
+// setCC al; movzx rax, al; test rax, rax; jz L  =>  jNCC L
+// Only valid for the stack-machine generators, which materialize the flag
+// for the branch alone, so rax is dead on both edges. Register-allocated
+// code may keep the value in rax, so this rule is not in the defaults.
+static bool x86_setcc_branch(PeepholeInstr** w, int count) {
+    (void)count;
+    if (w[0]->kind != PEEP_INSTRUCTION || strncmp(w[0]->mnemonic, "set", 3) != 0) return false;
+    if (!peephole_operand_is(w[0], 0, "al")) return false;
+    if (!peephole_is(w[1], "movzx") || !peephole_operand_is(w[1], 0, "rax") ||
+        !peephole_operand_is(w[1], 1, "al")) return false;
+    if (!peephole_is(w[2], "test") || !peephole_operand_is(w[2], 0, "rax") ||
+        !peephole_operand_is(w[2], 1, "rax")) return false;
+
+    const char* cc = w[0]->mnemonic + 3;
+    const char* inverse = x86_inverse_condition(cc);
+    if (!inverse || w[3]->num_operands != 1) return false;
+
+    char jump[16];
+    if (peephole_is(w[3], "jz") || peephole_is(w[3], "je")) {
+        snprintf(jump, sizeof(jump), "j%s", inverse);
+    } else if (peephole_is(w[3], "jnz") || peephole_is(w[3], "jne")) {
+        snprintf(jump, sizeof(jump), "j%s", cc);
+    } else {
+        return false;
+    }
+
+    peephole_set(w[0], jump, 1, w[3]->operands[0]);
+    peephole_delete(w[1]);
+    peephole_delete(w[2]);
+    peephole_delete(w[3]);
+    return true;
+}
+
+// ARM64 rules
+static bool arm64_self_move(PeepholeInstr** w, int count) {
+    (void)count;
+    return drop_self_move(w[0], "mov");
+}
+
+static bool arm64_jump_to_next(PeepholeInstr** w, int count) {
+    (void)count;
+    return drop_jump_to_next(w, "b");
+}
+
+static bool arm64_unreachable(PeepholeInstr** w, int count) {
+    (void)count;
+    return drop_unreachable(w, "b");
+}
+
+// str R1, [M]; ldr R2, [M]  =>  str R1, [M]; mov R2, R1
+// R1 and R2 must both be w or both be x registers: the access width.
+static bool arm64_store_load(PeepholeInstr** w, int count) {
+    (void)count;
+    if (!peephole_is(w[0], "str") || !peephole_is(w[1], "ldr")) return false;
+    if (w[0]->num_operands != 2 || w[1]->num_operands != 2) return false;
+    if (w[0]->operands[0][0] != w[1]->operands[0][0]) return false;
+    if (!same_operand(w[0]->operands[1], w[1]->operands[1])) return false;
+
+    if (same_operand(w[0]->operands[0], w[1]->operands[0])) {
+        peephole_delete(w[1]);
+    } else {
+        peephole_set(w[1], "mov", 2, w[1]->operands[0], w[0]->operands[0]);
+    }
+    return true;
+}
+
+// RISC-V rules
+static bool riscv64_self_move(PeepholeInstr** w, int count) {
+    (void)count;
+    return drop_self_move(w[0], "mv");
+}
+
+static bool riscv64_jump_to_next(PeepholeInstr** w, int count) {
+    (void)count;
+    return drop_jump_to_next(w, "j");
+}
+
+static bool riscv64_unreachable(PeepholeInstr** w, int count) {
+    (void)count;
+    return drop_unreachable(w, "j");
+}
+
+// sd R1, off(base); ld R2, off(base)  =>  sd R1, off(base); mv R2, R1
+static bool riscv64_store_load(PeepholeInstr** w, int count) {
+    (void)count;
+    if (!peephole_is(w[0], "sd") || !peephole_is(w[1], "ld")) return false;
+    if (w[0]->num_operands != 2 || w[1]->num_operands != 2) return false;
+    if (!same_operand(w[0]->operands[1], w[1]->operands[1])) return false;
+
+    if (same_operand(w[0]->operands[0], w[1]->operands[0])) {
+        peephole_delete(w[1]);
+    } else {
+        peephole_set(w[1], "mv", 2, w[1]->operands[0], w[0]->operands[0]);
+    }
+    return true;
+}
+
+// Rule tables
+PeepholeRuleSet* peephole_create_rules(TargetArch arch) {
+    PeepholeRuleSet* rules = (PeepholeRuleSet*)calloc(1, sizeof(PeepholeRuleSet));
+    if (!rules) return NULL;
+    rules->arch = arch;
+
+    switch (arch) {
+        case TARGET_X86_64:
+            peephole_add_rule(rules, "push-mov-pop", 3, x86_push_mov_pop);
+            peephole_add_rule(rules, "store-load", 2, x86_store_load);
+            peephole_add_rule(rules, "self-move", 1, x86_self_move);
+            peephole_add_rule(rules, "jump-to-next", 2, x86_jump_to_next);
+            peephole_add_rule(rules, "unreachable", 2, x86_unreachable);
+            break;
+        case TARGET_ARM64:
+            peephole_add_rule(rules, "store-load", 2, arm64_store_load);
+            peephole_add_rule(rules, "self-move", 1, arm64_self_move);
+            peephole_add_rule(rules, "jump-to-next", 2, arm64_jump_to_next);
+            peephole_add_rule(rules, "unreachable", 2, arm64_unreachable);
+            break;
+        case TARGET_RISCV64:
+            peephole_add_rule(rules, "store-load", 2, riscv64_store_load);
+            peephole_add_rule(rules, "self-move", 1, riscv64_self_move);
+            peephole_add_rule(rules, "jump-to-next", 2, riscv64_jump_to_next);
+            peephole_add_rule(rules, "unreachable", 2, riscv64_unreachable);
+            break;
+    }
+    return rules;
+}
+
+void peephole_add_stack_machine_rules(PeepholeRuleSet* rules) {
+    if (rules->arch == TARGET_X86_64) {
+        peephole_add_rule(rules, "setcc-branch", 4, x86_setcc_branch);
+    }
+}
+
+void peephole_free_rules(PeepholeRuleSet* rules) {
+    if (!rules) return;
+    free(rules->rules);
+    free(rules);
+}
+
+void peephole_add_rule(PeepholeRuleSet* rules, const char* name, int window, PeepholeApply apply) {
+    if (window < 1 || window > PEEPHOLE_MAX_WINDOW) {
+        fprintf(stderr, "peephole: rule %s has unsupported window %d\n", name, window);
+        return;
+    }
+    if (rules->count == rules->capacity) {
+        int capacity = rules->capacity ? rules->capacity * 2 : 8;
+        PeepholeRule* grown = (PeepholeRule*)realloc(rules->rules, capacity * sizeof(PeepholeRule));
+        if (!grown) return;
+        rules->rules = grown;
+        rules->capacity = capacity;
+    }
+
+    PeepholeRule* rule = &rules->rules[rules->count++];
+    rule->name = name;
+    rule->window = window;
+    rule->apply = apply;
+    rule->hits = 0;
+}
+
+// Collects up to `size` live entries starting at `index`, skipping comments
+static int collect_window(PeepholeList* list, int index, int size, PeepholeInstr** window) {
+    int count = 0;
+    for (int i = index; i < list->count && count < size; i++) {
+        PeepholeInstr* instr = &list->instrs[i];
+        if (instr->deleted || instr->kind == PEEP_COMMENT) continue;
+        if (instr->kind == PEEP_DIRECTIVE) break;
+        window[count++] = instr;
+    }
+    return count;
+}
+
+int peephole_run(PeepholeList* list, PeepholeRuleSet* rules) {
+    PeepholeInstr* window[PEEPHOLE_MAX_WINDOW];
+    int total = 0;
+    bool changed = true;
+
+    for (int pass = 0; changed && pass < PEEPHOLE_MAX_PASSES; pass++) {
+        changed = false;
+        for (int i = 0; i < list->count; i++) {
+            for (int r = 0; r < rules->count; r++) {
+                PeepholeInstr* first = &list->instrs[i];
+                if (first->deleted || first->kind == PEEP_COMMENT || first->kind == PEEP_DIRECTIVE) break;
+
+                PeepholeRule* rule = &rules->rules[r];
+                if (collect_window(list, i, rule->window, window) != rule->window) continue;
+                if (rule->apply(window, rule->window)) {
+                    rule->hits++;
+                    total++;
+                    changed = true;
+                }
+            }
+        }
+    }
+    return total;
+}
+
+void peephole_add_hits(PeepholeRuleSet* total, const PeepholeRuleSet* rules) {
+    for (int r = 0; r < rules->count && r < total->count; r++) {
+        total->rules[r].hits += rules->rules[r].hits;
+    }
+}
+
+void peephole_report(PeepholeRuleSet* rules, FILE* out) {
+    for (int r = 0; r < rules->count; r++) {
+        fprintf(out, ";; peephole %-14s %d\n", rules->rules[r].name, rules->rules[r].hits);
+    }
+}
+
+int peephole_optimize_buffer(const EmitBuffer* in, EmitBuffer* out, TargetArch arch,
+                             PeepholeRuleSet* rules) {
+    PeepholeList* list = peephole_create_list(arch);
+    PeepholeRuleSet* defaults = rules ? NULL : peephole_create_rules(arch);
+    if (!list || (!rules && !defaults)) {
+        peephole_free_list(list);
+        peephole_free_rules(defaults);
+        return 0;
+    }
+
+    peephole_parse_buffer(list, in);
+    int hits = peephole_run(list, rules ? rules : defaults);
+    peephole_write(list, out);
+
+    peephole_free_rules(defaults);
+    peephole_free_list(list);
+    return hits;
+}
@@ -0,0 +1,89 @@
+// ALETHEIA Peephole Optimizer
+// Windowed pattern-table rewriting over an in-memory assembly instruction list
+
+#ifndef ALETHEIA_PEEPHOLE_H
+#define ALETHEIA_PEEPHOLE_H
+
+#include "backend.h"
+
+#define PEEPHOLE_MAX_OPERANDS 4
+#define PEEPHOLE_MAX_WINDOW 8
+
+typedef enum {
+    PEEP_INSTRUCTION,
+    PEEP_LABEL,
+    PEEP_COMMENT,   // Comment-only or blank line, transparent to windows
+    PEEP_DIRECTIVE  // Anything else, passed through and never matched
+} PeepholeKind;
+
+typedef struct {
+    PeepholeKind kind;
+    bool deleted;
+    char indent[16];
+    char mnemonic[32];
+    char* operands[PEEPHOLE_MAX_OPERANDS]; // Owned by the instruction
+    int num_operands;
+    char* text;     // Label name, directive or comment text
+    char* comment;  // Trailing comment of an instruction
+} PeepholeInstr;
+
+typedef struct {
+    PeepholeInstr* instrs;
+    int count;
+    int capacity;
+    TargetArch arch;
+} PeepholeList;
+
+// A rule inspects `window` consecutive instructions (labels and directives
+// end a window, comment lines are skipped) and rewrites them in place.
+typedef bool (*PeepholeApply)(PeepholeInstr** window, int count);
+
+typedef struct {
+    const char* name;
+    int window;
+    PeepholeApply apply;
+    int hits;
+} PeepholeRule;
+
+typedef struct {
+    TargetArch arch;
+    PeepholeRule* rules;
+    int count;
+    int capacity;
+} PeepholeRuleSet;
+
+// Instruction list
+PeepholeList* peephole_create_list(TargetArch arch);
+void peephole_free_list(PeepholeList* list);
+void peephole_parse_line(PeepholeList* list, const char* line);
+void peephole_parse_buffer(PeepholeList* list, const EmitBuffer* in);
+void peephole_write(PeepholeList* list, EmitBuffer* out);
+
+// Rule tables: each target starts from its default table and may add more
+PeepholeRuleSet* peephole_create_rules(TargetArch arch);
+void peephole_free_rules(PeepholeRuleSet* rules);
+void peephole_add_rule(PeepholeRuleSet* rules, const char* name, int window, PeepholeApply apply);
+int peephole_run(PeepholeList* list, PeepholeRuleSet* rules);
+void peephole_report(PeepholeRuleSet* rules, FILE* out);
+
+// Rules that assume the value tested by a branch is dead afterwards, true
+// of the stack-machine generators (mescc-ale, tinycc-ale) but not of
+// register-allocated code. Add them after the defaults.
+void peephole_add_stack_machine_rules(PeepholeRuleSet* rules);
+
+// Adds the hits of `rules` into `total`, a table built the same way
+void peephole_add_hits(PeepholeRuleSet* total, const PeepholeRuleSet* rules);
+
+// Helpers for rule implementations
+bool peephole_is(PeepholeInstr* instr, const char* mnemonic);
+bool peephole_operand_is(PeepholeInstr* instr, int index, const char* operand);
+bool peephole_mentions(PeepholeInstr* instr, const char* reg);
+void peephole_set(PeepholeInstr* instr, const char* mnemonic, int num_operands, ...);
+void peephole_delete(PeepholeInstr* instr);
+
+// Reads assembly text from `in`, optimizes it and appends it to `out`.
+// Uses the target's default rules when `rules` is NULL; returns total hits.
+int peephole_optimize_buffer(const EmitBuffer* in, EmitBuffer* out, TargetArch arch,
+                             PeepholeRuleSet* rules);
+
+#endif // ALETHEIA_PEEPHOLE_H
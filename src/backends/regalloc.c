@@ -0,0 +1,378 @@
+// ALETHEIA Register Allocation Implementation
+// Live interval construction and linear-scan allocation (Poletto & Sarkar)
+
+#include "regalloc.h"
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#define BIT_TEST(bits, i) (((bits)[(i) / 64] >> ((i) % 64)) & 1ULL)
+
+static int add_range(FixedRanges* fixed, int start, int end) {
+    if (fixed->num_ranges == fixed->capacity) {
+        int capacity = fixed->capacity ? fixed->capacity * 2 : 8;
+        LiveRange* ranges = (LiveRange*)realloc(fixed->ranges, capacity * sizeof(LiveRange));
+        if (!ranges) return -1;
+        fixed->ranges = ranges;
+        fixed->capacity = capacity;
+    }
+    fixed->ranges[fixed->num_ranges].start = start;
+    fixed->ranges[fixed->num_ranges].end = end;
+    return fixed->num_ranges++;
+}
+
+bool regalloc_fixed_conflict(FixedRanges* fixed, int start, int end) {
+    for (int i = 0; i < fixed->num_ranges; i++) {
+        if (fixed->ranges[i].start <= end && start <= fixed->ranges[i].end) return true;
+    }
+    return false;
+}
+
+static int compare_intervals(const void* a, const void* b) {
+    const LiveInterval* x = (const LiveInterval*)a;
+    const LiveInterval* y = (const LiveInterval*)b;
+    if (x->start != y->start) return x->start < y->start ? -1 : 1;
+    return x->vreg - y->vreg;
+}
+
+// Builds one range list per live id by walking every block backwards from
+// its live-out set, then collapses the vreg lists into single intervals.
+LiveIntervals* regalloc_build_intervals(IRFunction* fn) {
+    const TargetBackend* backend = fn->backend;
+    int num_ids = ir_num_live_ids(fn);
+    LiveIntervals* live = (LiveIntervals*)calloc(1, sizeof(LiveIntervals));
+    FixedRanges* ranges = (FixedRanges*)calloc(num_ids, sizeof(FixedRanges));
+    int* open = (int*)malloc(num_ids * sizeof(int));
+    int* ids = (int*)malloc((backend->num_registers + IR_MAX_USES) * sizeof(int));
+    int* call_positions = NULL;
+    int num_calls = 0;
+
+    ir_compute_liveness(fn);
+
+    int position = 0;
+    for (int b = 0; b < fn->num_blocks; b++) {
+        IRBlock* block = fn->blocks[b];
+        int block_start = 2 * position;
+        int block_end = 2 * (position + block->num_instrs) - 1;
+
+        for (int i = 0; i < num_ids; i++) {
+            open[i] = -1;
+            if (block->num_instrs > 0 && BIT_TEST(block->live_out, i)) {
+                open[i] = add_range(&ranges[i], block_start, block_end);
+            }
+        }
+
+        for (int i = block->num_instrs - 1; i >= 0; i--) {
+            IRInstr* instr = &block->instrs[i];
+            int pos = 2 * (position + i);
+
+            if (instr->op == IR_CALL) {
+                call_positions = (int*)realloc(call_positions, (num_calls + 1) * sizeof(int));
+                call_positions[num_calls++] = pos + 1;
+            }
+
+            int count = ir_instr_def_ids(fn, instr, ids);
+            for (int k = 0; k < count; k++) {
+                if (open[ids[k]] >= 0) {
+                    ranges[ids[k]].ranges[open[ids[k]]].start = pos + 1;
+                    open[ids[k]] = -1;
+                } else {
+                    add_range(&ranges[ids[k]], pos + 1, pos + 1);
+                }
+            }
+
+            count = ir_instr_use_ids(fn, instr, ids);
+            for (int k = 0; k < count; k++) {
+                if (open[ids[k]] < 0) {
+                    open[ids[k]] = add_range(&ranges[ids[k]], block_start, pos);
+                }
+            }
+        }
+        position += block->num_instrs;
+    }
+
+    live->num_positions = 2 * position;
+    live->intervals = (LiveInterval*)calloc(fn->num_vregs ? fn->num_vregs : 1, sizeof(LiveInterval));
+    for (int v = 0; v < fn->num_vregs; v++) {
+        LiveInterval* interval = &live->intervals[live->num_intervals];
+        if (ranges[v].num_ranges == 0) continue;
+
+        interval->vreg = v;
+        interval->start = INT_MAX;
+        interval->end = -1;
+        interval->reg = -1;
+        for (int r = 0; r < ranges[v].num_ranges; r++) {
+            if (ranges[v].ranges[r].start < interval->start) interval->start = ranges[v].ranges[r].start;
+            if (ranges[v].ranges[r].end > interval->end) interval->end = ranges[v].ranges[r].end;
+        }
+        for (int c = 0; c < num_calls; c++) {
+            if (interval->start < call_positions[c] && call_positions[c] < interval->end) {
+                interval->crosses_call = true;
+            }
+        }
+        live->num_intervals++;
+        free(ranges[v].ranges);
+    }
+    qsort(live->intervals, live->num_intervals, sizeof(LiveInterval), compare_intervals);
+
+    live->num_fixed = backend->num_registers;
+    live->fixed = (FixedRanges*)malloc(live->num_fixed * sizeof(FixedRanges));
+    memcpy(live->fixed, ranges + fn->num_vregs, live->num_fixed * sizeof(FixedRanges));
+
+    free(call_positions);
+    free(ids);
+    free(open);
+    free(ranges);
+    return live;
+}
+
+void regalloc_free_intervals(LiveIntervals* live) {
+    if (!live) return;
+
+    for (int i = 0; i < live->num_fixed; i++) {
+        free(live->fixed[i].ranges);
+    }
+    free(live->fixed);
+    free(live->intervals);
+    free(live);
+}
+
+// Instructions whose result can be written straight to a fixed register
+static bool foldable_def(IRInstr* instr) {
+    switch (instr->op) {
+        case IR_MOV:
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        case IR_DIV:
+        case IR_LOAD:
+        case IR_SETCC:
+        case IR_SELECT:
+            return instr->dst.kind == IR_OPND_VREG;
+        default:
+            return false;
+    }
+}
+
+int regalloc_fold_fixed_moves(IRFunction* fn) {
+    int* defs = (int*)calloc(fn->num_vregs ? fn->num_vregs : 1, sizeof(int));
+    int* uses = (int*)calloc(fn->num_vregs ? fn->num_vregs : 1, sizeof(int));
+    int* ids = (int*)malloc((fn->backend->num_registers + IR_MAX_USES) * sizeof(int));
+    int folded = 0;
+
+    for (int b = 0; b < fn->num_blocks; b++) {
+        IRBlock* block = fn->blocks[b];
+        for (int i = 0; i < block->num_instrs; i++) {
+            int count = ir_instr_def_ids(fn, &block->instrs[i], ids);
+            for (int k = 0; k < count; k++) {
+                if (ids[k] < fn->num_vregs) defs[ids[k]]++;
+            }
+            count = ir_instr_use_ids(fn, &block->instrs[i], ids);
+            for (int k = 0; k < count; k++) {
+                if (ids[k] < fn->num_vregs) uses[ids[k]]++;
+            }
+        }
+    }
+
+    for (int b = 0; b < fn->num_blocks; b++) {
+        IRBlock* block = fn->blocks[b];
+        for (int i = 0; i + 1 < block->num_instrs; i++) {
+            IRInstr* def = &block->instrs[i];
+            IRInstr* move = &block->instrs[i + 1];
+            if (!foldable_def(def) || move->op != IR_MOV || move->dst.kind != IR_OPND_PREG ||
+                move->src1.kind != IR_OPND_VREG || move->src1.value != def->dst.value) {
+                continue;
+            }
+            int v = (int)def->dst.value;
+            if (defs[v] != 1 || uses[v] != 1) continue;
+
+            def->dst = move->dst;
+            memmove(move, move + 1, (block->num_instrs - i - 2) * sizeof(IRInstr));
+            block->num_instrs--;
+            folded++;
+        }
+    }
+
+    free(ids);
+    free(uses);
+    free(defs);
+    return folded;
+}
+
+// Register each vreg is copied to or from: a fixed register (argument,
+// parameter or return value) or another vreg, whose register is used once
+// it has one. -1 when there is no copy.
+static void find_copy_hints(IRFunction* fn, int* hint_reg, int* hint_vreg) {
+    for (int v = 0; v < fn->num_vregs; v++) {
+        hint_reg[v] = -1;
+        hint_vreg[v] = -1;
+    }
+    for (int b = 0; b < fn->num_blocks; b++) {
+        IRBlock* block = fn->blocks[b];
+        for (int i = 0; i < block->num_instrs; i++) {
+            IRInstr* instr = &block->instrs[i];
+            if (instr->op != IR_MOV) continue;
+
+            IROperand* dst = &instr->dst;
+            IROperand* src = &instr->src1;
+            if (dst->kind == IR_OPND_VREG && src->kind == IR_OPND_PREG) {
+                hint_reg[dst->value] = (int)src->value;
+            } else if (dst->kind == IR_OPND_PREG && src->kind == IR_OPND_VREG) {
+                hint_reg[src->value] = (int)dst->value;
+            } else if (dst->kind == IR_OPND_VREG && src->kind == IR_OPND_VREG && dst->value != src->value) {
+                if (hint_vreg[dst->value] < 0) hint_vreg[dst->value] = (int)src->value;
+                if (hint_vreg[src->value] < 0) hint_vreg[src->value] = (int)dst->value;
+            }
+        }
+    }
+}
+
+static bool register_free(IRFunction* fn, LiveIntervals* live, LiveInterval* interval, bool* busy, int r) {
+    return r >= 0 && ir_register_allocatable(fn->backend, r) && !busy[r] &&
+           !regalloc_fixed_conflict(&live->fixed[r], interval->start, interval->end);
+}
+
+// Picks a free register for the interval. The register it is copied to or
+// from comes first, so the copy disappears. Otherwise intervals live across
+// a call get callee-saved registers; short-lived ones prefer caller-saved
+// registers so the prologue does not have to save anything.
+static int pick_register(IRFunction* fn, LiveIntervals* live, LiveInterval* interval, bool* busy,
+                         int preferred) {
+    const TargetBackend* backend = fn->backend;
+
+    // Call clobbers are fixed ranges, so a caller-saved hint never survives a call
+    if (register_free(fn, live, interval, busy, preferred)) return preferred;
+    for (int pass = 0; pass < 2; pass++) {
+        bool want_preserved = interval->crosses_call ? pass == 0 : pass == 1;
+        for (int r = 0; r < backend->num_registers; r++) {
+            if (!ir_register_allocatable(backend, r) || busy[r]) continue;
+            if (backend->registers[r]->preserved != want_preserved) continue;
+            if (regalloc_fixed_conflict(&live->fixed[r], interval->start, interval->end)) continue;
+            return r;
+        }
+    }
+    return -1;
+}
+
+bool regalloc_linear_scan(IRFunction* fn) {
+    const TargetBackend* backend = fn->backend;
+    if (!backend->registers || !backend->scratch_registers[0] || !backend->scratch_registers[1]) {
+        fprintf(stderr, "regalloc: backend %s has no register description\n", backend->name);
+        return false;
+    }
+
+    fn->num_spilled = 0;
+    regalloc_fold_fixed_moves(fn);
+    LiveIntervals* live = regalloc_build_intervals(fn);
+    LiveInterval** active = (LiveInterval**)malloc((live->num_intervals + 1) * sizeof(LiveInterval*));
+    bool* busy = (bool*)calloc(backend->num_registers, sizeof(bool));
+    int* hint_reg = (int*)malloc((fn->num_vregs + 1) * sizeof(int));
+    int* hint_vreg = (int*)malloc((fn->num_vregs + 1) * sizeof(int));
+    int num_active = 0;
+
+    free(fn->vreg_reg);
+    fn->vreg_reg = (int*)malloc((fn->num_vregs + 1) * sizeof(int));
+    for (int v = 0; v < fn->num_vregs; v++) fn->vreg_reg[v] = -1;
+    find_copy_hints(fn, hint_reg, hint_vreg);
+
+    for (int i = 0; i < live->num_intervals; i++) {
+        LiveInterval* current = &live->intervals[i];
+
+        // Expire intervals that ended before this one starts
+        int kept = 0;
+        for (int a = 0; a < num_active; a++) {
+            if (active[a]->end < current->start) {
+                busy[active[a]->reg] = false;
+            } else {
+                active[kept++] = active[a];
+            }
+        }
+        num_active = kept;
+
+        int preferred = hint_reg[current->vreg];
+        if (preferred < 0 && hint_vreg[current->vreg] >= 0) preferred = fn->vreg_reg[hint_vreg[current->vreg]];
+        current->reg = pick_register(fn, live, current, busy, preferred);
+        if (current->reg < 0) {
+            // Spill whichever candidate ends last; steal its register if it
+            // outlives the current interval and the register is usable here.
+            int victim = -1;
+            for (int a = 0; a < num_active; a++) {
+                if (active[a]->end <= current->end) continue;
+                if (regalloc_fixed_conflict(&live->fixed[active[a]->reg], current->start, current->end)) continue;
+                if (victim < 0 || active[a]->end > active[victim]->end) victim = a;
+            }
+            if (victim < 0) continue;
+
+            current->reg = active[victim]->reg;
+            active[victim]->reg = -1;
+            fn->vreg_reg[active[victim]->vreg] = -1;
+            active[victim] = active[--num_active];
+        }
+
+        busy[current->reg] = true;
+        fn->vreg_reg[current->vreg] = current->reg;
+        active[num_active++] = current;
+    }
+
+    free(hint_vreg);
+    free(hint_reg);
+    free(busy);
+    free(active);
+    regalloc_free_intervals(live);
+    regalloc_finish(fn);
+    return true;
+}
+
+// Gives each spilled vreg a frame slot. Intervals are visited in start
+// order and a slot is handed out again once its previous owner has ended.
+static void assign_spill_slots(IRFunction* fn) {
+    LiveIntervals* live = regalloc_build_intervals(fn);
+    int* slot_end = (int*)malloc((live->num_intervals + 1) * sizeof(int));
+    int* slots = (int*)malloc((live->num_intervals + 1) * sizeof(int));
+    int num_slots = 0;
+
+    for (int i = 0; i < live->num_intervals; i++) {
+        LiveInterval* interval = &live->intervals[i];
+        if (fn->vreg_reg[interval->vreg] >= 0) continue;
+
+        int s = 0;
+        while (s < num_slots && slot_end[s] >= interval->start) s++;
+        if (s == num_slots) slots[num_slots++] = ir_new_slot(fn);
+        slot_end[s] = interval->end;
+        fn->vreg_slot[interval->vreg] = slots[s];
+        fn->num_spilled++;
+    }
+
+    free(slots);
+    free(slot_end);
+    regalloc_free_intervals(live);
+}
+
+void regalloc_finish(IRFunction* fn) {
+    const TargetBackend* backend = fn->backend;
+    bool any_spilled = false;
+
+    free(fn->vreg_slot);
+    fn->vreg_slot = (int*)malloc((fn->num_vregs + 1) * sizeof(int));
+    for (int v = 0; v < fn->num_vregs; v++) {
+        fn->vreg_slot[v] = -1;
+        if (fn->vreg_reg[v] < 0) any_spilled = true;
+    }
+    if (any_spilled) assign_spill_slots(fn);
+
+    free(fn->saved_regs);
+    free(fn->saved_slots);
+    fn->saved_regs = (int*)malloc(backend->num_registers * sizeof(int));
+    fn->saved_slots = (int*)malloc(backend->num_registers * sizeof(int));
+    fn->num_saved_regs = 0;
+    for (int r = 0; r < backend->num_registers; r++) {
+        if (!backend->registers[r]->preserved || !ir_register_allocatable(backend, r)) continue;
+        for (int v = 0; v < fn->num_vregs; v++) {
+            if (fn->vreg_reg[v] == r) {
+                fn->saved_regs[fn->num_saved_regs] = r;
+                fn->saved_slots[fn->num_saved_regs++] = ir_new_slot(fn);
+                break;
+            }
+        }
+    }
+}
@@ -0,0 +1,60 @@
+// ALETHEIA Register Allocation
+// Maps IR virtual registers onto the registers described by a TargetBackend
+
+#ifndef ALETHEIA_REGALLOC_H
+#define ALETHEIA_REGALLOC_H
+
+#include "ir.h"
+
+// Positions are inclusive. Instruction i reads its operands at 2i and
+// writes its results at 2i+1, so a use and a following def can share a register.
+typedef struct {
+    int start;
+    int end;
+} LiveRange;
+
+typedef struct {
+    int vreg;
+    int start;
+    int end;
+    bool crosses_call;
+    int reg;            // Assigned backend register index, -1 when spilled
+} LiveInterval;
+
+// Per-register occupied ranges (operands naming a register, call clobbers)
+typedef struct {
+    LiveRange* ranges;
+    int num_ranges;
+    int capacity;
+} FixedRanges;
+
+typedef struct {
+    LiveInterval* intervals;   // One per vreg, sorted by start after building
+    int num_intervals;
+    FixedRanges* fixed;        // One per backend register
+    int num_fixed;
+    int num_positions;
+} LiveIntervals;
+
+LiveIntervals* regalloc_build_intervals(IRFunction* fn);
+void regalloc_free_intervals(LiveIntervals* live);
+bool regalloc_fixed_conflict(FixedRanges* fixed, int start, int end);
+
+// Folds `v = op ...; mov PREG, v` into `PREG = op ...` when v has no other
+// def or use, so a value built for an argument or the return register goes
+// there directly. Registers the allocator may not hand out (the x86-64
+// return register) are only reachable this way. Both allocators run it
+// first; returns the number of copies removed.
+int regalloc_fold_fixed_moves(IRFunction* fn);
+
+// Allocators return false when the function cannot be allocated
+bool regalloc_linear_scan(IRFunction* fn);
+
+// Iterated register coalescing; spill choice weighs uses by loop depth.
+// Spilled vregs are rewritten into short-lived reload temporaries.
+bool regalloc_graph_coloring(IRFunction* fn);
+
+// Assigns spill slots and callee-saved save slots once vreg_reg is filled in
+void regalloc_finish(IRFunction* fn);
+
+#endif // ALETHEIA_REGALLOC_H
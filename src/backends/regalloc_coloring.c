@@ -0,0 +1,608 @@
+// ALETHEIA Graph-Coloring Register Allocation
+// Chaitin-Briggs allocation with iterated register coalescing (George & Appel)
+
+#include "regalloc.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define COLORING_MAX_ROUNDS 8
+#define BIT_TEST(bits, i) (((bits)[(i) / 64] >> ((i) % 64)) & 1ULL)
+
+typedef enum {
+    NODE_INITIAL,
+    NODE_SIMPLIFY,
+    NODE_FREEZE,
+    NODE_SPILL,
+    NODE_SPILLED,
+    NODE_COALESCED,
+    NODE_COLORED,
+    NODE_SELECT
+} NodeState;
+
+typedef enum {
+    MOVE_WORKLIST,
+    MOVE_ACTIVE,
+    MOVE_COALESCED,
+    MOVE_CONSTRAINED,
+    MOVE_FROZEN
+} MoveState;
+
+typedef struct {
+    int* items;
+    int count;
+    int capacity;
+} IntList;
+
+typedef struct {
+    int dst;
+    int src;
+    MoveState state;
+} CopyMove;
+
+typedef struct {
+    IRFunction* fn;
+    const TargetBackend* backend;
+    int num_nodes;
+    int k;                      // Number of allocatable registers
+    uint64_t allocatable;       // Mask of allocatable backend registers
+
+    uint8_t* adj_matrix;
+    IntList* adj_list;
+    int* degree;
+    uint64_t* forbidden;        // Registers a node interferes with
+    int* hint;                  // Register a node is copied to/from, or -1
+    double* spill_cost;
+    bool* no_spill;             // Spill reload temporaries
+    NodeState* state;
+    int* alias;
+    int* color;
+    IntList* move_list;
+
+    CopyMove* moves;
+    int num_moves;
+    int move_capacity;
+
+    int* select_stack;
+    int select_count;
+} ColoringState;
+
+static void list_push(IntList* list, int value) {
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 8;
+        list->items = (int*)realloc(list->items, list->capacity * sizeof(int));
+    }
+    list->items[list->count++] = value;
+}
+
+static int popcount64(uint64_t value) {
+    int count = 0;
+    while (value) {
+        value &= value - 1;
+        count++;
+    }
+    return count;
+}
+
+// Colors still available to a node once its forbidden registers are removed
+static int node_k(ColoringState* cs, int node) {
+    return cs->k - popcount64(cs->forbidden[node] & cs->allocatable);
+}
+
+static bool adjacent_bit(ColoringState* cs, int u, int v) {
+    size_t bit = (size_t)u * cs->num_nodes + v;
+    return (cs->adj_matrix[bit / 8] >> (bit % 8)) & 1;
+}
+
+static void add_edge(ColoringState* cs, int u, int v) {
+    if (u == v || adjacent_bit(cs, u, v)) return;
+
+    size_t bit = (size_t)u * cs->num_nodes + v;
+    cs->adj_matrix[bit / 8] |= (uint8_t)(1 << (bit % 8));
+    bit = (size_t)v * cs->num_nodes + u;
+    cs->adj_matrix[bit / 8] |= (uint8_t)(1 << (bit % 8));
+
+    list_push(&cs->adj_list[u], v);
+    list_push(&cs->adj_list[v], u);
+    cs->degree[u]++;
+    cs->degree[v]++;
+}
+
+// Records an interference between live id a and live id b
+static void add_interference(ColoringState* cs, int a, int b) {
+    int n = cs->num_nodes;
+    if (a >= n && b >= n) return;
+    if (a >= n) {
+        cs->forbidden[b] |= 1ULL << (a - n);
+    } else if (b >= n) {
+        cs->forbidden[a] |= 1ULL << (b - n);
+    } else {
+        add_edge(cs, a, b);
+    }
+}
+
+static bool is_copy(IRInstr* instr) {
+    return instr->op == IR_MOV &&
+           (instr->dst.kind == IR_OPND_VREG || instr->dst.kind == IR_OPND_PREG) &&
+           (instr->src1.kind == IR_OPND_VREG || instr->src1.kind == IR_OPND_PREG);
+}
+
+static void build_graph(ColoringState* cs) {
+    IRFunction* fn = cs->fn;
+    int n = cs->num_nodes;
+    int num_ids = ir_num_live_ids(fn);
+    int words = (num_ids + 63) / 64;
+    int* defs = (int*)malloc((cs->backend->num_registers + IR_MAX_USES) * sizeof(int));
+    int* uses = (int*)malloc((cs->backend->num_registers + IR_MAX_USES) * sizeof(int));
+    uint64_t* live = (uint64_t*)malloc(words * sizeof(uint64_t));
+    static const double depth_weight[] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+
+    ir_compute_liveness(fn);
+    ir_compute_loop_depths(fn);
+
+    for (int b = 0; b < fn->num_blocks; b++) {
+        IRBlock* block = fn->blocks[b];
+        int depth = block->loop_depth < 6 ? block->loop_depth : 6;
+        memcpy(live, block->live_out, words * sizeof(uint64_t));
+
+        for (int i = block->num_instrs - 1; i >= 0; i--) {
+            IRInstr* instr = &block->instrs[i];
+            int num_defs = ir_instr_def_ids(fn, instr, defs);
+            int num_uses = ir_instr_use_ids(fn, instr, uses);
+
+            if (is_copy(instr)) {
+                int dst = defs[0];
+                int src = uses[0];
+                live[src / 64] &= ~(1ULL << (src % 64));
+
+                if (dst < n && src < n) {
+                    CopyMove move = {dst, src, MOVE_WORKLIST};
+                    if (cs->num_moves == cs->move_capacity) {
+                        cs->move_capacity = cs->move_capacity ? cs->move_capacity * 2 : 16;
+                        cs->moves = (CopyMove*)realloc(cs->moves, cs->move_capacity * sizeof(CopyMove));
+                    }
+                    cs->moves[cs->num_moves] = move;
+                    list_push(&cs->move_list[dst], cs->num_moves);
+                    list_push(&cs->move_list[src], cs->num_moves);
+                    cs->num_moves++;
+                } else if (dst < n) {
+                    cs->hint[dst] = src - n;
+                } else if (src < n) {
+                    cs->hint[src] = dst - n;
+                }
+            }
+
+            for (int d = 0; d < num_defs; d++) {
+                live[defs[d] / 64] |= 1ULL << (defs[d] % 64);
+            }
+            for (int d = 0; d < num_defs; d++) {
+                for (int id = 0; id < num_ids; id++) {
+                    if (id != defs[d] && BIT_TEST(live, id)) add_interference(cs, defs[d], id);
+                }
+                if (defs[d] < n) cs->spill_cost[defs[d]] += depth_weight[depth];
+            }
+            for (int d = 0; d < num_defs; d++) {
+                live[defs[d] / 64] &= ~(1ULL << (defs[d] % 64));
+            }
+            for (int u = 0; u < num_uses; u++) {
+                live[uses[u] / 64] |= 1ULL << (uses[u] % 64);
+                if (uses[u] < n) cs->spill_cost[uses[u]] += depth_weight[depth];
+            }
+        }
+    }
+
+    free(live);
+    free(uses);
+    free(defs);
+}
+
+static bool move_related(ColoringState* cs, int node) {
+    IntList* list = &cs->move_list[node];
+    for (int i = 0; i < list->count; i++) {
+        MoveState state = cs->moves[list->items[i]].state;
+        if (state == MOVE_WORKLIST || state == MOVE_ACTIVE) return true;
+    }
+    return false;
+}
+
+static int get_alias(ColoringState* cs, int node) {
+    while (cs->state[node] == NODE_COALESCED) node = cs->alias[node];
+    return node;
+}
+
+static bool node_removed(ColoringState* cs, int node) {
+    return cs->state[node] == NODE_SELECT || cs->state[node] == NODE_COALESCED;
+}
+
+static void enable_moves(ColoringState* cs, int node) {
+    IntList* list = &cs->move_list[node];
+    for (int i = 0; i < list->count; i++) {
+        CopyMove* move = &cs->moves[list->items[i]];
+        if (move->state == MOVE_ACTIVE) move->state = MOVE_WORKLIST;
+    }
+}
+
+static void decrement_degree(ColoringState* cs, int node) {
+    int degree = cs->degree[node]--;
+    if (degree != node_k(cs, node)) return;
+
+    enable_moves(cs, node);
+    IntList* adj = &cs->adj_list[node];
+    for (int i = 0; i < adj->count; i++) {
+        if (!node_removed(cs, adj->items[i])) enable_moves(cs, adj->items[i]);
+    }
+    if (cs->state[node] == NODE_SPILL) {
+        cs->state[node] = move_related(cs, node) ? NODE_FREEZE : NODE_SIMPLIFY;
+    }
+}
+
+static void simplify_node(ColoringState* cs, int node) {
+    cs->state[node] = NODE_SELECT;
+    cs->select_stack[cs->select_count++] = node;
+
+    IntList* adj = &cs->adj_list[node];
+    for (int i = 0; i < adj->count; i++) {
+        if (!node_removed(cs, adj->items[i])) decrement_degree(cs, adj->items[i]);
+    }
+}
+
+static void add_worklist(ColoringState* cs, int node) {
+    if (cs->state[node] == NODE_FREEZE && !move_related(cs, node) &&
+        cs->degree[node] < node_k(cs, node)) {
+        cs->state[node] = NODE_SIMPLIFY;
+    }
+}
+
+// Briggs: the merged node has fewer significant neighbours than colors
+static bool briggs_safe(ColoringState* cs, int u, int v) {
+    int k = cs->k - popcount64((cs->forbidden[u] | cs->forbidden[v]) & cs->allocatable);
+    int significant = 0;
+
+    for (int pass = 0; pass < 2; pass++) {
+        IntList* adj = &cs->adj_list[pass == 0 ? u : v];
+        for (int i = 0; i < adj->count; i++) {
+            int t = adj->items[i];
+            if (node_removed(cs, t)) continue;
+            if (pass == 1 && adjacent_bit(cs, u, t)) continue;
+            if (cs->degree[t] >= node_k(cs, t)) significant++;
+        }
+    }
+    return significant < k;
+}
+
+// A node living across a call is limited to callee-saved registers. Merging
+// it with one that is not would drag the save into code that had no call,
+// such as an early exit that shrink-wrapping keeps frame-free.
+static bool crosses_call_boundary(ColoringState* cs, int u, int v) {
+    uint64_t scratch = 0;
+    for (int r = 0; r < cs->backend->num_registers; r++) {
+        if (!cs->backend->registers[r]->preserved) scratch |= 1ULL << r;
+    }
+    scratch &= cs->allocatable;
+    return ((scratch & ~cs->forbidden[u]) != 0) != ((scratch & ~cs->forbidden[v]) != 0);
+}
+
+static void combine(ColoringState* cs, int u, int v) {
+    cs->state[v] = NODE_COALESCED;
+    cs->alias[v] = u;
+    cs->forbidden[u] |= cs->forbidden[v];
+    cs->spill_cost[u] += cs->spill_cost[v];
+    cs->no_spill[u] = cs->no_spill[u] || cs->no_spill[v];
+    if (cs->hint[u] < 0) cs->hint[u] = cs->hint[v];
+
+    for (int i = 0; i < cs->move_list[v].count; i++) {
+        list_push(&cs->move_list[u], cs->move_list[v].items[i]);
+    }
+    enable_moves(cs, v);
+
+    IntList* adj = &cs->adj_list[v];
+    for (int i = 0; i < adj->count; i++) {
+        int t = adj->items[i];
+        if (node_removed(cs, t)) continue;
+        add_edge(cs, t, u);
+        decrement_degree(cs, t);
+    }
+    if (cs->degree[u] >= node_k(cs, u) && cs->state[u] == NODE_FREEZE) {
+        cs->state[u] = NODE_SPILL;
+    }
+}
+
+static void coalesce_move(ColoringState* cs, int index) {
+    CopyMove* move = &cs->moves[index];
+    int u = get_alias(cs, move->dst);
+    int v = get_alias(cs, move->src);
+
+    if (u == v) {
+        move->state = MOVE_COALESCED;
+        add_worklist(cs, u);
+    } else if (adjacent_bit(cs, u, v) || crosses_call_boundary(cs, u, v)) {
+        move->state = MOVE_CONSTRAINED;
+        add_worklist(cs, u);
+        add_worklist(cs, v);
+    } else if (briggs_safe(cs, u, v)) {
+        move->state = MOVE_COALESCED;
+        combine(cs, u, v);
+        add_worklist(cs, u);
+    } else {
+        move->state = MOVE_ACTIVE;
+    }
+}
+
+static void freeze_moves(ColoringState* cs, int u) {
+    IntList* list = &cs->move_list[u];
+    for (int i = 0; i < list->count; i++) {
+        CopyMove* move = &cs->moves[list->items[i]];
+        if (move->state != MOVE_WORKLIST && move->state != MOVE_ACTIVE) continue;
+
+        int x = get_alias(cs, move->dst);
+        int y = get_alias(cs, move->src);
+        int v = y == get_alias(cs, u) ? x : y;
+        move->state = MOVE_FROZEN;
+        if (cs->state[v] == NODE_FREEZE && !move_related(cs, v)) {
+            cs->state[v] = NODE_SIMPLIFY;
+        }
+    }
+}
+
+// Picks the node with the lowest loop-weighted cost per interference edge
+static int select_spill(ColoringState* cs) {
+    int best = -1;
+    double best_ratio = 0;
+
+    for (int node = 0; node < cs->num_nodes; node++) {
+        if (cs->state[node] != NODE_SPILL) continue;
+        double ratio = cs->no_spill[node] ? 1e30 : cs->spill_cost[node] / (cs->degree[node] + 1);
+        if (best < 0 || ratio < best_ratio) {
+            best = node;
+            best_ratio = ratio;
+        }
+    }
+    return best;
+}
+
+static int find_state(ColoringState* cs, NodeState state) {
+    for (int node = 0; node < cs->num_nodes; node++) {
+        if (cs->state[node] == state) return node;
+    }
+    return -1;
+}
+
+static int find_worklist_move(ColoringState* cs) {
+    for (int i = 0; i < cs->num_moves; i++) {
+        if (cs->moves[i].state == MOVE_WORKLIST) return i;
+    }
+    return -1;
+}
+
+static bool assign_colors(ColoringState* cs) {
+    bool spilled = false;
+
+    while (cs->select_count > 0) {
+        int node = cs->select_stack[--cs->select_count];
+        uint64_t ok = cs->allocatable & ~cs->forbidden[node];
+
+        IntList* adj = &cs->adj_list[node];
+        for (int i = 0; i < adj->count; i++) {
+            int t = get_alias(cs, adj->items[i]);
+            if (cs->state[t] == NODE_COLORED) ok &= ~(1ULL << cs->color[t]);
+        }
+        if (!ok) {
+            cs->state[node] = NODE_SPILLED;
+            spilled = true;
+            continue;
+        }
+
+        // Prefer the register a copy wants, then a coalescing partner's
+        // color, then caller-saved registers that need no save/restore.
+        int chosen = -1;
+        if (cs->hint[node] >= 0 && (ok >> cs->hint[node]) & 1ULL) chosen = cs->hint[node];
+        for (int i = 0; chosen < 0 && i < cs->move_list[node].count; i++) {
+            CopyMove* move = &cs->moves[cs->move_list[node].items[i]];
+            int other = get_alias(cs, move->dst == node ? move->src : move->dst);
+            if (cs->state[other] == NODE_COLORED && (ok >> cs->color[other]) & 1ULL) {
+                chosen = cs->color[other];
+            }
+        }
+        for (int r = 0; chosen < 0 && r < cs->backend->num_registers; r++) {
+            if ((ok >> r) & 1ULL && !cs->backend->registers[r]->preserved) chosen = r;
+        }
+        for (int r = 0; chosen < 0 && r < cs->backend->num_registers; r++) {
+            if ((ok >> r) & 1ULL) chosen = r;
+        }
+
+        cs->state[node] = NODE_COLORED;
+        cs->color[node] = chosen;
+    }
+
+    for (int node = 0; node < cs->num_nodes; node++) {
+        if (cs->state[node] == NODE_COALESCED) {
+            int target = get_alias(cs, node);
+            cs->color[node] = cs->state[target] == NODE_COLORED ? cs->color[target] : -1;
+        }
+    }
+    return !spilled;
+}
+
+// Rewrites every reference to a spilled vreg into a short-lived temporary
+// loaded before each use and stored after each def.
+static int rewrite_spills(ColoringState* cs) {
+    IRFunction* fn = cs->fn;
+    int* slots = (int*)malloc(cs->num_nodes * sizeof(int));
+    int num_spilled = 0;
+
+    for (int node = 0; node < cs->num_nodes; node++) {
+        slots[node] = -1;
+        if (cs->state[node] == NODE_SPILLED) {
+            slots[node] = ir_new_slot(fn);
+            num_spilled++;
+        }
+    }
+    // Nodes coalesced into a spilled node share its slot
+    for (int node = 0; node < cs->num_nodes; node++) {
+        if (cs->state[node] == NODE_COALESCED) slots[node] = slots[get_alias(cs, node)];
+    }
+
+    for (int b = 0; b < fn->num_blocks; b++) {
+        IRBlock* block = fn->blocks[b];
+        int capacity = block->num_instrs * 5 + 1;
+        IRInstr* out = (IRInstr*)malloc(capacity * sizeof(IRInstr));
+        int count = 0;
+
+        for (int i = 0; i < block->num_instrs; i++) {
+            IRInstr instr = block->instrs[i];
+            IROperand* srcs[4] = {&instr.src1, &instr.src2, &instr.if_true, &instr.if_false};
+
+            for (int s = 0; s < 4; s++) {
+                if (srcs[s]->kind != IR_OPND_VREG || slots[srcs[s]->value] < 0) continue;
+                IRInstr load;
+                memset(&load, 0, sizeof(load));
+                load.op = IR_LOAD;
+                load.target = load.target_false = -1;
+                load.dst = ir_vreg(ir_new_vreg(fn));
+                load.src1.kind = IR_OPND_SLOT;
+                load.src1.value = slots[srcs[s]->value];
+                out[count++] = load;
+                srcs[s]->value = load.dst.value;
+            }
+
+            IRInstr store;
+            bool has_store = false;
+            if (instr.dst.kind == IR_OPND_VREG && slots[instr.dst.value] >= 0) {
+                memset(&store, 0, sizeof(store));
+                store.op = IR_STORE;
+                store.target = store.target_false = -1;
+                store.dst.kind = IR_OPND_SLOT;
+                store.dst.value = slots[instr.dst.value];
+                store.src1 = ir_vreg(ir_new_vreg(fn));
+                instr.dst = store.src1;
+                has_store = true;
+            }
+
+            out[count++] = instr;
+            if (has_store) out[count++] = store;
+        }
+
+        free(block->instrs);
+        block->instrs = out;
+        block->num_instrs = count;
+        block->capacity = capacity;
+    }
+
+    free(slots);
+    return num_spilled;
+}
+
+static void free_state(ColoringState* cs) {
+    for (int i = 0; i < cs->num_nodes; i++) {
+        free(cs->adj_list[i].items);
+        free(cs->move_list[i].items);
+    }
+    free(cs->adj_matrix);
+    free(cs->adj_list);
+    free(cs->move_list);
+    free(cs->degree);
+    free(cs->forbidden);
+    free(cs->hint);
+    free(cs->spill_cost);
+    free(cs->no_spill);
+    free(cs->state);
+    free(cs->alias);
+    free(cs->color);
+    free(cs->moves);
+    free(cs->select_stack);
+}
+
+bool regalloc_graph_coloring(IRFunction* fn) {
+    const TargetBackend* backend = fn->backend;
+    if (!backend->registers || backend->num_registers > 64) {
+        return regalloc_linear_scan(fn);
+    }
+
+    bool* temp_flags = NULL;
+    int temp_capacity = 0;
+    fn->num_spilled = 0;
+    regalloc_fold_fixed_moves(fn);
+
+    for (int round = 0; round < COLORING_MAX_ROUNDS; round++) {
+        ColoringState cs;
+        memset(&cs, 0, sizeof(cs));
+        cs.fn = fn;
+        cs.backend = backend;
+        cs.num_nodes = fn->num_vregs;
+
+        int n = cs.num_nodes ? cs.num_nodes : 1;
+        cs.adj_matrix = (uint8_t*)calloc(((size_t)n * n + 7) / 8, 1);
+        cs.adj_list = (IntList*)calloc(n, sizeof(IntList));
+        cs.move_list = (IntList*)calloc(n, sizeof(IntList));
+        cs.degree = (int*)calloc(n, sizeof(int));
+        cs.forbidden = (uint64_t*)calloc(n, sizeof(uint64_t));
+        cs.hint = (int*)malloc(n * sizeof(int));
+        cs.spill_cost = (double*)calloc(n, sizeof(double));
+        cs.no_spill = (bool*)calloc(n, sizeof(bool));
+        cs.state = (NodeState*)calloc(n, sizeof(NodeState));
+        cs.alias = (int*)malloc(n * sizeof(int));
+        cs.color = (int*)malloc(n * sizeof(int));
+        cs.select_stack = (int*)malloc(n * sizeof(int));
+
+        for (int r = 0; r < backend->num_registers; r++) {
+            if (ir_register_allocatable(backend, r)) {
+                cs.allocatable |= 1ULL << r;
+                cs.k++;
+            }
+        }
+        for (int v = 0; v < cs.num_nodes; v++) {
+            cs.hint[v] = -1;
+            cs.alias[v] = v;
+            cs.color[v] = -1;
+            cs.no_spill[v] = v < temp_capacity && temp_flags[v];
+        }
+
+        build_graph(&cs);
+
+        // Make the initial worklists
+        for (int v = 0; v < cs.num_nodes; v++) {
+            if (cs.degree[v] >= node_k(&cs, v)) cs.state[v] = NODE_SPILL;
+            else if (move_related(&cs, v)) cs.state[v] = NODE_FREEZE;
+            else cs.state[v] = NODE_SIMPLIFY;
+        }
+
+        for (;;) {
+            int node;
+            int move;
+            if ((node = find_state(&cs, NODE_SIMPLIFY)) >= 0) {
+                simplify_node(&cs, node);
+            } else if ((move = find_worklist_move(&cs)) >= 0) {
+                coalesce_move(&cs, move);
+            } else if ((node = find_state(&cs, NODE_FREEZE)) >= 0) {
+                cs.state[node] = NODE_SIMPLIFY;
+                freeze_moves(&cs, node);
+            } else if ((node = select_spill(&cs)) >= 0) {
+                cs.state[node] = NODE_SIMPLIFY;
+                freeze_moves(&cs, node);
+            } else {
+                break;
+            }
+        }
+
+        if (assign_colors(&cs)) {
+            free(fn->vreg_reg);
+            fn->vreg_reg = (int*)malloc((fn->num_vregs + 1) * sizeof(int));
+            for (int v = 0; v < fn->num_vregs; v++) fn->vreg_reg[v] = cs.color[v];
+            free_state(&cs);
+            free(temp_flags);
+            regalloc_finish(fn);
+            return true;
+        }
+
+        // Reload temporaries created by the rewrite must never be spilled again
+        int before = fn->num_vregs;
+        fn->num_spilled += rewrite_spills(&cs);
+        temp_flags = (bool*)realloc(temp_flags, (fn->num_vregs + 1) * sizeof(bool));
+        for (int v = temp_capacity; v < fn->num_vregs; v++) temp_flags[v] = v >= before;
+        temp_capacity = fn->num_vregs;
+        free_state(&cs);
+    }
+
+    // Spill rewriting did not converge; the linear scan always succeeds
+    free(temp_flags);
+    return regalloc_linear_scan(fn);
+}
@@ -2,95 +2,120 @@
 // RV64G code generation for IoT and embedded platforms
 
 #include "../backend.h"
+#include "../isel.h"
 #include <stdlib.h>
 #include <string.h>
 
 // RISC-V 64 registers
-static TargetRegister riscv64_registers[] = {
+static const TargetRegister riscv64_registers[] = {
     // General purpose registers (x0-x31)
-    {"zero", REG_CLASS_GP, 0, false},  // Hardwired zero
-    {"ra", REG_CLASS_GP, 1, false},    // Return address
-    {"sp", REG_CLASS_GP, 2, false},    // Stack pointer
-    {"gp", REG_CLASS_GP, 3, false},    // Global pointer
-    {"tp", REG_CLASS_GP, 4, false},    // Thread pointer
-    {"t0", REG_CLASS_GP, 5, false},    // Temporary/alternate link register
-    {"t1", REG_CLASS_GP, 6, false},    // Temporary
-    {"t2", REG_CLASS_GP, 7, false},    // Temporary
-    {"s0", REG_CLASS_GP, 8, true},     // Saved register/frame pointer
-    {"s1", REG_CLASS_GP, 9, true},     // Saved register
-    {"a0", REG_CLASS_GP, 10, false},   // Function argument/return value
-    {"a1", REG_CLASS_GP, 11, false},   // Function argument/return value
-    {"a2", REG_CLASS_GP, 12, false},   // Function argument
-    {"a3", REG_CLASS_GP, 13, false},   // Function argument
-    {"a4", REG_CLASS_GP, 14, false},   // Function argument
-    {"a5", REG_CLASS_GP, 15, false},   // Function argument
-    {"a6", REG_CLASS_GP, 16, false},   // Function argument
-    {"a7", REG_CLASS_GP, 17, false},   // Function argument
-    {"s2", REG_CLASS_GP, 18, true},    // Saved register
-    {"s3", REG_CLASS_GP, 19, true},    // Saved register
-    {"s4", REG_CLASS_GP, 20, true},    // Saved register
-    {"s5", REG_CLASS_GP, 21, true},    // Saved register
-    {"s6", REG_CLASS_GP, 22, true},    // Saved register
-    {"s7", REG_CLASS_GP, 23, true},    // Saved register
-    {"s8", REG_CLASS_GP, 24, true},    // Saved register
-    {"s9", REG_CLASS_GP, 25, true},    // Saved register
-    {"s10", REG_CLASS_GP, 26, true},   // Saved register
-    {"s11", REG_CLASS_GP, 27, true},   // Saved register
-    {"t3", REG_CLASS_GP, 28, false},   // Temporary
-    {"t4", REG_CLASS_GP, 29, false},   // Temporary
-    {"t5", REG_CLASS_GP, 30, false},   // Temporary
-    {"t6", REG_CLASS_GP, 31, false},   // Temporary
+    {"zero", REG_CLASS_GP, 0, false, true},  // Hardwired zero
+    {"ra", REG_CLASS_GP, 1, false, true},    // Return address
+    {"sp", REG_CLASS_GP, 2, false, true},    // Stack pointer
+    {"gp", REG_CLASS_GP, 3, false, true},    // Global pointer
+    {"tp", REG_CLASS_GP, 4, false, true},    // Thread pointer
+    {"t0", REG_CLASS_GP, 5, false, true},    // Temporary/alternate link register
+    {"t1", REG_CLASS_GP, 6, false, false},    // Temporary
+    {"t2", REG_CLASS_GP, 7, false, false},    // Temporary
+    {"s0", REG_CLASS_GP, 8, true, true},     // Saved register/frame pointer
+    {"s1", REG_CLASS_GP, 9, true, false},     // Saved register
+    {"a0", REG_CLASS_GP, 10, false, false},   // Function argument/return value
+    {"a1", REG_CLASS_GP, 11, false, false},   // Function argument/return value
+    {"a2", REG_CLASS_GP, 12, false, false},   // Function argument
+    {"a3", REG_CLASS_GP, 13, false, false},   // Function argument
+    {"a4", REG_CLASS_GP, 14, false, false},   // Function argument
+    {"a5", REG_CLASS_GP, 15, false, false},   // Function argument
+    {"a6", REG_CLASS_GP, 16, false, false},   // Function argument
+    {"a7", REG_CLASS_GP, 17, false, false},   // Function argument
+    {"s2", REG_CLASS_GP, 18, true, false},    // Saved register
+    {"s3", REG_CLASS_GP, 19, true, false},    // Saved register
+    {"s4", REG_CLASS_GP, 20, true, false},    // Saved register
+    {"s5", REG_CLASS_GP, 21, true, false},    // Saved register
+    {"s6", REG_CLASS_GP, 22, true, false},    // Saved register
+    {"s7", REG_CLASS_GP, 23, true, false},    // Saved register
+    {"s8", REG_CLASS_GP, 24, true, false},    // Saved register
+    {"s9", REG_CLASS_GP, 25, true, false},    // Saved register
+    {"s10", REG_CLASS_GP, 26, true, false},   // Saved register
+    {"s11", REG_CLASS_GP, 27, true, false},   // Saved register
+    {"t3", REG_CLASS_GP, 28, false, false},   // Temporary
+    {"t4", REG_CLASS_GP, 29, false, false},   // Temporary
+    {"t5", REG_CLASS_GP, 30, false, true},   // Temporary, spill scratch
+    {"t6", REG_CLASS_GP, 31, false, true},   // Temporary, spill scratch
 
     // Floating point registers (f0-f31) - RV64G includes D extension
-    {"ft0", REG_CLASS_VEC, 0, false},  // FP temporary
-    {"ft1", REG_CLASS_VEC, 1, false},  // FP temporary
-    {"ft2", REG_CLASS_VEC, 2, false},  // FP temporary
-    {"ft3", REG_CLASS_VEC, 3, false},  // FP temporary
-    {"ft4", REG_CLASS_VEC, 4, false},  // FP temporary
-    {"ft5", REG_CLASS_VEC, 5, false},  // FP temporary
-    {"ft6", REG_CLASS_VEC, 6, false},  // FP temporary
-    {"ft7", REG_CLASS_VEC, 7, false},  // FP temporary
-    {"fs0", REG_CLASS_VEC, 8, true},   // FP saved register
-    {"fs1", REG_CLASS_VEC, 9, true},   // FP saved register
-    {"fa0", REG_CLASS_VEC, 10, false}, // FP argument/return value
-    {"fa1", REG_CLASS_VEC, 11, false}, // FP argument/return value
-    {"fa2", REG_CLASS_VEC, 12, false}, // FP argument
-    {"fa3", REG_CLASS_VEC, 13, false}, // FP argument
-    {"fa4", REG_CLASS_VEC, 14, false}, // FP argument
-    {"fa5", REG_CLASS_VEC, 15, false}, // FP argument
-    {"fa6", REG_CLASS_VEC, 16, false}, // FP argument
-    {"fa7", REG_CLASS_VEC, 17, false}, // FP argument
-    {"fs2", REG_CLASS_VEC, 18, true},  // FP saved register
-    {"fs3", REG_CLASS_VEC, 19, true},  // FP saved register
-    {"fs4", REG_CLASS_VEC, 20, true},  // FP saved register
-    {"fs5", REG_CLASS_VEC, 21, true},  // FP saved register
-    {"fs6", REG_CLASS_VEC, 22, true},  // FP saved register
-    {"fs7", REG_CLASS_VEC, 23, true},  // FP saved register
-    {"fs8", REG_CLASS_VEC, 24, true},  // FP saved register
-    {"fs9", REG_CLASS_VEC, 25, true},  // FP saved register
-    {"fs10", REG_CLASS_VEC, 26, true}, // FP saved register
-    {"fs11", REG_CLASS_VEC, 27, true}, // FP saved register
-    {"ft8", REG_CLASS_VEC, 28, false}, // FP temporary
-    {"ft9", REG_CLASS_VEC, 29, false}, // FP temporary
-    {"ft10", REG_CLASS_VEC, 30, false}, // FP temporary
-    {"ft11", REG_CLASS_VEC, 31, false}, // FP temporary
+    {"ft0", REG_CLASS_VEC, 0, false, false},  // FP temporary
+    {"ft1", REG_CLASS_VEC, 1, false, false},  // FP temporary
+    {"ft2", REG_CLASS_VEC, 2, false, false},  // FP temporary
+    {"ft3", REG_CLASS_VEC, 3, false, false},  // FP temporary
+    {"ft4", REG_CLASS_VEC, 4, false, false},  // FP temporary
+    {"ft5", REG_CLASS_VEC, 5, false, false},  // FP temporary
+    {"ft6", REG_CLASS_VEC, 6, false, false},  // FP temporary
+    {"ft7", REG_CLASS_VEC, 7, false, false},  // FP temporary
+    {"fs0", REG_CLASS_VEC, 8, true, false},   // FP saved register
+    {"fs1", REG_CLASS_VEC, 9, true, false},   // FP saved register
+    {"fa0", REG_CLASS_VEC, 10, false, false}, // FP argument/return value
+    {"fa1", REG_CLASS_VEC, 11, false, false}, // FP argument/return value
+    {"fa2", REG_CLASS_VEC, 12, false, false}, // FP argument
+    {"fa3", REG_CLASS_VEC, 13, false, false}, // FP argument
+    {"fa4", REG_CLASS_VEC, 14, false, false}, // FP argument
+    {"fa5", REG_CLASS_VEC, 15, false, false}, // FP argument
+    {"fa6", REG_CLASS_VEC, 16, false, false}, // FP argument
+    {"fa7", REG_CLASS_VEC, 17, false, false}, // FP argument
+    {"fs2", REG_CLASS_VEC, 18, true, false},  // FP saved register
+    {"fs3", REG_CLASS_VEC, 19, true, false},  // FP saved register
+    {"fs4", REG_CLASS_VEC, 20, true, false},  // FP saved register
+    {"fs5", REG_CLASS_VEC, 21, true, false},  // FP saved register
+    {"fs6", REG_CLASS_VEC, 22, true, false},  // FP saved register
+    {"fs7", REG_CLASS_VEC, 23, true, false},  // FP saved register
+    {"fs8", REG_CLASS_VEC, 24, true, false},  // FP saved register
+    {"fs9", REG_CLASS_VEC, 25, true, false},  // FP saved register
+    {"fs10", REG_CLASS_VEC, 26, true, false}, // FP saved register
+    {"fs11", REG_CLASS_VEC, 27, true, false}, // FP saved register
+    {"ft8", REG_CLASS_VEC, 28, false, false}, // FP temporary
+    {"ft9", REG_CLASS_VEC, 29, false, false}, // FP temporary
+    {"ft10", REG_CLASS_VEC, 30, false, false}, // FP temporary
+    {"ft11", REG_CLASS_VEC, 31, false, false}, // FP temporary
 };
 
 #define NUM_RISCV64_REGISTERS (sizeof(riscv64_registers) / sizeof(TargetRegister))
 
 // RISC-V calling convention (Linux ABI)
-static CallingConvention riscv64_calling_convention = {
-    .arg_registers = NULL, // Will be initialized
+static const TargetRegister* const riscv64_arg_registers[] = {
+    &riscv64_registers[10], &riscv64_registers[11], &riscv64_registers[12], // a0-a2
+    &riscv64_registers[13], &riscv64_registers[14], &riscv64_registers[15], // a3-a5
+    &riscv64_registers[16], &riscv64_registers[17],                          // a6, a7
+};
+
+static const CallingConvention riscv64_calling_convention = {
+    .arg_registers = riscv64_arg_registers,
     .num_arg_registers = 8,
     .return_register = &riscv64_registers[10], // a0
     .stack_pointer = &riscv64_registers[2],    // sp
     .frame_pointer = &riscv64_registers[8],    // s0
+    .locals_offset = 16,                       // ra and old s0 sit below s0
+    .slots_from_sp = true,                     // c.ldsp/c.sdsp reach 504 bytes up from sp
+    .red_zone_size = 0,
     .stack_alignment = 16,
     .caller_cleanup = false
 };
 
 // RISC-V code generation functions
-static void riscv64_generate_prologue(FILE* out, int stack_size) {
+// I-type and S-type immediates are signed 12-bit
+static bool riscv64_imm12(int value) {
+    return value >= -2048 && value <= 2047;
+}
+
+// Adjusts sp by `delta`, going through t0 when it does not fit in addi
+static void riscv64_adjust_sp(EmitBuffer* out, int delta) {
+    if (riscv64_imm12(delta)) {
+        emit_instruction(out, "addi sp, sp, %d", delta);
+    } else {
+        emit_instruction(out, "li t0, %d", delta);
+        emit_instruction(out, "add sp, sp, t0");
+    }
+}
+
+static void riscv64_generate_prologue(EmitBuffer* out, int stack_size) {
     emit_comment(out, "RISC-V function prologue");
     emit_instruction(out, "addi sp, sp, -16");  // Allocate stack space
     emit_instruction(out, "sd ra, 8(sp)");      // Save return address
@@ -100,16 +125,16 @@ static void riscv64_generate_prologue(FILE* out, int stack_size) {
     if (stack_size > 0) {
         // Align stack size to 16 bytes
         int aligned_size = (stack_size + 15) & ~15;
-        emit_instruction(out, "addi sp, sp, -%d", aligned_size);
+        riscv64_adjust_sp(out, -aligned_size);
     }
 }
 
-static void riscv64_generate_epilogue(FILE* out, int stack_size) {
+static void riscv64_generate_epilogue(EmitBuffer* out, int stack_size) {
     emit_comment(out, "RISC-V function epilogue");
 
     if (stack_size > 0) {
         int aligned_size = (stack_size + 15) & ~15;
-        emit_instruction(out, "addi sp, sp, %d", aligned_size);
+        riscv64_adjust_sp(out, aligned_size);
     }
 
     emit_instruction(out, "ld s0, 0(sp)");      // Restore frame pointer
@@ -118,95 +143,256 @@ static void riscv64_generate_epilogue(FILE* out, int stack_size) {
     emit_instruction(out, "ret");
 }
 
-static void riscv64_generate_mov(FILE* out, const char* dest, const char* src) {
+// Leaf functions keep ra in place and never set up s0
+static void riscv64_generate_leaf_prologue(EmitBuffer* out, int stack_size) {
+    if (stack_size > 0) {
+        riscv64_adjust_sp(out, -((stack_size + 15) & ~15));
+    }
+}
+
+static void riscv64_generate_leaf_epilogue(EmitBuffer* out, int stack_size) {
+    if (stack_size > 0) {
+        riscv64_adjust_sp(out, (stack_size + 15) & ~15);
+    }
+    emit_instruction(out, "ret");
+}
+
+static void riscv64_generate_mov(EmitBuffer* out, const char* dest, const char* src) {
     emit_instruction(out, "mv %s, %s", dest, src);
 }
 
-static void riscv64_generate_add(FILE* out, const char* dest, const char* src1, const char* src2) {
+static void riscv64_generate_mov_imm(EmitBuffer* out, const char* dest, long imm) {
+    emit_instruction(out, "li %s, %ld", dest, imm);
+}
+
+static void riscv64_generate_add(EmitBuffer* out, const char* dest, const char* src1, const char* src2) {
     emit_instruction(out, "add %s, %s, %s", dest, src1, src2);
 }
 
-static void riscv64_generate_sub(FILE* out, const char* dest, const char* src1, const char* src2) {
+static void riscv64_generate_add_imm(EmitBuffer* out, const char* dest, const char* src, long imm) {
+    emit_instruction(out, "addi %s, %s, %ld", dest, src, imm);
+}
+
+static void riscv64_generate_sub(EmitBuffer* out, const char* dest, const char* src1, const char* src2) {
     emit_instruction(out, "sub %s, %s, %s", dest, src1, src2);
 }
 
-static void riscv64_generate_mul(FILE* out, const char* dest, const char* src1, const char* src2) {
+static void riscv64_generate_mul(EmitBuffer* out, const char* dest, const char* src1, const char* src2) {
     emit_instruction(out, "mul %s, %s, %s", dest, src1, src2);
 }
 
-static void riscv64_generate_div(FILE* out, const char* dest, const char* src1, const char* src2) {
+static void riscv64_generate_div(EmitBuffer* out, const char* dest, const char* src1, const char* src2) {
     emit_instruction(out, "div %s, %s, %s", dest, src1, src2);  // Signed division
 }
 
+// Load and store mnemonics for each access width (lw sign-extends, lwu
+// and lbu zero-extend)
+static const char* riscv64_load_mnemonic(MemoryWidth width) {
+    switch (width) {
+        case MEM_S32: return "lw";
+        case MEM_U32: return "lwu";
+        case MEM_S8: return "lb";
+        case MEM_U8: return "lbu";
+        default: return "ld";
+    }
+}
+
+static const char* riscv64_store_mnemonic(MemoryWidth width) {
+    switch (width) {
+        case MEM_S32:
+        case MEM_U32: return "sw";
+        case MEM_S8:
+        case MEM_U8: return "sb";
+        default: return "sd";
+    }
+}
+
 // BUG FIX 1: Corrected format specifier order
 // Format string "ld %s, %d(%s)" expects (dest, offset, addr)
 // Was receiving (dest, addr, offset) causing %d to format string and %s to format int
-static void riscv64_generate_load(FILE* out, const char* dest, const char* addr, int offset) {
-    if (offset == 0) {
-        emit_instruction(out, "ld %s, 0(%s)", dest, addr);
+static void riscv64_generate_load_sized(EmitBuffer* out, MemoryWidth width, const char* dest,
+                                        const char* addr, int offset) {
+    const char* op = riscv64_load_mnemonic(width);
+    if (!riscv64_imm12(offset)) {
+        emit_instruction(out, "li t0, %d", offset);
+        emit_instruction(out, "add t0, t0, %s", addr);
+        emit_instruction(out, "%s %s, 0(t0)", op, dest);
+    } else if (offset == 0) {
+        emit_instruction(out, "%s %s, 0(%s)", op, dest, addr);
     } else {
-        emit_instruction(out, "ld %s, %d(%s)", dest, offset, addr);
+        emit_instruction(out, "%s %s, %d(%s)", op, dest, offset, addr);
     }
 }
 
 // BUG FIX 1: Corrected format specifier order for store as well
-static void riscv64_generate_store(FILE* out, const char* src, const char* addr, int offset) {
-    if (offset == 0) {
-        emit_instruction(out, "sd %s, 0(%s)", src, addr);
+static void riscv64_generate_store_sized(EmitBuffer* out, MemoryWidth width, const char* src,
+                                         const char* addr, int offset) {
+    const char* op = riscv64_store_mnemonic(width);
+    if (!riscv64_imm12(offset)) {
+        emit_instruction(out, "li t0, %d", offset);
+        emit_instruction(out, "add t0, t0, %s", addr);
+        emit_instruction(out, "%s %s, 0(t0)", op, src);
+    } else if (offset == 0) {
+        emit_instruction(out, "%s %s, 0(%s)", op, src, addr);
+    } else {
+        emit_instruction(out, "%s %s, %d(%s)", op, src, offset, addr);
+    }
+}
+
+// No indexed addressing: the scaled index is added into t0 first, by one
+// shNadd with Zba and by a shift and an add without it
+static void riscv64_emit_load_indexed(EmitBuffer* out, MemoryWidth width, const char* dest,
+                                      const char* base, const char* index, int shift,
+                                      int offset, bool zba) {
+    if (shift == 0) {
+        emit_instruction(out, "add t0, %s, %s", base, index);
+    } else if (zba) {
+        emit_instruction(out, "sh%dadd t0, %s, %s", shift, index, base);
     } else {
-        emit_instruction(out, "sd %s, %d(%s)", src, offset, addr);
+        emit_instruction(out, "slli t0, %s, %d", index, shift);
+        emit_instruction(out, "add t0, t0, %s", base);
     }
+    if (!riscv64_imm12(offset)) {
+        // base and index are consumed, so dest is free to hold the offset
+        emit_instruction(out, "li %s, %d", dest, offset);
+        emit_instruction(out, "add t0, t0, %s", dest);
+        offset = 0;
+    }
+    emit_instruction(out, "%s %s, %d(t0)", riscv64_load_mnemonic(width), dest, offset);
+}
+
+// Zba only changes address generation. RVC changes no text: the assembler
+// compresses under .option rvc, and the encoder reads the feature itself.
+static void riscv64_generate_load_indexed(EmitBuffer* out, MemoryWidth width, const char* dest,
+                                          const char* base, const char* index, int shift,
+                                          int offset) {
+    riscv64_emit_load_indexed(out, width, dest, base, index, shift, offset,
+                              (out->features & TARGET_FEATURE_ZBA) != 0);
+}
+
+static void riscv64_generate_load(EmitBuffer* out, const char* dest, const char* addr, int offset) {
+    riscv64_generate_load_sized(out, MEM_WORD, dest, addr, offset);
 }
 
-static void riscv64_generate_cmp(FILE* out, const char* op1, const char* op2) {
+static void riscv64_generate_store(EmitBuffer* out, const char* src, const char* addr, int offset) {
+    riscv64_generate_store_sized(out, MEM_WORD, src, addr, offset);
+}
+
+static void riscv64_generate_cmp(EmitBuffer* out, const char* op1, const char* op2) {
     // RISC-V doesn't have a direct compare instruction
     // Comparison is done with branches or using slt
     emit_instruction(out, "slt t0, %s, %s", op1, op2);  // Set if less than
 }
 
-static void riscv64_generate_jmp(FILE* out, const char* label) {
+static void riscv64_generate_jmp(EmitBuffer* out, const char* label) {
     emit_instruction(out, "j %s", label);
 }
 
 // BUG FIX 2: Changed from unconditional branch to proper conditional jump
 // Original: "beq zero, zero, label" (always true - unconditional)
 // Fixed: "beq t0, zero, label" (conditional based on comparison result in t0)
-static void riscv64_generate_je(FILE* out, const char* label) {
+static void riscv64_generate_je(EmitBuffer* out, const char* label) {
     emit_comment(out, "RISC-V conditional jump if equal (based on previous comparison)");
     emit_instruction(out, "beq t0, zero, %s", label);  // Branch if t0 == 0 (comparison result)
 }
 
-static void riscv64_generate_jne(FILE* out, const char* label) {
+static void riscv64_generate_jne(EmitBuffer* out, const char* label) {
     // This is tricky in RISC-V - we'd need to set up condition flags
     emit_comment(out, "JNE requires condition setup in RISC-V");
     emit_instruction(out, "j %s", label);  // Placeholder
 }
 
-static void riscv64_generate_jl(FILE* out, const char* label) {
+static void riscv64_generate_jl(EmitBuffer* out, const char* label) {
     emit_instruction(out, "blt t0, zero, %s", label);
 }
 
-static void riscv64_generate_jg(FILE* out, const char* label) {
+static void riscv64_generate_jg(EmitBuffer* out, const char* label) {
     emit_instruction(out, "bgt t0, zero, %s", label);
 }
 
-static void riscv64_generate_call(FILE* out, const char* function) {
+// No flags register: conditions are computed with slt/xori/seqz/snez
+static void riscv64_generate_setcc(EmitBuffer* out, CompareCondition cond, const char* dest,
+                                   const char* op1, const char* op2) {
+    switch (cond) {
+        case COND_EQ:
+            emit_instruction(out, "sub %s, %s, %s", dest, op1, op2);
+            emit_instruction(out, "seqz %s, %s", dest, dest);
+            break;
+        case COND_NE:
+            emit_instruction(out, "sub %s, %s, %s", dest, op1, op2);
+            emit_instruction(out, "snez %s, %s", dest, dest);
+            break;
+        case COND_LT:
+            emit_instruction(out, "slt %s, %s, %s", dest, op1, op2);
+            break;
+        case COND_GT:
+            emit_instruction(out, "slt %s, %s, %s", dest, op2, op1);
+            break;
+        case COND_LE:
+            emit_instruction(out, "slt %s, %s, %s", dest, op2, op1);
+            emit_instruction(out, "xori %s, %s, 1", dest, dest);
+            break;
+        case COND_GE:
+            emit_instruction(out, "slt %s, %s, %s", dest, op1, op2);
+            emit_instruction(out, "xori %s, %s, 1", dest, dest);
+            break;
+    }
+}
+
+// Base RV64 has no conditional move: turn the 0/1 condition into an all-ones
+// mask and blend, dest = if_false ^ ((if_true ^ if_false) & mask). t5/t6 are
+// the scratch registers and hold no operand here.
+static void riscv64_generate_select(EmitBuffer* out, CompareCondition cond, const char* dest,
+                                    const char* op1, const char* op2,
+                                    const char* if_true, const char* if_false) {
+    riscv64_generate_setcc(out, cond, "t5", op1, op2 ? op2 : "zero");
+    emit_instruction(out, "neg t5, t5");
+    emit_instruction(out, "xor t6, %s, %s", if_true, if_false);
+    emit_instruction(out, "and t6, t6, t5");
+    emit_instruction(out, "xor %s, t6, %s", dest, if_false);
+}
+
+static void riscv64_generate_branch(EmitBuffer* out, CompareCondition cond, const char* op1,
+                                    const char* op2, const char* label) {
+    switch (cond) {
+        case COND_EQ: emit_instruction(out, "beq %s, %s, %s", op1, op2, label); break;
+        case COND_NE: emit_instruction(out, "bne %s, %s, %s", op1, op2, label); break;
+        case COND_LT: emit_instruction(out, "blt %s, %s, %s", op1, op2, label); break;
+        case COND_LE: emit_instruction(out, "bge %s, %s, %s", op2, op1, label); break;
+        case COND_GT: emit_instruction(out, "blt %s, %s, %s", op2, op1, label); break;
+        case COND_GE: emit_instruction(out, "bge %s, %s, %s", op1, op2, label); break;
+    }
+}
+
+static void riscv64_generate_branch_zero(EmitBuffer* out, CompareCondition cond, const char* op,
+                                         const char* label) {
+    switch (cond) {
+        case COND_EQ: emit_instruction(out, "beqz %s, %s", op, label); break;
+        case COND_NE: emit_instruction(out, "bnez %s, %s", op, label); break;
+        case COND_LT: emit_instruction(out, "bltz %s, %s", op, label); break;
+        case COND_LE: emit_instruction(out, "blez %s, %s", op, label); break;
+        case COND_GT: emit_instruction(out, "bgtz %s, %s", op, label); break;
+        case COND_GE: emit_instruction(out, "bgez %s, %s", op, label); break;
+    }
+}
+
+static void riscv64_generate_call(EmitBuffer* out, const char* function) {
     emit_instruction(out, "call %s", function);
 }
 
-static void riscv64_generate_ret(FILE* out) {
+static void riscv64_generate_ret(EmitBuffer* out) {
     emit_instruction(out, "ret");
 }
 
-static void riscv64_generate_label(FILE* out, const char* label) {
+static void riscv64_generate_label(EmitBuffer* out, const char* label) {
     emit_label(out, label);
 }
 
-static void riscv64_apply_ia_hints(FILE* out, const char* optimization_type) {
+static void riscv64_apply_ia_hints(EmitBuffer* out, const char* optimization_type) {
     emit_comment(out, "RISC-V IA optimization hints");
 
     if (strcmp(optimization_type, "loop_unroll") == 0) {
-        emit_instruction(out, ";; IA: RISC-V loop unrolling - use compressed instructions");
+        emit_instruction(out, ";; IA: RISC-V loop unrolling - keep the body small, -mrvc halves most instructions");
     } else if (strcmp(optimization_type, "vectorize") == 0) {
         emit_instruction(out, ";; IA: SIMD vectorization - future RV64V extension");
         emit_instruction(out, ";; IA suggests: prepare for vector instructions");
@@ -220,7 +406,7 @@ static void riscv64_apply_ia_hints(FILE* out, const char* optimization_type) {
 }
 
 // RISC-V instruction set (RV64G subset)
-static TargetInstruction riscv64_instructions[] = {
+static const TargetInstruction riscv64_instructions[] = {
     {"add", 3, false},
     {"addi", 3, true},   // Add immediate
     {"sub", 3, false},
@@ -243,12 +429,79 @@ static TargetInstruction riscv64_instructions[] = {
     {"bge", 3, false},   // Branch if greater or equal
     {"ret", 0, false},   // Return (pseudo-instruction)
     {"call", 1, false},  // Call function (pseudo-instruction)
+
+    // C extension: 16-bit forms the encoder picks under TARGET_FEATURE_RVC
+    {"c.addi", 2, true},     // rd += nzimm6
+    {"c.addi16sp", 1, true}, // sp += nzimm6 * 16
+    {"c.addi4spn", 2, true}, // rd' = sp + nzuimm8 * 4
+    {"c.li", 2, true},       // rd = imm6
+    {"c.lui", 2, true},
+    {"c.mv", 2, false},
+    {"c.add", 2, false},
+    {"c.sub", 2, false},     // rd' -= rs2'
+    {"c.ld", 3, true},       // x8..x15, offset 0..248
+    {"c.sd", 3, true},
+    {"c.ldsp", 2, true},     // sp-relative, offset 0..504
+    {"c.sdsp", 2, true},
+    {"c.j", 1, false},       // +-2KB
+    {"c.beqz", 2, false},    // x8..x15, +-256 bytes
+    {"c.bnez", 2, false},
+    {"c.jr", 1, false},      // ret is c.jr ra
 };
 
 #define NUM_RISCV64_INSTRUCTIONS (sizeof(riscv64_instructions) / sizeof(TargetInstruction))
 
+// RISC-V selection rules, costs in cycles on an in-order RV64GC core. addi
+// is the only ALU immediate and loads take no index, so a scaled index is
+// one shNadd with Zba and a shift plus an add without it.
+static const IselRule riscv64_isel_rules[] = {
+    ISEL_LEAF(ISEL_NT_REG, ISEL_CONST, 1, ISEL_ACT_MOV_IMM),
+    ISEL_LEAF(ISEL_NT_REG, ISEL_VREG, 0, ISEL_ACT_VREG),
+    ISEL_LEAF(ISEL_NT_REG, ISEL_SLOT, 3, ISEL_ACT_LOAD_SLOT),
+    ISEL_IMM(ISEL_NT_ADDIMM, -2048, 2047),               // addi simm12
+    ISEL_IMM(ISEL_NT_SUBIMM, -2047, 2048),
+    ISEL_IMM(ISEL_NT_ZERO, 0, 0),
+    ISEL_IMM(ISEL_NT_SCALE, 0, 3),
+    ISEL_IMM(ISEL_NT_DISP, INT_MIN, INT_MAX),
+    ISEL_RULE(ISEL_NT_REG, ISEL_ADD, ISEL_NT_REG, ISEL_NT_REG, 1, ISEL_ACT_OP),
+    ISEL_RULE(ISEL_NT_REG, ISEL_ADD, ISEL_NT_REG, ISEL_NT_ADDIMM, 1, ISEL_ACT_OP_IMM),
+    ISEL_RULE(ISEL_NT_REG, ISEL_SUB, ISEL_NT_REG, ISEL_NT_REG, 1, ISEL_ACT_OP),
+    ISEL_RULE(ISEL_NT_REG, ISEL_SUB, ISEL_NT_REG, ISEL_NT_SUBIMM, 1, ISEL_ACT_SUB_IMM),
+    ISEL_RULE(ISEL_NT_REG, ISEL_MUL, ISEL_NT_REG, ISEL_NT_REG, 3, ISEL_ACT_OP),
+    ISEL_RULE(ISEL_NT_REG, ISEL_DIV, ISEL_NT_REG, ISEL_NT_REG, 20, ISEL_ACT_OP),
+    ISEL_RULE(ISEL_NT_REG, ISEL_SHL, ISEL_NT_REG, ISEL_NT_SCALE, 4, ISEL_ACT_SHL),
+    ISEL_RULE(ISEL_NT_REG, ISEL_CMP, ISEL_NT_REG, ISEL_NT_REG, 2, ISEL_ACT_SETCC),
+    ISEL_RULE(ISEL_NT_INDEX, ISEL_SHL, ISEL_NT_REG, ISEL_NT_SCALE, 0, ISEL_ACT_INDEX),
+    ISEL_CHAIN(ISEL_NT_INDEX, ISEL_NT_REG, 0, ISEL_ACT_INDEX_REG),
+    ISEL_RULE(ISEL_NT_BASEIDX, ISEL_ADD, ISEL_NT_REG, ISEL_NT_INDEX, 2, ISEL_ACT_BASE_INDEX),
+    ISEL_RULE_IF(TARGET_FEATURE_ZBA, ISEL_NT_BASEIDX, ISEL_ADD, ISEL_NT_REG, ISEL_NT_INDEX, 1,
+                 ISEL_ACT_BASE_INDEX),
+    ISEL_CHAIN(ISEL_NT_ADDR, ISEL_NT_REG, 0, ISEL_ACT_BASE),
+    ISEL_CHAIN(ISEL_NT_ADDR, ISEL_NT_BASEIDX, 0, ISEL_ACT_KEEP),
+    ISEL_RULE(ISEL_NT_ADDR, ISEL_ADD, ISEL_NT_REG, ISEL_NT_DISP, 0, ISEL_ACT_BASE_DISP),
+    ISEL_RULE(ISEL_NT_ADDR, ISEL_ADD, ISEL_NT_BASEIDX, ISEL_NT_DISP, 0, ISEL_ACT_ADD_DISP),
+    ISEL_RULE(ISEL_NT_REG, ISEL_LOAD, ISEL_NT_ADDR, ISEL_NT_REG, 3, ISEL_ACT_LOAD),
+    ISEL_RULE(ISEL_NT_BRANCH, ISEL_CMP, ISEL_NT_REG, ISEL_NT_REG, 1, ISEL_ACT_BRANCH),
+    ISEL_RULE(ISEL_NT_BRANCH, ISEL_CMP, ISEL_NT_REG, ISEL_NT_ZERO, 1, ISEL_ACT_BRANCH_ZERO),
+};
+
+// SiFive U74 is dual-issue and in order, with a 3-cycle load-to-use and a
+// divider that blocks until it is done. Every stall is the scheduler's to
+// hide, so blocks are scheduled whole.
+static const TargetTuning riscv64_tunings[] = {
+    {"sifive-u74", 2, 0, {
+        [SCHED_ALU] = {1, 2, 1},
+        [SCHED_MUL] = {3, 1, 1},
+        [SCHED_DIV] = {20, 1, 20},
+        [SCHED_LOAD] = {3, 1, 1},
+        [SCHED_STORE] = {3, 1, 1},
+        [SCHED_VECTOR] = {4, 1, 1},
+        [SCHED_BRANCH] = {1, 1, 1},
+    }},
+};
+
 // Create RISC-V 64 backend
-TargetBackend* create_riscv64_backend(void) {
+const TargetBackend* create_riscv64_backend(void) {
     TargetBackend* backend = (TargetBackend*)malloc(sizeof(TargetBackend));
     if (!backend) return NULL;
 
@@ -256,49 +509,75 @@ TargetBackend* create_riscv64_backend(void) {
     backend->name = "RISC-V 64";
     backend->triple = "riscv64-linux-gnu";
 
-    // Allocate and copy registers
-    backend->registers = (TargetRegister**)malloc(NUM_RISCV64_REGISTERS * sizeof(TargetRegister*));
-    for (int i = 0; i < NUM_RISCV64_REGISTERS; i++) {
-        backend->registers[i] = &riscv64_registers[i];
+    // Allocate and copy registers and instructions
+    const TargetRegister** registers = malloc(NUM_RISCV64_REGISTERS * sizeof(const TargetRegister*));
+    const TargetInstruction** instructions =
+        malloc(NUM_RISCV64_INSTRUCTIONS * sizeof(TargetInstruction*));
+    if (!registers || !instructions) {
+        free(registers);
+        free(instructions);
+        free(backend);
+        return NULL;
+    }
+    for (int i = 0; i < (int)NUM_RISCV64_REGISTERS; i++) {
+        registers[i] = &riscv64_registers[i];
     }
+    for (int i = 0; i < (int)NUM_RISCV64_INSTRUCTIONS; i++) {
+        instructions[i] = &riscv64_instructions[i];
+    }
+    backend->registers = registers;
     backend->num_registers = NUM_RISCV64_REGISTERS;
+    backend->scratch_registers[0] = &riscv64_registers[30]; // t5
+    backend->scratch_registers[1] = &riscv64_registers[31]; // t6
 
-    // Set up calling convention
     backend->calling_convention = &riscv64_calling_convention;
-    backend->calling_convention->arg_registers = (TargetRegister**)malloc(
-        backend->calling_convention->num_arg_registers * sizeof(TargetRegister*));
-    for (int i = 0; i < backend->calling_convention->num_arg_registers; i++) {
-        // Map to a0-a7 registers (indices 10-17 in our array)
-        backend->calling_convention->arg_registers[i] = &riscv64_registers[10 + i];
-    }
 
-    // Allocate and copy instructions
-    backend->instructions = (TargetInstruction**)malloc(NUM_RISCV64_INSTRUCTIONS * sizeof(TargetInstruction*));
-    for (int i = 0; i < NUM_RISCV64_INSTRUCTIONS; i++) {
-        backend->instructions[i] = &riscv64_instructions[i];
-    }
+    backend->instructions = instructions;
     backend->num_instructions = NUM_RISCV64_INSTRUCTIONS;
+    backend->isel_rules = riscv64_isel_rules;
+    backend->num_isel_rules = sizeof(riscv64_isel_rules) / sizeof(IselRule);
+    backend->tunings = riscv64_tunings;
+    backend->num_tunings = sizeof(riscv64_tunings) / sizeof(TargetTuning);
 
     // Initialize function pointers
     backend->generate_prologue = riscv64_generate_prologue;
     backend->generate_epilogue = riscv64_generate_epilogue;
+    backend->generate_leaf_prologue = riscv64_generate_leaf_prologue;
+    backend->generate_leaf_epilogue = riscv64_generate_leaf_epilogue;
     backend->generate_mov = riscv64_generate_mov;
+    backend->generate_mov_imm = riscv64_generate_mov_imm;
     backend->generate_add = riscv64_generate_add;
     backend->generate_sub = riscv64_generate_sub;
     backend->generate_mul = riscv64_generate_mul;
     backend->generate_div = riscv64_generate_div;
+    backend->generate_add_imm = riscv64_generate_add_imm;
+    backend->generate_mul_imm = NULL;
     backend->generate_load = riscv64_generate_load;
     backend->generate_store = riscv64_generate_store;
+    backend->generate_load_sized = riscv64_generate_load_sized;
+    backend->generate_store_sized = riscv64_generate_store_sized;
+    backend->generate_load_indexed = riscv64_generate_load_indexed;
+    backend->generate_store_pair = NULL;
+    backend->generate_load_pair = NULL;
     backend->generate_cmp = riscv64_generate_cmp;
     backend->generate_jmp = riscv64_generate_jmp;
     backend->generate_je = riscv64_generate_je;
     backend->generate_jne = riscv64_generate_jne;
     backend->generate_jl = riscv64_generate_jl;
     backend->generate_jg = riscv64_generate_jg;
+    backend->generate_setcc = riscv64_generate_setcc;
+    backend->generate_branch = riscv64_generate_branch;
+    backend->generate_branch_zero = riscv64_generate_branch_zero;
+    backend->generate_select = riscv64_generate_select;
+    backend->generate_vzero = NULL;
+    backend->generate_vadd_indexed = NULL;
+    backend->generate_vreduce = NULL;
+    backend->generate_resolver = NULL;
     backend->generate_call = riscv64_generate_call;
     backend->generate_ret = riscv64_generate_ret;
     backend->generate_label = riscv64_generate_label;
     backend->apply_ia_hints = riscv64_apply_ia_hints;
+    backend->encoder = &riscv64_encoder;
 
     return backend;
 }
\ No newline at end of file
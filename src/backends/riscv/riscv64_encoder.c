@@ -0,0 +1,653 @@
+// ALETHEIA RISC-V 64 Machine Code Encoder
+// Encodes the instruction sequences the RISC-V text callbacks in
+// riscv64_backend.c print, expanding pseudo-instructions (li, mv, call,
+// ret, ...) the way the assembler does. With TARGET_FEATURE_RVC every
+// instruction whose operands fit a 16-bit C-extension form is emitted in
+// that form, as an assembler targeting RV64GC would; branches start short
+// and are widened by mcode_relax when their label is out of reach.
+
+#include "../backend.h"
+
+#define RV_ZERO 0
+#define RV_RA 1
+#define RV_SP 2
+#define RV_T0 5
+#define RV_A7 17
+#define RV_T5 30
+#define RV_T6 31
+
+// Major opcodes
+#define RV_LOAD 0x03
+#define RV_OP_IMM 0x13
+#define RV_AUIPC 0x17
+#define RV_OP_IMM_32 0x1B
+#define RV_STORE 0x23
+#define RV_OP 0x33
+#define RV_OP_32 0x3B
+#define RV_LUI 0x37
+#define RV_BRANCH 0x63
+#define RV_JALR 0x67
+#define RV_JAL 0x6F
+
+// funct3 of the branches; flipping bit 0 inverts the condition
+#define RV_BEQ 0
+#define RV_BNE 1
+#define RV_BLT 4
+#define RV_BGE 5
+
+static bool rv_compress(CodeBuffer* out) {
+    return (out->features & TARGET_FEATURE_RVC) != 0;
+}
+
+// Most 16-bit forms only have 3-bit register fields, naming x8..x15
+static bool rv_prime(int reg) {
+    return reg >= 8 && reg <= 15;
+}
+
+static bool rv_simm(long value, int bits) {
+    return value >= -(1L << (bits - 1)) && value < (1L << (bits - 1));
+}
+
+static uint32_t rv_bits(long value, int hi, int lo, int to) {
+    return (uint32_t)(((unsigned long)value >> lo) & ((1ul << (hi - lo + 1)) - 1)) << to;
+}
+
+static void rv_insn(CodeBuffer* out, uint32_t insn) {
+    mcode_u32(out, insn);
+}
+
+static void rv_insn16(CodeBuffer* out, uint32_t insn) {
+    mcode_u16(out, (uint16_t)insn);
+    out->compressed++;
+}
+
+static uint32_t rv_r_type(uint32_t funct7, int rs2, int rs1, uint32_t funct3, int rd, uint32_t opcode) {
+    return funct7 << 25 | (uint32_t)rs2 << 20 | (uint32_t)rs1 << 15 | funct3 << 12 |
+           (uint32_t)rd << 7 | opcode;
+}
+
+static uint32_t rv_i_type(long imm, int rs1, uint32_t funct3, int rd, uint32_t opcode) {
+    return rv_bits(imm, 11, 0, 20) | (uint32_t)rs1 << 15 | funct3 << 12 | (uint32_t)rd << 7 | opcode;
+}
+
+// CI format: imm[5] at bit 12, imm[4:0] at bits 6:2
+static uint32_t rv_ci(uint32_t funct3, int rd, long imm, uint32_t op) {
+    return funct3 << 13 | rv_bits(imm, 5, 5, 12) | (uint32_t)rd << 7 | rv_bits(imm, 4, 0, 2) | op;
+}
+
+// CA format: rd' = rd' op rs2'
+static uint32_t rv_ca(uint32_t funct6, int rd, uint32_t funct2, int rs2) {
+    return funct6 << 10 | (uint32_t)(rd - 8) << 7 | funct2 << 5 | (uint32_t)(rs2 - 8) << 2 | 0x1;
+}
+
+// addi and its 16-bit forms: c.nop, c.li from zero, c.mv for a zero
+// immediate, c.addi in place, c.addi16sp and c.addi4spn off sp
+static void rv_addi(CodeBuffer* out, int rd, int rs1, long imm) {
+    if (rv_compress(out) && rd == RV_ZERO && rs1 == RV_ZERO && imm == 0) {
+        rv_insn16(out, 0x0001);  // c.nop
+        return;
+    }
+    if (rv_compress(out) && rd != RV_ZERO) {
+        if (rs1 == RV_ZERO && rv_simm(imm, 6)) {
+            rv_insn16(out, rv_ci(2, rd, imm, 0x1));  // c.li
+            return;
+        }
+        if (imm == 0 && rs1 != RV_ZERO) {
+            rv_insn16(out, 0x8002 | (uint32_t)rd << 7 | (uint32_t)rs1 << 2);  // c.mv
+            return;
+        }
+        if (rd == rs1 && imm != 0 && rv_simm(imm, 6)) {
+            rv_insn16(out, rv_ci(0, rd, imm, 0x1));  // c.addi
+            return;
+        }
+        if (rd == RV_SP && rs1 == RV_SP && imm != 0 && imm % 16 == 0 && rv_simm(imm, 10)) {
+            rv_insn16(out, 0x6101 | rv_bits(imm, 9, 9, 12) | rv_bits(imm, 4, 4, 6) |
+                           rv_bits(imm, 6, 6, 5) | rv_bits(imm, 8, 7, 3) | rv_bits(imm, 5, 5, 2));
+            return;
+        }
+        if (rv_prime(rd) && rs1 == RV_SP && imm > 0 && imm < 1024 && imm % 4 == 0) {
+            rv_insn16(out, rv_bits(imm, 5, 4, 11) | rv_bits(imm, 9, 6, 7) | rv_bits(imm, 2, 2, 6) |
+                           rv_bits(imm, 3, 3, 5) | (uint32_t)(rd - 8) << 2);  // c.addi4spn
+            return;
+        }
+    }
+    rv_insn(out, rv_i_type(imm, rs1, 0, rd, RV_OP_IMM));
+}
+
+static void rv_addiw(CodeBuffer* out, int rd, int rs1, long imm) {
+    if (rv_compress(out) && rd != RV_ZERO && rd == rs1 && rv_simm(imm, 6)) {
+        rv_insn16(out, rv_ci(1, rd, imm, 0x1));  // c.addiw
+        return;
+    }
+    rv_insn(out, rv_i_type(imm, rs1, 0, rd, RV_OP_IMM_32));
+}
+
+// `hi20` is the 20-bit field; c.lui takes the nonzero ones a 6-bit signed
+// value sign-extends to
+static void rv_lui(CodeBuffer* out, int rd, long hi20) {
+    if (rv_compress(out) && rd != RV_ZERO && rd != RV_SP &&
+        ((hi20 >= 1 && hi20 <= 31) || (hi20 >= 0xFFFE0 && hi20 <= 0xFFFFF))) {
+        rv_insn16(out, rv_ci(3, rd, hi20, 0x1));
+        return;
+    }
+    rv_insn(out, rv_bits(hi20, 19, 0, 12) | (uint32_t)rd << 7 | RV_LUI);
+}
+
+// slli, srli and srai with a 6-bit shift amount
+static void rv_shift_imm(CodeBuffer* out, uint32_t funct3, bool arithmetic, int rd, int rs1, int shamt) {
+    if (rv_compress(out) && rd == rs1 && shamt != 0) {
+        if (funct3 == 1 && rd != RV_ZERO) {
+            rv_insn16(out, rv_ci(0, rd, shamt, 0x2));  // c.slli
+            return;
+        }
+        if (funct3 == 5 && rv_prime(rd)) {
+            rv_insn16(out, 0x8001 | (arithmetic ? 1u << 10 : 0) | rv_bits(shamt, 5, 5, 12) |
+                           (uint32_t)(rd - 8) << 7 | rv_bits(shamt, 4, 0, 2));  // c.srli, c.srai
+            return;
+        }
+    }
+    rv_insn(out, rv_i_type((arithmetic ? 0x400 : 0) | shamt, rs1, funct3, rd, RV_OP_IMM));
+}
+
+static void rv_xori(CodeBuffer* out, int rd, int rs1, long imm) {
+    rv_insn(out, rv_i_type(imm, rs1, 4, rd, RV_OP_IMM));
+}
+
+// Register-register ALU operations. add becomes c.mv or c.add when one
+// source is zero or the destination; sub, xor, or and and have c.* forms
+// on x8..x15 when the destination is the first (or, commutative, either)
+// source.
+static void rv_op(CodeBuffer* out, uint32_t funct7, uint32_t funct3, int rd, int rs1, int rs2) {
+    if (rv_compress(out) && funct7 == 0 && rd != RV_ZERO) {
+        if (funct3 == 0) {
+            int other = rd == rs1 ? rs2 : rd == rs2 ? rs1 : -1;
+            if (rs1 == RV_ZERO && rs2 != RV_ZERO) {
+                rv_insn16(out, 0x8002 | (uint32_t)rd << 7 | (uint32_t)rs2 << 2);  // c.mv
+                return;
+            }
+            if (rs2 == RV_ZERO && rs1 != RV_ZERO) {
+                rv_insn16(out, 0x8002 | (uint32_t)rd << 7 | (uint32_t)rs1 << 2);
+                return;
+            }
+            if (other > RV_ZERO) {
+                rv_insn16(out, 0x9002 | (uint32_t)rd << 7 | (uint32_t)other << 2);  // c.add
+                return;
+            }
+        }
+        if ((funct3 == 4 || funct3 == 6 || funct3 == 7) && rv_prime(rd) && rd == rs2 && rv_prime(rs1)) {
+            rs2 = rs1;
+            rs1 = rd;
+        }
+        if (rv_prime(rd) && rd == rs1 && rv_prime(rs2)) {
+            switch (funct3) {
+                case 4: rv_insn16(out, rv_ca(0x23, rd, 1, rs2)); return;  // c.xor
+                case 6: rv_insn16(out, rv_ca(0x23, rd, 2, rs2)); return;  // c.or
+                case 7: rv_insn16(out, rv_ca(0x23, rd, 3, rs2)); return;  // c.and
+                default: break;
+            }
+        }
+    }
+    if (rv_compress(out) && funct7 == 0x20 && funct3 == 0 && rv_prime(rd) && rd == rs1 &&
+        rv_prime(rs2)) {
+        rv_insn16(out, rv_ca(0x23, rd, 0, rs2));  // c.sub
+        return;
+    }
+    rv_insn(out, rv_r_type(funct7, rs2, rs1, funct3, rd, RV_OP));
+}
+
+static void rv_add(CodeBuffer* out, int rd, int rs1, int rs2) {
+    rv_op(out, 0, 0, rd, rs1, rs2);
+}
+
+// Same expansion as the assembler's li: lui/addiw for 32-bit values,
+// otherwise the upper part recursively, shifted, plus the low 12 bits
+typedef enum {
+    RV_STEP_LUI,
+    RV_STEP_ADDI,
+    RV_STEP_ADDIW,
+    RV_STEP_SLLI,
+    RV_STEP_SRLI,
+    RV_STEP_SLLI_UW,  // Zba: shift the zero-extended low word
+    RV_STEP_ZEXT_W,   // Zba: add.uw rd, rs, zero
+    RV_STEP_SHADD     // Zba: shNadd rd, rs, rs multiplies by 2^N + 1
+} RVImmStep;
+
+typedef struct {
+    int count;
+    RVImmStep steps[12];
+    long imms[12];
+} RVImmSeq;
+
+static void rv_seq_push(RVImmSeq* seq, RVImmStep step, long imm) {
+    seq->steps[seq->count] = step;
+    seq->imms[seq->count] = imm;
+    seq->count++;
+}
+
+static long rv_sign_extend(unsigned long value, int bits) {
+    return (long)(value << (64 - bits)) >> (64 - bits);
+}
+
+static void rv_imm_seq(long value, bool zba, RVImmSeq* seq) {
+    if (rv_simm(value, 32)) {
+        long hi20 = ((value + 0x800) >> 12) & 0xFFFFF;
+        long lo12 = rv_sign_extend((unsigned long)value, 12);
+        if (hi20) rv_seq_push(seq, RV_STEP_LUI, hi20);
+        if (lo12 || hi20 == 0) rv_seq_push(seq, hi20 ? RV_STEP_ADDIW : RV_STEP_ADDI, lo12);
+        return;
+    }
+
+    long lo12 = rv_sign_extend((unsigned long)value, 12);
+    unsigned long hi52 = ((unsigned long)value + 0x800) >> 12;
+    int shift = 12;
+    while (!(hi52 >> (shift - 12) & 1)) shift++;
+    long upper = rv_sign_extend(hi52 >> (shift - 12), 64 - shift);
+    bool unsigned_word = false;
+
+    // lui zeroes the low 12 bits itself, which saves part of the shift; with
+    // Zba, slli.uw drops the upper half a lui of an unsigned word sets
+    if (shift > 12 && !rv_simm(upper, 12)) {
+        unsigned long shifted = (unsigned long)upper << 12;
+        if (rv_simm((long)shifted, 32)) {
+            shift -= 12;
+            upper = (long)shifted;
+        } else if (zba && shifted >> 32 == 0) {
+            shift -= 12;
+            upper = (long)(shifted | 0xFFFFFFFF00000000ul);
+            unsigned_word = true;
+        }
+    }
+    if (zba && (unsigned long)upper >> 32 == 0 && !rv_simm(upper, 32)) {
+        upper = (long)((unsigned long)upper | 0xFFFFFFFF00000000ul);
+        unsigned_word = true;
+    }
+    rv_imm_seq(upper, zba, seq);
+    rv_seq_push(seq, unsigned_word ? RV_STEP_SLLI_UW : RV_STEP_SLLI, shift);
+    if (lo12) rv_seq_push(seq, RV_STEP_ADDI, lo12);
+}
+
+// Positive values with leading zeros may be shorter built shifted up to the
+// top and moved back down with srli, or with Zba built sign-extended from
+// the low word and zero-extended
+static void rv_li_seq(long value, bool zba, RVImmSeq* seq) {
+    seq->count = 0;
+    rv_imm_seq(value, zba, seq);
+    if (value <= 0 || seq->count <= 2) return;
+
+    int zeros = 0;
+    while (!((unsigned long)value << zeros >> 63)) zeros++;
+    unsigned long shifted = (unsigned long)value << zeros;
+    unsigned long fills[2] = {shifted | ((1ul << zeros) - 1), shifted};
+    for (int i = 0; i < 2; i++) {
+        RVImmSeq alt = {0};
+        rv_imm_seq((long)fills[i], zba, &alt);
+        rv_seq_push(&alt, RV_STEP_SRLI, zeros);
+        if (alt.count < seq->count) *seq = alt;
+    }
+    if (zba && zeros == 32) {
+        RVImmSeq alt = {0};
+        rv_imm_seq((long)((unsigned long)value | 0xFFFFFFFF00000000ul), zba, &alt);
+        rv_seq_push(&alt, RV_STEP_ZEXT_W, 0);
+        if (alt.count < seq->count) *seq = alt;
+    }
+}
+
+// With Zba a multiple of 3, 5 or 9 (before adding the low 12 bits) is a
+// 32-bit value times sh1add, sh2add or sh3add
+static void rv_li_shadd_seq(long value, RVImmSeq* seq) {
+    static const long factors[3] = {3, 5, 9};
+    long upper = (long)(((unsigned long)value + 0x800) & ~0xFFFul);
+    long lo12 = rv_sign_extend((unsigned long)value, 12);
+    long base = value;
+
+    int n = 0;
+    while (n < 3 && !(value % factors[n] == 0 && rv_simm(value / factors[n], 32))) n++;
+    if (n == 3) {
+        base = upper;
+        n = 0;
+        while (n < 3 && !(upper % factors[n] == 0 && rv_simm(upper / factors[n], 32))) n++;
+        if (n == 3) return;
+    }
+
+    RVImmSeq alt = {0};
+    rv_imm_seq(base / factors[n], true, &alt);
+    rv_seq_push(&alt, RV_STEP_SHADD, n + 1);
+    if (base != value) rv_seq_push(&alt, RV_STEP_ADDI, lo12);
+    if (alt.count < seq->count) *seq = alt;
+}
+
+static void rv_li(CodeBuffer* out, int rd, long value) {
+    RVImmSeq seq;
+    int src = RV_ZERO;
+    bool zba = (out->features & TARGET_FEATURE_ZBA) != 0;
+
+    rv_li_seq(value, zba, &seq);
+    if (zba && seq.count > 2) rv_li_shadd_seq(value, &seq);
+    for (int i = 0; i < seq.count; i++) {
+        switch (seq.steps[i]) {
+            case RV_STEP_LUI: rv_lui(out, rd, seq.imms[i]); break;
+            case RV_STEP_ADDI: rv_addi(out, rd, src, seq.imms[i]); break;
+            case RV_STEP_ADDIW: rv_addiw(out, rd, src, seq.imms[i]); break;
+            case RV_STEP_SLLI: rv_shift_imm(out, 1, false, rd, src, (int)seq.imms[i]); break;
+            case RV_STEP_SRLI: rv_shift_imm(out, 5, false, rd, src, (int)seq.imms[i]); break;
+            case RV_STEP_SLLI_UW:
+                rv_insn(out, rv_i_type(0x080 | seq.imms[i], src, 1, rd, RV_OP_IMM_32));
+                break;
+            case RV_STEP_ZEXT_W:
+                rv_insn(out, rv_r_type(0x04, RV_ZERO, src, 0, rd, RV_OP_32));
+                break;
+            case RV_STEP_SHADD:
+                rv_insn(out, rv_r_type(0x10, src, src, (uint32_t)seq.imms[i] * 2, rd, RV_OP));
+                break;
+        }
+        src = rd;
+    }
+}
+
+// Same choice as riscv64_adjust_sp
+static void rv_adjust_sp(CodeBuffer* out, int delta) {
+    if (rv_simm(delta, 12)) {
+        rv_addi(out, RV_SP, RV_SP, delta);
+    } else {
+        rv_li(out, RV_T0, delta);
+        rv_add(out, RV_SP, RV_SP, RV_T0);
+    }
+}
+
+// funct3 of the load and store for each access width
+static uint32_t rv_load_funct3(MemoryWidth width) {
+    switch (width) {
+        case MEM_S32: return 2;  // lw
+        case MEM_U32: return 6;  // lwu
+        case MEM_S8: return 0;   // lb
+        case MEM_U8: return 4;   // lbu
+        default: return 3;       // ld
+    }
+}
+
+static uint32_t rv_store_funct3(MemoryWidth width) {
+    switch (width) {
+        case MEM_S32:
+        case MEM_U32: return 2;
+        case MEM_S8:
+        case MEM_U8: return 0;
+        default: return 3;
+    }
+}
+
+// c.ld/c.sd and c.lw/c.sw take x8..x15 and a scaled 5-bit offset;
+// c.ldsp/c.sdsp and c.lwsp/c.swsp any register and a scaled 6-bit offset
+// from sp. Only the 32-bit sign-extending lw and the 64-bit accesses have
+// such forms.
+static bool rv_compress_access(CodeBuffer* out, bool load, uint32_t funct3, int reg, int base,
+                               int offset) {
+    int bytes = funct3 == 3 ? 8 : 4;
+    uint32_t opcode = (load ? 0x4000u : 0xC000u) | (funct3 == 3 ? 0x2000u : 0);
+
+    if (!rv_compress(out) || funct3 < 2 || funct3 > 3 || offset < 0 || offset % bytes != 0) {
+        return false;
+    }
+    if (base == RV_SP && offset < bytes * 64 && (!load || reg != RV_ZERO)) {
+        uint32_t field;
+        if (load && bytes == 8) {
+            field = rv_bits(offset, 5, 5, 12) | rv_bits(offset, 4, 3, 5) | rv_bits(offset, 8, 6, 2) |
+                    (uint32_t)reg << 7;
+        } else if (load) {
+            field = rv_bits(offset, 5, 5, 12) | rv_bits(offset, 4, 2, 4) | rv_bits(offset, 7, 6, 2) |
+                    (uint32_t)reg << 7;
+        } else if (bytes == 8) {
+            field = rv_bits(offset, 5, 3, 10) | rv_bits(offset, 8, 6, 7) | (uint32_t)reg << 2;
+        } else {
+            field = rv_bits(offset, 5, 2, 9) | rv_bits(offset, 7, 6, 7) | (uint32_t)reg << 2;
+        }
+        rv_insn16(out, opcode | field | 0x2);
+        return true;
+    }
+    if (rv_prime(base) && rv_prime(reg) && offset < bytes * 32) {
+        uint32_t field = rv_bits(offset, 5, 3, 10) | (uint32_t)(base - 8) << 7 | (uint32_t)(reg - 8) << 2;
+        if (bytes == 8) field |= rv_bits(offset, 7, 6, 5);
+        else field |= rv_bits(offset, 2, 2, 6) | rv_bits(offset, 6, 6, 5);
+        rv_insn16(out, opcode | field);
+        return true;
+    }
+    return false;
+}
+
+static void rv_load(CodeBuffer* out, uint32_t funct3, int rd, int base, int offset) {
+    if (rv_compress_access(out, true, funct3, rd, base, offset)) return;
+    rv_insn(out, rv_i_type(offset, base, funct3, rd, RV_LOAD));
+}
+
+static void rv_store(CodeBuffer* out, uint32_t funct3, int src, int base, int offset) {
+    if (rv_compress_access(out, false, funct3, src, base, offset)) return;
+    rv_insn(out, rv_bits(offset, 11, 5, 25) | (uint32_t)src << 20 | (uint32_t)base << 15 |
+                 funct3 << 12 | rv_bits(offset, 4, 0, 7) | RV_STORE);
+}
+
+static void rv_ret(CodeBuffer* out) {
+    if (rv_compress(out)) rv_insn16(out, 0x8002 | RV_RA << 7);  // c.jr ra
+    else rv_insn(out, rv_i_type(0, RV_RA, 0, RV_ZERO, RV_JALR));
+}
+
+static void rv_enc_prologue(CodeBuffer* out, int stack_size) {
+    rv_addi(out, RV_SP, RV_SP, -16);
+    rv_store(out, 3, RV_RA, RV_SP, 8);
+    rv_store(out, 3, 8, RV_SP, 0);
+    rv_addi(out, 8, RV_SP, 16);
+    if (stack_size > 0) rv_adjust_sp(out, -((stack_size + 15) & ~15));
+}
+
+static void rv_enc_epilogue(CodeBuffer* out, int stack_size) {
+    if (stack_size > 0) rv_adjust_sp(out, (stack_size + 15) & ~15);
+    rv_load(out, 3, 8, RV_SP, 0);
+    rv_load(out, 3, RV_RA, RV_SP, 8);
+    rv_addi(out, RV_SP, RV_SP, 16);
+    rv_ret(out);
+}
+
+static void rv_enc_leaf_prologue(CodeBuffer* out, int stack_size) {
+    if (stack_size > 0) rv_adjust_sp(out, -((stack_size + 15) & ~15));
+}
+
+static void rv_enc_leaf_epilogue(CodeBuffer* out, int stack_size) {
+    if (stack_size > 0) rv_adjust_sp(out, (stack_size + 15) & ~15);
+    rv_ret(out);
+}
+
+static void rv_enc_mov(CodeBuffer* out, int dest, int src) {
+    rv_addi(out, dest, src, 0);
+}
+
+static void rv_enc_mov_imm(CodeBuffer* out, int dest, long imm) {
+    rv_li(out, dest, imm);
+}
+
+static void rv_enc_add(CodeBuffer* out, int dest, int src1, int src2) {
+    rv_add(out, dest, src1, src2);
+}
+
+static void rv_enc_sub(CodeBuffer* out, int dest, int src1, int src2) {
+    rv_op(out, 0x20, 0, dest, src1, src2);
+}
+
+static void rv_enc_mul(CodeBuffer* out, int dest, int src1, int src2) {
+    rv_op(out, 1, 0, dest, src1, src2);
+}
+
+static void rv_enc_div(CodeBuffer* out, int dest, int src1, int src2) {
+    rv_op(out, 1, 4, dest, src1, src2);
+}
+
+static void rv_enc_add_imm(CodeBuffer* out, int dest, int src, long imm) {
+    rv_addi(out, dest, src, imm);
+}
+
+// Offsets beyond 12 bits go through t0, as in riscv64_generate_load_sized
+static void rv_enc_load(CodeBuffer* out, MemoryWidth width, int dest, int base, int offset) {
+    if (!rv_simm(offset, 12)) {
+        rv_li(out, RV_T0, offset);
+        rv_add(out, RV_T0, RV_T0, base);
+        base = RV_T0;
+        offset = 0;
+    }
+    rv_load(out, rv_load_funct3(width), dest, base, offset);
+}
+
+static void rv_enc_store(CodeBuffer* out, MemoryWidth width, int src, int base, int offset) {
+    if (!rv_simm(offset, 12)) {
+        rv_li(out, RV_T0, offset);
+        rv_add(out, RV_T0, RV_T0, base);
+        base = RV_T0;
+        offset = 0;
+    }
+    rv_store(out, rv_store_funct3(width), src, base, offset);
+}
+
+// Same sequence as riscv64_emit_load_indexed, shNadd when Zba is enabled
+static void rv_enc_load_indexed(CodeBuffer* out, MemoryWidth width, int dest, int base, int index,
+                                int shift, int offset) {
+    if (shift == 0) {
+        rv_add(out, RV_T0, base, index);
+    } else if (out->features & TARGET_FEATURE_ZBA) {
+        rv_insn(out, rv_r_type(0x10, base, index, (uint32_t)shift * 2, RV_T0, RV_OP));
+    } else {
+        rv_shift_imm(out, 1, false, RV_T0, index, shift);
+        rv_add(out, RV_T0, RV_T0, base);
+    }
+    if (!rv_simm(offset, 12)) {
+        rv_li(out, dest, offset);
+        rv_add(out, RV_T0, RV_T0, dest);
+        offset = 0;
+    }
+    rv_load(out, rv_load_funct3(width), dest, RV_T0, offset);
+}
+
+static void rv_enc_setcc(CodeBuffer* out, CompareCondition cond, int dest, int op1, int op2) {
+    switch (cond) {
+        case COND_EQ:
+            rv_enc_sub(out, dest, op1, op2);
+            rv_insn(out, rv_i_type(1, dest, 3, dest, RV_OP_IMM));  // seqz: sltiu 1
+            break;
+        case COND_NE:
+            rv_enc_sub(out, dest, op1, op2);
+            rv_op(out, 0, 3, dest, RV_ZERO, dest);                 // snez: sltu zero
+            break;
+        case COND_LT:
+            rv_op(out, 0, 2, dest, op1, op2);
+            break;
+        case COND_GT:
+            rv_op(out, 0, 2, dest, op2, op1);
+            break;
+        case COND_LE:
+            rv_op(out, 0, 2, dest, op2, op1);
+            rv_xori(out, dest, dest, 1);
+            break;
+        case COND_GE:
+            rv_op(out, 0, 2, dest, op1, op2);
+            rv_xori(out, dest, dest, 1);
+            break;
+    }
+}
+
+// Same mask blend as riscv64_generate_select
+static void rv_enc_select(CodeBuffer* out, CompareCondition cond, int dest, int op1, int op2,
+                          int if_true, int if_false) {
+    rv_enc_setcc(out, cond, RV_T5, op1, op2 < 0 ? RV_ZERO : op2);
+    rv_enc_sub(out, RV_T5, RV_ZERO, RV_T5);
+    rv_op(out, 0, 4, RV_T6, if_true, if_false);
+    rv_op(out, 0, 7, RV_T6, RV_T6, RV_T5);
+    rv_op(out, 0, 4, dest, RV_T6, if_false);
+}
+
+// A conditional branch in the shortest form mcode_branch_form allows:
+// c.beqz/c.bnez (+-256 bytes), then the 32-bit branch (+-4KB), then the
+// inverted branch skipping a jal (+-1MB)
+static void rv_branch(CodeBuffer* out, uint32_t funct3, int rs1, int rs2, int label) {
+    int form = mcode_branch_form(out);
+    bool zero_test = rv_compress(out) && rs2 == RV_ZERO && rv_prime(rs1) && funct3 <= RV_BNE;
+
+    if (zero_test && form-- == 0) {
+        mcode_insn16_label(out, (uint16_t)(0xC001 | funct3 << 13 | (uint32_t)(rs1 - 8) << 7),
+                           MCODE_RV_CBRANCH, label);
+        out->compressed++;
+        return;
+    }
+    if (form == 0) {
+        mcode_insn_label(out, rv_r_type(0, rs2, rs1, funct3, 0, RV_BRANCH), MCODE_RV_BRANCH, label);
+        return;
+    }
+    if (zero_test) {
+        // c.beqz/c.bnez +6 over the jal
+        rv_insn16(out, 0xC001 | (funct3 ^ 1) << 13 | (uint32_t)(rs1 - 8) << 7 | 0x3 << 3);
+    } else {
+        // +8 over the jal: offset bits 4:1 sit in the rd field shifted up one
+        rv_insn(out, rv_r_type(0, rs2, rs1, funct3 ^ 1, 8, RV_BRANCH));
+    }
+    mcode_insn_label(out, RV_JAL, MCODE_RV_JAL, label);
+}
+
+static void rv_enc_branch(CodeBuffer* out, CompareCondition cond, int op1, int op2, int label) {
+    switch (cond) {
+        case COND_EQ: rv_branch(out, RV_BEQ, op1, op2, label); break;
+        case COND_NE: rv_branch(out, RV_BNE, op1, op2, label); break;
+        case COND_LT: rv_branch(out, RV_BLT, op1, op2, label); break;
+        case COND_LE: rv_branch(out, RV_BGE, op2, op1, label); break;
+        case COND_GT: rv_branch(out, RV_BLT, op2, op1, label); break;
+        case COND_GE: rv_branch(out, RV_BGE, op1, op2, label); break;
+    }
+}
+
+// beqz, bnez, bltz, blez, bgtz and bgez are branches against zero
+static void rv_enc_branch_zero(CodeBuffer* out, CompareCondition cond, int op, int label) {
+    rv_enc_branch(out, cond, op, RV_ZERO, label);
+}
+
+// j: c.j (+-2KB) until widened to jal (+-1MB)
+static void rv_enc_jmp(CodeBuffer* out, int label) {
+    if (rv_compress(out) && mcode_branch_form(out) == 0) {
+        mcode_insn16_label(out, 0xA001, MCODE_RV_CJUMP, label);
+        out->compressed++;
+    } else {
+        mcode_insn_label(out, RV_JAL, MCODE_RV_JAL, label);
+    }
+}
+
+// call: auipc ra plus jalr ra, patched together by the linker
+static void rv_enc_call(CodeBuffer* out, const char* function) {
+    mcode_insn_symbol(out, (uint32_t)RV_RA << 7 | RV_AUIPC, MCODE_RV_CALL, function);
+    rv_insn(out, rv_i_type(0, RV_RA, 0, RV_RA, RV_JALR));
+}
+
+// Calls the function, then the exit system call (93) with its result
+static void rv_enc_start(CodeBuffer* out, const char* function) {
+    rv_enc_call(out, function);
+    rv_li(out, RV_A7, 93);
+    rv_insn(out, 0x00000073);  // ecall
+}
+
+const MachineEncoder riscv64_encoder = {
+    .prologue = rv_enc_prologue,
+    .epilogue = rv_enc_epilogue,
+    .leaf_prologue = rv_enc_leaf_prologue,
+    .leaf_epilogue = rv_enc_leaf_epilogue,
+    .mov = rv_enc_mov,
+    .mov_imm = rv_enc_mov_imm,
+    .add = rv_enc_add,
+    .sub = rv_enc_sub,
+    .mul = rv_enc_mul,
+    .div = rv_enc_div,
+    .add_imm = rv_enc_add_imm,
+    .mul_imm = NULL,
+    .load = rv_enc_load,
+    .store = rv_enc_store,
+    .load_indexed = rv_enc_load_indexed,
+    .store_pair = NULL,
+    .load_pair = NULL,
+    .setcc = rv_enc_setcc,
+    .branch = rv_enc_branch,
+    .branch_zero = rv_enc_branch_zero,
+    .select = rv_enc_select,
+    .jmp = rv_enc_jmp,
+    .call = rv_enc_call,
+    .start = rv_enc_start,
+};
@@ -0,0 +1,504 @@
+// ALETHEIA Instruction Scheduling
+// Dependence graphs over basic blocks, critical-path list scheduling
+// between fixed points, and an issue model that decides which order to keep
+
+#include "sched.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define SCHED_MAX_UNITS 8
+
+// Dependence graph of one block: instruction i must wait `latency` cycles
+// after each of its predecessors starts. Frame slots are never address-taken,
+// so memory dependencies are tracked per slot like registers, and indexed
+// loads are free to pass slot stores.
+typedef struct {
+    int count;
+    int* head;          // First outgoing edge per instruction, -1 for none
+    int* next;
+    int* to;
+    int* latency;
+    int num_edges;
+    int capacity;
+} SchedGraph;
+
+// Pipe occupancy and issue slots while instructions are placed in cycles
+typedef struct {
+    const TargetTuning* tuning;
+    int cycle;
+    int issued;         // Instructions started in `cycle`
+    int busy[SCHED_NUM_CLASSES][SCHED_MAX_UNITS];
+} SchedMachine;
+
+SchedClass sched_class(const IRInstr* instr) {
+    switch (instr->op) {
+        case IR_MUL: return SCHED_MUL;
+        case IR_DIV: return SCHED_DIV;
+        case IR_LOAD:
+        case IR_LOAD_INDEXED: return SCHED_LOAD;
+        case IR_STORE: return SCHED_STORE;
+        case IR_VADD:
+        case IR_VSUB:
+        case IR_VREDUCE: return SCHED_VECTOR;
+        case IR_BRANCH:
+        case IR_JMP:
+        case IR_CALL:
+        case IR_RET: return SCHED_BRANCH;
+        default: return SCHED_ALU;
+    }
+}
+
+static int sched_latency(const TargetTuning* tuning, const IRInstr* instr) {
+    return tuning->costs[sched_class(instr)].latency;
+}
+
+// Register and slot ids an instruction reads and writes. Slot s is id
+// ir_num_live_ids + s. A reduction also destroys its source vector.
+static int sched_uses(IRFunction* fn, IRInstr* instr, int* ids) {
+    int count = ir_instr_use_ids(fn, instr, ids);
+    if (instr->op == IR_LOAD && instr->src1.kind == IR_OPND_SLOT) {
+        ids[count++] = ir_num_live_ids(fn) + (int)instr->src1.value;
+    }
+    return count;
+}
+
+static int sched_defs(IRFunction* fn, IRInstr* instr, int* ids) {
+    int count = ir_instr_def_ids(fn, instr, ids);
+    int id;
+    if (instr->op == IR_STORE && instr->dst.kind == IR_OPND_SLOT) {
+        ids[count++] = ir_num_live_ids(fn) + (int)instr->dst.value;
+    }
+    if (instr->op == IR_VREDUCE && (id = ir_live_id(fn, &instr->src1)) >= 0) {
+        ids[count++] = id;
+    }
+    return count;
+}
+
+static bool sched_add_edge(SchedGraph* graph, int from, int to, int latency) {
+    if (from < 0 || from == to) return true;
+    if (graph->num_edges == graph->capacity) {
+        int capacity = graph->capacity ? graph->capacity * 2 : 64;
+        int* next = realloc(graph->next, capacity * sizeof(int));
+        if (next) graph->next = next;
+        int* dest = realloc(graph->to, capacity * sizeof(int));
+        if (dest) graph->to = dest;
+        int* lat = realloc(graph->latency, capacity * sizeof(int));
+        if (lat) graph->latency = lat;
+        if (!next || !dest || !lat) return false;
+        graph->capacity = capacity;
+    }
+    int e = graph->num_edges++;
+    graph->to[e] = to;
+    graph->latency[e] = latency;
+    graph->next[e] = graph->head[from];
+    graph->head[from] = e;
+    return true;
+}
+
+static void sched_free_graph(SchedGraph* graph) {
+    free(graph->head);
+    free(graph->next);
+    free(graph->to);
+    free(graph->latency);
+}
+
+// Read-after-write edges carry the writer's latency; write-after-read and
+// write-after-write edges only keep the order
+static bool sched_build_graph(IRFunction* fn, const TargetTuning* tuning, IRInstr* instrs,
+                              int count, SchedGraph* graph) {
+    int num_ids = ir_num_live_ids(fn) + fn->num_slots;
+    int* last_def = malloc(num_ids * sizeof(int));
+    int* first_use = malloc(num_ids * sizeof(int));    // Readers since that write
+    int* use_next = malloc((count * IR_MAX_USES + 1) * sizeof(int));
+    int* use_instr = malloc((count * IR_MAX_USES + 1) * sizeof(int));
+    int* ids = malloc((IR_MAX_USES + fn->backend->num_registers) * sizeof(int));
+    int num_uses = 0;
+    bool ok = last_def && first_use && use_next && use_instr && ids;
+
+    memset(graph, 0, sizeof(SchedGraph));
+    graph->count = count;
+    graph->head = malloc(count * sizeof(int));
+    ok = ok && graph->head;
+    if (ok) {
+        for (int i = 0; i < num_ids; i++) last_def[i] = first_use[i] = -1;
+        for (int i = 0; i < count; i++) graph->head[i] = -1;
+    }
+
+    for (int j = 0; ok && j < count; j++) {
+        IRInstr* instr = &instrs[j];
+        int n = sched_uses(fn, instr, ids);
+        for (int k = 0; k < n && ok; k++) {
+            int from = last_def[ids[k]];
+            if (from >= 0) ok = sched_add_edge(graph, from, j, sched_latency(tuning, &instrs[from]));
+        }
+        for (int k = 0; k < n; k++) {
+            use_instr[num_uses] = j;
+            use_next[num_uses] = first_use[ids[k]];
+            first_use[ids[k]] = num_uses++;
+        }
+
+        n = sched_defs(fn, instr, ids);
+        for (int k = 0; k < n && ok; k++) {
+            ok = sched_add_edge(graph, last_def[ids[k]], j, 0);
+            for (int u = first_use[ids[k]]; u >= 0 && ok; u = use_next[u]) {
+                ok = sched_add_edge(graph, use_instr[u], j, 0);
+            }
+            last_def[ids[k]] = j;
+            first_use[ids[k]] = -1;
+        }
+    }
+
+    free(last_def);
+    free(first_use);
+    free(use_next);
+    free(use_instr);
+    free(ids);
+    if (!ok) sched_free_graph(graph);
+    return ok;
+}
+
+static void sched_machine_init(SchedMachine* machine, const TargetTuning* tuning) {
+    memset(machine, 0, sizeof(SchedMachine));
+    machine->tuning = tuning;
+}
+
+static int sched_units(const TargetTuning* tuning, SchedClass cls) {
+    int units = tuning->costs[cls].units;
+    if (units < 1) return 1;
+    return units > SCHED_MAX_UNITS ? SCHED_MAX_UNITS : units;
+}
+
+// A pipe of the class free in the current cycle, or -1
+static int sched_free_unit(SchedMachine* machine, SchedClass cls) {
+    for (int u = 0; u < sched_units(machine->tuning, cls); u++) {
+        if (machine->busy[cls][u] <= machine->cycle) return u;
+    }
+    return -1;
+}
+
+static bool sched_can_issue(SchedMachine* machine, SchedClass cls) {
+    int width = machine->tuning->issue_width > 0 ? machine->tuning->issue_width : 1;
+    return machine->issued < width && sched_free_unit(machine, cls) >= 0;
+}
+
+static void sched_issue(SchedMachine* machine, SchedClass cls) {
+    int interval = machine->tuning->costs[cls].interval;
+    machine->busy[cls][sched_free_unit(machine, cls)] =
+        machine->cycle + (interval > 0 ? interval : 1);
+    machine->issued++;
+}
+
+static void sched_next_cycle(SchedMachine* machine) {
+    machine->cycle++;
+    machine->issued = 0;
+}
+
+// Cycles an in-order core spends issuing instrs[order[0]], instrs[order[1]],
+// ... where `order` respects the graph (NULL for source order)
+static int sched_simulate(const TargetTuning* tuning, IRInstr* instrs, SchedGraph* graph,
+                          const int* order) {
+    int* ready = calloc(graph->count ? graph->count : 1, sizeof(int));
+    SchedMachine machine;
+    int cycles = 0;
+    if (!ready) return 0;
+
+    sched_machine_init(&machine, tuning);
+    for (int k = 0; k < graph->count; k++) {
+        int i = order ? order[k] : k;
+        SchedClass cls = sched_class(&instrs[i]);
+        while (machine.cycle < ready[i] || !sched_can_issue(&machine, cls)) {
+            sched_next_cycle(&machine);
+        }
+        sched_issue(&machine, cls);
+        for (int e = graph->head[i]; e >= 0; e = graph->next[e]) {
+            int at = machine.cycle + graph->latency[e];
+            if (at > ready[graph->to[e]]) ready[graph->to[e]] = at;
+        }
+        cycles = machine.cycle + 1;
+    }
+    free(ready);
+    return cycles;
+}
+
+int sched_estimate_cycles(IRFunction* fn, const TargetTuning* tuning, IRInstr* instrs, int count) {
+    SchedGraph graph;
+    if (!sched_build_graph(fn, tuning, instrs, count, &graph)) return 0;
+    int cycles = sched_simulate(tuning, instrs, &graph, NULL);
+    sched_free_graph(&graph);
+    return cycles;
+}
+
+// Instructions that stay where they are: calls, the terminator, and
+// anything naming a general register. Those are argument, parameter and
+// return moves, and the targets also use some of those registers implicitly
+// (x86-64 division and setcc), which no dependency edge describes.
+static bool sched_is_fixed(IRFunction* fn, IRInstr* instr) {
+    if (instr->op == IR_CALL || instr->op == IR_BRANCH || instr->op == IR_JMP ||
+        instr->op == IR_RET) {
+        return true;
+    }
+    IROperand* operands[] = {&instr->dst, &instr->src1, &instr->src2, &instr->if_true,
+                             &instr->if_false};
+    for (size_t k = 0; k < sizeof(operands) / sizeof(operands[0]); k++) {
+        if (operands[k]->kind == IR_OPND_PREG &&
+            fn->backend->registers[operands[k]->value]->class != REG_CLASS_VEC) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Longest latency-weighted path from each instruction to the end of the
+// block. Edges only point forward, so one backwards sweep settles it.
+static void sched_heights(const TargetTuning* tuning, IRInstr* instrs, SchedGraph* graph,
+                          int* height) {
+    for (int i = graph->count - 1; i >= 0; i--) {
+        height[i] = sched_latency(tuning, &instrs[i]);
+        for (int e = graph->head[i]; e >= 0; e = graph->next[e]) {
+            int h = graph->latency[e] + height[graph->to[e]];
+            if (h > height[i]) height[i] = h;
+        }
+    }
+}
+
+// Working state of the list scheduler over one block
+typedef struct {
+    IRFunction* fn;
+    IRInstr* instrs;
+    SchedGraph* graph;
+    int* height;
+    int* preds;         // Unscheduled predecessors
+    int* ready;         // Earliest cycle the operands allow
+    bool* done;
+    int* remaining;     // Unscheduled reads per vreg defined in the block
+    bool* defined;      // Vreg live in or written by a scheduled instruction
+    bool* written;      // Vreg written anywhere in the block
+    int live;           // Such vregs with reads still to come
+    int* ids;
+} SchedState;
+
+// Change in live vregs if `i` were scheduled next
+static int sched_pressure_delta(SchedState* state, int i) {
+    IRFunction* fn = state->fn;
+    IRInstr* instr = &state->instrs[i];
+    int delta = 0;
+    int n = ir_instr_def_ids(fn, instr, state->ids);
+    for (int k = 0; k < n; k++) {
+        int id = state->ids[k];
+        if (id < fn->num_vregs && state->remaining[id] > 0 && !state->defined[id]) delta++;
+    }
+    n = ir_instr_use_ids(fn, instr, state->ids);
+    for (int k = 0; k < n; k++) {
+        int id = state->ids[k];
+        if (id >= fn->num_vregs || !state->defined[id]) continue;
+        int reads = 0;
+        bool first = true;
+        for (int m = 0; m < n; m++) {
+            if (state->ids[m] != id) continue;
+            if (m < k) first = false;
+            reads++;
+        }
+        if (first && reads == state->remaining[id]) delta--;
+    }
+    return delta;
+}
+
+static void sched_account(SchedState* state, int i) {
+    IRFunction* fn = state->fn;
+    IRInstr* instr = &state->instrs[i];
+    int n = ir_instr_use_ids(fn, instr, state->ids);
+    for (int k = 0; k < n; k++) {
+        int id = state->ids[k];
+        if (id >= fn->num_vregs || state->remaining[id] == 0) continue;
+        if (--state->remaining[id] == 0 && state->defined[id]) state->live--;
+    }
+    n = ir_instr_def_ids(fn, instr, state->ids);
+    for (int k = 0; k < n; k++) {
+        int id = state->ids[k];
+        if (id >= fn->num_vregs || state->defined[id]) continue;
+        state->defined[id] = true;
+        if (state->remaining[id] > 0) state->live++;
+    }
+}
+
+// The next instruction to start this cycle between `first` and `end`, or
+// -1 to wait a cycle. Past the pressure limit, an instruction that adds a
+// live value only starts when nothing that frees one is left to wait for;
+// otherwise the longest path to the end of the block wins.
+static int sched_pick(SchedState* state, SchedMachine* machine, int first, int end, int limit) {
+    int window = machine->tuning->window;
+    int best = -1;
+    int best_delta = 0;
+    bool tight = state->live >= limit;
+    bool relief = false;    // Something that does not add pressure is waiting
+
+    if (window > 0 && first + window < end) end = first + window;
+    for (int i = first; i < end; i++) {
+        if (state->done[i] || state->preds[i] > 0) continue;
+        int delta = tight ? sched_pressure_delta(state, i) : 0;
+        if (delta <= 0) relief = true;
+        if (state->ready[i] > machine->cycle) continue;
+        if (!sched_can_issue(machine, sched_class(&state->instrs[i]))) continue;
+        if (best < 0 || delta < best_delta ||
+            (delta == best_delta && state->height[i] > state->height[best])) {
+            best = i;
+            best_delta = delta;
+        }
+    }
+    if (best >= 0 && best_delta > 0 && relief) return -1;
+    return best;
+}
+
+// Schedules instrs[first..end) into `order`, which already holds the
+// instructions before `first`. Everything before `end` may have an edge
+// into the range, so only scheduled predecessors count as resolved.
+static void sched_range(SchedState* state, SchedMachine* machine, int* order, int first,
+                        int end, int limit) {
+    int placed = first;
+    while (placed < end) {
+        int lowest = first;
+        while (state->done[lowest]) lowest++;
+        int i = sched_pick(state, machine, lowest, end, limit);
+        if (i < 0) {
+            sched_next_cycle(machine);
+            continue;
+        }
+
+        sched_issue(machine, sched_class(&state->instrs[i]));
+        state->done[i] = true;
+        order[placed++] = i;
+        sched_account(state, i);
+        for (int e = state->graph->head[i]; e >= 0; e = state->graph->next[e]) {
+            int to = state->graph->to[e];
+            int at = machine->cycle + state->graph->latency[e];
+            state->preds[to]--;
+            if (at > state->ready[to]) state->ready[to] = at;
+        }
+    }
+}
+
+// Registers the allocator can hand out, less a few for values live through
+// the block that the pressure count does not see
+static int sched_pressure_limit(const TargetBackend* backend) {
+    int allocatable = 0;
+    for (int i = 0; i < backend->num_registers; i++) {
+        if (ir_register_allocatable(backend, i)) allocatable++;
+    }
+    return allocatable > 6 ? allocatable - 5 : 2;
+}
+
+// Returns the instructions moved; 0 when the block keeps its order
+static int sched_block(IRFunction* fn, const TargetTuning* tuning, IRBlock* block,
+                       SchedStats* stats) {
+    int n = block->num_instrs;
+    SchedGraph graph;
+    SchedState state = {0};
+    int moved = 0;
+
+    if (n < 3) {
+        if (stats && n > 0) {
+            int cycles = sched_estimate_cycles(fn, tuning, block->instrs, n);
+            stats->cycles_before += cycles;
+            stats->cycles_after += cycles;
+        }
+        return 0;
+    }
+    if (!sched_build_graph(fn, tuning, block->instrs, n, &graph)) return 0;
+
+    state.fn = fn;
+    state.instrs = block->instrs;
+    state.graph = &graph;
+    state.height = malloc(n * sizeof(int));
+    state.preds = calloc(n, sizeof(int));
+    state.ready = calloc(n, sizeof(int));
+    state.done = calloc(n, sizeof(bool));
+    state.remaining = calloc(fn->num_vregs + 1, sizeof(int));
+    state.defined = calloc(fn->num_vregs + 1, sizeof(bool));
+    state.written = calloc(fn->num_vregs + 1, sizeof(bool));
+    state.ids = malloc((IR_MAX_USES + fn->backend->num_registers) * sizeof(int));
+    int* order = malloc(n * sizeof(int));
+    IRInstr* scheduled = malloc(n * sizeof(IRInstr));
+
+    if (state.height && state.preds && state.ready && state.done && state.remaining &&
+        state.defined && state.written && state.ids && order && scheduled) {
+        sched_heights(tuning, block->instrs, &graph, state.height);
+        // Vregs the block reads without writing them first come in live
+        for (int i = 0; i < n; i++) {
+            for (int e = graph.head[i]; e >= 0; e = graph.next[e]) state.preds[graph.to[e]]++;
+            int count = ir_instr_use_ids(fn, &block->instrs[i], state.ids);
+            for (int k = 0; k < count; k++) {
+                int id = state.ids[k];
+                if (id >= fn->num_vregs) continue;
+                if (state.remaining[id]++ == 0 && !state.written[id]) {
+                    state.defined[id] = true;
+                    state.live++;
+                }
+            }
+            count = ir_instr_def_ids(fn, &block->instrs[i], state.ids);
+            for (int k = 0; k < count; k++) {
+                if (state.ids[k] < fn->num_vregs) state.written[state.ids[k]] = true;
+            }
+        }
+
+        // Fixed instructions split the block into ranges; each is placed
+        // after everything before it, with the machine state carried over
+        SchedMachine machine;
+        int limit = sched_pressure_limit(fn->backend);
+        int start = 0;
+        sched_machine_init(&machine, tuning);
+        for (int i = 0; i <= n; i++) {
+            if (i < n && !sched_is_fixed(fn, &block->instrs[i])) continue;
+            if (i > start) sched_range(&state, &machine, order, start, i, limit);
+            if (i < n) sched_range(&state, &machine, order, i, i + 1, limit);
+            start = i + 1;
+        }
+
+        int before = sched_simulate(tuning, block->instrs, &graph, NULL);
+        int after = sched_simulate(tuning, block->instrs, &graph, order);
+        for (int i = 0; i < n; i++) {
+            if (order[i] != i) moved++;
+        }
+        if (moved > 0 && after < before) {
+            for (int i = 0; i < n; i++) scheduled[i] = block->instrs[order[i]];
+            memcpy(block->instrs, scheduled, n * sizeof(IRInstr));
+        } else {
+            moved = 0;
+            after = before;
+        }
+        if (stats) {
+            stats->blocks += moved > 0;
+            stats->moved += moved;
+            stats->cycles_before += before;
+            stats->cycles_after += after;
+        }
+    }
+
+    free(state.height);
+    free(state.preds);
+    free(state.ready);
+    free(state.done);
+    free(state.remaining);
+    free(state.defined);
+    free(state.written);
+    free(state.ids);
+    free(order);
+    free(scheduled);
+    sched_free_graph(&graph);
+    return moved;
+}
+
+int sched_function(IRFunction* fn, const TargetTuning* tuning, SchedStats* stats) {
+    int moved = 0;
+    if (!tuning) return 0;
+    for (int b = 0; b < fn->num_blocks; b++) {
+        moved += sched_block(fn, tuning, fn->blocks[b], stats);
+    }
+    return moved;
+}
+
+void sched_report(SchedStats* stats, FILE* out) {
+    fprintf(out, ";; sched %-12s %d\n", "blocks", stats->blocks);
+    fprintf(out, ";; sched %-12s %d\n", "moved", stats->moved);
+    fprintf(out, ";; sched %-12s %d -> %d\n", "cycles", stats->cycles_before,
+            stats->cycles_after);
+}
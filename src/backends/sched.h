@@ -0,0 +1,33 @@
+// ALETHEIA Instruction Scheduling
+// List scheduling of IR basic blocks against a per-core cost model
+// (TargetTuning). Runs before register allocation, so reordering is limited
+// only by true dependencies and by the register pressure it adds.
+
+#ifndef ALETHEIA_SCHED_H
+#define ALETHEIA_SCHED_H
+
+#include "ir.h"
+
+typedef struct {
+    int blocks;         // Blocks whose order changed
+    int moved;          // Instructions no longer at their source position
+    int cycles_before;  // Modelled issue cycles over all blocks, source order
+    int cycles_after;   // The same for the order kept
+} SchedStats;
+
+SchedClass sched_class(const IRInstr* instr);
+
+// Estimated cycles to issue `count` instructions of one block in the given
+// order on an in-order core with `tuning`'s costs
+int sched_estimate_cycles(IRFunction* fn, const TargetTuning* tuning, IRInstr* instrs, int count);
+
+// Reorders each block between its fixed points (calls, instructions naming
+// general registers, the terminator) so that long-latency results are
+// started early and independent chains interleave. A block keeps its source
+// order unless the model says the new one issues in fewer cycles. Counts
+// accumulate into `stats` (may be NULL); returns the instructions moved.
+int sched_function(IRFunction* fn, const TargetTuning* tuning, SchedStats* stats);
+
+void sched_report(SchedStats* stats, FILE* out);
+
+#endif // ALETHEIA_SCHED_H
@@ -0,0 +1,577 @@
+// ALETHEIA x86-64 Machine Code Encoder
+// Encodes the instruction sequences the x86-64 text callbacks in backend.c
+// print, straight into a CodeBuffer. Registers are hardware numbers.
+
+#include "backend.h"
+
+#define X86_RAX 0
+#define X86_RBX 3
+#define X86_RSP 4
+#define X86_RBP 5
+#define X86_RDI 7
+
+// Condition nibble of jcc/setcc/cmovcc; the inverse flips the low bit
+static uint8_t x86_cc(CompareCondition cond) {
+    switch (cond) {
+        case COND_EQ: return 0x4;
+        case COND_NE: return 0x5;
+        case COND_LT: return 0xC;
+        case COND_GE: return 0xD;
+        case COND_LE: return 0xE;
+        case COND_GT: return 0xF;
+    }
+    return 0x4;
+}
+
+static bool x86_fits_int8(long value) {
+    return value >= -128 && value <= 127;
+}
+
+// REX prefix, omitted when it would carry no bits. `force` keeps it for the
+// byte registers spl/bpl/sil/dil, which need a REX to be addressable.
+static void x86_rex(CodeBuffer* out, bool wide, int reg, int index, int base, bool force) {
+    uint8_t rex = 0x40;
+    if (wide) rex |= 0x08;
+    if (reg & 8) rex |= 0x04;
+    if (index >= 0 && (index & 8)) rex |= 0x02;
+    if (base & 8) rex |= 0x01;
+    if (rex != 0x40 || force) mcode_byte(out, rex);
+}
+
+static void x86_opcode(CodeBuffer* out, uint8_t op0, uint8_t op1) {
+    mcode_byte(out, op0);
+    if (op0 == 0x0F) mcode_byte(out, op1);
+}
+
+// op reg, rm with both operands registers. A leading 0x0F makes the opcode
+// two bytes long.
+static void x86_rr(CodeBuffer* out, bool wide, uint8_t op0, uint8_t op1, int reg, int rm) {
+    x86_rex(out, wide, reg, -1, rm, false);
+    x86_opcode(out, op0, op1);
+    mcode_byte(out, (uint8_t)(0xC0 | (reg & 7) << 3 | (rm & 7)));
+}
+
+// ModRM, SIB and displacement of [base + (index << shift) + disp]; index
+// is -1 for none. rsp and r12 bases need a SIB byte, rbp and r13 bases an
+// explicit displacement. EVEX scales 8-bit displacements by the operand
+// size `n`, 1 everywhere else.
+static void x86_mem(CodeBuffer* out, int reg, int base, int index, int shift, int disp, int n) {
+    int mod = 2;
+    if (disp == 0 && (base & 7) != X86_RBP) mod = 0;
+    else if (disp % n == 0 && x86_fits_int8(disp / n)) mod = 1;
+
+    if (index < 0 && (base & 7) != X86_RSP) {
+        mcode_byte(out, (uint8_t)(mod << 6 | (reg & 7) << 3 | (base & 7)));
+    } else {
+        int sib_index = index < 0 ? X86_RSP : index;  // rsp in the index field means none
+        mcode_byte(out, (uint8_t)(mod << 6 | (reg & 7) << 3 | 4));
+        mcode_byte(out, (uint8_t)(shift << 6 | (sib_index & 7) << 3 | (base & 7)));
+    }
+    if (mod == 1) mcode_byte(out, (uint8_t)(disp / n));
+    else if (mod == 2) mcode_u32(out, (uint32_t)disp);
+}
+
+// op reg, [base + (index << shift) + disp]
+static void x86_rm(CodeBuffer* out, bool wide, uint8_t op0, uint8_t op1, int reg, int base,
+                   int index, int shift, int disp, bool force_rex) {
+    x86_rex(out, wide, reg, index, base, force_rex);
+    x86_opcode(out, op0, op1);
+    x86_mem(out, reg, base, index, shift, disp, 1);
+}
+
+// add/sub rsp, imm with the sign-extended imm8 form when it fits
+static void x86_adjust_rsp(CodeBuffer* out, uint8_t digit, int amount) {
+    x86_rex(out, true, 0, -1, X86_RSP, false);
+    if (x86_fits_int8(amount)) {
+        mcode_byte(out, 0x83);
+        mcode_byte(out, (uint8_t)(0xC0 | digit << 3 | X86_RSP));
+        mcode_byte(out, (uint8_t)amount);
+    } else {
+        mcode_byte(out, 0x81);
+        mcode_byte(out, (uint8_t)(0xC0 | digit << 3 | X86_RSP));
+        mcode_u32(out, (uint32_t)amount);
+    }
+}
+
+static void x86_push(CodeBuffer* out, int reg) {
+    x86_rex(out, false, 0, -1, reg, false);
+    mcode_byte(out, (uint8_t)(0x50 + (reg & 7)));
+}
+
+static void x86_pop(CodeBuffer* out, int reg) {
+    x86_rex(out, false, 0, -1, reg, false);
+    mcode_byte(out, (uint8_t)(0x58 + (reg & 7)));
+}
+
+static void x86_mov_rr(CodeBuffer* out, int dest, int src) {
+    x86_rr(out, true, 0x89, 0, src, dest);
+}
+
+static void x86_cmp_rr(CodeBuffer* out, int op1, int op2) {
+    x86_rr(out, true, 0x39, 0, op2, op1);
+}
+
+static void x86_test_rr(CodeBuffer* out, int op) {
+    x86_rr(out, true, 0x85, 0, op, op);
+}
+
+static void x86_jcc(CodeBuffer* out, uint8_t cc, int label) {
+    mcode_byte(out, 0x0F);
+    mcode_byte(out, (uint8_t)(0x80 | cc));
+    mcode_rel32_label(out, label);
+}
+
+static void x86_cmovcc(CodeBuffer* out, uint8_t cc, int dest, int src) {
+    x86_rr(out, true, 0x0F, (uint8_t)(0x40 | cc), dest, src);
+}
+
+static void x86_enc_prologue(CodeBuffer* out, int stack_size) {
+    x86_push(out, X86_RBP);
+    x86_mov_rr(out, X86_RBP, X86_RSP);
+    if (stack_size > 0) x86_adjust_rsp(out, 5, stack_size);
+}
+
+static void x86_enc_epilogue(CodeBuffer* out, int stack_size) {
+    if (stack_size > 0) x86_adjust_rsp(out, 0, stack_size);
+    x86_pop(out, X86_RBP);
+    mcode_byte(out, 0xC3);
+}
+
+static void x86_enc_leaf_prologue(CodeBuffer* out, int stack_size) {
+    if (stack_size > 0) x86_adjust_rsp(out, 5, stack_size);
+}
+
+static void x86_enc_leaf_epilogue(CodeBuffer* out, int stack_size) {
+    if (stack_size > 0) x86_adjust_rsp(out, 0, stack_size);
+    mcode_byte(out, 0xC3);
+}
+
+static void x86_enc_mov(CodeBuffer* out, int dest, int src) {
+    x86_mov_rr(out, dest, src);
+}
+
+// Shortest of mov r32, imm32 (zero-extends), mov r/m64, simm32 and the
+// full 64-bit immediate. None of them touch the flags.
+static void x86_enc_mov_imm(CodeBuffer* out, int dest, long imm) {
+    if (imm >= 0 && imm <= 0xFFFFFFFFL) {
+        x86_rex(out, false, 0, -1, dest, false);
+        mcode_byte(out, (uint8_t)(0xB8 + (dest & 7)));
+        mcode_u32(out, (uint32_t)imm);
+    } else if (imm < 0 && imm >= -2147483647L - 1) {
+        x86_rr(out, true, 0xC7, 0, 0, dest);
+        mcode_u32(out, (uint32_t)imm);
+    } else {
+        x86_rex(out, true, 0, -1, dest, false);
+        mcode_byte(out, (uint8_t)(0xB8 + (dest & 7)));
+        mcode_u64(out, (uint64_t)imm);
+    }
+}
+
+static void x86_enc_add(CodeBuffer* out, int dest, int src1, int src2) {
+    if (dest == src2) {
+        x86_rr(out, true, 0x01, 0, src1, dest);
+        return;
+    }
+    if (dest != src1) x86_mov_rr(out, dest, src1);
+    x86_rr(out, true, 0x01, 0, src2, dest);
+}
+
+static void x86_enc_sub(CodeBuffer* out, int dest, int src1, int src2) {
+    if (dest == src2 && dest != src1) {
+        x86_rr(out, true, 0xF7, 0, 3, dest);  // neg
+        x86_rr(out, true, 0x01, 0, src1, dest);
+        return;
+    }
+    if (dest != src1) x86_mov_rr(out, dest, src1);
+    x86_rr(out, true, 0x29, 0, src2, dest);
+}
+
+static void x86_enc_mul(CodeBuffer* out, int dest, int src1, int src2) {
+    if (dest == src2) {
+        x86_rr(out, true, 0x0F, 0xAF, dest, src1);
+        return;
+    }
+    if (dest != src1) x86_mov_rr(out, dest, src1);
+    x86_rr(out, true, 0x0F, 0xAF, dest, src2);
+}
+
+// Sign-extended imm8 or imm32 operand of the group-1 and imul forms
+static void x86_imm(CodeBuffer* out, long imm) {
+    if (x86_fits_int8(imm)) mcode_byte(out, (uint8_t)imm);
+    else mcode_u32(out, (uint32_t)imm);
+}
+
+static void x86_enc_add_imm(CodeBuffer* out, int dest, int src, long imm) {
+    if (dest != src) {
+        x86_rm(out, true, 0x8D, 0, dest, src, -1, 0, (int)imm, false);  // lea
+        return;
+    }
+    if (dest == X86_RAX && !x86_fits_int8(imm)) {
+        mcode_byte(out, 0x48);
+        mcode_byte(out, 0x05);  // add rax, imm32
+        mcode_u32(out, (uint32_t)imm);
+        return;
+    }
+    x86_rr(out, true, x86_fits_int8(imm) ? 0x83 : 0x81, 0, 0, dest);
+    x86_imm(out, imm);
+}
+
+static void x86_enc_mul_imm(CodeBuffer* out, int dest, int src, long imm) {
+    x86_rr(out, true, x86_fits_int8(imm) ? 0x6B : 0x69, 0, dest, src);
+    x86_imm(out, imm);
+}
+
+static void x86_enc_div(CodeBuffer* out, int dest, int src1, int src2) {
+    if (src1 != X86_RAX) x86_mov_rr(out, X86_RAX, src1);
+    mcode_byte(out, 0x48);  // cqo
+    mcode_byte(out, 0x99);
+    x86_rr(out, true, 0xF7, 0, 7, src2);  // idiv
+    if (dest != X86_RAX) x86_mov_rr(out, dest, X86_RAX);
+}
+
+// Same forms as x86_64_generate_load_sized: movsxd, a 32-bit mov that
+// zero-extends, movsx and a 32-bit movzx
+static void x86_load(CodeBuffer* out, MemoryWidth width, int dest, int base, int index,
+                     int shift, int offset) {
+    switch (width) {
+        case MEM_S32:
+            x86_rm(out, true, 0x63, 0, dest, base, index, shift, offset, false);
+            break;
+        case MEM_U32:
+            x86_rm(out, false, 0x8B, 0, dest, base, index, shift, offset, false);
+            break;
+        case MEM_S8:
+            x86_rm(out, true, 0x0F, 0xBE, dest, base, index, shift, offset, false);
+            break;
+        case MEM_U8:
+            x86_rm(out, false, 0x0F, 0xB6, dest, base, index, shift, offset, false);
+            break;
+        default:
+            x86_rm(out, true, 0x8B, 0, dest, base, index, shift, offset, false);
+            break;
+    }
+}
+
+static void x86_enc_load(CodeBuffer* out, MemoryWidth width, int dest, int base, int offset) {
+    x86_load(out, width, dest, base, -1, 0, offset);
+}
+
+static void x86_enc_load_indexed(CodeBuffer* out, MemoryWidth width, int dest, int base,
+                                 int index, int shift, int offset) {
+    x86_load(out, width, dest, base, index, shift, offset);
+}
+
+static void x86_enc_store(CodeBuffer* out, MemoryWidth width, int src, int base, int offset) {
+    switch (width) {
+        case MEM_S32:
+        case MEM_U32:
+            x86_rm(out, false, 0x89, 0, src, base, -1, 0, offset, false);
+            break;
+        case MEM_S8:
+        case MEM_U8:
+            x86_rm(out, false, 0x88, 0, src, base, -1, 0, offset, src >= 4 && src < 8);
+            break;
+        default:
+            x86_rm(out, true, 0x89, 0, src, base, -1, 0, offset, false);
+            break;
+    }
+}
+
+static void x86_enc_setcc(CodeBuffer* out, CompareCondition cond, int dest, int op1, int op2) {
+    x86_cmp_rr(out, op1, op2);
+    mcode_byte(out, 0x0F);
+    mcode_byte(out, (uint8_t)(0x90 | x86_cc(cond)));
+    mcode_byte(out, 0xC0);  // al
+    x86_rr(out, false, 0x0F, 0xB6, dest, X86_RAX);  // movzx dest32, al
+}
+
+static void x86_enc_branch(CodeBuffer* out, CompareCondition cond, int op1, int op2, int label) {
+    x86_cmp_rr(out, op1, op2);
+    x86_jcc(out, x86_cc(cond), label);
+}
+
+static void x86_enc_branch_zero(CodeBuffer* out, CompareCondition cond, int op, int label) {
+    x86_test_rr(out, op);
+    x86_jcc(out, x86_cc(cond), label);
+}
+
+static void x86_enc_select(CodeBuffer* out, CompareCondition cond, int dest, int op1, int op2,
+                           int if_true, int if_false) {
+    if (op2 >= 0) {
+        x86_cmp_rr(out, op1, op2);
+    } else {
+        x86_test_rr(out, op1);
+    }
+    if (dest == if_true) {
+        if (dest != if_false) x86_cmovcc(out, x86_cc(cond) ^ 1, dest, if_false);
+        return;
+    }
+    if (dest != if_false) x86_mov_rr(out, dest, if_false);
+    x86_cmovcc(out, x86_cc(cond), dest, if_true);
+}
+
+static void x86_enc_jmp(CodeBuffer* out, int label) {
+    mcode_byte(out, 0xE9);
+    mcode_rel32_label(out, label);
+}
+
+static void x86_enc_call(CodeBuffer* out, const char* function) {
+    mcode_byte(out, 0xE8);
+    mcode_rel32_symbol(out, function);
+}
+
+// VEX prefix with the 66 prefix implied, as every vector form below uses.
+// `map` is 1 for the 0F opcode map and 3 for 0F3A; the two-byte form
+// covers 0F without W, X or B. vvvv is the extra source, 0 for none.
+static void x86_vex(CodeBuffer* out, int map, bool wide, bool l256, int reg, int vvvv, int index,
+                    int rm) {
+    bool x = index >= 0 && (index & 8);
+    uint8_t tail = (uint8_t)((~vvvv & 15) << 3 | (l256 ? 4 : 0) | 1);
+
+    if (map == 1 && !wide && !x && !(rm & 8)) {
+        mcode_byte(out, 0xC5);
+        mcode_byte(out, (uint8_t)((reg & 8 ? 0 : 0x80) | tail));
+        return;
+    }
+    mcode_byte(out, 0xC4);
+    mcode_byte(out, (uint8_t)((reg & 8 ? 0 : 0x80) | (x ? 0 : 0x40) | (rm & 8 ? 0 : 0x20) | map));
+    mcode_byte(out, (uint8_t)((wide ? 0x80 : 0) | tail));
+}
+
+// 512-bit EVEX prefix with the 66 prefix implied, no masking and only the
+// first 16 registers
+static void x86_evex(CodeBuffer* out, int map, bool wide, int reg, int vvvv, int index, int rm) {
+    bool x = index >= 0 && (index & 8);
+
+    mcode_byte(out, 0x62);
+    mcode_byte(out, (uint8_t)((reg & 8 ? 0 : 0x80) | (x ? 0 : 0x40) | (rm & 8 ? 0 : 0x20) |
+                              0x10 | map));
+    mcode_byte(out, (uint8_t)((wide ? 0x80 : 0) | (~vvvv & 15) << 3 | 4 | 1));
+    mcode_byte(out, 0x48);  // L'L = 512 bits, V' clear
+}
+
+static void x86_modrm_rr(CodeBuffer* out, int reg, int rm) {
+    mcode_byte(out, (uint8_t)(0xC0 | (reg & 7) << 3 | (rm & 7)));
+}
+
+// Same forms as x86_64_generate_vzero and friends; xmm15 is the scratch
+#define X86_VSCRATCH 15
+
+static void x86_enc_vzero(CodeBuffer* out, int bits, int dest) {
+    if (bits == 128) {
+        mcode_byte(out, 0x66);
+        x86_rr(out, false, 0x0F, 0xEF, dest, dest);  // pxor
+        return;
+    }
+    x86_vex(out, 1, false, false, dest, dest, -1, dest);  // vpxor xmm
+    mcode_byte(out, 0xEF);
+    x86_modrm_rr(out, dest, dest);
+}
+
+static void x86_enc_vadd_indexed(CodeBuffer* out, int bits, bool subtract, int dest, int base,
+                                 int index, int shift, int offset) {
+    uint8_t op = subtract ? 0xFB : 0xD4;  // psubq, paddq
+
+    if (bits == 128) {
+        mcode_byte(out, 0xF3);  // movdqu
+        x86_rm(out, false, 0x0F, 0x6F, X86_VSCRATCH, base, index, shift, offset, false);
+        mcode_byte(out, 0x66);
+        x86_rr(out, false, 0x0F, op, dest, X86_VSCRATCH);
+        return;
+    }
+    if (bits == 512) {
+        x86_evex(out, 1, true, dest, dest, index, base);
+        mcode_byte(out, op);
+        x86_mem(out, dest, base, index, shift, offset, 64);
+        return;
+    }
+    x86_vex(out, 1, false, true, dest, dest, index, base);
+    mcode_byte(out, op);
+    x86_mem(out, dest, base, index, shift, offset, 1);
+}
+
+static void x86_enc_vreduce(CodeBuffer* out, int bits, int dest, int src) {
+    if (bits == 128) {
+        mcode_byte(out, 0x66);
+        x86_rr(out, false, 0x0F, 0x70, X86_VSCRATCH, src);  // pshufd
+        mcode_byte(out, 78);
+        mcode_byte(out, 0x66);
+        x86_rr(out, false, 0x0F, 0xD4, src, X86_VSCRATCH);  // paddq
+        mcode_byte(out, 0x66);
+        x86_rr(out, true, 0x0F, 0x7E, src, dest);           // movq
+        return;
+    }
+    if (bits == 512) {
+        x86_evex(out, 3, true, src, 0, -1, X86_VSCRATCH);   // vextracti64x4
+        mcode_byte(out, 0x3B);
+        x86_modrm_rr(out, src, X86_VSCRATCH);
+        mcode_byte(out, 1);
+        x86_vex(out, 1, false, true, src, X86_VSCRATCH, -1, src);
+        mcode_byte(out, 0xD4);
+        x86_modrm_rr(out, src, src);
+    }
+    x86_vex(out, 3, false, true, src, 0, -1, X86_VSCRATCH);  // vextracti128
+    mcode_byte(out, 0x39);
+    x86_modrm_rr(out, src, X86_VSCRATCH);
+    mcode_byte(out, 1);
+    x86_vex(out, 1, false, false, src, X86_VSCRATCH, -1, src);
+    mcode_byte(out, 0xD4);
+    x86_modrm_rr(out, src, src);
+    x86_vex(out, 1, false, false, X86_VSCRATCH, 0, -1, src);  // vpshufd
+    mcode_byte(out, 0x70);
+    x86_modrm_rr(out, X86_VSCRATCH, src);
+    mcode_byte(out, 78);
+    x86_vex(out, 1, false, false, src, X86_VSCRATCH, -1, src);
+    mcode_byte(out, 0xD4);
+    x86_modrm_rr(out, src, src);
+    x86_vex(out, 1, true, false, src, 0, -1, dest);  // vmovq
+    mcode_byte(out, 0x7E);
+    x86_modrm_rr(out, src, dest);
+    mcode_byte(out, 0xC5);  // vzeroupper
+    mcode_byte(out, 0xF8);
+    mcode_byte(out, 0x77);
+}
+
+// 32-bit group-1 op reg, imm: imm8 when it fits, the eax short form, imm32
+static void x86_alu32_imm(CodeBuffer* out, uint8_t digit, int reg, uint32_t imm) {
+    if (x86_fits_int8((int32_t)imm)) {
+        x86_rr(out, false, 0x83, 0, digit, reg);
+        mcode_byte(out, (uint8_t)imm);
+    } else if (reg == X86_RAX) {
+        mcode_byte(out, (uint8_t)(digit << 3 | 5));
+        mcode_u32(out, imm);
+    } else {
+        x86_rr(out, false, 0x81, 0, digit, reg);
+        mcode_u32(out, imm);
+    }
+}
+
+static void x86_test32_imm(CodeBuffer* out, int reg, uint32_t imm) {
+    x86_rr(out, false, 0xF7, 0, 0, reg);
+    mcode_u32(out, imm);
+}
+
+static void x86_cpuid(CodeBuffer* out) {
+    mcode_byte(out, 0x0F);
+    mcode_byte(out, 0xA2);
+}
+
+// lea rax, [rip + symbol]
+static void x86_lea_symbol(CodeBuffer* out, const char* symbol) {
+    x86_rex(out, true, X86_RAX, -1, 0, false);
+    mcode_byte(out, 0x8D);
+    mcode_byte(out, 0x05);
+    mcode_rel32_symbol(out, symbol);
+}
+
+// Same sequence as x86_64_generate_resolver
+static void x86_enc_resolver(CodeBuffer* out, const char* name, const char* const* clones,
+                             const uint32_t* features, int count) {
+    int labels = mcode_new_labels(out, count + 1);
+    int pick = labels;
+    int avx512 = labels + count;
+    (void)name;
+
+    x86_push(out, X86_RBX);
+    x86_rr(out, false, 0x31, 0, 8, 8);                  // xor r8d, r8d
+    x86_rr(out, false, 0x31, 0, X86_RAX, X86_RAX);      // xor eax, eax
+    x86_cpuid(out);
+    x86_alu32_imm(out, 7, X86_RAX, 7);                  // cmp eax, 7
+    x86_jcc(out, x86_cc(COND_LT), pick);
+    x86_enc_mov_imm(out, X86_RAX, 1);
+    x86_cpuid(out);
+    x86_alu32_imm(out, 4, 1, 0x18000000);               // and ecx, OSXSAVE | AVX
+    x86_alu32_imm(out, 7, 1, 0x18000000);
+    x86_jcc(out, x86_cc(COND_NE), pick);
+    x86_rr(out, false, 0x31, 0, 1, 1);                  // xor ecx, ecx
+    mcode_byte(out, 0x0F);                              // xgetbv
+    mcode_byte(out, 0x01);
+    mcode_byte(out, 0xD0);
+    x86_rr(out, false, 0x89, 0, X86_RAX, 9);            // mov r9d, eax
+    x86_enc_mov_imm(out, X86_RAX, 7);
+    x86_rr(out, false, 0x31, 0, 1, 1);
+    x86_cpuid(out);
+    x86_rr(out, false, 0x89, 0, 9, X86_RAX);            // mov eax, r9d
+    x86_alu32_imm(out, 4, X86_RAX, 6);                  // XMM | YMM state
+    x86_alu32_imm(out, 7, X86_RAX, 6);
+    x86_jcc(out, x86_cc(COND_NE), pick);
+    x86_test32_imm(out, X86_RBX, 1u << 5);              // AVX2
+    x86_jcc(out, x86_cc(COND_EQ), avx512);
+    x86_alu32_imm(out, 1, 8, TARGET_FEATURE_AVX2);      // or r8d
+    mcode_bind(out, avx512);
+    x86_alu32_imm(out, 4, 9, 0xE6);                     // and r9d, opmask | ZMM state
+    x86_alu32_imm(out, 7, 9, 0xE6);
+    x86_jcc(out, x86_cc(COND_NE), pick);
+    x86_test32_imm(out, X86_RBX, 1u << 16);             // AVX512F
+    x86_jcc(out, x86_cc(COND_EQ), pick);
+    x86_alu32_imm(out, 1, 8, TARGET_FEATURE_AVX512F);
+    mcode_bind(out, pick);
+    x86_pop(out, X86_RBX);
+    for (int i = 0; i < count; i++) {
+        if (i + 1 < count) {
+            x86_rr(out, false, 0x89, 0, 8, X86_RAX);    // mov eax, r8d
+            x86_alu32_imm(out, 4, X86_RAX, features[i]);
+            x86_alu32_imm(out, 7, X86_RAX, features[i]);
+            x86_jcc(out, x86_cc(COND_NE), labels + i + 1);
+        }
+        x86_lea_symbol(out, clones[i]);
+        mcode_byte(out, 0xC3);
+        if (i + 1 < count) mcode_bind(out, labels + i + 1);
+    }
+}
+
+// jmp qword ptr [rip + slot]
+static void x86_enc_dispatch(CodeBuffer* out, const char* slot) {
+    mcode_byte(out, 0xFF);
+    mcode_byte(out, 0x25);
+    mcode_rel32_symbol(out, slot);
+}
+
+// call resolver; mov qword ptr [rip + slot], rax
+static void x86_enc_bind(CodeBuffer* out, const char* resolver, const char* slot) {
+    x86_enc_call(out, resolver);
+    x86_rex(out, true, X86_RAX, -1, 0, false);
+    mcode_byte(out, 0x89);
+    mcode_byte(out, 0x05);
+    mcode_rel32_symbol(out, slot);
+}
+
+// Linux exit(2) with the callee's return value as the status
+static void x86_enc_start(CodeBuffer* out, const char* function) {
+    x86_enc_call(out, function);
+    x86_rr(out, false, 0x89, 0, X86_RAX, X86_RDI);  // mov edi, eax
+    x86_enc_mov_imm(out, X86_RAX, 60);
+    mcode_byte(out, 0x0F);                           // syscall
+    mcode_byte(out, 0x05);
+}
+
+const MachineEncoder x86_64_encoder = {
+    .prologue = x86_enc_prologue,
+    .epilogue = x86_enc_epilogue,
+    .leaf_prologue = x86_enc_leaf_prologue,
+    .leaf_epilogue = x86_enc_leaf_epilogue,
+    .mov = x86_enc_mov,
+    .mov_imm = x86_enc_mov_imm,
+    .add = x86_enc_add,
+    .sub = x86_enc_sub,
+    .mul = x86_enc_mul,
+    .div = x86_enc_div,
+    .add_imm = x86_enc_add_imm,
+    .mul_imm = x86_enc_mul_imm,
+    .load = x86_enc_load,
+    .store = x86_enc_store,
+    .load_indexed = x86_enc_load_indexed,
+    .setcc = x86_enc_setcc,
+    .branch = x86_enc_branch,
+    .branch_zero = x86_enc_branch_zero,
+    .select = x86_enc_select,
+    .jmp = x86_enc_jmp,
+    .call = x86_enc_call,
+    .start = x86_enc_start,
+    .vzero = x86_enc_vzero,
+    .vadd_indexed = x86_enc_vadd_indexed,
+    .vreduce = x86_enc_vreduce,
+    .resolver = x86_enc_resolver,
+    .dispatch = x86_enc_dispatch,
+    .bind = x86_enc_bind,
+};
@@ -73,140 +73,213 @@ static const char* get_register() {
     return regs[reg_counter++ % 6];
 }
 
+// System V AMD64 integer argument registers
+static const char* arg_registers[] = {"rdi", "rsi", "rdx", "rcx", "r8", "r9"};
+
+// Numbers and variables can be loaded into any register without clobbering others
+static int is_simple_operand(ASTNode* node) {
+    return node->type == AST_NUM || node->type == AST_VAR;
+}
+
+static void generate_operand(ASTNode* node, const char* reg, EmitBuffer* output, SymbolTable* symtab) {
+    if (node->type == AST_NUM) {
+        emit_format(output, "    mov %s, %d\n", reg, node->data.num_value);
+        return;
+    }
+
+    int offset = get_symbol_offset(symtab, node->data.var_name);
+    if (offset != 0) {
+        emit_format(output, "    mov %s, [rbp%+d]  ;; load %s\n", reg, offset, node->data.var_name);
+    } else {
+        emit_format(output, "    ;; Variable %s not found\n", node->data.var_name);
+        emit_format(output, "    mov %s, 0\n", reg);
+    }
+}
+
 // Generate code for expressions
-static void generate_expression(ASTNode* node, FILE* output, SymbolTable* symtab) {
+static void generate_expression(ASTNode* node, EmitBuffer* output, SymbolTable* symtab) {
     switch (node->type) {
         case AST_NUM:
-            fprintf(output, "    mov rax, %d\n", node->data.num_value);
+            emit_format(output, "    mov rax, %d\n", node->data.num_value);
             break;
 
         case AST_VAR:
             {
                 int offset = get_symbol_offset(symtab, node->data.var_name);
                 if (offset != 0) {
-                    fprintf(output, "    mov rax, [rbp%+d]  ;; load %s\n",
+                    emit_format(output, "    mov rax, [rbp%+d]  ;; load %s\n",
                            offset, node->data.var_name);
                 } else {
-                    fprintf(output, "    ;; Variable %s not found\n", node->data.var_name);
-                    fprintf(output, "    mov rax, 0\n");
+                    emit_format(output, "    ;; Variable %s not found\n", node->data.var_name);
+                    emit_format(output, "    mov rax, 0\n");
                 }
             }
             break;
 
         case AST_DEREF:
             generate_expression(node->data.deref_expr, output, symtab);
-            fprintf(output, "    mov rax, [rax]  ;; dereference\n");
+            emit_format(output, "    mov rax, [rax]  ;; dereference\n");
             break;
 
         case AST_ADDR:
             {
                 int offset = get_symbol_offset(symtab, node->data.addr_var_name);
                 if (offset != 0) {
-                    fprintf(output, "    lea rax, [rbp%+d]  ;; address of %s\n",
+                    emit_format(output, "    lea rax, [rbp%+d]  ;; address of %s\n",
                            offset, node->data.addr_var_name);
                 } else {
-                    fprintf(output, "    ;; Variable %s not found for address\n",
+                    emit_format(output, "    ;; Variable %s not found for address\n",
                            node->data.addr_var_name);
-                    fprintf(output, "    mov rax, 0\n");
+                    emit_format(output, "    mov rax, 0\n");
                 }
             }
             break;
 
         case AST_FUNC_CALL:
-            // Push arguments in reverse order (x86-64 calling convention)
-            for (int i = node->data.func_call.arg_count - 1; i >= 0; i--) {
-                generate_expression(node->data.func_call.args[i], output, symtab);
-                fprintf(output, "    push rax  ;; push arg %d\n", i);
-            }
+            {
+                // System V AMD64: the first 6 arguments go in registers, the
+                // rest on the stack. Simple operands are loaded straight into
+                // their register once every nested call has been evaluated.
+                int arg_count = node->data.func_call.arg_count;
+                int pushed = 0;
+                for (int i = arg_count - 1; i >= 0; i--) {
+                    ASTNode* arg = node->data.func_call.args[i];
+                    if (i < 6 && is_simple_operand(arg)) continue;
+                    generate_expression(arg, output, symtab);
+                    emit_format(output, "    push rax  ;; push arg %d\n", i);
+                    pushed++;
+                }
+                for (int i = 0; i < arg_count && i < 6; i++) {
+                    if (is_simple_operand(node->data.func_call.args[i])) continue;
+                    emit_format(output, "    pop %s  ;; arg %d\n", arg_registers[i], i);
+                    pushed--;
+                }
+                for (int i = 0; i < arg_count && i < 6; i++) {
+                    ASTNode* arg = node->data.func_call.args[i];
+                    if (!is_simple_operand(arg)) continue;
+                    generate_operand(arg, arg_registers[i], output, symtab);
+                }
 
-            // Call the function
-            fprintf(output, "    call %s\n", node->data.func_call.name);
+                // Variadic callees read the vector register count from al
+                emit_format(output, "    xor eax, eax\n");
+                emit_format(output, "    call %s\n", node->data.func_call.name);
 
-            // Clean up stack (each arg is 8 bytes)
-            if (node->data.func_call.arg_count > 0) {
-                fprintf(output, "    add rsp, %d  ;; clean up %d args\n",
-                       node->data.func_call.arg_count * 8, node->data.func_call.arg_count);
+                // Clean up stack arguments (each arg is 8 bytes)
+                if (pushed > 0) {
+                    emit_format(output, "    add rsp, %d  ;; clean up %d stack args\n",
+                           pushed * 8, pushed);
+                }
             }
             break;
 
         case AST_BINARY_OP:
             // Generate right operand first (x86 convention)
             generate_expression(node->data.binary.right, output, symtab);
-            fprintf(output, "    push rax\n");
+            emit_format(output, "    push rax\n");
 
             // Generate left operand
             generate_expression(node->data.binary.left, output, symtab);
 
             // Perform operation
-            fprintf(output, "    pop rbx\n");
+            emit_format(output, "    pop rbx\n");
             switch (node->data.binary.op) {
                 case '+':
-                    fprintf(output, "    add rax, rbx\n");
+                    emit_format(output, "    add rax, rbx\n");
                     break;
                 case '-':
-                    fprintf(output, "    sub rax, rbx\n");
+                    emit_format(output, "    sub rax, rbx\n");
                     break;
                 case '*':
-                    fprintf(output, "    imul rax, rbx\n");
+                    emit_format(output, "    imul rax, rbx\n");
                     break;
                 case '/':
-                    fprintf(output, "    cqo\n");
-                    fprintf(output, "    idiv rbx\n");
+                    emit_format(output, "    cqo\n");
+                    emit_format(output, "    idiv rbx\n");
                     break;
                 case '<':
-                    fprintf(output, "    cmp rax, rbx\n");
-                    fprintf(output, "    setl al\n");
-                    fprintf(output, "    movzx rax, al\n");
+                    emit_format(output, "    cmp rax, rbx\n");
+                    emit_format(output, "    setl al\n");
+                    emit_format(output, "    movzx rax, al\n");
                     break;
                 case '>':
-                    fprintf(output, "    cmp rax, rbx\n");
-                    fprintf(output, "    setg al\n");
-                    fprintf(output, "    movzx rax, al\n");
+                    emit_format(output, "    cmp rax, rbx\n");
+                    emit_format(output, "    setg al\n");
+                    emit_format(output, "    movzx rax, al\n");
                     break;
                 case 'L': // <=
-                    fprintf(output, "    cmp rax, rbx\n");
-                    fprintf(output, "    setle al\n");
-                    fprintf(output, "    movzx rax, al\n");
+                    emit_format(output, "    cmp rax, rbx\n");
+                    emit_format(output, "    setle al\n");
+                    emit_format(output, "    movzx rax, al\n");
                     break;
                 case 'G': // >=
-                    fprintf(output, "    cmp rax, rbx\n");
-                    fprintf(output, "    setge al\n");
-                    fprintf(output, "    movzx rax, al\n");
+                    emit_format(output, "    cmp rax, rbx\n");
+                    emit_format(output, "    setge al\n");
+                    emit_format(output, "    movzx rax, al\n");
                     break;
                 case 'E': // ==
-                    fprintf(output, "    cmp rax, rbx\n");
-                    fprintf(output, "    sete al\n");
-                    fprintf(output, "    movzx rax, al\n");
+                    emit_format(output, "    cmp rax, rbx\n");
+                    emit_format(output, "    sete al\n");
+                    emit_format(output, "    movzx rax, al\n");
                     break;
                 default:
-                    fprintf(output, "    ;; Unsupported operator: %c\n", node->data.binary.op);
+                    emit_format(output, "    ;; Unsupported operator: %c\n", node->data.binary.op);
             }
             break;
 
         default:
-            fprintf(output, "    ;; Unsupported expression type\n");
+            emit_format(output, "    ;; Unsupported expression type\n");
+    }
+}
+
+// Generate a jump to `label` taken when the condition is false.
+// Comparisons branch on the flags from cmp instead of materializing 0/1.
+static void generate_condition(ASTNode* cond, const char* label, int id,
+                               EmitBuffer* output, SymbolTable* symtab) {
+    const char* jump = NULL;
+
+    if (cond->type == AST_BINARY_OP) {
+        switch (cond->data.binary.op) {
+            case '<': jump = "jge"; break;
+            case '>': jump = "jle"; break;
+            case 'L': jump = "jg"; break;   // <=
+            case 'G': jump = "jl"; break;   // >=
+            case 'E': jump = "jne"; break;  // ==
+        }
+    }
+
+    if (jump) {
+        generate_expression(cond->data.binary.right, output, symtab);
+        emit_format(output, "    push rax\n");
+        generate_expression(cond->data.binary.left, output, symtab);
+        emit_format(output, "    pop rbx\n");
+        emit_format(output, "    cmp rax, rbx\n");
+        emit_format(output, "    %s .L%s_%d\n", jump, label, id);
+    } else {
+        generate_expression(cond, output, symtab);
+        emit_format(output, "    test rax, rax\n");
+        emit_format(output, "    jz .L%s_%d\n", label, id);
     }
 }
 
 // Generate code for statements
-static void generate_statement(ASTNode* node, FILE* output, SymbolTable* symtab) {
+static void generate_statement(ASTNode* node, EmitBuffer* output, SymbolTable* symtab) {
     switch (node->type) {
         case AST_RETURN:
             generate_expression(node->data.return_expr, output, symtab);
-            fprintf(output, "    mov rsp, rbp\n");
-            fprintf(output, "    pop rbp\n");
-            fprintf(output, "    ret\n");
+            emit_format(output, "    mov rsp, rbp\n");
+            emit_format(output, "    pop rbp\n");
+            emit_format(output, "    ret\n");
             break;
 
         case AST_VAR_DECL:
             {
                 int offset = add_symbol(symtab, node->data.var_decl.var_name);
-                fprintf(output, "    ;; Declare variable %s at [rbp%+d]\n",
+                emit_format(output, "    ;; Declare variable %s at [rbp%+d]\n",
                        node->data.var_decl.var_name, offset);
 
                 if (node->data.var_decl.initializer) {
                     generate_expression(node->data.var_decl.initializer, output, symtab);
-                    fprintf(output, "    mov [rbp%+d], rax  ;; initialize %s\n",
+                    emit_format(output, "    mov [rbp%+d], rax  ;; initialize %s\n",
                            offset, node->data.var_decl.var_name);
                 }
             }
@@ -217,10 +290,10 @@ static void generate_statement(ASTNode* node, FILE* output, SymbolTable* symtab)
                 int offset = get_symbol_offset(symtab, node->data.assignment.var_name);
                 if (offset != 0) {
                     generate_expression(node->data.assignment.value, output, symtab);
-                    fprintf(output, "    mov [rbp%+d], rax  ;; %s =\n",
+                    emit_format(output, "    mov [rbp%+d], rax  ;; %s =\n",
                            offset, node->data.assignment.var_name);
                 } else {
-                    fprintf(output, "    ;; Variable %s not found for assignment\n",
+                    emit_format(output, "    ;; Variable %s not found for assignment\n",
                            node->data.assignment.var_name);
                 }
             }
@@ -232,22 +305,20 @@ static void generate_statement(ASTNode* node, FILE* output, SymbolTable* symtab)
                 int current_if = if_count++;
 
                 // Generate condition
-                generate_expression(node->data.if_stmt.condition, output, symtab);
-                fprintf(output, "    test rax, rax\n");
-                fprintf(output, "    jz .Lelse_%d\n", current_if);
+                generate_condition(node->data.if_stmt.condition, "else", current_if, output, symtab);
 
                 // Generate then branch
                 generate_statement(node->data.if_stmt.then_branch, output, symtab);
 
                 if (node->data.if_stmt.else_branch) {
-                    fprintf(output, "    jmp .Lend_%d\n", current_if);
-                    fprintf(output, ".Lelse_%d:\n", current_if);
+                    emit_format(output, "    jmp .Lend_%d\n", current_if);
+                    emit_format(output, ".Lelse_%d:\n", current_if);
                     generate_statement(node->data.if_stmt.else_branch, output, symtab);
                 } else {
-                    fprintf(output, ".Lelse_%d:\n", current_if);
+                    emit_format(output, ".Lelse_%d:\n", current_if);
                 }
 
-                fprintf(output, ".Lend_%d:\n", current_if);
+                emit_format(output, ".Lend_%d:\n", current_if);
             }
             break;
 
@@ -256,18 +327,16 @@ static void generate_statement(ASTNode* node, FILE* output, SymbolTable* symtab)
                 static int while_count = 0;
                 int current_while = while_count++;
 
-                fprintf(output, ".Lwhile_%d:\n", current_while);
+                emit_format(output, ".Lwhile_%d:\n", current_while);
 
                 // Generate condition
-                generate_expression(node->data.while_stmt.condition, output, symtab);
-                fprintf(output, "    test rax, rax\n");
-                fprintf(output, "    jz .Lend_while_%d\n", current_while);
+                generate_condition(node->data.while_stmt.condition, "end_while", current_while, output, symtab);
 
                 // Generate body
                 generate_statement(node->data.while_stmt.body, output, symtab);
-                fprintf(output, "    jmp .Lwhile_%d\n", current_while);
+                emit_format(output, "    jmp .Lwhile_%d\n", current_while);
 
-                fprintf(output, ".Lend_while_%d:\n", current_while);
+                emit_format(output, ".Lend_while_%d:\n", current_while);
             }
             break;
 
@@ -278,19 +347,46 @@ static void generate_statement(ASTNode* node, FILE* output, SymbolTable* symtab)
             break;
 
         default:
-            fprintf(output, "    ;; Unsupported statement type\n");
+            emit_format(output, "    ;; Unsupported statement type\n");
     }
 }
 
-// Generate code for function definition
-static void generate_function(ASTNode* node, FILE* output, SymbolTable* symtab) {
-    fprintf(output, ";; Function: %s\n", node->data.func_def.name);
-    fprintf(output, "global %s\n", node->data.func_def.name);
-    fprintf(output, "%s:\n", node->data.func_def.name);
+// Count the variable declarations in a function body (upper bound on its slots)
+static int count_locals(ASTNode* node) {
+    int count = 0;
+    if (!node) return 0;
 
-    // Function prologue
-    fprintf(output, "    push rbp\n");
-    fprintf(output, "    mov rbp, rsp\n");
+    switch (node->type) {
+        case AST_VAR_DECL:
+            return 1;
+        case AST_IF:
+            return count_locals(node->data.if_stmt.then_branch) +
+                   count_locals(node->data.if_stmt.else_branch);
+        case AST_WHILE:
+            return count_locals(node->data.while_stmt.body);
+        case AST_BLOCK:
+            for (int i = 0; i < node->data.block.statement_count; i++) {
+                count += count_locals(node->data.block.statements[i]);
+            }
+            return count;
+        default:
+            return 0;
+    }
+}
+
+// Generate code for function definition
+static void generate_function(ASTNode* node, EmitBuffer* output, SymbolTable* symtab) {
+    emit_format(output, ";; Function: %s\n", node->data.func_def.name);
+    emit_format(output, "global %s\n", node->data.func_def.name);
+    emit_format(output, "%s:\n", node->data.func_def.name);
+
+    // Function prologue: reserve the parameter and local slots so pushed
+    // temporaries stay below them, keeping rsp 16-byte aligned for calls
+    int slots = count_locals(node->data.func_def.body);
+    if (node->data.func_def.params) slots += node->data.func_def.params->data.param_list.param_count;
+    emit_format(output, "    push rbp\n");
+    emit_format(output, "    mov rbp, rsp\n");
+    if (slots > 0) emit_format(output, "    sub rsp, %d\n", (slots * 8 + 15) & ~15);
 
     // Initialize symbol table for this function
     init_symbol_table(symtab);
@@ -302,22 +398,17 @@ static void generate_function(ASTNode* node, FILE* output, SymbolTable* symtab)
             char* param_name = params->data.param_list.param_names[i];
             int param_offset;
 
+            param_offset = add_symbol(symtab, param_name);
             if (i < 6) {
                 // First 6 parameters in registers: rdi, rsi, rdx, rcx, r8, r9
-                const char* reg_names[] = {"rdi", "rsi", "rdx", "rcx", "r8", "r9"};
-                fprintf(output, "    ;; Parameter %s in register %s\n", param_name, reg_names[i]);
-
-                // Move parameter register to a local variable on stack
-                param_offset = -(symtab->count + 1) * 8;
-                fprintf(output, "    mov [rbp%+d], %s  ;; store param %s\n",
-                       param_offset, reg_names[i], param_name);
+                emit_format(output, "    mov [rbp%+d], %s  ;; store param %s\n",
+                       param_offset, arg_registers[i], param_name);
             } else {
                 // Additional parameters on stack at [rbp+16] + (i-6)*8
-                param_offset = 16 + ((i - 6) * 8);
-                fprintf(output, "    ;; Parameter %s at [rbp+%d]\n", param_name, param_offset);
+                emit_format(output, "    mov rax, [rbp+%d]\n", 16 + (i - 6) * 8);
+                emit_format(output, "    mov [rbp%+d], rax  ;; store param %s\n",
+                       param_offset, param_name);
             }
-
-            add_symbol(symtab, param_name);
         }
     }
 
@@ -325,25 +416,25 @@ static void generate_function(ASTNode* node, FILE* output, SymbolTable* symtab)
     generate_statement(node->data.func_def.body, output, symtab);
 
     // Function epilogue (only if not already done by return)
-    fprintf(output, "    mov rsp, rbp\n");
-    fprintf(output, "    pop rbp\n");
-    fprintf(output, "    ret\n");
-    fprintf(output, "\n");
+    emit_format(output, "    mov rsp, rbp\n");
+    emit_format(output, "    pop rbp\n");
+    emit_format(output, "    ret\n");
+    emit_format(output, "\n");
 
     // Clean up symbol table
     free_symbol_table(symtab);
 }
 
 // Main code generation function
-void generate_code(ASTNode* ast, FILE* output, SymbolTable* symtab) {
+void generate_code(ASTNode* ast, EmitBuffer* output, SymbolTable* symtab) {
     if (!ast) return;
 
     // Generate NASM header
-    fprintf(output, ";; ALETHEIA MesCC-ALE Phase 2 Output\n");
-    fprintf(output, ";; Generated assembly code with variables and control flow\n");
-    fprintf(output, "\n");
-    fprintf(output, "section .text\n");
-    fprintf(output, "\n");
+    emit_format(output, ";; ALETHEIA MesCC-ALE Phase 2 Output\n");
+    emit_format(output, ";; Generated assembly code with variables and control flow\n");
+    emit_format(output, "\n");
+    emit_format(output, "section .text\n");
+    emit_format(output, "\n");
 
     // Generate code based on AST type
     switch (ast->type) {
@@ -361,18 +452,18 @@ void generate_code(ASTNode* ast, FILE* output, SymbolTable* symtab) {
             break;
 
         default:
-            fprintf(output, ";; Unsupported AST root type\n");
+            emit_format(output, ";; Unsupported AST root type\n");
     }
 
     // Add program entry point if this is a main function
     if (ast->type == AST_FUNC_DEF &&
         strcmp(ast->data.func_def.name, "main") == 0) {
-        fprintf(output, ";; Program entry point\n");
-        fprintf(output, "global _start\n");
-        fprintf(output, "_start:\n");
-        fprintf(output, "    call main\n");
-        fprintf(output, "    mov rdi, rax\n");
-        fprintf(output, "    mov rax, 60  ; sys_exit\n");
-        fprintf(output, "    syscall\n");
+        emit_format(output, ";; Program entry point\n");
+        emit_format(output, "global _start\n");
+        emit_format(output, "_start:\n");
+        emit_format(output, "    call main\n");
+        emit_format(output, "    mov rdi, rax\n");
+        emit_format(output, "    mov rax, 60  ; sys_exit\n");
+        emit_format(output, "    syscall\n");
     }
 }
@@ -1,14 +1,25 @@
 /*
  * ALETHEIA MesCC-ALE Phase 1: Main Compiler
  *
- * Usage: mescc-ale < input.c > output.asm
+ * Usage: mescc-ale [-O0] [--peephole-stats] < input.c > output.asm
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "mescc.h"
+#include "peephole.h"
+
+int main(int argc, char** argv) {
+    // -O0 disables the peephole pass over the generated assembly;
+    // --peephole-stats prints how often each rule fired to stderr
+    bool optimize = true;
+    bool peephole_stats = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-O0") == 0) optimize = false;
+        if (strcmp(argv[i], "--peephole-stats") == 0) peephole_stats = true;
+    }
 
-int main() {
     // Read source code from stdin
     char* source = NULL;
     size_t source_size = 0;
@@ -64,13 +75,36 @@ int main() {
         return 1;
     }
 
-    // Generate code
+    // Generate code into memory, run the peephole pass over it, and write
+    // the result out in one go
     SymbolTable symtab;
-    generate_code(ast, stdout, &symtab);
+    EmitBuffer code;
+    EmitBuffer optimized;
+    emit_buffer_init(&code);
+    emit_buffer_init(&optimized);
+    generate_code(ast, &code, &symtab);
+    if (optimize) {
+        PeepholeRuleSet* rules = peephole_create_rules(TARGET_X86_64);
+        if (rules) {
+            peephole_add_stack_machine_rules(rules);
+            peephole_optimize_buffer(&code, &optimized, TARGET_X86_64, rules);
+            if (peephole_stats) peephole_report(rules, stderr);
+            peephole_free_rules(rules);
+        } else {
+            optimize = false;
+        }
+    }
+    bool written = emit_flush(optimize ? &optimized : &code, stdout);
+    emit_buffer_free(&code);
+    emit_buffer_free(&optimized);
 
     // Cleanup
     free_ast(ast);
     free(source);
 
+    if (!written) {
+        fprintf(stderr, "Writing output failed\n");
+        return 1;
+    }
     return 0;
 }
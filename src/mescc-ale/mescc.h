@@ -8,6 +8,8 @@
 #ifndef MESCC_H
 #define MESCC_H
 
+#include "emit.h"
+
 // Token types for TinyCC-ALE compatibility
 typedef enum {
     TOK_EOF = 0,
@@ -145,7 +147,7 @@ typedef struct {
 // Function declarations (Phase 2)
 Token* tokenize(const char* source);
 ASTNode* parse(Token* tokens);
-void generate_code(ASTNode* ast, FILE* output, SymbolTable* symtab);
+void generate_code(ASTNode* ast, EmitBuffer* output, SymbolTable* symtab);
 void free_ast(ASTNode* node);
 void free_symbol_table(SymbolTable* symtab);
 
@@ -182,8 +182,9 @@ typedef struct ASTNode {
         } switch_stmt;
 
         struct {
-            struct ASTNode* value;
+            struct ASTNode* value;  // NULL for default
             struct ASTNode* body;
+            int breaks;             // Body ends in break (no fall-through)
         } case_stmt;
 
         struct {
@@ -211,6 +212,7 @@ typedef struct ASTNode {
 Token* tokens;
 int token_count;
 int token_pos;
+int parse_errors;   // Semantic errors found while parsing; the program is rejected
 
 // Lexer
 Token* tokenize(const char* source) {
@@ -457,6 +459,22 @@ Token* tokenize(const char* source) {
             continue;
         }
 
+        if (source[i] == '&' && source[i+1] == '&') {
+            tokens[token_count].type = TOK_ANDAND;
+            tokens[token_count].value = "&&";
+            token_count++;
+            i += 2;
+            continue;
+        }
+
+        if (source[i] == '|' && source[i+1] == '|') {
+            tokens[token_count].type = TOK_OROR;
+            tokens[token_count].value = "||";
+            token_count++;
+            i += 2;
+            continue;
+        }
+
         if (source[i] == '&') {
             tokens[token_count].type = TOK_AMP;
             tokens[token_count].value = "&";
@@ -625,6 +643,7 @@ ASTNode* parse_unary();
 ASTNode* parse_function_call();
 ASTNode* parse_switch_statement();
 ASTNode* parse_case_statement();
+int evaluate_constant_expression(ASTNode* ast, int* value);
 
 ASTNode* parse_unary() {
     if (tokens[token_pos].type == TOK_AMP) {
@@ -722,6 +741,10 @@ ASTNode* parse_primary() {
             if (tokens[token_pos].type != TOK_RBRACKET) return NULL;
             token_pos++; // consume ]
 
+            // Variables have no storage or element type to address from
+            printf(";; Parse error: indexing %s is not supported\n", var_name);
+            parse_errors++;
+
             ASTNode* array_access = (ASTNode*)malloc(sizeof(ASTNode));
             array_access->type = AST_ARRAY_ACCESS;
             array_access->data.array_access.array_name = var_name;
@@ -782,7 +805,21 @@ ASTNode* parse_comparison() {
     return left;
 }
 
-ASTNode* parse_expression() {
+// Binary operator characters: '<' '>' '=' (==) '!' (!=) 'l' (<=) 'g' (>=),
+// '&' and '|' for the logical && and ||
+char comparison_op(TokenType type) {
+    switch (type) {
+        case TOK_LT: return '<';
+        case TOK_GT: return '>';
+        case TOK_LE: return 'l';
+        case TOK_GE: return 'g';
+        case TOK_EQ: return '=';
+        case TOK_NE: return '!';
+        default: return 0;
+    }
+}
+
+ASTNode* parse_relational() {
     ASTNode* left = parse_comparison();
     if (!left) return NULL;
 
@@ -793,7 +830,7 @@ ASTNode* parse_expression() {
            tokens[token_pos].type == TOK_EQ ||
            tokens[token_pos].type == TOK_NE) {
 
-        char* op = tokens[token_pos].value;
+        char op = comparison_op(tokens[token_pos].type);
         token_pos++;
 
         ASTNode* right = parse_comparison();
@@ -801,7 +838,31 @@ ASTNode* parse_expression() {
 
         ASTNode* binary = (ASTNode*)malloc(sizeof(ASTNode));
         binary->type = AST_BINARY_OP;
-        binary->data.binary.op = op[0]; // Pour simplifier, on garde juste le premier caractère
+        binary->data.binary.op = op;
+        binary->data.binary.left = left;
+        binary->data.binary.right = right;
+
+        left = binary;
+    }
+
+    return left;
+}
+
+// && binds tighter than ||; both associate to the left
+ASTNode* parse_logical(int level) {
+    ASTNode* left = level ? parse_logical(0) : parse_relational();
+    if (!left) return NULL;
+
+    TokenType type = level ? TOK_OROR : TOK_ANDAND;
+    while (tokens[token_pos].type == type) {
+        token_pos++;
+
+        ASTNode* right = level ? parse_logical(0) : parse_relational();
+        if (!right) return NULL;
+
+        ASTNode* binary = (ASTNode*)malloc(sizeof(ASTNode));
+        binary->type = AST_BINARY_OP;
+        binary->data.binary.op = level ? '|' : '&';
         binary->data.binary.left = left;
         binary->data.binary.right = right;
 
@@ -811,6 +872,10 @@ ASTNode* parse_expression() {
     return left;
 }
 
+ASTNode* parse_expression() {
+    return parse_logical(1);
+}
+
 ASTNode* parse_variable_declaration() {
     // Check for storage class specifiers
     int is_const = 0, is_static = 0, is_inline = 0;
@@ -1024,6 +1089,40 @@ ASTNode* parse_struct_declaration() {
     return struct_decl;
 }
 
+// Case values must be integer constants, each used once per switch, and a
+// switch has at most one default
+static int check_case_label(ASTNode* body, ASTNode* label) {
+    if (label->type == AST_DEFAULT) {
+        for (int i = 0; i < body->data.block.count; i++) {
+            if (body->data.block.statements[i]->type == AST_DEFAULT) {
+                printf(";; Parse error: multiple default labels in one switch\n");
+                parse_errors++;
+                return 0;
+            }
+        }
+        return 1;
+    }
+
+    int value;
+    if (!evaluate_constant_expression(label->data.case_stmt.value, &value)) {
+        printf(";; Parse error: case label is not an integer constant expression\n");
+        parse_errors++;
+        return 0;
+    }
+    for (int i = 0; i < body->data.block.count; i++) {
+        ASTNode* other = body->data.block.statements[i];
+        int other_value;
+        if (other->type == AST_CASE &&
+            evaluate_constant_expression(other->data.case_stmt.value, &other_value) &&
+            other_value == value) {
+            printf(";; Parse error: duplicate case value %d\n", value);
+            parse_errors++;
+            return 0;
+        }
+    }
+    return 1;
+}
+
 ASTNode* parse_switch_statement() {
     if (tokens[token_pos].type != TOK_SWITCH) return NULL;
     token_pos++;
@@ -1042,18 +1141,15 @@ ASTNode* parse_switch_statement() {
 
     ASTNode* body = (ASTNode*)malloc(sizeof(ASTNode));
     body->type = AST_BLOCK;
-    body->data.block.statements = (ASTNode**)malloc(sizeof(ASTNode*) * 50);
+    body->data.block.statements = (ASTNode**)malloc(sizeof(ASTNode*) * 512);
     body->data.block.count = 0;
 
     while (tokens[token_pos].type != TOK_RBRACE && tokens[token_pos].type != TOK_EOF) {
-        if (tokens[token_pos].type == TOK_CASE) {
+        if (body->data.block.count >= 512) return NULL;
+        if (tokens[token_pos].type == TOK_CASE || tokens[token_pos].type == TOK_DEFAULT) {
             ASTNode* case_stmt = parse_case_statement();
-            if (case_stmt) {
-                body->data.block.statements[body->data.block.count++] = case_stmt;
-            }
-        } else if (tokens[token_pos].type == TOK_DEFAULT) {
-            // Skip default for now
-            token_pos += 2; // skip "default:"
+            if (!case_stmt || !check_case_label(body, case_stmt)) return NULL;
+            body->data.block.statements[body->data.block.count++] = case_stmt;
         } else {
             ASTNode* stmt = parse_statement();
             if (stmt) {
@@ -1076,11 +1172,16 @@ ASTNode* parse_switch_statement() {
 }
 
 ASTNode* parse_case_statement() {
-    if (tokens[token_pos].type != TOK_CASE) return NULL;
-    token_pos++;
-
-    ASTNode* value = parse_expression();
-    if (!value) return NULL;
+    ASTNode* value = NULL;
+    if (tokens[token_pos].type == TOK_CASE) {
+        token_pos++;
+        value = parse_expression();
+        if (!value) return NULL;
+    } else if (tokens[token_pos].type == TOK_DEFAULT) {
+        token_pos++;
+    } else {
+        return NULL;
+    }
 
     if (tokens[token_pos].type != TOK_COLON) return NULL;
     token_pos++;
@@ -1090,14 +1191,17 @@ ASTNode* parse_case_statement() {
     body->type = AST_BLOCK;
     body->data.block.statements = (ASTNode**)malloc(sizeof(ASTNode*) * 20);
     body->data.block.count = 0;
+    int breaks = 0;
 
-    while (tokens[token_pos].type != TOK_CASE &&
+    while (body->data.block.count < 20 &&
+           tokens[token_pos].type != TOK_CASE &&
            tokens[token_pos].type != TOK_DEFAULT &&
            tokens[token_pos].type != TOK_RBRACE &&
            tokens[token_pos].type != TOK_EOF) {
         if (tokens[token_pos].type == TOK_BREAK) {
             token_pos++; // skip break
             if (tokens[token_pos].type == TOK_SEMI) token_pos++; // skip ;
+            breaks = 1;
             break;
         }
 
@@ -1110,9 +1214,10 @@ ASTNode* parse_case_statement() {
     }
 
     ASTNode* case_stmt = (ASTNode*)malloc(sizeof(ASTNode));
-    case_stmt->type = AST_CASE;
+    case_stmt->type = value ? AST_CASE : AST_DEFAULT;
     case_stmt->data.case_stmt.value = value;
     case_stmt->data.case_stmt.body = body;
+    case_stmt->data.case_stmt.breaks = breaks;
 
     return case_stmt;
 }
@@ -1301,30 +1406,41 @@ ASTNode* parse_program() {
 }
 
 // Code generator
-// Basic constant folding optimization
-int evaluate_constant_expression(ASTNode* ast) {
+// Basic constant folding optimization. Returns 1 and sets *value when the
+// expression is a constant, 0 otherwise.
+int evaluate_constant_expression(ASTNode* ast, int* value) {
     if (ast->type == AST_NUM) {
-        return ast->data.num_value;
+        *value = ast->data.num_value;
+        return 1;
     }
 
     if (ast->type == AST_BINARY_OP) {
-        int left = evaluate_constant_expression(ast->data.binary.left);
-        int right = evaluate_constant_expression(ast->data.binary.right);
+        int left, right;
+        if (!evaluate_constant_expression(ast->data.binary.left, &left) ||
+            !evaluate_constant_expression(ast->data.binary.right, &right)) {
+            return 0;
+        }
 
         char op = ast->data.binary.op; // op is already a char
-        if (op == '+') return left + right;
-        if (op == '-') return left - right;
-        if (op == '*') return left * right;
-        if (op == '/' && right != 0) return left / right;
+        if (op == '+') *value = left + right;
+        else if (op == '-') *value = left - right;
+        else if (op == '*') *value = left * right;
+        else if (op == '/' && right != 0) *value = left / right;
+        else return 0;
+        return 1;
     }
 
-    return -999999; // Not a constant
+    return 0; // Not a constant
 }
 
+const char* condition_code(char op);
+int is_logical(ASTNode* ast);
+void generate_logical_value(ASTNode* ast);
+
 void generate_expression(ASTNode* ast) {
     // Try constant folding first
-    int const_val = evaluate_constant_expression(ast);
-    if (const_val != -999999) {
+    int const_val;
+    if (evaluate_constant_expression(ast, &const_val)) {
         printf("    mov rax, %d  ;; constant folded\n", const_val);
         return;
     }
@@ -1346,14 +1462,6 @@ void generate_expression(ASTNode* ast) {
         return;
     }
 
-    if (ast->type == AST_ARRAY_ACCESS) {
-        printf("    ;; array access %s[...] (simplified)\n", ast->data.array_access.array_name);
-        generate_expression(ast->data.array_access.index);
-        printf("    ;; simplified: assume array starts at address 0\n");
-        printf("    mov rax, 0\n");
-        return;
-    }
-
     if (ast->type == AST_ADDR_OF) {
         printf("    ;; address of %s (simplified)\n", ast->data.addr_of.var_name);
         printf("    mov rax, 0\n"); // Simplified
@@ -1375,6 +1483,11 @@ void generate_expression(ASTNode* ast) {
         return;
     }
 
+    if (is_logical(ast)) {
+        generate_logical_value(ast);
+        return;
+    }
+
     if (ast->type == AST_BINARY_OP) {
         generate_expression(ast->data.binary.left);
 
@@ -1401,35 +1514,405 @@ void generate_expression(ASTNode* ast) {
             printf("    pop rax\n");
             printf("    cqo\n");
             printf("    idiv rbx\n");
-        } else if (ast->data.binary.op == '<') {
-            printf("    push rax\n");
-            generate_expression(ast->data.binary.right);
-            printf("    mov rbx, rax\n");
-            printf("    pop rax\n");
-            printf("    cmp rax, rbx\n");
-            printf("    setl al\n");
-            printf("    movzx rax, al\n");
-        } else if (ast->data.binary.op == '>') {
+        } else if (condition_code(ast->data.binary.op)) {
             printf("    push rax\n");
             generate_expression(ast->data.binary.right);
             printf("    mov rbx, rax\n");
             printf("    pop rax\n");
             printf("    cmp rax, rbx\n");
-            printf("    setg al\n");
-            printf("    movzx rax, al\n");
-        } else if (ast->data.binary.op == '=') { // Pour == (égalité)
-            printf("    push rax\n");
-            generate_expression(ast->data.binary.right);
-            printf("    mov rbx, rax\n");
-            printf("    pop rax\n");
-            printf("    cmp rax, rbx\n");
-            printf("    sete al\n");
+            printf("    set%s al\n", condition_code(ast->data.binary.op));
             printf("    movzx rax, al\n");
         }
         return;
     }
 }
 
+// Short-circuit lowering
+// In branch context && and || become chains of conditional jumps; nothing
+// materializes the intermediate booleans. Callers jump away when the
+// condition fails, so the taken path is the fall-through.
+const char* condition_code(char op) {
+    switch (op) {
+        case '<': return "l";
+        case '>': return "g";
+        case 'l': return "le";
+        case 'g': return "ge";
+        case '=': return "e";
+        case '!': return "ne";
+        default: return NULL;
+    }
+}
+
+const char* inverse_condition_code(char op) {
+    switch (op) {
+        case '<': return "ge";
+        case '>': return "le";
+        case 'l': return "g";
+        case 'g': return "l";
+        case '=': return "ne";
+        case '!': return "e";
+        default: return NULL;
+    }
+}
+
+int is_logical(ASTNode* ast) {
+    return ast->type == AST_BINARY_OP &&
+           (ast->data.binary.op == '&' || ast->data.binary.op == '|');
+}
+
+// Jumps to label when cond evaluates to `sense` (nonzero for 1), falls through otherwise
+void generate_jump_if(ASTNode* cond, int sense, const char* label) {
+    static int logic_count = 0;
+
+    int const_val;
+    if (evaluate_constant_expression(cond, &const_val)) {
+        if ((const_val != 0) == sense) printf("    jmp %s\n", label);
+        return;
+    }
+
+    if (is_logical(cond)) {
+        // a && b jumps on false as soon as either fails; a || b jumps on
+        // true as soon as either holds. The other sense needs a skip label.
+        int is_and = cond->data.binary.op == '&';
+        if (sense != is_and) {
+            generate_jump_if(cond->data.binary.left, sense, label);
+            generate_jump_if(cond->data.binary.right, sense, label);
+        } else {
+            char skip[32];
+            sprintf(skip, ".L_logic_%d", logic_count++);
+            generate_jump_if(cond->data.binary.left, !sense, skip);
+            generate_jump_if(cond->data.binary.right, sense, label);
+            printf("%s:\n", skip);
+        }
+        return;
+    }
+
+    if (cond->type == AST_BINARY_OP && condition_code(cond->data.binary.op)) {
+        generate_expression(cond->data.binary.left);
+        printf("    push rax\n");
+        generate_expression(cond->data.binary.right);
+        printf("    mov rbx, rax\n");
+        printf("    pop rax\n");
+        printf("    cmp rax, rbx\n");
+        printf("    j%s %s\n", sense ? condition_code(cond->data.binary.op)
+                                : inverse_condition_code(cond->data.binary.op), label);
+        return;
+    }
+
+    generate_expression(cond);
+    printf("    test rax, rax\n");
+    printf("    %s %s\n", sense ? "jnz" : "jz", label);
+}
+
+// Operands that can be evaluated unconditionally: no calls, no memory
+int is_speculatable(ASTNode* ast) {
+    switch (ast->type) {
+        case AST_NUM:
+        case AST_VAR_REF:
+            return 1;
+        case AST_BINARY_OP:
+            return ast->data.binary.op != '/' &&
+                   is_speculatable(ast->data.binary.left) &&
+                   is_speculatable(ast->data.binary.right);
+        default:
+            return 0;
+    }
+}
+
+// Leaves 0 or 1 in rax
+void generate_boolean(ASTNode* ast) {
+    generate_expression(ast);
+    if (ast->type == AST_BINARY_OP &&
+        (condition_code(ast->data.binary.op) || is_logical(ast))) {
+        return;
+    }
+    printf("    test rax, rax\n");
+    printf("    setne al\n");
+    printf("    movzx rax, al\n");
+}
+
+// Value context: when the right operand is safe to evaluate anyway, both
+// sides become setcc booleans combined with and/or; otherwise branch
+void generate_logical_value(ASTNode* ast) {
+    static int value_count = 0;
+
+    if (is_speculatable(ast->data.binary.right)) {
+        generate_boolean(ast->data.binary.left);
+        printf("    push rax\n");
+        generate_boolean(ast->data.binary.right);
+        printf("    pop rbx\n");
+        printf("    %s rax, rbx\n", ast->data.binary.op == '&' ? "and" : "or");
+        return;
+    }
+
+    int current = value_count++;
+    char other[32];
+    char done[32];
+    sprintf(other, ".L_logic_value_%d", current);
+    sprintf(done, ".L_logic_value_%d_done", current);
+    int is_and = ast->data.binary.op == '&';
+    generate_jump_if(ast, !is_and, other);
+    printf("    mov rax, %d\n", is_and);
+    printf("    jmp %s\n", done);
+    printf("%s:\n", other);
+    printf("    mov rax, %d\n", !is_and);
+    printf("%s:\n", done);
+}
+
+// Switch lowering
+// Sorted case values are split into clusters: dense runs become a jump
+// table in .rodata, short runs with few distinct targets become bit tests,
+// and the rest single compares. A balanced binary tree over the clusters
+// picks the right one in O(log n) compares.
+#define SWITCH_MAX_CASES 512
+#define SWITCH_MIN_TABLE 4          // Cases needed for a jump table
+#define SWITCH_MIN_DENSITY 40       // Percent of table entries that are cases
+#define SWITCH_MIN_BIT_TEST 3       // Cases needed for a bit-test cluster
+#define SWITCH_MAX_BIT_TARGETS 3
+
+typedef enum { CLUSTER_CASE, CLUSTER_TABLE, CLUSTER_BITS } ClusterKind;
+
+typedef struct {
+    long long value;
+    int target;     // Case whose label the value jumps to
+} SwitchCase;
+
+typedef struct {
+    ClusterKind kind;
+    int first;      // Index range into the sorted cases
+    int last;
+} SwitchCluster;
+
+typedef struct {
+    int id;
+    SwitchCase cases[SWITCH_MAX_CASES];
+    int case_count;
+    SwitchCluster clusters[SWITCH_MAX_CASES];
+    int cluster_count;
+    int table_count;
+    int node_count;
+    char default_label[48];
+} SwitchLowering;
+
+void generate_statement(ASTNode* stmt);
+
+static int compare_switch_cases(const void* a, const void* b) {
+    long long x = ((const SwitchCase*)a)->value;
+    long long y = ((const SwitchCase*)b)->value;
+    return x < y ? -1 : x > y;
+}
+
+static long long switch_span(SwitchLowering* sw, int first, int last) {
+    return sw->cases[last].value - sw->cases[first].value + 1;
+}
+
+static int switch_distinct_targets(SwitchLowering* sw, int first, int last) {
+    int count = 0;
+    for (int i = first; i <= last; i++) {
+        int seen = 0;
+        for (int j = first; j < i && !seen; j++) {
+            seen = sw->cases[j].target == sw->cases[i].target;
+        }
+        if (!seen) count++;
+    }
+    return count;
+}
+
+static void partition_switch_clusters(SwitchLowering* sw) {
+    int i = 0;
+    sw->cluster_count = 0;
+    while (i < sw->case_count) {
+        SwitchCluster* cluster = &sw->clusters[sw->cluster_count++];
+        int table_last = -1;
+        int bits_last = -1;
+        cluster->kind = CLUSTER_CASE;
+        cluster->first = i;
+        cluster->last = i;
+
+        // Widest run from i that is still dense enough for a table
+        for (int j = sw->case_count - 1; j >= i + SWITCH_MIN_TABLE - 1; j--) {
+            if ((long long)(j - i + 1) * 100 >= SWITCH_MIN_DENSITY * switch_span(sw, i, j)) {
+                table_last = j;
+                break;
+            }
+        }
+
+        // Widest run fitting in one 64-bit mask per target
+        for (int j = i + 1; j < sw->case_count && switch_span(sw, i, j) <= 64; j++) {
+            if (switch_distinct_targets(sw, i, j) > SWITCH_MAX_BIT_TARGETS) break;
+            if (j - i + 1 >= SWITCH_MIN_BIT_TEST) bits_last = j;
+        }
+
+        // Bit tests need no memory load, so they win when they cover as much
+        if (bits_last >= 0 && bits_last >= table_last) {
+            cluster->kind = CLUSTER_BITS;
+            cluster->last = bits_last;
+        } else if (table_last >= 0) {
+            cluster->kind = CLUSTER_TABLE;
+            cluster->last = table_last;
+        }
+        i = cluster->last + 1;
+    }
+}
+
+// Emits one cluster; values outside it continue at `miss`
+static void generate_switch_cluster(SwitchLowering* sw, SwitchCluster* cluster, const char* miss) {
+    SwitchCase* first = &sw->cases[cluster->first];
+    long long span = switch_span(sw, cluster->first, cluster->last);
+
+    if (cluster->kind == CLUSTER_CASE) {
+        printf("    cmp rax, %lld\n", first->value);
+        printf("    je .L_switch_%d_case_%d\n", sw->id, first->target);
+        return;
+    }
+
+    // Both forms rebase the value and bounds-check it with one unsigned compare
+    printf("    mov rcx, rax\n");
+    if (first->value != 0) printf("    sub rcx, %lld\n", first->value);
+    printf("    cmp rcx, %lld\n", span - 1);
+    printf("    ja %s\n", miss);
+
+    if (cluster->kind == CLUSTER_BITS) {
+        for (int i = cluster->first; i <= cluster->last; i++) {
+            int target = sw->cases[i].target;
+            unsigned long long mask = 0;
+            int emitted = 0;
+            for (int j = cluster->first; j < i && !emitted; j++) {
+                emitted = sw->cases[j].target == target;
+            }
+            if (emitted) continue;
+            for (int j = i; j <= cluster->last; j++) {
+                if (sw->cases[j].target == target) {
+                    mask |= 1ULL << (sw->cases[j].value - first->value);
+                }
+            }
+            printf("    mov rdx, 0x%llx\n", mask);
+            printf("    bt rdx, rcx\n");
+            printf("    jc .L_switch_%d_case_%d\n", sw->id, target);
+        }
+        printf("    jmp %s\n", miss);
+        return;
+    }
+
+    // Entries hold the target's offset from the entry itself. The tables
+    // need GAS (.section, `.long L - .`, rip-relative lea, movsxd); the
+    // stage-A assembler in src/asm handles none of them.
+    int table = sw->table_count++;
+    printf("    lea rdx, [rip + .L_switch_%d_table_%d]\n", sw->id, table);
+    printf("    lea rdx, [rdx+rcx*4]\n");
+    printf("    movsxd rcx, dword ptr [rdx]\n");
+    printf("    add rcx, rdx\n");
+    printf("    jmp rcx\n");
+    printf(".section .rodata\n");
+    printf("    .p2align 2\n");
+    printf(".L_switch_%d_table_%d:\n", sw->id, table);
+    int next = cluster->first;
+    for (long long v = first->value; v <= sw->cases[cluster->last].value; v++) {
+        if (next <= cluster->last && sw->cases[next].value == v) {
+            printf("    .long .L_switch_%d_case_%d - .\n", sw->id, sw->cases[next++].target);
+        } else {
+            printf("    .long %s - .\n", sw->default_label);
+        }
+    }
+    printf(".text\n");
+}
+
+// Balanced decision tree over clusters[lo..hi]
+static void generate_switch_tree(SwitchLowering* sw, int lo, int hi) {
+    char miss[48];
+
+    if (hi - lo < 3) {
+        for (int c = lo; c <= hi; c++) {
+            if (c == hi) {
+                generate_switch_cluster(sw, &sw->clusters[c], sw->default_label);
+                break;
+            }
+            snprintf(miss, sizeof(miss), ".L_switch_%d_node_%d", sw->id, sw->node_count++);
+            generate_switch_cluster(sw, &sw->clusters[c], miss);
+            if (sw->clusters[c].kind != CLUSTER_CASE) printf("%s:\n", miss);
+        }
+        if (sw->clusters[hi].kind == CLUSTER_CASE) printf("    jmp %s\n", sw->default_label);
+        return;
+    }
+
+    int mid = (lo + hi + 1) / 2;
+    int node = sw->node_count++;
+    printf("    cmp rax, %lld\n", sw->cases[sw->clusters[mid].first].value);
+    printf("    jl .L_switch_%d_node_%d\n", sw->id, node);
+    generate_switch_tree(sw, mid, hi);
+    printf(".L_switch_%d_node_%d:\n", sw->id, node);
+    generate_switch_tree(sw, lo, mid - 1);
+}
+
+static void generate_switch(ASTNode* stmt) {
+    static int switch_count = 0;
+    static SwitchLowering sw;
+    ASTNode* body = stmt->data.switch_stmt.body;
+    int id = switch_count++;
+    int has_default = 0;
+
+    // Cases with an empty body fall through, so they share the next label
+    sw.id = id;
+    sw.case_count = 0;
+    sw.table_count = 0;
+    sw.node_count = 0;
+    for (int i = 0; i < body->data.block.count; i++) {
+        ASTNode* entry = body->data.block.statements[i];
+        if (entry->type == AST_DEFAULT) has_default = 1;
+        if (entry->type != AST_CASE) continue;
+
+        // The parser rejected non-constant and duplicate values. Only case
+        // labels are chained: an empty case before default or before a
+        // plain statement keeps its own label and falls through to it.
+        int value = 0;
+        evaluate_constant_expression(entry->data.case_stmt.value, &value);
+        int target = i;
+        while (target + 1 < body->data.block.count &&
+               body->data.block.statements[target + 1]->type == AST_CASE &&
+               body->data.block.statements[target]->data.case_stmt.body->data.block.count == 0 &&
+               !body->data.block.statements[target]->data.case_stmt.breaks) {
+            target++;
+        }
+        if (sw.case_count >= SWITCH_MAX_CASES) continue;
+        sw.cases[sw.case_count].value = value;
+        sw.cases[sw.case_count].target = target;
+        sw.case_count++;
+    }
+    if (has_default) {
+        snprintf(sw.default_label, sizeof(sw.default_label), ".L_switch_%d_default", id);
+    } else {
+        snprintf(sw.default_label, sizeof(sw.default_label), ".L_switch_%d_end", id);
+    }
+
+    qsort(sw.cases, sw.case_count, sizeof(SwitchCase), compare_switch_cases);
+    partition_switch_clusters(&sw);
+    printf("    ;; switch: %d cases in %d clusters\n", sw.case_count, sw.cluster_count);
+
+    generate_expression(stmt->data.switch_stmt.expression);
+    if (sw.cluster_count > 0) {
+        generate_switch_tree(&sw, 0, sw.cluster_count - 1);
+    } else {
+        printf("    jmp %s\n", sw.default_label);
+    }
+
+    // Bodies in source order, so fall-through between them is preserved
+    for (int i = 0; i < body->data.block.count; i++) {
+        ASTNode* entry = body->data.block.statements[i];
+        if (entry->type == AST_CASE || entry->type == AST_DEFAULT) {
+            if (entry->type == AST_CASE) {
+                printf(".L_switch_%d_case_%d:\n", id, i);
+            } else {
+                printf(".L_switch_%d_default:\n", id);
+            }
+            generate_statement(entry->data.case_stmt.body);
+            if (entry->data.case_stmt.breaks) printf("    jmp .L_switch_%d_end\n", id);
+        } else {
+            generate_statement(entry);
+        }
+    }
+    printf(".L_switch_%d_end:\n", id);
+}
+
 void generate_statement(ASTNode* stmt) {
     if (stmt->type == AST_VAR_DECL) {
         printf("    ;; int %s", stmt->data.var_decl.var_name);
@@ -1454,9 +1937,8 @@ void generate_statement(ASTNode* stmt) {
         sprintf(else_label, ".L_else_%d", current_if);
         sprintf(end_label, ".L_end_%d", current_if);
 
-        generate_expression(stmt->data.if_stmt.condition);
-        printf("    test rax, rax\n");
-        printf("    jz %s\n", stmt->data.if_stmt.else_branch ? else_label : end_label);
+        generate_jump_if(stmt->data.if_stmt.condition, 0,
+                         stmt->data.if_stmt.else_branch ? else_label : end_label);
 
         generate_statement(stmt->data.if_stmt.then_branch);
 
@@ -1476,9 +1958,7 @@ void generate_statement(ASTNode* stmt) {
         sprintf(end_label, ".L_while_end_%d", current_while);
 
         printf("%s:\n", start_label);
-        generate_expression(stmt->data.while_stmt.condition);
-        printf("    test rax, rax\n");
-        printf("    jz %s\n", end_label);
+        generate_jump_if(stmt->data.while_stmt.condition, 0, end_label);
 
         generate_statement(stmt->data.while_stmt.body);
         printf("    jmp %s\n", start_label);
@@ -1523,15 +2003,7 @@ void generate_statement(ASTNode* stmt) {
     } else if (stmt->type == AST_STRUCT_DECL) {
         printf("    ;; struct %s declaration (simplified)\n", stmt->data.struct_decl.struct_name);
     } else if (stmt->type == AST_SWITCH) {
-        printf("    ;; switch statement (simplified)\n");
-        generate_expression(stmt->data.switch_stmt.expression);
-        printf("    ;; switch body\n");
-        generate_statement(stmt->data.switch_stmt.body);
-    } else if (stmt->type == AST_CASE) {
-        printf("    ;; case ");
-        generate_expression(stmt->data.case_stmt.value);
-        printf(":\n");
-        generate_statement(stmt->data.case_stmt.body);
+        generate_switch(stmt);
     } else if (stmt->type == AST_BREAK) {
         printf("    ;; break statement\n");
     } else if (stmt->type == AST_ATTRIBUTE) {
@@ -1763,8 +2235,9 @@ int main(int argc, char* argv[]) {
             tokenize(buffer);
             token_pos = 0;
 
+            parse_errors = 0;
             ASTNode* ast = parse_program();
-            if (!ast) {
+            if (!ast || parse_errors > 0) {
                 printf(";; Parse error in user program\n");
                 return 1;
             }
@@ -67,147 +67,147 @@ int get_symbol_offset(TinySymbolTable* symtab, const char* name) {
 }
 
 // Generate code for expressions
-static void generate_expression(TinyASTNode* node, FILE* output, TinySymbolTable* symtab) {
+static void generate_expression(TinyASTNode* node, EmitBuffer* output, TinySymbolTable* symtab) {
     switch (node->type) {
         case AST_NUM:
-            fprintf(output, "    mov rax, %d\n", node->data.num_value);
+            emit_format(output, "    mov rax, %d\n", node->data.num_value);
             break;
 
         case AST_VAR:
             {
                 int offset = get_symbol_offset(symtab, node->data.var_name);
                 if (offset != 0) {
-                    fprintf(output, "    mov rax, [rbp%+d]  ;; load %s\n",
+                    emit_format(output, "    mov rax, [rbp%+d]  ;; load %s\n",
                            offset, node->data.var_name);
                 } else {
-                    fprintf(output, "    ;; Variable %s not found\n", node->data.var_name);
-                    fprintf(output, "    mov rax, 0\n");
+                    emit_format(output, "    ;; Variable %s not found\n", node->data.var_name);
+                    emit_format(output, "    mov rax, 0\n");
                 }
             }
             break;
 
         case AST_DEREF:
             generate_expression(node->data.deref_expr, output, symtab);
-            fprintf(output, "    mov rax, [rax]  ;; dereference\n");
+            emit_format(output, "    mov rax, [rax]  ;; dereference\n");
             break;
 
         case AST_ADDR:
             {
                 int offset = get_symbol_offset(symtab, node->data.addr_var_name);
                 if (offset != 0) {
-                    fprintf(output, "    lea rax, [rbp%+d]  ;; address of %s\n",
+                    emit_format(output, "    lea rax, [rbp%+d]  ;; address of %s\n",
                            offset, node->data.addr_var_name);
                 } else {
-                    fprintf(output, "    ;; Variable %s not found for address\n",
+                    emit_format(output, "    ;; Variable %s not found for address\n",
                            node->data.addr_var_name);
-                    fprintf(output, "    mov rax, 0\n");
+                    emit_format(output, "    mov rax, 0\n");
                 }
             }
             break;
 
         case AST_FUNC_CALL:
             // Simple function calls without arguments
-            fprintf(output, "    call %s\n", node->data.func_call.name);
+            emit_format(output, "    call %s\n", node->data.func_call.name);
             break;
 
         case AST_BINARY_OP:
             // Generate right operand first (x86 convention)
             generate_expression(node->data.binary.right, output, symtab);
-            fprintf(output, "    push rax\n");
+            emit_format(output, "    push rax\n");
 
             // Generate left operand
             generate_expression(node->data.binary.left, output, symtab);
 
             // Perform operation
-            fprintf(output, "    pop rbx\n");
+            emit_format(output, "    pop rbx\n");
             switch (node->data.binary.op) {
                 case '+':
-                    fprintf(output, "    add rax, rbx\n");
+                    emit_format(output, "    add rax, rbx\n");
                     break;
                 case '-':
-                    fprintf(output, "    sub rax, rbx\n");
+                    emit_format(output, "    sub rax, rbx\n");
                     break;
                 case '*':
-                    fprintf(output, "    imul rax, rbx\n");
+                    emit_format(output, "    imul rax, rbx\n");
                     break;
                 case '/':
-                    fprintf(output, "    cqo\n");
-                    fprintf(output, "    idiv rbx\n");
+                    emit_format(output, "    cqo\n");
+                    emit_format(output, "    idiv rbx\n");
                     break;
                 case '<':
-                    fprintf(output, "    cmp rax, rbx\n");
-                    fprintf(output, "    setl al\n");
-                    fprintf(output, "    movzx rax, al\n");
+                    emit_format(output, "    cmp rax, rbx\n");
+                    emit_format(output, "    setl al\n");
+                    emit_format(output, "    movzx rax, al\n");
                     break;
                 case '>':
-                    fprintf(output, "    cmp rax, rbx\n");
-                    fprintf(output, "    setg al\n");
-                    fprintf(output, "    movzx rax, al\n");
+                    emit_format(output, "    cmp rax, rbx\n");
+                    emit_format(output, "    setg al\n");
+                    emit_format(output, "    movzx rax, al\n");
                     break;
                 case 'L': // <=
-                    fprintf(output, "    cmp rax, rbx\n");
-                    fprintf(output, "    setle al\n");
-                    fprintf(output, "    movzx rax, al\n");
+                    emit_format(output, "    cmp rax, rbx\n");
+                    emit_format(output, "    setle al\n");
+                    emit_format(output, "    movzx rax, al\n");
                     break;
                 case 'G': // >=
-                    fprintf(output, "    cmp rax, rbx\n");
-                    fprintf(output, "    setge al\n");
-                    fprintf(output, "    movzx rax, al\n");
+                    emit_format(output, "    cmp rax, rbx\n");
+                    emit_format(output, "    setge al\n");
+                    emit_format(output, "    movzx rax, al\n");
                     break;
                 case 'E': // ==
-                    fprintf(output, "    cmp rax, rbx\n");
-                    fprintf(output, "    sete al\n");
-                    fprintf(output, "    movzx rax, al\n");
+                    emit_format(output, "    cmp rax, rbx\n");
+                    emit_format(output, "    sete al\n");
+                    emit_format(output, "    movzx rax, al\n");
                     break;
                 default:
-                    fprintf(output, "    ;; Unsupported operator: %c\n", node->data.binary.op);
+                    emit_format(output, "    ;; Unsupported operator: %c\n", node->data.binary.op);
             }
             break;
 
         default:
-            fprintf(output, "    ;; Unsupported expression type\n");
+            emit_format(output, "    ;; Unsupported expression type\n");
     }
 }
 
 // Generate code for statements
-static void generate_statement(TinyASTNode* node, FILE* output, TinySymbolTable* symtab) {
+static void generate_statement(TinyASTNode* node, EmitBuffer* output, TinySymbolTable* symtab) {
     switch (node->type) {
         case AST_RETURN:
             generate_expression(node->data.return_expr, output, symtab);
-            fprintf(output, "    mov rsp, rbp\n");
-            fprintf(output, "    pop rbp\n");
-            fprintf(output, "    ret\n");
+            emit_format(output, "    mov rsp, rbp\n");
+            emit_format(output, "    pop rbp\n");
+            emit_format(output, "    ret\n");
             break;
 
         case AST_VAR_DECL:
             {
                 int offset = add_symbol(symtab, node->data.var_decl.var_name,
                                        node->data.var_decl.var_type);
-                fprintf(output, "    ;; Declare variable %s at [rbp%+d]\n",
+                emit_format(output, "    ;; Declare variable %s at [rbp%+d]\n",
                        node->data.var_decl.var_name, offset);
 
                 if (node->data.var_decl.initializer) {
                     generate_expression(node->data.var_decl.initializer, output, symtab);
-                    fprintf(output, "    mov [rbp%+d], rax  ;; initialize %s\n",
+                    emit_format(output, "    mov [rbp%+d], rax  ;; initialize %s\n",
                            offset, node->data.var_decl.var_name);
                 }
             }
             break;
 
         default:
-            fprintf(output, "    ;; Unsupported statement type\n");
+            emit_format(output, "    ;; Unsupported statement type\n");
     }
 }
 
 // Generate code for function definition
-static void generate_function(TinyASTNode* node, FILE* output, TinySymbolTable* symtab) {
-    fprintf(output, ";; Function: %s\n", node->data.func_def.name);
-    fprintf(output, "global %s\n", node->data.func_def.name);
-    fprintf(output, "%s:\n", node->data.func_def.name);
+static void generate_function(TinyASTNode* node, EmitBuffer* output, TinySymbolTable* symtab) {
+    emit_format(output, ";; Function: %s\n", node->data.func_def.name);
+    emit_format(output, "global %s\n", node->data.func_def.name);
+    emit_format(output, "%s:\n", node->data.func_def.name);
 
     // Function prologue
-    fprintf(output, "    push rbp\n");
-    fprintf(output, "    mov rbp, rsp\n");
+    emit_format(output, "    push rbp\n");
+    emit_format(output, "    mov rbp, rsp\n");
 
     // Initialize symbol table for this function
     init_symbol_table(symtab);
@@ -216,25 +216,25 @@ static void generate_function(TinyASTNode* node, FILE* output, TinySymbolTable*
     generate_statement(node->data.func_def.body, output, symtab);
 
     // Function epilogue (only if not already done by return)
-    fprintf(output, "    mov rsp, rbp\n");
-    fprintf(output, "    pop rbp\n");
-    fprintf(output, "    ret\n");
-    fprintf(output, "\n");
+    emit_format(output, "    mov rsp, rbp\n");
+    emit_format(output, "    pop rbp\n");
+    emit_format(output, "    ret\n");
+    emit_format(output, "\n");
 
     // Clean up symbol table
     free_symbol_table(symtab);
 }
 
 // Main code generation function
-void tiny_generate_code(TinyASTNode* ast, FILE* output, TinySymbolTable* symtab) {
+void tiny_generate_code(TinyASTNode* ast, EmitBuffer* output, TinySymbolTable* symtab) {
     if (!ast) return;
 
     // Generate NASM header
-    fprintf(output, ";; ALETHEIA TinyCC-ALE Output\n");
-    fprintf(output, ";; Extended C compiler with types\n");
-    fprintf(output, "\n");
-    fprintf(output, "section .text\n");
-    fprintf(output, "\n");
+    emit_format(output, ";; ALETHEIA TinyCC-ALE Output\n");
+    emit_format(output, ";; Extended C compiler with types\n");
+    emit_format(output, "\n");
+    emit_format(output, "section .text\n");
+    emit_format(output, "\n");
 
     // Generate code based on AST type
     switch (ast->type) {
@@ -243,19 +243,19 @@ void tiny_generate_code(TinyASTNode* ast, FILE* output, TinySymbolTable* symtab)
             break;
 
         default:
-            fprintf(output, ";; Unsupported AST root type\n");
+            emit_format(output, ";; Unsupported AST root type\n");
     }
 
     // Add program entry point if this is a main function
     if (ast->type == AST_FUNC_DEF &&
         strcmp(ast->data.func_def.name, "main") == 0) {
-        fprintf(output, ";; Program entry point\n");
-        fprintf(output, "global _start\n");
-        fprintf(output, "_start:\n");
-        fprintf(output, "    call main\n");
-        fprintf(output, "    mov rdi, rax\n");
-        fprintf(output, "    mov rax, 60  ; sys_exit\n");
-        fprintf(output, "    syscall\n");
+        emit_format(output, ";; Program entry point\n");
+        emit_format(output, "global _start\n");
+        emit_format(output, "_start:\n");
+        emit_format(output, "    call main\n");
+        emit_format(output, "    mov rdi, rax\n");
+        emit_format(output, "    mov rax, 60  ; sys_exit\n");
+        emit_format(output, "    syscall\n");
     }
 }
 
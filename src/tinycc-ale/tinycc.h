@@ -11,6 +11,8 @@
 #ifndef TINYCC_H
 #define TINYCC_H
 
+#include "emit.h"
+
 // Extended token types for TinyCC-ALE
 typedef enum {
     TOK_EOF = 0,
@@ -181,7 +183,7 @@ typedef struct {
 // Function declarations
 TinyToken* tiny_tokenize(const char* source);
 TinyASTNode* tiny_parse(TinyToken* tokens);
-void tiny_generate_code(TinyASTNode* ast, FILE* output, TinySymbolTable* symtab);
+void tiny_generate_code(TinyASTNode* ast, EmitBuffer* output, TinySymbolTable* symtab);
 void tiny_free_ast(TinyASTNode* node);
 void tiny_free_symbol_table(TinySymbolTable* symtab);
 
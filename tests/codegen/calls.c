@@ -0,0 +1,24 @@
+/* Expected exit code: 55 */
+/* Recursion and calls with several arguments: values in the argument
+   registers must survive the nested calls around them. */
+
+int fib(int n) {
+    if (n < 2) return n;
+    return fib(n - 1) + fib(n - 2);
+}
+
+int add3(int a, int b, int c) {
+    return a + b + c;
+}
+
+int weigh(int a, int b, int c, int d) {
+    return add3(a * 4, b * 3, c * 2) + d;
+}
+
+int main(void) {
+    int base = fib(10);                 /* 55 */
+    int w = weigh(1, 2, 3, 4);          /* 4 + 6 + 6 + 4 = 20 */
+    if (w != 20) return 1;
+    if (add3(w, -w, base) != base) return 2;
+    return base;
+}
@@ -0,0 +1,22 @@
+/* Expected exit code: 33 */
+/* Early returns on a guard before any work is done. */
+
+int guarded(int p, int n) {
+    if (!p) return 0;
+    int sum = 0;
+    for (int i = 0; i < n; i++) sum += p;
+    return sum;
+}
+
+int clamp(int x, int lo, int hi) {
+    if (x < lo) return lo;
+    if (x > hi) return hi;
+    return x;
+}
+
+int main(void) {
+    if (guarded(0, 5) != 0) return 1;
+    if (clamp(-4, 0, 10) != 0) return 2;
+    if (clamp(40, 0, 10) != 10) return 3;
+    return guarded(3, 7) + clamp(12, 0, 12);   /* 21 + 12 = 33 */
+}
@@ -0,0 +1,32 @@
+/* Expected exit code: 0 */
+/* Assembly: movsxd rcx, dword ptr [rdi + rsi*4 + 8] */
+/* Assembly: [rsi + 8] */
+/* Assembly: [rdi + 24] */
+/* Assembly: dword ptr [rdi + rcx*4] */
+/* Array elements are loaded at the width of what the pointer points to:
+   an int element is a sign-extended dword four bytes from the next, a long
+   or a pointer a full word eight bytes on. The int loop stays scalar, as
+   the vector adds only take 8-byte lanes. Nothing here can point to
+   memory when the program runs, so only main is called. */
+
+int third(int *a, long i) {
+    return a[i + 2];
+}
+
+long pick(long *b, int **c, long i) {
+    return b[i] + c[1] - b[3];
+}
+
+int sum(int *a, int n) {
+    int s = 0;
+    int i = 0;
+    while (i < n) {
+        s = s + a[i];
+        i = i + 1;
+    }
+    return s;
+}
+
+int main(void) {
+    return 0;
+}
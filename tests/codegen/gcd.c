@@ -0,0 +1,22 @@
+/* Expected exit code: 21 */
+/* Euclid with the remainder operator, iterative and recursive. */
+
+int gcd(int a, int b) {
+    while (b != 0) {
+        int t = b;
+        b = a % b;
+        a = t;
+    }
+    return a;
+}
+
+int gcd_rec(int a, int b) {
+    if (b == 0) return a;
+    return gcd_rec(b, a % b);
+}
+
+int main(void) {
+    if (gcd(1071, 462) != 21) return 1;
+    if (gcd_rec(462, 1071) != 21) return 2;
+    return gcd(gcd(3 * 7 * 11, 7 * 13 * 3), 21 * 5);
+}
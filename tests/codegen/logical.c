@@ -0,0 +1,25 @@
+/* Expected exit code: 7 */
+/* && and || short-circuit, both as branch conditions and as values: the
+   right operand must not run when the left decides. */
+
+int count(int x) {
+    return x;
+}
+
+int in_range(int x, int lo, int hi) {
+    return x >= lo && x <= hi;
+}
+
+int main(void) {
+    int n = 0;
+    int zero = 0;
+    if (zero && 1 / zero) return 1;
+    if (!(1 || 1 / zero)) return 2;
+    if (in_range(5, 1, 9)) n++;
+    if (!in_range(15, 1, 9)) n++;
+    if (in_range(1, 1, 1) || count(0)) n++;
+    n = n + (count(0) || count(4));
+    n = n + (count(2) && count(0));
+    if (n == 4 && in_range(n, 4, 4)) n = n + 3;
+    return n;
+}
@@ -0,0 +1,18 @@
+/* Expected exit code: 0 */
+/* Constants past 32 bits must reach the code whole, and the ends of the
+   int range still fit an int. */
+
+long scale(long x, long unit) {
+    return x / unit;
+}
+
+int main() {
+    long big = 4000000000;
+    int low = -2147483648;
+    int high = 2147483647;
+
+    if (scale(big, 1000000000) != 4) return 1;
+    if (big + 0x100000000 != 8294967296) return 2;
+    if (low + high != -1) return 3;
+    return 0;
+}
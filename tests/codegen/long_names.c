@@ -0,0 +1,12 @@
+/* Expected exit code: 0 */
+/* Symbols longer than any fixed operand buffer must come through the
+   peephole pass whole, in calls and in the branches to their labels. */
+
+int a_function_name_well_past_sixty_four_characters_to_check_the_peephole_pass(int n) {
+    if (n <= 1) return n;
+    return a_function_name_well_past_sixty_four_characters_to_check_the_peephole_pass(n - 1) + 1;
+}
+
+int main() {
+    return a_function_name_well_past_sixty_four_characters_to_check_the_peephole_pass(10) != 10;
+}
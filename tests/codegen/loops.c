@@ -0,0 +1,40 @@
+/* Expected exit code: 95 */
+/* Nested loops with break and continue, counted both up and down. */
+
+int triangle(int n) {
+    int sum = 0;
+    for (int i = 1; i <= n; i++) {
+        sum += i;
+    }
+    return sum;
+}
+
+int skip_odd(int n) {
+    int sum = 0;
+    int i = 0;
+    while (i < n) {
+        i = i + 1;
+        if (i % 2) continue;
+        if (i > 12) break;
+        sum = sum + i;
+    }
+    return sum;
+}
+
+int grid(int rows, int cols) {
+    int count = 0;
+    for (int r = 0; r < rows; r++) {
+        for (int c = cols; c > 0; c--) {
+            if (c == r) break;
+            count++;
+        }
+    }
+    return count;
+}
+
+int main(void) {
+    int t = triangle(10);               /* 55 */
+    int s = skip_odd(100);              /* 2 + 4 + ... + 12 = 42 */
+    int g = grid(4, 3);                 /* 3 + 2 + 1 + 0 = 6 */
+    return t + s - g + 4;               /* 55 + 42 - 6 + 4 = 95 */
+}
@@ -0,0 +1,8 @@
+/* Expected error: 'char' is not supported */
+/* char, short, unsigned and _Bool would be lowered as 64-bit signed
+   values, so the compiler must refuse them rather than skip the wrap. */
+
+int main() {
+    char c = 300;
+    return c != 44;
+}
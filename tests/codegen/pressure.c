@@ -0,0 +1,33 @@
+/* Expected exit code: 88 */
+/* More values live across calls than there are callee-saved registers, so
+   some must be saved around the calls or spilled, and every one must come
+   back intact. */
+
+int id(int x) {
+    return x;
+}
+
+int spread(int seed) {
+    int a = seed + 1;
+    int b = seed + 2;
+    int c = seed + 3;
+    int d = seed + 4;
+    int e = seed + 5;
+    int f = seed + 6;
+    int g = seed + 7;
+    int h = seed + 8;
+    int k = id(seed);
+    a = a + id(a);
+    b = b + id(b);
+    c = c + id(c);
+    d = d + id(d);
+    e = e + id(e);
+    f = f + id(f);
+    g = g + id(g);
+    h = h + id(h);
+    return a + b + c + d + e + f + g + h + k - 8 * seed;
+}
+
+int main(void) {
+    return spread(5) - 29;              /* 2 * (6 + ... + 13) + 5 - 40 - 29 = 88 */
+}
@@ -0,0 +1,122 @@
+#!/bin/bash
+
+# ALETHEIA code generation tests
+# Compiles every program in this directory at -O0 to -O3, runs it and
+# compares its exit code with the "Expected exit code" line at its top.
+# The programs are linked for x86-64 and run natively. Functions listed on a
+# "Shrink-wrapped:" line must return before their prologue from -O1 on, and
+# text on an "Assembly:" line must appear in the -O2 assembly.
+# Programs headed "Expected error" instead must fail to compile at every
+# level with that message.
+# Assembly and executables must come out the same on one thread and on
+# several, and the assembly must hold code for the program and define
+# every label it calls or jumps to.
+
+cd "$(dirname "$0")"
+COMPILER="${1:-../../src/aletheia-full/aletheia-full}"
+WORK_DIR="$(mktemp -d)"
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+if [ ! -x "$COMPILER" ]; then
+    echo "Compiler not found: $COMPILER"
+    exit 1
+fi
+if [ "$(uname -m)" != "x86_64" ]; then
+    echo "SKIP: the test programs run natively on x86-64 only"
+    exit 0
+fi
+
+passed=0
+failed=0
+for source in *.c; do
+    error=$(sed -n '1s/.*Expected error: \(.*[^ ]\) *\*\/.*/\1/p' "$source")
+    if [ -n "$error" ]; then
+        for level in 0 1 2 3; do
+            if "$COMPILER" "-O$level" "$source" "$WORK_DIR/rejected" >"$WORK_DIR/log" 2>&1; then
+                echo "FAIL $source -O$level: compiled, expected an error"
+                failed=$((failed + 1))
+            elif ! grep -qF "$error" "$WORK_DIR/log"; then
+                echo "FAIL $source -O$level: no \"$error\" error"
+                failed=$((failed + 1))
+            else
+                passed=$((passed + 1))
+            fi
+        done
+        continue
+    fi
+
+    expected=$(sed -n '1s/.*Expected exit code: \([0-9]*\).*/\1/p' "$source")
+    if [ -z "$expected" ]; then
+        echo "FAIL $source: no expected exit code"
+        failed=$((failed + 1))
+        continue
+    fi
+
+    for level in 0 1 2 3; do
+        binary="$WORK_DIR/${source%.c}_O$level"
+        if ! "$COMPILER" "-O$level" "$source" "$binary" >"$WORK_DIR/log" 2>&1; then
+            echo "FAIL $source -O$level: compilation failed"
+            grep -i "error" "$WORK_DIR/log" | head -5
+            failed=$((failed + 1))
+            continue
+        fi
+
+        "$binary"
+        actual=$?
+        if [ "$actual" -eq "$expected" ]; then
+            passed=$((passed + 1))
+        else
+            echo "FAIL $source -O$level: exit code $actual, expected $expected"
+            failed=$((failed + 1))
+        fi
+    done
+
+    # Functions are emitted into per-job buffers and written in source order
+    for threads in 1 4; do
+        "$COMPILER" -O2 "-j$threads" -S "$source" "$WORK_DIR/asm" >"$WORK_DIR/j$threads.s" 2>/dev/null
+        "$COMPILER" -O2 "-j$threads" "$source" "$WORK_DIR/j$threads" >/dev/null 2>&1
+    done
+    if ! grep -q '^main:$' "$WORK_DIR/j1.s" || ! grep -q '^ret$' "$WORK_DIR/j1.s"; then
+        echo "FAIL $source: -S printed no code"
+        failed=$((failed + 1))
+    elif ! cmp -s "$WORK_DIR/j1.s" "$WORK_DIR/j4.s" || ! cmp -s "$WORK_DIR/j1" "$WORK_DIR/j4"; then
+        echo "FAIL $source: output differs between -j1 and -j4"
+        failed=$((failed + 1))
+    elif undefined=$(awk '/^[A-Za-z_.][A-Za-z0-9_.$]*:$/ { defined[substr($0, 1, length($0) - 1)] = 1 }
+                          /^\.set [A-Za-z_.]/ { defined[substr($2, 1, length($2) - 1)] = 1 }
+                          /^(call|j[a-z]+) [A-Za-z_.]/ { used[$2] = 1 }
+                          END { for (name in used) if (!(name in defined)) print name }' "$WORK_DIR/j1.s") &&
+         [ -n "$undefined" ]; then
+        echo "FAIL $source: -S branches to undefined symbols:" $undefined
+        failed=$((failed + 1))
+    else
+        passed=$((passed + 1))
+    fi
+
+    while IFS= read -r text; do
+        if grep -qF -- "$text" "$WORK_DIR/j1.s"; then
+            passed=$((passed + 1))
+        else
+            echo "FAIL $source: no \"$text\" in the -O2 assembly"
+            failed=$((failed + 1))
+        fi
+    done < <(sed -n 's/.*Assembly: \(.*[^ ]\) *\*\/.*/\1/p' "$source")
+
+    for function in $(sed -n 's/.*Shrink-wrapped: \([^*]*\).*/\1/p' "$source"); do
+        for level in 1 2 3; do
+            # First ret and first push of the function's own text
+            order=$("$COMPILER" "-O$level" -S "$source" "$WORK_DIR/asm" 2>/dev/null |
+                sed -n "/^$function:/,/^[A-Za-z_][A-Za-z0-9_]*:/p" |
+                grep -m1 -E '^(ret|push)')
+            if [ "$order" = "ret" ]; then
+                passed=$((passed + 1))
+            else
+                echo "FAIL $source -O$level: $function sets up its frame before the early return"
+                failed=$((failed + 1))
+            fi
+        done
+    done
+done
+
+echo "Code generation tests: $passed passed, $failed failed"
+[ "$failed" -eq 0 ]
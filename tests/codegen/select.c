@@ -0,0 +1,26 @@
+/* Expected exit code: 71 */
+/* Branches that assign a local become selects; an arm assigning two locals
+   must stay a branch. */
+
+int max(int a, int b) {
+    int m = a;
+    if (b > a) m = b;
+    return m;
+}
+
+int absdiff(int a, int b) {
+    int d;
+    if (a > b) d = a - b; else d = b - a;
+    return d;
+}
+
+int two(int a, int b) {
+    int x = 0;
+    int y = 0;
+    if (a < b) { x = 1; y = 2; }
+    return x * 10 + y;
+}
+
+int main(void) {
+    return max(3, 9) + absdiff(2, 7) * 10 + two(1, 2) + two(2, 1);   /* 9 + 50 + 12 + 0 */
+}
@@ -0,0 +1,20 @@
+/* Expected exit code: 21 */
+/* Shrink-wrapped: walk count */
+/* Non-leaf functions with an early exit: from -O1 on the guard's return
+   must leave before the prologue, although the parameters live across the
+   recursive calls on the other path. */
+
+int walk(int p, int n) {
+    if (!p) return 0;
+    return n + walk(p - 1, n);
+}
+
+int count(int n, int limit) {
+    if (n >= limit) return n;
+    n = n + count(n + 1, limit);
+    return n - 1;
+}
+
+int main(void) {
+    return walk(5, 3) + count(0, 4);   /* 15 + 6 = 21 */
+}
@@ -0,0 +1,12 @@
+/* Expected error: only 6 fit in registers */
+/* Arguments past the sixth go on the stack under System V, which is not
+   supported: the call and the definition must both be rejected instead of
+   dropping the extra arguments. */
+
+int f8(int a, int b, int c, int d, int e, int f, int g, int h) {
+    return h;
+}
+
+int main() {
+    return f8(1, 2, 3, 4, 5, 6, 7, 8) != 8;
+}
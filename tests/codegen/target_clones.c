@@ -0,0 +1,20 @@
+/* Expected exit code: 7 */
+/* Assembly: .globl total */
+/* Assembly: .type total, @gnu_indirect_function */
+/* A target_clones attribute after the declarator clones the function like
+   one before it. Callers go through the resolver's choice, and in
+   assembly the indirect function is a global symbol. */
+
+long total(long *a, long n) __attribute__((target_clones("avx2", "default"))) {
+    long s = 0;
+    long i = 0;
+    while (i < n) {
+        s = s + a[i];
+        i = i + 1;
+    }
+    return s + 7;
+}
+
+int main(void) {
+    return total(0, 0);
+}
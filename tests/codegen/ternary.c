@@ -0,0 +1,38 @@
+/* Expected exit code: 42 */
+/* Assembly: cmovg */
+/* The conditional operator runs only the chosen operand. A division by
+   zero or a load through a null pointer in the other one must not run
+   early, so those diamonds keep their branch; max and clamp become
+   selects. */
+
+long ratio(long a, long b) {
+    return b ? a / b : 0;
+}
+
+long first(long *p) {
+    return p ? p[0] : 5;
+}
+
+long max(long a, long b) {
+    return a > b ? a : b;
+}
+
+long clamp(long x, long lo, long hi) {
+    return x < lo ? lo : x > hi ? hi : x;
+}
+
+long sign(long x) {
+    long s = x < 0 ? 0 - 1 : x > 0;
+    return s;
+}
+
+int main(void) {
+    long total = 0;
+    if (ratio(7, 0) != 0 || ratio(12, 4) != 3) return 1;
+    if (first(0) != 5) return 2;
+    if (max(3, 9) != 9 || max(9, 3) != 9) return 3;
+    if (clamp(-5, 0, 10) != 0 || clamp(50, 0, 10) != 10 || clamp(4, 0, 10) != 4) return 4;
+    if (sign(-8) != -1 || sign(0) != 0 || sign(8) != 1) return 5;
+    total = (sign(3) ? 20 : 1) + (max(1, 2) == 2 ? 22 : 0);
+    return total ? total : 99;
+}
@@ -0,0 +1,15 @@
+/* Expected error: does not point to int, long or a pointer */
+/* Indexing scales by the size of what the variable points to, which
+   void and a plain long do not have. */
+
+long first(void *p) {
+    return p[0];
+}
+
+long second(long n, long i) {
+    return n[i];
+}
+
+int main(void) {
+    return 0;
+}
@@ -0,0 +1,96 @@
+// ALETHEIA encoder tests
+// Shared checks for the test_*_encoder.c programs. A case runs encoder
+// callbacks into one CodeBuffer, then expect_bytes resolves its labels,
+// compares the bytes with a reference encoding written as hex (as printed
+// by an assembler) and empties the buffer for the next case. Branch range
+// cases pad with nops and check single instructions with expect_bytes_at.
+
+#ifndef ALETHEIA_ENCODER_TEST_H
+#define ALETHEIA_ENCODER_TEST_H
+
+#include <stdio.h>
+#include <string.h>
+#include "backend.h"
+
+static int tests_run;
+static int tests_failed;
+
+static void print_bytes(const char* label, const uint8_t* bytes, size_t length) {
+    printf("    %s", label);
+    for (size_t i = 0; i < length; i++) printf(" %02x", bytes[i]);
+    printf("\n");
+}
+
+// Parses whitespace-separated hex bytes; returns the count, -1 on bad input
+static int parse_hex(const char* hex, uint8_t* bytes, int capacity) {
+    int count = 0;
+    unsigned value;
+    int used;
+
+    while (sscanf(hex, " %2x%n", &value, &used) == 1) {
+        if (count == capacity) return -1;
+        bytes[count++] = (uint8_t)value;
+        hex += used;
+    }
+    while (*hex == ' ') hex++;
+    return *hex ? -1 : count;
+}
+
+static void expect_true(const char* name, bool condition) {
+    tests_run++;
+    if (!condition) {
+        tests_failed++;
+        printf("FAIL %s\n", name);
+    }
+}
+
+// Compares the bytes at `offset` with `hex`; true when they match
+static bool match_bytes(const char* name, const CodeBuffer* buf, size_t offset, const char* hex,
+                        bool whole) {
+    uint8_t expected[256];
+    int length = parse_hex(hex, expected, (int)sizeof(expected));
+
+    if (length < 0) {
+        printf("FAIL %s: bad reference bytes\n", name);
+        return false;
+    }
+    if (offset + (size_t)length > buf->size || (whole && offset + (size_t)length != buf->size) ||
+        memcmp(buf->data + offset, expected, (size_t)length) != 0) {
+        size_t available = buf->size > offset ? buf->size - offset : 0;
+        size_t shown = whole ? available : available < (size_t)length ? available : (size_t)length;
+
+        printf("FAIL %s\n", name);
+        print_bytes("expected:", expected, (size_t)length);
+        print_bytes("got:     ", buf->data + offset, shown);
+        return false;
+    }
+    return true;
+}
+
+static void expect_bytes(const char* name, CodeBuffer* buf, const char* hex) {
+    bool resolved = mcode_resolve_labels(buf);
+
+    tests_run++;
+    if (!resolved) {
+        tests_failed++;
+        printf("FAIL %s: labels did not resolve\n", name);
+    } else if (!match_bytes(name, buf, 0, hex, true)) {
+        tests_failed++;
+    }
+    mcode_buffer_reset(buf);
+}
+
+// One instruction inside a longer, already resolved sequence
+static void expect_bytes_at(const char* name, const CodeBuffer* buf, size_t offset,
+                            const char* hex) {
+    tests_run++;
+    if (!match_bytes(name, buf, offset, hex, false)) tests_failed++;
+}
+
+// Prints the summary line run_tests.sh reads; nonzero exit on failure
+static int finish_tests(const char* target) {
+    printf("%s encoder: %d passed, %d failed\n", target, tests_run - tests_failed, tests_failed);
+    return tests_failed ? 1 : 0;
+}
+
+#endif // ALETHEIA_ENCODER_TEST_H
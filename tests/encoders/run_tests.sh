@@ -0,0 +1,41 @@
+#!/bin/bash
+
+# ALETHEIA encoder tests
+# Builds every test_<encoder>.c in this directory against the machine code
+# buffer and the matching encoder from src/backends, then runs it. Each
+# program compares encoder output with reference bytes, so they run on any
+# host.
+
+cd "$(dirname "$0")"
+BACKENDS=../../src/backends
+CC="${CC:-gcc}"
+WORK_DIR="$(mktemp -d)"
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+passed=0
+failed=0
+for source in test_*.c; do
+    name="${source%.c}"
+    encoder=$(find "$BACKENDS" -name "${name#test_}.c" | head -1)
+    if [ -z "$encoder" ]; then
+        echo "FAIL $source: no ${name#test_}.c in $BACKENDS"
+        failed=$((failed + 1))
+        continue
+    fi
+
+    if ! "$CC" -Wall -Wextra -std=c99 -I"$BACKENDS" -o "$WORK_DIR/$name" \
+        "$source" "$encoder" "$BACKENDS/mcode.c" >"$WORK_DIR/log" 2>&1; then
+        echo "FAIL $source: build failed"
+        head -20 "$WORK_DIR/log"
+        failed=$((failed + 1))
+        continue
+    fi
+    if "$WORK_DIR/$name"; then
+        passed=$((passed + 1))
+    else
+        failed=$((failed + 1))
+    fi
+done
+
+echo "Encoder tests: $passed passed, $failed failed"
+[ "$failed" -eq 0 ]
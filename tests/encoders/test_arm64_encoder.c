@@ -0,0 +1,210 @@
+// ALETHEIA ARM64 encoder tests
+// Reference bytes come from an assembler fed the instructions named by
+// each case. Branch cases check the offset fields at the edges of their
+// range; b and bl (+-128MB) are only checked near.
+
+#include "encoder_test.h"
+
+enum { X0, X1, X2, X3, X4, X5, X6, X7, X16 = 16, X17, X19 = 19, X20, X29 = 29, SP = 31 };
+
+static const MachineEncoder* enc = &arm64_encoder;
+
+static void emit_nops(CodeBuffer* buf, int count) {
+    for (int i = 0; i < count; i++) mcode_u32(buf, 0xD503201Fu);
+}
+
+static void test_frames(CodeBuffer* buf) {
+    enc->prologue(buf, 0);
+    expect_bytes("stp x29, x30, [sp, -16]!; mov x29, sp", buf, "fd 7b bf a9 fd 03 00 91");
+    enc->prologue(buf, 4100);
+    expect_bytes("prologue, sub sp, sp, #1, lsl #12; sub sp, sp, #16", buf,
+                 "fd 7b bf a9 fd 03 00 91 ff 07 40 d1 ff 43 00 d1");
+    enc->epilogue(buf, 8);
+    expect_bytes("add sp, sp, #16; ldp x29, x30, [sp], 16; ret", buf,
+                 "ff 43 00 91 fd 7b c1 a8 c0 03 5f d6");
+    enc->leaf_prologue(buf, 0);
+    enc->leaf_epilogue(buf, 0);
+    expect_bytes("leaf without a frame", buf, "c0 03 5f d6");
+}
+
+static void test_moves(CodeBuffer* buf) {
+    enc->mov(buf, X19, X0);
+    expect_bytes("mov x19, x0", buf, "f3 03 00 aa");
+    enc->mov(buf, SP, X29);
+    expect_bytes("mov sp, x29", buf, "bf 03 00 91");
+    enc->mov_imm(buf, X3, 65535);
+    expect_bytes("mov x3, #65535", buf, "e3 ff 9f d2");
+    enc->mov_imm(buf, X3, -65536);
+    expect_bytes("mov x3, #-65536 (movn)", buf, "e3 ff 9f 92");
+    enc->mov_imm(buf, 9, 0x0001000012345678L);
+    expect_bytes("movz x9, #0x5678; movk lsl #16; movk lsl #48", buf,
+                 "09 cf 8a d2 89 46 a2 f2 29 00 e0 f2");
+}
+
+static void test_arithmetic(CodeBuffer* buf) {
+    enc->add(buf, X0, X1, X2);
+    expect_bytes("add x0, x1, x2", buf, "20 00 02 8b");
+    enc->sub(buf, X0, X1, X2);
+    expect_bytes("sub x0, x1, x2", buf, "20 00 02 cb");
+    enc->mul(buf, X5, X6, X7);
+    expect_bytes("mul x5, x6, x7", buf, "c5 7c 07 9b");
+    enc->div(buf, X5, X6, X7);
+    expect_bytes("sdiv x5, x6, x7", buf, "c5 0c c7 9a");
+    enc->add_imm(buf, X2, X2, -8);
+    expect_bytes("sub x2, x2, #8", buf, "42 20 00 d1");
+    enc->add_imm(buf, X2, X3, 4095);
+    expect_bytes("add x2, x3, #4095", buf, "62 fc 3f 91");
+}
+
+static void test_memory(CodeBuffer* buf) {
+    enc->load(buf, MEM_WORD, X0, X29, 16);
+    expect_bytes("ldr x0, [x29, #16]", buf, "a0 0b 40 f9");
+    enc->load(buf, MEM_WORD, X0, X29, -8);
+    expect_bytes("ldur x0, [x29, #-8]", buf, "a0 83 5f f8");
+    enc->load(buf, MEM_S32, X1, X2, 4);
+    expect_bytes("ldrsw x1, [x2, #4]", buf, "41 04 80 b9");
+    enc->load(buf, MEM_U32, X1, X2, 6);
+    expect_bytes("ldur w1, [x2, #6] (unaligned)", buf, "41 60 40 b8");
+    enc->load(buf, MEM_S8, X1, X2, 0);
+    expect_bytes("ldrsb x1, [x2]", buf, "41 00 80 39");
+    enc->load(buf, MEM_U8, X1, X2, 4095);
+    expect_bytes("ldrb w1, [x2, #4095]", buf, "41 fc 7f 39");
+    enc->load(buf, MEM_WORD, X3, X3, 40000);
+    expect_bytes("mov x17, #40000; ldr x3, [x3, x17]", buf, "11 88 93 d2 63 68 71 f8");
+    enc->load(buf, MEM_WORD, X3, SP, 40000);
+    expect_bytes("mov x3, #40000; add x3, sp, x3, uxtx; ldr x3, [x3]", buf,
+                 "03 88 93 d2 e3 63 23 8b 63 00 40 f9");
+    enc->load_indexed(buf, MEM_WORD, X0, X1, X2, 3, 0);
+    expect_bytes("ldr x0, [x1, x2, lsl #3]", buf, "20 78 62 f8");
+    enc->load_indexed(buf, MEM_WORD, X0, X1, X2, 0, 0);
+    expect_bytes("ldr x0, [x1, x2]", buf, "20 68 62 f8");
+    enc->load_indexed(buf, MEM_S32, X0, X1, X2, 2, 8);
+    expect_bytes("add x0, x1, x2, lsl #2; ldrsw x0, [x0, #8]", buf, "20 08 02 8b 00 08 80 b9");
+
+    enc->store(buf, MEM_WORD, X0, X29, -256);
+    expect_bytes("stur x0, [x29, #-256]", buf, "a0 03 10 f8");
+    enc->store(buf, MEM_U8, X0, X29, -1);
+    expect_bytes("sturb w0, [x29, #-1]", buf, "a0 f3 1f 38");
+    enc->store(buf, MEM_S32, X0, SP, 8);
+    expect_bytes("str w0, [sp, #8]", buf, "e0 0b 00 b9");
+    enc->store(buf, MEM_WORD, X0, X29, 40000);
+    expect_bytes("mov x17, #40000; add x17, x29, x17; str x0, [x17]", buf,
+                 "11 88 93 d2 b1 03 11 8b 20 02 00 f9");
+
+    enc->store_pair(buf, X19, X20, SP, 16);
+    expect_bytes("stp x19, x20, [sp, #16]", buf, "f3 53 01 a9");
+    enc->load_pair(buf, X19, X20, X29, -512);
+    expect_bytes("ldp x19, x20, [x29, #-512]", buf, "b3 53 60 a9");
+    enc->store_pair(buf, X19, X20, SP, 1024);
+    expect_bytes("add x16, sp, #1024; stp x19, x20, [x16]", buf, "f0 03 10 91 13 52 00 a9");
+}
+
+static void test_compares(CodeBuffer* buf) {
+    enc->setcc(buf, COND_LT, X2, X0, X1);
+    expect_bytes("cmp x0, x1; cset x2, lt", buf, "1f 00 01 eb e2 a7 9f 9a");
+    enc->select(buf, COND_EQ, X3, X0, X1, X4, X5);
+    expect_bytes("cmp x0, x1; csel x3, x4, x5, eq", buf, "1f 00 01 eb 83 00 85 9a");
+    enc->select(buf, COND_GT, X3, X0, -1, X4, X5);
+    expect_bytes("cmp x0, #0; csel x3, x4, x5, gt", buf, "1f 00 00 f1 83 c0 85 9a");
+}
+
+static void test_branches(CodeBuffer* buf) {
+    int labels = mcode_new_labels(buf, 2);
+
+    mcode_bind(buf, labels);
+    enc->branch(buf, COND_LT, X0, X1, labels + 1);
+    enc->branch_zero(buf, COND_EQ, X3, labels + 1);
+    enc->branch_zero(buf, COND_LT, X3, labels + 1);
+    enc->branch_zero(buf, COND_GT, X5, labels);
+    enc->jmp(buf, labels);
+    mcode_bind(buf, labels + 1);
+    expect_bytes("b.lt +24; cbz +20; tbnz #63 +16; b.gt -20; b -24", buf,
+                 "1f 00 01 eb cb 00 00 54 a3 00 00 b4 83 00 f8 b7 "
+                 "bf 00 00 f1 6c ff ff 54 fa ff ff 17");
+}
+
+// tbz/tbnz reach +-32KB, cbz/cbnz and b.cond +-1MB, counted from the branch
+static void test_branch_ranges(CodeBuffer* buf) {
+    int label = mcode_new_labels(buf, 1);
+
+    enc->branch_zero(buf, COND_LT, X3, label);
+    emit_nops(buf, 8190);
+    mcode_bind(buf, label);
+    expect_true("tbnz +32764 resolves", mcode_resolve_labels(buf));
+    expect_bytes_at("tbnz x3, #63, +32764", buf, 0, "e3 ff fb b7");
+    mcode_buffer_reset(buf);
+
+    label = mcode_new_labels(buf, 1);
+    mcode_bind(buf, label);
+    emit_nops(buf, 8192);
+    enc->branch_zero(buf, COND_GE, X4, label);
+    expect_true("tbz -32768 resolves", mcode_resolve_labels(buf));
+    expect_bytes_at("tbz x4, #63, -32768", buf, 32768, "04 00 fc b6");
+    mcode_buffer_reset(buf);
+
+    // mcode reports the out of range branches on stderr
+    label = mcode_new_labels(buf, 1);
+    enc->branch_zero(buf, COND_LT, X3, label);
+    emit_nops(buf, 8191);
+    mcode_bind(buf, label);
+    expect_true("tbnz +32768 is out of range", !mcode_resolve_labels(buf));
+    mcode_buffer_reset(buf);
+
+    label = mcode_new_labels(buf, 1);
+    enc->branch_zero(buf, COND_EQ, X3, label);
+    emit_nops(buf, 262142);
+    mcode_bind(buf, label);
+    expect_true("cbz +1048572 resolves", mcode_resolve_labels(buf));
+    expect_bytes_at("cbz x3, +1048572", buf, 0, "e3 ff 7f b4");
+    mcode_buffer_reset(buf);
+
+    label = mcode_new_labels(buf, 1);
+    mcode_bind(buf, label);
+    emit_nops(buf, 262144);
+    enc->branch_zero(buf, COND_NE, X3, label);
+    expect_true("cbnz -1048576 resolves", mcode_resolve_labels(buf));
+    expect_bytes_at("cbnz x3, -1048576", buf, 1048576, "03 00 80 b5");
+    mcode_buffer_reset(buf);
+
+    label = mcode_new_labels(buf, 1);
+    enc->branch(buf, COND_LE, X0, X1, label);
+    emit_nops(buf, 262142);
+    mcode_bind(buf, label);
+    expect_true("b.le +1048572 resolves", mcode_resolve_labels(buf));
+    expect_bytes_at("b.le +1048572", buf, 4, "ed ff 7f 54");
+    mcode_buffer_reset(buf);
+
+    label = mcode_new_labels(buf, 1);
+    enc->branch(buf, COND_LE, X0, X1, label);
+    emit_nops(buf, 262143);
+    mcode_bind(buf, label);
+    expect_true("b.le +1048576 is out of range", !mcode_resolve_labels(buf));
+    mcode_buffer_reset(buf);
+}
+
+static void test_symbols(CodeBuffer* buf) {
+    enc->call(buf, "helper");
+    expect_true("bl records a branch26 relocation",
+                buf->num_relocs == 1 && strcmp(buf->relocs[0].symbol, "helper") == 0 &&
+                buf->relocs[0].offset == 0 && buf->relocs[0].kind == MCODE_A64_BRANCH26);
+    expect_bytes("bl helper", buf, "00 00 00 94");
+
+    enc->start(buf, "main");
+    expect_bytes("bl main; mov x8, #93; svc #0", buf, "00 00 00 94 a8 0b 80 d2 01 00 00 d4");
+}
+
+int main(void) {
+    CodeBuffer buf;
+
+    mcode_buffer_init(&buf);
+    test_frames(&buf);
+    test_moves(&buf);
+    test_arithmetic(&buf);
+    test_memory(&buf);
+    test_compares(&buf);
+    test_branches(&buf);
+    test_branch_ranges(&buf);
+    test_symbols(&buf);
+    mcode_buffer_free(&buf);
+    return finish_tests("ARM64");
+}
@@ -0,0 +1,335 @@
+// ALETHEIA RISC-V 64 encoder tests
+// Reference bytes come from an assembler fed the instructions named by
+// each case, with and without the C extension. Branch cases run the same
+// emit, relax and emit-again loop as ir_encode_function and check that each
+// branch keeps its short form up to the edge of its range and is widened
+// one step past it.
+
+#include "encoder_test.h"
+
+enum { ZERO, RA, SP, T0 = 5, S0 = 8, S1, A0, A1, A2, A3, A5 = 15, A7 = 17 };
+
+static const MachineEncoder* enc = &riscv64_encoder;
+
+// li a0 in the base ISA, with C and with Zba
+typedef struct {
+    long value;
+    const char* base;
+    const char* rvc;
+    const char* zba;
+} LiCase;
+
+static const LiCase li_cases[] = {
+    {5, "13 05 50 00", "15 45", "13 05 50 00"},
+    {0x7ff, "13 05 f0 7f", "13 05 f0 7f", "13 05 f0 7f"},
+    {0x800, "37 15 00 00 1b 05 05 80", "05 65 1b 05 05 80", "37 15 00 00 1b 05 05 80"},
+    {0x12345, "37 25 01 00 1b 05 55 34", "49 65 1b 05 55 34", "37 25 01 00 1b 05 55 34"},
+    {-2049, "37 f5 ff ff 1b 05 f5 7f", "7d 75 1b 05 f5 7f", "37 f5 ff ff 1b 05 f5 7f"},
+    {-4096, "37 f5 ff ff", "7d 75", "37 f5 ff ff"},
+    {0x80000000L, "13 05 10 00 13 15 f5 01", "05 45 7e 05", "13 05 10 00 13 15 f5 01"},
+    {0xffffffffL, "13 05 f0 ff 13 55 05 02", "7d 55 01 91", "13 05 f0 ff 13 55 05 02"},
+    {0xfffff000L, "37 05 10 00 1b 05 f5 ff 13 15 c5 00", "37 05 10 00 7d 35 32 05",
+     "37 f5 ff ff 3b 05 05 08"},
+    {0x100000000L, "13 05 10 00 13 15 05 02", "05 45 02 15", "13 05 10 00 13 15 05 02"},
+    {0x300000003L, "13 05 30 00 13 15 05 02 13 05 35 00", "0d 45 02 15 0d 05",
+     "13 05 30 00 13 15 05 02 13 05 35 00"},
+    {0x7fffffffffffffffL, "13 05 f0 ff 13 55 15 00", "7d 55 05 81", "13 05 f0 ff 13 55 15 00"},
+    {0x123456789abcdef0L,
+     "37 75 24 00 1b 05 d5 8a 13 15 e5 00 13 05 d5 c4 13 15 c5 00 13 05 75 5e 13 15 d5 00 "
+     "13 05 05 ef",
+     "37 75 24 00 1b 05 d5 8a 3a 05 13 05 d5 c4 32 05 13 05 75 5e 36 05 13 05 05 ef",
+     "37 75 24 00 1b 05 d5 8a 13 15 e5 00 13 05 d5 c4 13 15 c5 00 13 05 75 5e 13 15 d5 00 "
+     "13 05 05 ef"},
+};
+
+static void test_li(CodeBuffer* buf) {
+    char name[64];
+
+    for (size_t i = 0; i < sizeof(li_cases) / sizeof(li_cases[0]); i++) {
+        const LiCase* c = &li_cases[i];
+
+        snprintf(name, sizeof(name), "li a0, %#lx", c->value);
+        buf->features = 0;
+        enc->mov_imm(buf, A0, c->value);
+        expect_bytes(name, buf, c->base);
+
+        snprintf(name, sizeof(name), "li a0, %#lx (C)", c->value);
+        buf->features = TARGET_FEATURE_RVC;
+        enc->mov_imm(buf, A0, c->value);
+        expect_bytes(name, buf, c->rvc);
+
+        snprintf(name, sizeof(name), "li a0, %#lx (Zba)", c->value);
+        buf->features = TARGET_FEATURE_ZBA;
+        enc->mov_imm(buf, A0, c->value);
+        expect_bytes(name, buf, c->zba);
+    }
+}
+
+static void test_base_forms(CodeBuffer* buf) {
+    buf->features = 0;
+    enc->prologue(buf, 0);
+    expect_bytes("addi sp, sp, -16; sd ra, 8(sp); sd s0, 0(sp); addi s0, sp, 16", buf,
+                 "13 01 01 ff 23 34 11 00 23 30 81 00 13 04 01 01");
+    enc->leaf_prologue(buf, 20);
+    expect_bytes("addi sp, sp, -32", buf, "13 01 01 fe");
+    enc->leaf_prologue(buf, 4096);
+    expect_bytes("lui t0, 0xfffff; add sp, sp, t0", buf, "b7 f2 ff ff 33 01 51 00");
+    enc->epilogue(buf, 0);
+    expect_bytes("ld s0, 0(sp); ld ra, 8(sp); addi sp, sp, 16; ret", buf,
+                 "03 34 01 00 83 30 81 00 13 01 01 01 67 80 00 00");
+
+    enc->mov(buf, A0, A1);
+    expect_bytes("mv a0, a1", buf, "13 85 05 00");
+    enc->add(buf, A0, A0, A1);
+    expect_bytes("add a0, a0, a1", buf, "33 05 b5 00");
+    enc->sub(buf, S0, S0, S1);
+    expect_bytes("sub s0, s0, s1", buf, "33 04 94 40");
+    enc->mul(buf, A0, A1, A2);
+    expect_bytes("mul a0, a1, a2", buf, "33 85 c5 02");
+    enc->div(buf, A0, A1, A2);
+    expect_bytes("div a0, a1, a2", buf, "33 c5 c5 02");
+    enc->add_imm(buf, A0, A0, -8);
+    expect_bytes("addi a0, a0, -8", buf, "13 05 85 ff");
+
+    enc->load(buf, MEM_WORD, A0, SP, 16);
+    expect_bytes("ld a0, 16(sp)", buf, "03 35 01 01");
+    enc->load(buf, MEM_S32, A0, S1, 4);
+    expect_bytes("lw a0, 4(s1)", buf, "03 a5 44 00");
+    enc->load(buf, MEM_WORD, A0, SP, 2048);
+    expect_bytes("li t0, 2048; add t0, t0, sp; ld a0, 0(t0)", buf,
+                 "b7 12 00 00 9b 82 02 80 b3 82 22 00 03 b5 02 00");
+    enc->store(buf, MEM_WORD, A0, SP, 504);
+    expect_bytes("sd a0, 504(sp)", buf, "23 3c a1 1e");
+    enc->store(buf, MEM_U32, S1, S0, 8);
+    expect_bytes("sw s1, 8(s0)", buf, "23 24 94 00");
+    enc->load_indexed(buf, MEM_WORD, A0, A0, A1, 3, 8);
+    expect_bytes("slli t0, a1, 3; add t0, t0, a0; ld a0, 8(t0)", buf,
+                 "93 92 35 00 b3 82 a2 00 03 b5 82 00");
+}
+
+// The same operations where a 16-bit form exists, and some where none does
+static void test_compressed_forms(CodeBuffer* buf) {
+    buf->features = TARGET_FEATURE_RVC;
+    enc->prologue(buf, 0);
+    expect_bytes("c.addi sp, -16; c.sdsp ra, 8; c.sdsp s0, 0; c.addi4spn s0, sp, 16", buf,
+                 "41 11 06 e4 22 e0 00 08");
+    enc->leaf_prologue(buf, 4096);
+    expect_bytes("c.lui t0, 0xfffff; c.add sp, t0", buf, "fd 72 16 91");
+    enc->epilogue(buf, 0);
+    expect_bytes("c.ldsp s0, 0; c.ldsp ra, 8; c.addi sp, 16; c.jr ra", buf,
+                 "02 64 a2 60 41 01 82 80");
+
+    enc->mov(buf, A0, A1);
+    expect_bytes("c.mv a0, a1", buf, "2e 85");
+    enc->add(buf, A0, A0, A1);
+    expect_bytes("c.add a0, a1", buf, "2e 95");
+    enc->add(buf, A0, A1, A2);
+    expect_bytes("add a0, a1, a2 (no C form)", buf, "33 85 c5 00");
+    enc->sub(buf, S0, S0, S1);
+    expect_bytes("c.sub s0, s1", buf, "05 8c");
+    enc->sub(buf, A0, A1, A2);
+    expect_bytes("sub a0, a1, a2 (no C form)", buf, "33 85 c5 40");
+    enc->mul(buf, S0, S0, S1);
+    expect_bytes("mul s0, s0, s1 (no C form)", buf, "33 04 94 02");
+    enc->add_imm(buf, A0, A0, -8);
+    expect_bytes("c.addi a0, -8", buf, "61 15");
+    enc->add_imm(buf, A5, SP, 24);
+    expect_bytes("c.addi4spn a5, sp, 24", buf, "3c 08");
+    enc->add_imm(buf, S1, SP, 1020);
+    expect_bytes("c.addi4spn s1, sp, 1020", buf, "e4 1f");
+
+    enc->load(buf, MEM_WORD, A0, SP, 16);
+    expect_bytes("c.ldsp a0, 16(sp)", buf, "42 65");
+    enc->load(buf, MEM_WORD, A0, S1, 16);
+    expect_bytes("c.ld a0, 16(s1)", buf, "88 68");
+    enc->load(buf, MEM_S32, A0, S1, 4);
+    expect_bytes("c.lw a0, 4(s1)", buf, "c8 40");
+    enc->load(buf, MEM_U32, A0, S1, 4);
+    expect_bytes("lwu a0, 4(s1) (no C form)", buf, "03 e5 44 00");
+    enc->load(buf, MEM_U8, A0, S1, 0);
+    expect_bytes("lbu a0, 0(s1) (no C form)", buf, "03 c5 04 00");
+    enc->load(buf, MEM_S8, A0, SP, -1);
+    expect_bytes("lb a0, -1(sp)", buf, "03 05 f1 ff");
+    enc->load(buf, MEM_WORD, A0, SP, 2048);
+    expect_bytes("c.lui t0, 1; addiw t0, t0, -2048; c.add t0, sp; ld a0, 0(t0)", buf,
+                 "85 62 9b 82 02 80 8a 92 03 b5 02 00");
+    enc->store(buf, MEM_WORD, A0, SP, 504);
+    expect_bytes("c.sdsp a0, 504(sp)", buf, "aa ff");
+    enc->store(buf, MEM_S32, S1, S0, 8);
+    expect_bytes("c.sw s1, 8(s0)", buf, "04 c4");
+    enc->store(buf, MEM_U8, A0, S0, -1);
+    expect_bytes("sb a0, -1(s0)", buf, "a3 0f a4 fe");
+    enc->load_indexed(buf, MEM_WORD, A0, A0, A1, 3, 8);
+    expect_bytes("slli t0, a1, 3; c.add t0, a0; ld a0, 8(t0)", buf,
+                 "93 92 35 00 aa 92 03 b5 82 00");
+
+    buf->features = TARGET_FEATURE_RVC | TARGET_FEATURE_ZBA;
+    enc->load_indexed(buf, MEM_WORD, A0, A0, A1, 3, 8);
+    expect_bytes("sh3add t0, a1, a0; ld a0, 8(t0)", buf, "b3 e2 a5 20 03 b5 82 00");
+}
+
+static void test_compares(CodeBuffer* buf) {
+    buf->features = 0;
+    enc->setcc(buf, COND_LT, A0, A1, A2);
+    expect_bytes("slt a0, a1, a2", buf, "33 a5 c5 00");
+    enc->setcc(buf, COND_GE, A0, A1, A2);
+    expect_bytes("slt a0, a1, a2; xori a0, a0, 1", buf, "33 a5 c5 00 13 45 15 00");
+    enc->setcc(buf, COND_EQ, A0, A1, A2);
+    expect_bytes("sub a0, a1, a2; seqz a0, a0", buf, "33 85 c5 40 13 35 15 00");
+    enc->setcc(buf, COND_NE, A0, A1, A2);
+    expect_bytes("sub a0, a1, a2; snez a0, a0", buf, "33 85 c5 40 33 35 a0 00");
+    enc->select(buf, COND_LT, A0, A1, -1, A2, A3);
+    expect_bytes("sltz t5, a1; neg t5, t5; xor t6, a2, a3; and t6, t6, t5; xor a0, t6, a3",
+                 buf, "33 af 05 00 33 0f e0 41 b3 4f d6 00 b3 ff ef 01 33 c5 df 00");
+}
+
+// Local branches in reach need a single pass
+static void test_branches(CodeBuffer* buf) {
+    int labels;
+
+    buf->features = 0;
+    labels = mcode_new_labels(buf, 2);
+    mcode_bind(buf, labels);
+    enc->branch_zero(buf, COND_EQ, A0, labels + 1);
+    enc->branch(buf, COND_GT, A0, A1, labels + 1);
+    enc->branch_zero(buf, COND_LE, A0, labels);
+    enc->jmp(buf, labels);
+    mcode_bind(buf, labels + 1);
+    expect_bytes("beqz a0, +16; blt a1, a0, +12; blez a0, -8; j -12", buf,
+                 "63 08 05 00 63 c6 a5 00 e3 5c a0 fe 6f f0 5f ff");
+
+    buf->features = TARGET_FEATURE_RVC;
+    labels = mcode_new_labels(buf, 2);
+    mcode_bind(buf, labels);
+    enc->branch_zero(buf, COND_EQ, A0, labels + 1);
+    enc->branch(buf, COND_GT, A0, A1, labels + 1);
+    enc->branch_zero(buf, COND_LE, A0, labels);
+    enc->jmp(buf, labels);
+    mcode_bind(buf, labels + 1);
+    expect_true("short branches are counted as compressed", buf->compressed == 2);
+    expect_bytes("c.beqz a0, +12; blt a1, a0, +10; blez a0, -6; c.j -10", buf,
+                 "11 c5 63 c5 a5 00 e3 5d a0 fe dd bf");
+}
+
+// One branch `pad` bytes before (or after, when backward) its label
+typedef struct {
+    const char* name;
+    bool jump;              // jmp, else a branch on cond, op1, op2
+    CompareCondition cond;
+    int op1;
+    int op2;
+    bool backward;
+    int pad;
+    int passes;             // Emissions needed until nothing is widened
+    size_t at;              // Offset of the checked instruction
+    const char* bytes;
+} FarBranch;
+
+static const FarBranch far_branches[] = {
+    {"c.beqz s0, +254", false, COND_EQ, S0, ZERO, false, 252, 1, 0, "7d cc"},
+    {"c.beqz s0 at +256 widens to beqz", false, COND_EQ, S0, ZERO, false, 254, 2, 0,
+     "63 01 04 10"},
+    {"c.bnez s0, -256", false, COND_NE, S0, ZERO, true, 256, 1, 256, "01 f0"},
+    {"c.bnez a0 at -4096 widens to bnez", false, COND_NE, A0, ZERO, true, 4096, 2, 4096,
+     "63 10 05 80"},
+    {"blt a0, a1, +4094", false, COND_LT, A0, A1, false, 4090, 1, 0, "e3 4f b5 7e"},
+    {"blt a0, a1 at +4096 becomes bge +8; j +4096", false, COND_LT, A0, A1, false, 4092, 2, 0,
+     "63 54 b5 00 6f 10 00 00"},
+    {"c.beqz s0 beyond 4KB becomes c.bnez +6; j", false, COND_EQ, S0, ZERO, false, 4200, 3, 0,
+     "19 e0 6f 10 c0 06"},
+    {"c.j +2046", true, COND_EQ, 0, 0, false, 2044, 1, 0, "fd af"},
+    {"c.j at +2048 widens to j +2050", true, COND_EQ, 0, 0, false, 2046, 2, 0, "6f 00 30 00"},
+    {"c.j -2048", true, COND_EQ, 0, 0, true, 2048, 1, 2048, "01 b0"},
+    {"j +1048574", true, COND_EQ, 0, 0, false, 1048570, 2, 0, "6f f0 ff 7f"},
+};
+
+static void emit_far_branch(CodeBuffer* buf, const FarBranch* b) {
+    int label = mcode_new_labels(buf, 1);
+
+    if (b->backward) mcode_bind(buf, label);
+    if (!b->backward) {
+        if (b->jump) enc->jmp(buf, label);
+        else enc->branch(buf, b->cond, b->op1, b->op2, label);
+    }
+    // c.nop; the padding only has to take up space
+    for (int i = 0; i < b->pad; i += 2) mcode_u16(buf, 0x0001);
+    if (b->backward) {
+        if (b->jump) enc->jmp(buf, label);
+        else enc->branch(buf, b->cond, b->op1, b->op2, label);
+    }
+    if (!b->backward) mcode_bind(buf, label);
+}
+
+// The loop of ir_encode_function; returns the number of emissions
+static int encode_relaxed(CodeBuffer* buf, const FarBranch* b) {
+    MCodeMark mark;
+    int passes = 0;
+
+    mcode_mark(buf, &mark);
+    do {
+        mcode_rewind(buf, &mark);
+        emit_far_branch(buf, b);
+        passes++;
+    } while (mcode_relax(buf));
+    return passes;
+}
+
+static void test_relaxation(CodeBuffer* buf) {
+    char name[96];
+
+    buf->features = TARGET_FEATURE_RVC;
+    for (size_t i = 0; i < sizeof(far_branches) / sizeof(far_branches[0]); i++) {
+        const FarBranch* b = &far_branches[i];
+        int passes = encode_relaxed(buf, b);
+
+        snprintf(name, sizeof(name), "%s: emitted %d times", b->name, b->passes);
+        expect_true(name, passes == b->passes);
+        snprintf(name, sizeof(name), "%s: resolves", b->name);
+        expect_true(name, mcode_resolve_labels(buf));
+        expect_bytes_at(b->name, buf, b->at, b->bytes);
+        mcode_buffer_reset(buf);
+    }
+
+    // A jal cannot be widened further; mcode reports it on stderr
+    FarBranch beyond = {"j +1048576", true, COND_EQ, 0, 0, false, 1048572, 2, 0, NULL};
+    expect_true("j +1048576 is out of range",
+                encode_relaxed(buf, &beyond) == 2 && !mcode_resolve_labels(buf));
+    mcode_buffer_reset(buf);
+
+    // Without the C extension branches start at the 32-bit form
+    buf->features = 0;
+    FarBranch base = {"beqz a0", false, COND_EQ, A0, ZERO, false, 4092, 2, 0, NULL};
+    expect_true("beqz a0 at +4096 is widened once without C", encode_relaxed(buf, &base) == 2);
+    expect_true("bnez a0, +8; j +4096 resolves", mcode_resolve_labels(buf));
+    expect_bytes_at("bnez a0, +8; j +4096", buf, 0, "63 14 05 00 6f 10 00 00");
+    mcode_buffer_reset(buf);
+}
+
+static void test_symbols(CodeBuffer* buf) {
+    // The auipc/jalr pair stays 32-bit with C so the linker can patch it
+    buf->features = TARGET_FEATURE_RVC;
+    enc->call(buf, "helper");
+    expect_true("call records a call relocation",
+                buf->num_relocs == 1 && strcmp(buf->relocs[0].symbol, "helper") == 0 &&
+                buf->relocs[0].offset == 0 && buf->relocs[0].kind == MCODE_RV_CALL);
+    expect_bytes("auipc ra, 0; jalr ra, 0(ra)", buf, "97 00 00 00 e7 80 00 00");
+
+    enc->start(buf, "main");
+    expect_bytes("call main; li a7, 93; ecall", buf,
+                 "97 00 00 00 e7 80 00 00 93 08 d0 05 73 00 00 00");
+}
+
+int main(void) {
+    CodeBuffer buf;
+
+    mcode_buffer_init(&buf);
+    test_li(&buf);
+    test_base_forms(&buf);
+    test_compressed_forms(&buf);
+    test_compares(&buf);
+    test_branches(&buf);
+    test_relaxation(&buf);
+    test_symbols(&buf);
+    mcode_buffer_free(&buf);
+    return finish_tests("RISC-V 64");
+}
@@ -0,0 +1,185 @@
+// ALETHEIA x86-64 encoder tests
+// Reference bytes come from an assembler fed the instructions named by
+// each case (Intel syntax), so every case also documents the form chosen.
+
+#include "encoder_test.h"
+
+enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13 };
+
+static const MachineEncoder* enc = &x86_64_encoder;
+
+static void test_frames(CodeBuffer* buf) {
+    enc->prologue(buf, 0);
+    expect_bytes("push rbp; mov rbp, rsp", buf, "55 48 89 e5");
+    enc->prologue(buf, 16);
+    expect_bytes("prologue, sub rsp, imm8", buf, "55 48 89 e5 48 83 ec 10");
+    enc->prologue(buf, 256);
+    expect_bytes("prologue, sub rsp, imm32", buf, "55 48 89 e5 48 81 ec 00 01 00 00");
+    enc->epilogue(buf, 16);
+    expect_bytes("add rsp, 16; pop rbp; ret", buf, "48 83 c4 10 5d c3");
+    enc->leaf_prologue(buf, 0);
+    enc->leaf_epilogue(buf, 0);
+    expect_bytes("leaf without a frame", buf, "c3");
+}
+
+static void test_moves(CodeBuffer* buf) {
+    enc->mov(buf, R12, RAX);
+    expect_bytes("mov r12, rax", buf, "49 89 c4");
+    enc->mov_imm(buf, RCX, 5);
+    expect_bytes("mov ecx, 5", buf, "b9 05 00 00 00");
+    enc->mov_imm(buf, R8, 0xFFFFFFFFL);
+    expect_bytes("mov r8d, 0xffffffff", buf, "41 b8 ff ff ff ff");
+    enc->mov_imm(buf, R9, -1);
+    expect_bytes("mov r9, -1", buf, "49 c7 c1 ff ff ff ff");
+    enc->mov_imm(buf, RAX, 0x123456789L);
+    expect_bytes("movabs rax, 0x123456789", buf, "48 b8 89 67 45 23 01 00 00 00");
+}
+
+static void test_arithmetic(CodeBuffer* buf) {
+    enc->add(buf, RAX, RCX, RDX);
+    expect_bytes("mov rax, rcx; add rax, rdx", buf, "48 89 c8 48 01 d0");
+    enc->add(buf, RDX, RCX, RDX);
+    expect_bytes("add rdx, rcx", buf, "48 01 ca");
+    enc->sub(buf, RDX, RCX, RDX);
+    expect_bytes("neg rdx; add rdx, rcx", buf, "48 f7 da 48 01 ca");
+    enc->mul(buf, R10, R10, R11);
+    expect_bytes("imul r10, r11", buf, "4d 0f af d3");
+    enc->div(buf, RCX, RSI, RDI);
+    expect_bytes("mov rax, rsi; cqo; idiv rdi; mov rcx, rax", buf,
+                 "48 89 f0 48 99 48 f7 ff 48 89 c1");
+
+    enc->add_imm(buf, RCX, RCX, -8);
+    expect_bytes("add rcx, -8", buf, "48 83 c1 f8");
+    enc->add_imm(buf, RAX, RAX, 1000);
+    expect_bytes("add rax, 1000 (short form)", buf, "48 05 e8 03 00 00");
+    enc->add_imm(buf, R11, R11, 4096);
+    expect_bytes("add r11, 4096", buf, "49 81 c3 00 10 00 00");
+    enc->add_imm(buf, RDI, RSI, 4);
+    expect_bytes("lea rdi, [rsi + 4]", buf, "48 8d 7e 04");
+    enc->add_imm(buf, R9, R13, 0);
+    expect_bytes("lea r9, [r13 + 0]", buf, "4d 8d 4d 00");
+    enc->mul_imm(buf, RCX, RDX, 100);
+    expect_bytes("imul rcx, rdx, 100", buf, "48 6b ca 64");
+    enc->mul_imm(buf, RCX, RDX, 1000);
+    expect_bytes("imul rcx, rdx, 1000", buf, "48 69 ca e8 03 00 00");
+}
+
+static void test_memory(CodeBuffer* buf) {
+    enc->load(buf, MEM_WORD, RAX, RBP, -8);
+    expect_bytes("mov rax, [rbp - 8]", buf, "48 8b 45 f8");
+    enc->load(buf, MEM_WORD, RCX, RSP, 8);
+    expect_bytes("mov rcx, [rsp + 8]", buf, "48 8b 4c 24 08");
+    enc->load(buf, MEM_WORD, RDX, R12, 0);
+    expect_bytes("mov rdx, [r12]", buf, "49 8b 14 24");
+    enc->load(buf, MEM_WORD, RAX, R13, 0);
+    expect_bytes("mov rax, [r13 + 0]", buf, "49 8b 45 00");
+    enc->load(buf, MEM_S32, RAX, RBP, -300);
+    expect_bytes("movsxd rax, dword ptr [rbp - 300]", buf, "48 63 85 d4 fe ff ff");
+    enc->load(buf, MEM_U32, R8, RDI, 4);
+    expect_bytes("mov r8d, dword ptr [rdi + 4]", buf, "44 8b 47 04");
+    enc->load(buf, MEM_S8, RAX, RDI, 0);
+    expect_bytes("movsx rax, byte ptr [rdi]", buf, "48 0f be 07");
+    enc->load(buf, MEM_U8, RAX, RDI, 1);
+    expect_bytes("movzx eax, byte ptr [rdi + 1]", buf, "0f b6 47 01");
+    enc->load_indexed(buf, MEM_WORD, RAX, RDI, RSI, 3, 16);
+    expect_bytes("mov rax, [rdi + rsi*8 + 16]", buf, "48 8b 44 f7 10");
+    enc->load_indexed(buf, MEM_S32, RCX, R8, R9, 2, 0);
+    expect_bytes("movsxd rcx, dword ptr [r8 + r9*4]", buf, "4b 63 0c 88");
+
+    enc->store(buf, MEM_WORD, RBX, RBP, -16);
+    expect_bytes("mov [rbp - 16], rbx", buf, "48 89 5d f0");
+    enc->store(buf, MEM_U32, R9, RSP, 4);
+    expect_bytes("mov dword ptr [rsp + 4], r9d", buf, "44 89 4c 24 04");
+    enc->store(buf, MEM_U8, RAX, RDI, 0);
+    expect_bytes("mov byte ptr [rdi], al", buf, "88 07");
+    enc->store(buf, MEM_U8, RSI, RBP, -1);
+    expect_bytes("mov byte ptr [rbp - 1], sil (forced REX)", buf, "40 88 75 ff");
+}
+
+static void test_compares(CodeBuffer* buf) {
+    enc->setcc(buf, COND_LT, RCX, RDI, RSI);
+    expect_bytes("cmp rdi, rsi; setl al; movzx ecx, al", buf, "48 39 f7 0f 9c c0 0f b6 c8");
+    enc->select(buf, COND_EQ, RAX, RDI, -1, RCX, RDX);
+    expect_bytes("test rdi, rdi; mov rax, rdx; cmove rax, rcx", buf,
+                 "48 85 ff 48 89 d0 48 0f 44 c1");
+    enc->select(buf, COND_GT, RCX, RDI, RSI, RCX, RDX);
+    expect_bytes("cmp rdi, rsi; cmovle rcx, rdx", buf, "48 39 f7 48 0f 4e ca");
+}
+
+// jcc and jmp always take the rel32 form, counted from the end of the field
+static void test_branches(CodeBuffer* buf) {
+    int labels = mcode_new_labels(buf, 2);
+
+    mcode_bind(buf, labels);
+    enc->branch_zero(buf, COND_NE, RAX, labels + 1);
+    enc->jmp(buf, labels);
+    mcode_bind(buf, labels + 1);
+    enc->leaf_epilogue(buf, 0);
+    expect_bytes("test rax, rax; jne +5; jmp -14; ret", buf,
+                 "48 85 c0 0f 85 05 00 00 00 e9 f2 ff ff ff c3");
+
+    labels = mcode_new_labels(buf, 1);
+    enc->branch(buf, COND_GE, RDI, RSI, labels);
+    enc->leaf_epilogue(buf, 0);
+    mcode_bind(buf, labels);
+    expect_bytes("cmp rdi, rsi; jge +1; ret", buf, "48 39 f7 0f 8d 01 00 00 00 c3");
+
+    // mcode reports the unbound label on stderr
+    labels = mcode_new_labels(buf, 1);
+    enc->jmp(buf, labels);
+    expect_true("jmp to an unbound label fails", !mcode_resolve_labels(buf));
+    mcode_buffer_reset(buf);
+}
+
+static void test_symbols(CodeBuffer* buf) {
+    enc->call(buf, "helper");
+    expect_true("call records a rel32 relocation",
+                buf->num_relocs == 1 && strcmp(buf->relocs[0].symbol, "helper") == 0 &&
+                buf->relocs[0].offset == 1 && buf->relocs[0].kind == MCODE_REL32);
+    expect_bytes("call helper", buf, "e8 00 00 00 00");
+
+    enc->start(buf, "main");
+    expect_bytes("call main; mov edi, eax; mov eax, 60; syscall", buf,
+                 "e8 00 00 00 00 89 c7 b8 3c 00 00 00 0f 05");
+
+    enc->dispatch(buf, "slot");
+    expect_true("dispatch relocates its rip-relative slot",
+                buf->num_relocs == 1 && buf->relocs[0].offset == 2);
+    expect_bytes("jmp qword ptr [rip + slot]", buf, "ff 25 00 00 00 00");
+}
+
+static void test_vectors(CodeBuffer* buf) {
+    enc->vzero(buf, 128, 3);
+    expect_bytes("pxor xmm3, xmm3", buf, "66 0f ef db");
+    enc->vzero(buf, 256, 3);
+    expect_bytes("vpxor xmm3, xmm3, xmm3", buf, "c5 e1 ef db");
+    enc->vadd_indexed(buf, 128, false, 1, RDI, RSI, 3, 0);
+    expect_bytes("movdqu xmm15, [rdi + rsi*8]; paddq xmm1, xmm15", buf,
+                 "f3 44 0f 6f 3c f7 66 41 0f d4 cf");
+    enc->vadd_indexed(buf, 256, false, 1, RDI, RSI, 3, 32);
+    expect_bytes("vpaddq ymm1, ymm1, [rdi + rsi*8 + 32]", buf, "c5 f5 d4 4c f7 20");
+    enc->vadd_indexed(buf, 256, true, 9, R8, R10, 3, 0);
+    expect_bytes("vpsubq ymm9, ymm9, [r8 + r10*8]", buf, "c4 01 35 fb 0c d0");
+    enc->vadd_indexed(buf, 512, false, 1, RDI, RSI, 3, 64);
+    expect_bytes("vpaddq zmm1, zmm1, [rdi + rsi*8 + 64] (disp8*64)", buf,
+                 "62 f1 f5 48 d4 4c f7 01");
+    enc->vreduce(buf, 128, RAX, 1);
+    expect_bytes("pshufd xmm15, xmm1, 78; paddq xmm1, xmm15; movq rax, xmm1", buf,
+                 "66 44 0f 70 f9 4e 66 41 0f d4 cf 66 48 0f 7e c8");
+}
+
+int main(void) {
+    CodeBuffer buf;
+
+    mcode_buffer_init(&buf);
+    test_frames(&buf);
+    test_moves(&buf);
+    test_arithmetic(&buf);
+    test_memory(&buf);
+    test_compares(&buf);
+    test_branches(&buf);
+    test_symbols(&buf);
+    test_vectors(&buf);
+    mcode_buffer_free(&buf);
+    return finish_tests("x86-64");
+}
@@ -0,0 +1,33 @@
+#!/bin/bash
+
+# ALETHEIA-Core frame layout tests
+# Builds every test_*.c in this directory against the ALETHEIA-Core lexer,
+# parser and code generator from src/aletheia-core, then runs it. The
+# programs only read the generated text, so they run on any host.
+
+cd "$(dirname "$0")"
+CORE=../../src/aletheia-core
+CC="${CC:-gcc}"
+WORK_DIR="$(mktemp -d)"
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+passed=0
+failed=0
+for source in test_*.c; do
+    name="${source%.c}"
+    if ! "$CC" -std=c99 -I"$CORE" -o "$WORK_DIR/$name" "$source" "$CORE/lexer.c" \
+        "$CORE/parser.c" "$CORE/ast.c" "$CORE/codegen.c" "$CORE/utils.c" >"$WORK_DIR/log" 2>&1; then
+        echo "FAIL $source: build failed"
+        head -20 "$WORK_DIR/log"
+        failed=$((failed + 1))
+        continue
+    fi
+    if "$WORK_DIR/$name"; then
+        passed=$((passed + 1))
+    else
+        failed=$((failed + 1))
+    fi
+done
+
+echo "Frame tests: $passed passed, $failed failed"
+[ "$failed" -eq 0 ]
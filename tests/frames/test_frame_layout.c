@@ -0,0 +1,174 @@
+// ALETHEIA-Core frame layout tests
+// Each case compiles one function with the ALETHEIA-Core parser and code
+// generator (src/aletheia-core) and looks for lines of the NASM output.
+// The output is not assembled, so the cases run on any host.
+
+#include <stdio.h>
+#include <string.h>
+#include "lexer.h"
+#include "parser.h"
+#include "codegen.h"
+
+static int tests_run;
+static int tests_failed;
+static char output[16384];
+
+// Compiles `source` into `output`; false when it does not parse
+static bool compile(const char* name, const char* source) {
+    static char text[4096];
+    Parser* parser;
+    ASTNode* program;
+    FILE* file = tmpfile();
+    size_t length;
+
+    strncpy(text, source, sizeof(text) - 1);
+    parser = create_parser(create_lexer(text));
+    program = parse_program(parser);
+    output[0] = '\0';
+    if (!file || !program || program->data.program.decl_count != 1) {
+        printf("FAIL %s: does not parse\n", name);
+        if (file) fclose(file);
+        return false;
+    }
+    generate_code(program, create_codegen(file));
+    rewind(file);
+    length = fread(output, 1, sizeof(output) - 1, file);
+    output[length] = '\0';
+    fclose(file);
+    return true;
+}
+
+// Looks for `line` as a whole instruction, ignoring trailing ;; comments
+static bool has_line(const char* line) {
+    size_t length = strlen(line);
+
+    for (const char* at = strstr(output, line); at; at = strstr(at + 1, line)) {
+        if (at - output < 4 || strncmp(at - 4, "    ", 4) != 0) continue;
+        if (at[length] == '\n' || at[length] == ' ') return true;
+    }
+    return false;
+}
+
+static void expect_line(const char* name, const char* line, bool present) {
+    tests_run++;
+    if (has_line(line) != present) {
+        tests_failed++;
+        printf("FAIL %s: %s \"%s\"\n", name, present ? "missing" : "unexpected", line);
+    }
+}
+
+static void test_mixed_widths(void) {
+    const char* name = "mixed widths";
+
+    if (!compile(name,
+                 "int f(int a) {\n"
+                 "    char c = 1;\n"
+                 "    int i = 2;\n"
+                 "    int *p = 0;\n"
+                 "    g(a);\n"
+                 "    return i + c;\n"
+                 "}\n")) {
+        tests_run++;
+        tests_failed++;
+        return;
+    }
+    // a 4, p 8, i 4, c 1: 17 bytes placed largest-first, rounded to 32
+    expect_line(name, "sub rsp, 32", true);
+    expect_line(name, "mov dword [rbp-4], edi", true);
+    expect_line(name, "mov [rbp-16], rax", true);
+    expect_line(name, "mov dword [rbp-20], eax", true);
+    expect_line(name, "mov byte [rbp-21], al", true);
+}
+
+static void test_sibling_scopes(void) {
+    const char* name = "sibling scopes";
+
+    if (!compile(name,
+                 "int f(int a) {\n"
+                 "    int i = 2;\n"
+                 "    if (a) {\n"
+                 "        int x = 5;\n"
+                 "        g(x);\n"
+                 "    } else {\n"
+                 "        int *y = 0;\n"
+                 "        g(y);\n"
+                 "    }\n"
+                 "    return i;\n"
+                 "}\n")) {
+        tests_run++;
+        tests_failed++;
+        return;
+    }
+    // x and y live in different branches, so both start right below i and
+    // overlap; kept apart they would need 24 bytes and a 32-byte frame
+    expect_line(name, "mov dword [rbp-8], eax", true);
+    expect_line(name, "mov dword [rbp-12], eax", true);
+    expect_line(name, "mov [rbp-16], rax", true);
+    expect_line(name, "sub rsp, 16", true);
+}
+
+static void test_red_zone(void) {
+    const char* name = "red zone leaf";
+
+    if (!compile(name,
+                 "int f(int a) {\n"
+                 "    int t = a + 1;\n"
+                 "    int *p = 0;\n"
+                 "    int u = t * (a - t);\n"
+                 "    return u - t;\n"
+                 "}\n")) {
+        tests_run++;
+        tests_failed++;
+        return;
+    }
+    // No calls: rsp stays put, locals and temporaries sit below it
+    expect_line(name, "push rbp", false);
+    expect_line(name, "mov rbp, rsp", false);
+    expect_line(name, "push rax", false);
+    expect_line(name, "mov dword [rsp-4], edi", true);
+    expect_line(name, "mov [rsp-16], rax", true);
+    expect_line(name, "mov dword [rsp-20], eax", true);
+    expect_line(name, "mov [rsp-32], rax", true);
+    expect_line(name, "mov rbx, [rsp-32]", true);
+}
+
+// Nests `depth` additions on the left, so each one keeps a temporary live
+static bool compile_nested(const char* name, int depth) {
+    char source[512];
+    int length = snprintf(source, sizeof(source), "int f(int a) {\n    return a * ");
+
+    for (int i = 0; i < depth; i++) source[length++] = '(';
+    source[length++] = 'a';
+    for (int i = 0; i < depth; i++) length += snprintf(source + length, sizeof(source) - length, "+a)");
+    snprintf(source + length, sizeof(source) - length, ";\n}\n");
+    return compile(name, source);
+}
+
+static void test_red_zone_limit(void) {
+    // a takes 8 bytes with its padding and 15 temporaries fill the rest
+    // of the 128 bytes; one more and the function gets a frame
+    if (compile_nested("red zone full", 15)) {
+        expect_line("red zone full", "push rbp", false);
+        expect_line("red zone full", "mov [rsp-128], rax", true);
+    } else {
+        tests_run++;
+        tests_failed++;
+    }
+    if (compile_nested("red zone overflow", 16)) {
+        expect_line("red zone overflow", "push rbp", true);
+        expect_line("red zone overflow", "push rax", true);
+        expect_line("red zone overflow", "mov dword [rbp-4], edi", true);
+    } else {
+        tests_run++;
+        tests_failed++;
+    }
+}
+
+int main(void) {
+    test_mixed_widths();
+    test_sibling_scopes();
+    test_red_zone();
+    test_red_zone_limit();
+    printf("Frame layout: %d passed, %d failed\n", tests_run - tests_failed, tests_failed);
+    return tests_failed ? 1 : 0;
+}
@@ -0,0 +1,50 @@
+int main() {
+    int x = 1;
+    int y = 0;
+    switch (x) {
+        case 1:
+        default:
+            y = 7;
+            break;
+        case 2:
+            y = 3;
+            break;
+    }
+    switch (x) {
+        case 0:
+        case 1:
+        case 2:
+        case 3:
+        default:
+            y = 1;
+            break;
+        case 4:
+            y = 2;
+            break;
+        case 5:
+            y = 3;
+            break;
+    }
+    switch (x) {
+        case 0:
+            y = 1;
+            break;
+        case 1:
+            y = 2;
+            break;
+        case 2:
+            y = 3;
+            break;
+        case 3:
+        default:
+            y = 4;
+            break;
+        case 4:
+            y = 5;
+            break;
+        case 5:
+            y = 6;
+            break;
+    }
+    return y;
+}
@@ -0,0 +1,16 @@
+int main() {
+    int x = 0;
+    int y = 0;
+    switch (x) {
+        case 0 - 999999:
+            y = 1;
+            break;
+        case 0:
+            y = 2;
+            break;
+        case 1:
+            y = 3;
+            break;
+    }
+    return y;
+}
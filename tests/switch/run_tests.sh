@@ -0,0 +1,45 @@
+#!/bin/bash
+
+# ALETHEIA switch lowering tests
+# Builds the MesCC-ALE GCC 100% compiler (src/mescc-ale/mescc_extended.c)
+# and compiles every program in this directory with it. Each must parse,
+# and every label its switch code jumps to or lists in a jump table must be
+# defined. The generated code keeps variables symbolic, so nothing is run.
+
+cd "$(dirname "$0")"
+CC="${CC:-gcc}"
+WORK_DIR="$(mktemp -d)"
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+if ! "$CC" -std=c99 -o "$WORK_DIR/mescc_gcc100" ../../src/mescc-ale/mescc_extended.c \
+    >"$WORK_DIR/log" 2>&1; then
+    echo "FAIL: mescc_extended.c does not build"
+    head -20 "$WORK_DIR/log"
+    exit 1
+fi
+
+passed=0
+failed=0
+for source in *.c; do
+    if ! "$WORK_DIR/mescc_gcc100" <"$source" >"$WORK_DIR/out.s" 2>&1; then
+        echo "FAIL $source: compilation failed"
+        grep -i "error" "$WORK_DIR/out.s" | head -5
+        failed=$((failed + 1))
+        continue
+    fi
+
+    undefined=$(sed -n '/=== CODE GENERATION ===/,/=== GCC 100% FEATURES/p' "$WORK_DIR/out.s" |
+        awk '/^[A-Za-z_.][A-Za-z0-9_.]*:$/ { defined[substr($0, 1, length($0) - 1)] = 1 }
+             $1 ~ /^j[a-z]+$/ && $2 ~ /^\.L/ { used[$2] = 1 }
+             $1 == ".long" && $2 ~ /^\.L/ { used[$2] = 1 }
+             END { for (name in used) if (!(name in defined)) print name }')
+    if [ -n "$undefined" ]; then
+        echo "FAIL $source: undefined labels:" $undefined
+        failed=$((failed + 1))
+    else
+        passed=$((passed + 1))
+    fi
+done
+
+echo "Switch tests: $passed passed, $failed failed"
+[ "$failed" -eq 0 ]